@@ -29,7 +29,7 @@ AdjustProxyPackageHandler::~AdjustProxyPackageHandler() {
 
 void AdjustProxyPackageHandler::processData(const QByteArray& input) {
   logger.debug() << "Processing new data";
-  m_buffer.append(input);
+  m_reader.append(input);
 
   switch (m_state) {
     case ProcessingState::NotStarted:
@@ -59,18 +59,11 @@ void AdjustProxyPackageHandler::processData(const QByteArray& input) {
 bool AdjustProxyPackageHandler::processFirstLine() {
   logger.debug() << "Processing first line";
 
-  if (m_buffer.isEmpty()) {
+  QByteArray line;
+  if (!m_reader.readLine(line)) {
     return false;
   }
 
-  int pos = m_buffer.indexOf("\n");
-  if (pos == -1) {
-    return false;
-  }
-
-  QByteArray line = m_buffer.left(pos);
-  m_buffer.remove(0, pos + 1);
-
   QList<QByteArray> parts = line.split(' ');
   if (parts.length() < 2) {
     logger.error() << "Invalid HTTP request; connection should be closed";
@@ -90,32 +83,23 @@ bool AdjustProxyPackageHandler::processFirstLine() {
 bool AdjustProxyPackageHandler::processHeaders() {
   logger.debug() << "Processing headers";
 
-  if (m_buffer.isEmpty()) {
-    return false;
-  }
-
   while (true) {
-    int pos = m_buffer.indexOf("\n");
-    if (pos == -1) {
+    QByteArray header;
+    if (!m_reader.readLine(header)) {
       return false;
     }
 
-    QByteArray line = m_buffer.left(pos);
-    m_buffer.remove(0, pos + 1);
-
-    QByteArray header = line.trimmed();
     if (header.isEmpty()) {
       break;
     }
 
-    pos = header.indexOf(":");
+    int pos = header.indexOf(":");
     if (pos == -1) {
       continue;
     }
 
     QByteArray headerName = header.left(pos);
-    header.remove(0, pos + 1);
-    QByteArray headerValue = header.trimmed();
+    QByteArray headerValue = header.mid(pos + 1).trimmed();
 
     QPair<QString, QString> headerPair;
     headerPair.first = QString(headerName);
@@ -148,7 +132,8 @@ bool AdjustProxyPackageHandler::processHeaders() {
 bool AdjustProxyPackageHandler::processParameters() {
   logger.debug() << "Processing parameters";
 
-  uint32_t bodyLength = m_buffer.trimmed().length();
+  QByteArray body = m_reader.pending().trimmed();
+  uint32_t bodyLength = body.length();
 
   if (bodyLength > m_contentLength) {
     logger.error() << "Buffer longer than the declared Contend-Length; "
@@ -160,7 +145,7 @@ bool AdjustProxyPackageHandler::processParameters() {
   if (bodyLength < m_contentLength) {
     return false;
   }
-  m_bodyParameters = QUrlQuery(m_buffer.trimmed());
+  m_bodyParameters = QUrlQuery(QString(body));
 
   m_queryParameters = QUrlQuery(m_route);
 
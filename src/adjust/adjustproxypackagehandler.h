@@ -5,6 +5,8 @@
 #ifndef ADJUSTPROXYPACKAGEHANDLER_H
 #define ADJUSTPROXYPACKAGEHANDLER_H
 
+#include "framereader.h"
+
 #include <QByteArray>
 #include <QUrl>
 #include <QUrlQuery>
@@ -51,7 +53,7 @@ class AdjustProxyPackageHandler final {
 
  public:
   ProcessingState m_state = ProcessingState::NotStarted;
-  QByteArray m_buffer;
+  FrameReader m_reader;
   uint32_t m_contentLength = 0;
   QString m_method;
   QUrl m_route;
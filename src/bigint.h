@@ -5,123 +5,152 @@
 #ifndef BIGINT_H
 #define BIGINT_H
 
-#include <QVector>
+#include <QtGlobal>
+
+#include <cstdint>
 
 // This BigInt implementation is meant to be used for IPv6 addresses. It
 // doesn't support dynamic resize: when the max size is reached, the value
-// overflows. If you need to change the size, use `resize()`.
+// overflows. The size is fixed at construction time and it cannot be bigger
+// than 16 bytes (128 bits).
+//
+// The value is stored in two 64-bit words, so all the operations are
+// word-wise and no heap allocation is needed.
 
 class BigInt final {
  public:
-  explicit BigInt(uint8_t bytes) {
-    m_value.resize(bytes);
-    memset(m_value.data(), 0, bytes);
-  }
+  static constexpr uint8_t MAX_BYTES = 16;
 
-  BigInt(const BigInt& other) { m_value = other.m_value; }
+  constexpr explicit BigInt(uint8_t bytes) : m_size(bytes) {
+    Q_ASSERT(bytes > 0 && bytes <= MAX_BYTES);
+  }
 
-  const uint8_t* value() const { return m_value.data(); }
+  constexpr BigInt(const BigInt& other) = default;
 
-  uint8_t size() const { return m_value.size(); }
+  constexpr uint8_t size() const { return m_size; }
 
   // Assign operator.
 
-  BigInt& operator=(const BigInt& other) {
-    m_value = other.m_value;
-    return *this;
-  }
+  constexpr BigInt& operator=(const BigInt& other) = default;
 
   // Comparison operators.
 
-  bool operator==(const BigInt& other) const {
-    return m_value == other.m_value;
+  constexpr bool operator==(const BigInt& other) const {
+    Q_ASSERT(size() == other.size());
+    return m_high == other.m_high && m_low == other.m_low;
   }
 
-  bool operator!=(const BigInt& other) const { return !(*this == other); }
+  constexpr bool operator!=(const BigInt& other) const {
+    return !(*this == other);
+  }
 
-  bool operator<(const BigInt& other) const { return cmp(other) < 0; }
+  constexpr bool operator<(const BigInt& other) const {
+    return cmp(other) < 0;
+  }
 
-  bool operator>(const BigInt& other) const { return cmp(other) > 0; }
+  constexpr bool operator>(const BigInt& other) const {
+    return cmp(other) > 0;
+  }
 
-  bool operator<=(const BigInt& other) const { return cmp(other) <= 0; }
+  constexpr bool operator<=(const BigInt& other) const {
+    return cmp(other) <= 0;
+  }
 
-  bool operator>=(const BigInt& other) const { return cmp(other) >= 0; }
+  constexpr bool operator>=(const BigInt& other) const {
+    return cmp(other) >= 0;
+  }
 
   // math operators (only some of them are implemented)
 
-  BigInt& operator++() {
-    for (int i = size() - 1; i >= 0; --i) {
-      if (m_value[i] < UINT8_MAX) {
-        ++m_value[i];
-        return *this;
-      }
-      m_value[i] = 0;
+  constexpr BigInt& operator++() {
+    if (++m_low == 0) {
+      ++m_high;
     }
 
     // overflow
-    memset(m_value.data(), 0, size());
+    truncate();
     return *this;
   }
 
-  BigInt& operator+=(const BigInt& other) {
+  constexpr BigInt& operator+=(const BigInt& other) {
     Q_ASSERT(other.size() == size());
 
-    uint8_t carry = 0;
-    for (int i = m_value.size() - 1; i >= 0; --i) {
-      uint16_t total = carry + m_value[i] + other.m_value[i];
-      m_value[i] = (uint8_t)(total & UINT8_MAX);
-      carry = (uint8_t)((total & 0xFF00) >> 8);
-    }
+    uint64_t low = m_low + other.m_low;
+    m_high += other.m_high + (low < m_low ? 1 : 0);
+    m_low = low;
 
+    truncate();
     return *this;
   }
 
   // Shift operators
 
-  BigInt operator>>(int shift) {
-    BigInt x(size());
-    x = *this;
-
-    for (int i = 0; i < shift; i++) {
-      BigInt a(size());
-      a = x;
-
-      a.m_value[size() - 1] = x.m_value[size() - 1] >> 1;
-      for (int j = size() - 2; j >= 0; j--) {
-        a.m_value[j] = x.m_value[j] >> 1;
-        if ((x.m_value[j] & 1) != 0) {
-          a.m_value[j + 1] |= 128;  // Set most significant bit or a uint8_t
-        }
-      }
-
-      x = a;
+  constexpr BigInt operator>>(int shift) const {
+    Q_ASSERT(shift >= 0);
+
+    BigInt x(*this);
+    if (shift >= 128) {
+      x.m_high = 0;
+      x.m_low = 0;
+    } else if (shift >= 64) {
+      x.m_low = x.m_high >> (shift - 64);
+      x.m_high = 0;
+    } else if (shift > 0) {
+      x.m_low = (x.m_low >> shift) | (x.m_high << (64 - shift));
+      x.m_high >>= shift;
     }
 
     return x;
   }
 
-  void setValueAt(uint8_t value, uint8_t pos) {
+  // The byte at position 0 is the most significant one.
+
+  constexpr void setValueAt(uint8_t value, uint8_t pos) {
     Q_ASSERT(pos < size());
-    m_value[pos] = value;
+
+    uint8_t bit = (size() - 1 - pos) * 8;
+    if (bit >= 64) {
+      bit -= 64;
+      m_high = (m_high & ~(uint64_t(0xFF) << bit)) | (uint64_t(value) << bit);
+    } else {
+      m_low = (m_low & ~(uint64_t(0xFF) << bit)) | (uint64_t(value) << bit);
+    }
   }
 
-  uint8_t valueAt(uint8_t pos) const {
+  constexpr uint8_t valueAt(uint8_t pos) const {
     Q_ASSERT(size() > pos);
-    return m_value[pos];
+
+    uint8_t bit = (size() - 1 - pos) * 8;
+    if (bit >= 64) {
+      return (uint8_t)(m_high >> (bit - 64));
+    }
+    return (uint8_t)(m_low >> bit);
   }
 
  private:
-  int cmp(const BigInt& other) const {
+  constexpr int cmp(const BigInt& other) const {
     Q_ASSERT(size() == other.size());
-    for (int i = 0; i < size(); i++) {
-      int diff = (m_value[i] - other.m_value[i]);
-      if (diff != 0) return diff;
-    }
+    if (m_high != other.m_high) return m_high < other.m_high ? -1 : 1;
+    if (m_low != other.m_low) return m_low < other.m_low ? -1 : 1;
     return 0;
   }
 
+  // Drops the bits exceeding the size of this BigInt.
+  constexpr void truncate() {
+    if (m_size <= 8) {
+      m_high = 0;
+      if (m_size < 8) {
+        m_low &= (uint64_t(1) << (m_size * 8)) - 1;
+      }
+    } else if (m_size < 16) {
+      m_high &= (uint64_t(1) << ((m_size - 8) * 8)) - 1;
+    }
+  }
+
  private:
-  QVector<uint8_t> m_value;
+  uint64_t m_high = 0;
+  uint64_t m_low = 0;
+  uint8_t m_size;
 };
 
 #endif  // BIGINT_H
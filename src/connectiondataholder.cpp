@@ -17,6 +17,10 @@
 #include <QSplineSeries>
 #include <QValueAxis>
 
+// The counters page is not used anymore if the daemon doesn't update it for
+// this long.
+constexpr qint64 COUNTERS_PAGE_MAX_AGE_MSEC = 5 * COUNTERS_PAGE_INTERVAL_MSEC;
+
 namespace {
 Logger logger(LOG_NETWORKING, "ConnectionDataHolder");
 }
@@ -31,6 +35,22 @@ ConnectionDataHolder::ConnectionDataHolder()
   connect(&m_ipAddressTimer, &QTimer::timeout, this,
           [this]() { updateIpAddress(); });
   connect(&m_checkStatusTimer, &QTimer::timeout, this, [this]() {
+    if (m_countersPage.isOpen()) {
+      CountersPage::Counters counters;
+      if (m_countersPage.read(counters, COUNTERS_PAGE_MAX_AGE_MSEC)) {
+        if (counters.m_connected) {
+          add(counters.m_txBytes, counters.m_rxBytes);
+        }
+        return;
+      }
+
+      logger.warning() << "The counters page is not updated anymore";
+      m_countersPage.close();
+      m_checkStatusTimer.stop();
+      startStatusStream();
+      return;
+    }
+
     MozillaVPN::instance()->controller()->getStatus(
         [this](const QString& serverIpv4Gateway,
                const QString& deviceIpv4Address, uint64_t txBytes,
@@ -156,7 +176,7 @@ void ConnectionDataHolder::activate(const QVariant& a_txSeries,
     m_rxSeries->append(m_rxSeries->count(), 0);
   }
 
-  m_checkStatusTimer.start(Constants::checkStatusTimerMsec());
+  startStatusUpdates();
 }
 
 void ConnectionDataHolder::deactivate() {
@@ -168,7 +188,70 @@ void ConnectionDataHolder::deactivate() {
   m_txSeries = nullptr;
   m_rxSeries = nullptr;
 
+  stopStatusUpdates();
+}
+
+void ConnectionDataHolder::startStatusUpdates() {
+  Controller* controller = MozillaVPN::instance()->controller();
+  connect(controller, &Controller::statusStreamed, this,
+          &ConnectionDataHolder::statusStreamed, Qt::UniqueConnection);
+  connect(controller, &Controller::countersSubscribed, this,
+          &ConnectionDataHolder::countersSubscribed, Qt::UniqueConnection);
+
+  // The counters published by the daemon in shared memory can be sampled
+  // without any request to it, once the daemon lets this client read them.
+  // The status stream is the fallback.
+  m_countersSubscribed = controller->subscribeCounters();
+  m_countersSubscribing = m_countersSubscribed;
+  if (!m_countersSubscribing) {
+    startStatusStream();
+  }
+}
+
+void ConnectionDataHolder::countersSubscribed(bool subscribed) {
+  if (!m_countersSubscribing) {
+    return;
+  }
+  m_countersSubscribing = false;
+
+  if (subscribed && m_countersPage.open(COUNTERS_PAGE_NAME)) {
+    m_checkStatusTimer.start(Constants::checkStatusTimerMsec());
+    return;
+  }
+
+  startStatusStream();
+}
+
+void ConnectionDataHolder::startStatusStream() {
+  m_statusStreaming = MozillaVPN::instance()->controller()->subscribeStatus(
+      Constants::checkStatusTimerMsec());
+  if (!m_statusStreaming) {
+    m_checkStatusTimer.start(Constants::checkStatusTimerMsec());
+  }
+}
+
+void ConnectionDataHolder::stopStatusUpdates() {
+  // This ends the counters subscription too.
+  if (m_statusStreaming || m_countersSubscribed) {
+    MozillaVPN::instance()->controller()->unsubscribeStatus();
+    m_statusStreaming = false;
+    m_countersSubscribed = false;
+  }
+  m_countersSubscribing = false;
   m_checkStatusTimer.stop();
+  m_countersPage.close();
+}
+
+void ConnectionDataHolder::statusStreamed(const QString& serverIpv4Gateway,
+                                          const QString& deviceIpv4Address,
+                                          uint64_t txBytes, uint64_t rxBytes) {
+  Q_UNUSED(deviceIpv4Address);
+  if (!m_statusStreaming || serverIpv4Gateway.isEmpty()) {
+    return;
+  }
+
+  // The streamed counters are relative to the previous update.
+  add(m_txBytes + txBytes, m_rxBytes + rxBytes);
 }
 
 void ConnectionDataHolder::computeAxes() {
@@ -235,7 +318,7 @@ void ConnectionDataHolder::updateIpAddress() {
 
     // Let's skip this for unit-tests to make them simpler.
 #ifndef UNIT_TEST
-        if (m_checkStatusTimer.isActive() &&
+        if ((m_checkStatusTimer.isActive() || m_statusStreaming) &&
             country !=
                 MozillaVPN::instance()->currentServer()->exitCountryCode()) {
           // In case the country-we're reported in does not match the
@@ -295,6 +378,6 @@ void ConnectionDataHolder::stateChanged() {
   reset();
 
   if (m_txSeries && vpn->controller()->state() == Controller::StateOn) {
-    m_checkStatusTimer.start();
+    startStatusUpdates();
   }
 }
@@ -5,6 +5,8 @@
 #ifndef CONNECTIONDATAHOLDER_H
 #define CONNECTIONDATAHOLDER_H
 
+#include "counterspage.h"
+
 #include <QObject>
 #include <QPair>
 #include <QString>
@@ -57,6 +59,16 @@ class ConnectionDataHolder final : public QObject {
  private:
   void add(uint64_t txBytes, uint64_t rxBytes);
 
+  // The counters are sampled in the counters page when possible. Otherwise,
+  // the status is pushed by the controller when possible, polled otherwise.
+  void startStatusUpdates();
+  void startStatusStream();
+  void stopStatusUpdates();
+  void countersSubscribed(bool subscribed);
+  void statusStreamed(const QString& serverIpv4Gateway,
+                      const QString& deviceIpv4Address, uint64_t txBytes,
+                      uint64_t rxBytes);
+
   void computeAxes();
   void updateIpAddress();
 
@@ -95,6 +107,10 @@ class ConnectionDataHolder final : public QObject {
   QString m_ipv6Address;
   QTimer m_ipAddressTimer;
   QTimer m_checkStatusTimer;
+  bool m_statusStreaming = false;
+  bool m_countersSubscribing = false;
+  bool m_countersSubscribed = false;
+  CountersPage m_countersPage;
 
 #ifdef UNIT_TEST
   friend class TestConnectionDataHolder;
@@ -10,10 +10,7 @@
 #include "features/featurecaptiveportal.h"
 #include "features/featurelocalareaaccess.h"
 #include "features/featuremultihop.h"
-#include "rfc/rfc1112.h"
-#include "rfc/rfc1918.h"
-#include "rfc/rfc4193.h"
-#include "rfc/rfc4291.h"
+#include "rfc/rfclocalnetworks.h"
 
 #include "ipaddress.h"
 #include "leakdetector.h"
@@ -125,6 +122,10 @@ void Controller::initialize() {
           &Controller::implInitialized);
   connect(m_impl.get(), &ControllerImpl::statusUpdated, this,
           &Controller::statusUpdated);
+  connect(m_impl.get(), &ControllerImpl::statusStreamed, this,
+          &Controller::statusStreamed);
+  connect(m_impl.get(), &ControllerImpl::countersSubscribed, this,
+          &Controller::countersSubscribed);
   connect(this, &Controller::stateChanged, this,
           &Controller::maybeEnableDisconnectInConfirming);
 
@@ -654,6 +655,14 @@ void Controller::getStatus(
     return;
   }
 
+  // Each caller gets the reply to its own request when the backend service
+  // can tell them apart. Otherwise, the callers waiting at the same time
+  // share the next status.
+  if (m_impl &&
+      m_impl->requestStatus(ControllerImpl::StatusCallback(callback))) {
+    return;
+  }
+
   bool requestStatus = m_getStatusCallbacks.isEmpty();
 
   m_getStatusCallbacks.append(std::move(callback));
@@ -663,6 +672,33 @@ void Controller::getStatus(
   }
 }
 
+bool Controller::subscribeStatus(int intervalMsec) {
+  if (!m_impl) {
+    return false;
+  }
+  return m_impl->subscribeStatus(intervalMsec);
+}
+
+void Controller::unsubscribeStatus() {
+  if (m_impl) {
+    m_impl->unsubscribeStatus();
+  }
+}
+
+bool Controller::subscribeCounters() {
+  if (!m_impl) {
+    return false;
+  }
+  return m_impl->subscribeCounters();
+}
+
+QJsonObject Controller::backendMetrics() const {
+  if (!m_impl) {
+    return QJsonObject();
+  }
+  return m_impl->metrics();
+}
+
 void Controller::statusUpdated(const QString& serverIpv4Gateway,
                                const QString& deviceIpv4Address,
                                uint64_t txBytes, uint64_t rxBytes) {
@@ -684,26 +720,10 @@ QList<IPAddress> Controller::getAllowedIPAddressRanges(
     const QList<Server>& serverList) {
   logger.debug() << "Computing the allowed IP addresses";
 
-  QList<IPAddress> excludeIPv4s;
-  QList<IPAddress> excludeIPv6s;
   // For multi-hop connections, the last entry in the server list is the
   // ingress node to the network of wireguard servers, and must not be
   // routed through the VPN.
 
-  // filtering out the RFC1918 local area network
-  if (FeatureLocalAreaAccess::instance()->isSupported() &&
-      SettingsHolder::instance()->localNetworkAccess()) {
-    logger.debug() << "Filtering out the local area networks (rfc 1918)";
-    excludeIPv4s.append(RFC1918::ipv4());
-
-    logger.debug() << "Filtering out the local area networks (rfc 4193)";
-    excludeIPv6s.append(RFC4193::ipv6());
-
-    logger.debug() << "Filtering out multicast addresses";
-    excludeIPv4s.append(RFC1112::ipv4MulticastAddressBlock());
-    excludeIPv6s.append(RFC4291::ipv6MulticastAddressBlock());
-  }
-
   QList<IPAddress> list;
 
 #ifdef MVPN_IOS
@@ -724,11 +744,21 @@ QList<IPAddress> Controller::getAllowedIPAddressRanges(
   list.append(
       IPAddress(QHostAddress(MULLVAD_PROXY_RANGE), MULLVAD_PROXY_RANGE_LENGTH));
 
-  // Allow access to everything not covered by an excluded address.
-  QList<IPAddress> allowedIPv4 = {IPAddress("0.0.0.0/0")};
-  list.append(IPAddress::excludeAddresses(allowedIPv4, excludeIPv4s));
-  QList<IPAddress> allowedIPv6 = {IPAddress("::/0")};
-  list.append(IPAddress::excludeAddresses(allowedIPv6, excludeIPv6s));
+  // Allow access to everything not covered by an excluded address. When the
+  // local area networks (rfc 1918, rfc 4193) and the multicast addresses are
+  // filtered out, the complement is precomputed.
+  if (FeatureLocalAreaAccess::instance()->isSupported() &&
+      SettingsHolder::instance()->localNetworkAccess()) {
+    logger.debug() << "Filtering out the local area networks and multicast";
+    list.append(RFCLocalNetworks::ipv4Complement());
+    list.append(RFCLocalNetworks::ipv6Complement());
+  } else {
+    list.append(IPAddress(QHostAddress(QHostAddress::AnyIPv4), 0));
+    list.append(IPAddress(QHostAddress(QHostAddress::AnyIPv6), 0));
+  }
+
+  // Merge the adjacent prefixes to reduce the number of routes.
+  list = IPAddress::aggregate(list);
 #endif
 
   return list;
@@ -9,6 +9,7 @@
 #include "connectioncheck.h"
 
 #include <QElapsedTimer>
+#include <QJsonObject>
 #include <QList>
 #include <QObject>
 #include <QTimer>
@@ -81,6 +82,20 @@ class Controller final : public QObject {
                          const QString& deviceIpv4Address, uint64_t txBytes,
                          uint64_t rxBytes)>&& callback);
 
+  // When the backend supports it, the status is pushed every "intervalMsec"
+  // milliseconds through the statusStreamed signal. Returns false if the
+  // status must be polled with getStatus().
+  bool subscribeStatus(int intervalMsec);
+  void unsubscribeStatus();
+
+  // When the backend supports it, the counters page can be read once the
+  // countersSubscribed signal reports it, until unsubscribeStatus() is
+  // called. Returns false if there is no counters page.
+  bool subscribeCounters();
+
+  // The latency of the requests to the backend service, per command.
+  QJsonObject backendMetrics() const;
+
   int connectionRetry() const { return m_connectionRetry; }
 
   bool enableDisconnectInConfirming() const {
@@ -121,6 +136,10 @@ class Controller final : public QObject {
   void connectionRetryChanged();
   void enableDisconnectInConfirmingChanged();
   void silentSwitchDone();
+  void statusStreamed(const QString& serverIpv4Gateway,
+                      const QString& deviceIpv4Address, uint64_t txBytes,
+                      uint64_t rxBytes);
+  void countersSubscribed(bool subscribed);
 
  private:
   void setState(State state);
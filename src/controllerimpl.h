@@ -7,6 +7,7 @@
 
 #include "controller.h"
 
+#include <QJsonObject>
 #include <QObject>
 
 #include <functional>
@@ -62,6 +63,36 @@ class ControllerImpl : public QObject {
   // active.
   virtual void checkStatus() = 0;
 
+  // This method retrieves the VPN tunnel status for a single caller, when
+  // the backend service replies to each request separately. It returns
+  // false if the status can only be retrieved with checkStatus(), whose
+  // statusUpdated signal is shared by all the callers waiting for it.
+  using StatusCallback =
+      std::function<void(const QString& serverIpv4Gateway,
+                         const QString& deviceIpv4Address, uint64_t txBytes,
+                         uint64_t rxBytes)>;
+  virtual bool requestStatus(StatusCallback&& callback) {
+    Q_UNUSED(callback);
+    return false;
+  }
+
+  // This method asks the backend service to push the VPN tunnel status every
+  // "intervalMsec" milliseconds, via the statusStreamed signal, until
+  // unsubscribeStatus() is called. It returns false if the status can only be
+  // retrieved with checkStatus().
+  virtual bool subscribeStatus(int intervalMsec) {
+    Q_UNUSED(intervalMsec);
+    return false;
+  }
+  virtual void unsubscribeStatus() {}
+
+  // This method asks the backend service to let this client read the
+  // counters page (see CountersPage), and to keep it up to date until
+  // unsubscribeStatus() is called. The outcome is reported by the
+  // countersSubscribed signal. It returns false if the backend service has
+  // no counters page.
+  virtual bool subscribeCounters() { return false; }
+
   // This method is used to retrieve the logs from the backend service. Use
   // the callback to report logs when available.
   virtual void getBackendLogs(
@@ -70,6 +101,10 @@ class ControllerImpl : public QObject {
   // Cleanup the backend logs.
   virtual void cleanupBackendLogs() = 0;
 
+  // The latency of the requests to the backend service, per command, for
+  // the diagnostics.
+  virtual QJsonObject metrics() const { return QJsonObject(); }
+
  signals:
   // This signal is emitted when the controller is initialized. Note that the
   // VPN tunnel can be already active. In this case, "connected" should be set
@@ -91,6 +126,17 @@ class ControllerImpl : public QObject {
   void statusUpdated(const QString& serverIpv4Gateway,
                      const QString& deviceIpv4Address, uint64_t txBytes,
                      uint64_t rxBytes);
+
+  // This signal is emitted after a subscribeStatus() call, at the requested
+  // interval. "txBytes" and "rxBytes" contain the number of bytes transmitted
+  // and received since the previous statusStreamed signal.
+  void statusStreamed(const QString& serverIpv4Gateway,
+                      const QString& deviceIpv4Address, uint64_t txBytes,
+                      uint64_t rxBytes);
+
+  // This signal is emitted after a subscribeCounters() call. If
+  // "subscribed" is true, the counters page can be opened.
+  void countersSubscribed(bool subscribed);
 };
 
 #endif  // CONTROLLERIMPL_H
@@ -0,0 +1,243 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "counterspage.h"
+#include "leakdetector.h"
+#include "logger.h"
+
+#include <QDateTime>
+
+#include <atomic>
+#include <new>
+
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MACOS)
+#  define COUNTERS_PAGE_SUPPORTED
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <string.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "The counters must be lock-free to be shared between processes");
+#endif
+
+constexpr quint32 COUNTERS_PAGE_MAGIC = 0x4d565043;  // "MVPC"
+constexpr quint32 COUNTERS_PAGE_VERSION = 1;
+
+// A reader gives up after this many concurrent updates.
+constexpr int COUNTERS_READ_ATTEMPTS = 100;
+
+namespace {
+Logger logger(LOG_MAIN, "CountersPage");
+}
+
+// The layout of the page. The sequence is odd while the daemon is updating
+// the fields.
+struct CountersPage::Page {
+  quint32 m_magic;
+  quint32 m_version;
+  std::atomic<quint32> m_sequence;
+  std::atomic<quint32> m_connected;
+  std::atomic<quint64> m_txBytes;
+  std::atomic<quint64> m_rxBytes;
+  std::atomic<qint64> m_handshake;
+  std::atomic<qint64> m_connectionDate;
+  // When the page has been updated, in milliseconds since the epoch.
+  std::atomic<qint64> m_updated;
+};
+
+CountersPage::CountersPage() { MVPN_COUNT_CTOR(CountersPage); }
+
+CountersPage::~CountersPage() {
+  MVPN_COUNT_DTOR(CountersPage);
+  close();
+}
+
+bool CountersPage::create(const QString& name) {
+  close();
+
+#ifdef COUNTERS_PAGE_SUPPORTED
+  m_name = name.toLocal8Bit();
+
+  // A page created by somebody else cannot be trusted.
+  shm_unlink(m_name.constData());
+  int fd = shm_open(m_name.constData(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                    S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    logger.error() << "Failed to create the counters page:" << strerror(errno);
+    return false;
+  }
+
+  // Nobody else can read the page until allowGroup() is called.
+  fchmod(fd, S_IRUSR | S_IWUSR);
+
+  void* addr = MAP_FAILED;
+  if (ftruncate(fd, sizeof(Page)) == 0) {
+    addr = mmap(nullptr, sizeof(Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+  }
+
+  if (addr == MAP_FAILED) {
+    logger.error() << "Failed to map the counters page:" << strerror(errno);
+    ::close(fd);
+    shm_unlink(m_name.constData());
+    return false;
+  }
+
+  m_fd = fd;
+  m_page = new (addr) Page();
+  m_page->m_magic = COUNTERS_PAGE_MAGIC;
+  m_page->m_version = COUNTERS_PAGE_VERSION;
+  m_owner = true;
+
+  publish(Counters());
+  logger.debug() << "Counters page created";
+  return true;
+#else
+  Q_UNUSED(name);
+  return false;
+#endif
+}
+
+void CountersPage::publish(const Counters& counters) {
+  Q_ASSERT(m_owner);
+  if (!m_page) {
+    return;
+  }
+
+  quint32 sequence = m_page->m_sequence.load(std::memory_order_relaxed);
+  m_page->m_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  m_page->m_connected.store(counters.m_connected, std::memory_order_relaxed);
+  m_page->m_txBytes.store(counters.m_txBytes, std::memory_order_relaxed);
+  m_page->m_rxBytes.store(counters.m_rxBytes, std::memory_order_relaxed);
+  m_page->m_handshake.store(counters.m_handshake, std::memory_order_relaxed);
+  m_page->m_connectionDate.store(counters.m_connectionDate,
+                                 std::memory_order_relaxed);
+  m_page->m_updated.store(QDateTime::currentMSecsSinceEpoch(),
+                          std::memory_order_relaxed);
+
+  m_page->m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool CountersPage::allowGroup(uint gid) {
+  Q_ASSERT(m_owner);
+  if (!m_page) {
+    return false;
+  }
+
+#ifdef COUNTERS_PAGE_SUPPORTED
+  // The readers don't need any write access.
+  if (fchown(m_fd, (uid_t)-1, (gid_t)gid) != 0 ||
+      fchmod(m_fd, S_IRUSR | S_IWUSR | S_IRGRP) != 0) {
+    logger.error() << "Failed to share the counters page:" << strerror(errno);
+    return false;
+  }
+  return true;
+#else
+  Q_UNUSED(gid);
+  return false;
+#endif
+}
+
+bool CountersPage::open(const QString& name) {
+  close();
+
+#ifdef COUNTERS_PAGE_SUPPORTED
+  m_name = name.toLocal8Bit();
+
+  int fd = shm_open(m_name.constData(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    logger.debug() << "No counters page:" << strerror(errno);
+    return false;
+  }
+
+  // Only the daemon, or the user itself for the tests, can publish the
+  // counters.
+  struct stat st;
+  void* addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (st.st_uid == 0 || st.st_uid == getuid()) &&
+      st.st_size >= (off_t)sizeof(Page)) {
+    addr = mmap(nullptr, sizeof(Page), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+
+  if (addr == MAP_FAILED) {
+    logger.warning() << "The counters page cannot be used";
+    return false;
+  }
+
+  m_page = static_cast<Page*>(addr);
+  if (m_page->m_magic != COUNTERS_PAGE_MAGIC ||
+      m_page->m_version != COUNTERS_PAGE_VERSION) {
+    logger.warning() << "Unsupported counters page";
+    close();
+    return false;
+  }
+
+  logger.debug() << "Counters page opened";
+  return true;
+#else
+  Q_UNUSED(name);
+  return false;
+#endif
+}
+
+bool CountersPage::read(Counters& counters, qint64 maxAgeMsec) const {
+  if (!m_page) {
+    return false;
+  }
+
+  for (int attempt = 0; attempt < COUNTERS_READ_ATTEMPTS; ++attempt) {
+    quint32 sequence = m_page->m_sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      continue;
+    }
+
+    Counters result;
+    result.m_connected = m_page->m_connected.load(std::memory_order_relaxed);
+    result.m_txBytes = m_page->m_txBytes.load(std::memory_order_relaxed);
+    result.m_rxBytes = m_page->m_rxBytes.load(std::memory_order_relaxed);
+    result.m_handshake = m_page->m_handshake.load(std::memory_order_relaxed);
+    result.m_connectionDate =
+        m_page->m_connectionDate.load(std::memory_order_relaxed);
+    qint64 updated = m_page->m_updated.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_page->m_sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+
+    if (QDateTime::currentMSecsSinceEpoch() - updated > maxAgeMsec) {
+      return false;
+    }
+
+    counters = result;
+    return true;
+  }
+
+  logger.warning() << "The counters page is updated too often";
+  return false;
+}
+
+void CountersPage::close() {
+  if (!m_page) {
+    return;
+  }
+
+#ifdef COUNTERS_PAGE_SUPPORTED
+  munmap(m_page, sizeof(Page));
+  if (m_owner) {
+    ::close(m_fd);
+    shm_unlink(m_name.constData());
+  }
+#endif
+
+  m_page = nullptr;
+  m_owner = false;
+  m_fd = -1;
+}
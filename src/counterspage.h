@@ -0,0 +1,72 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef COUNTERSPAGE_H
+#define COUNTERSPAGE_H
+
+#include <QByteArray>
+#include <QString>
+
+// The shared memory page where the daemon publishes the counters of the
+// main peer.
+constexpr const char* COUNTERS_PAGE_NAME = "/mozillavpn-counters";
+
+// How often the daemon updates the page while the VPN is active and a client
+// reads it.
+constexpr int COUNTERS_PAGE_INTERVAL_MSEC = 1000;
+
+// A small shared memory page with the counters of the VPN connection. The
+// daemon creates it and updates it after each stats fetch. The clients map
+// it read-only, and can sample it at any rate without any request to the
+// daemon. The fields are protected by a sequence lock: a reader retries if
+// the page has been updated while it was reading it.
+//
+// Only the daemon can read the page at first. It lets the group of each
+// client which subscribes to the counters read it.
+//
+// This is available only on Linux and macOS. The clients fall back to the
+// status requests when the page cannot be opened (sandboxed clients, older
+// daemons) or when it is not updated anymore.
+class CountersPage final {
+  Q_DISABLE_COPY_MOVE(CountersPage)
+
+ public:
+  struct Counters {
+    bool m_connected = false;
+    quint64 m_txBytes = 0;
+    quint64 m_rxBytes = 0;
+    // In milliseconds since the epoch, or 0 if unknown.
+    qint64 m_handshake = 0;
+    qint64 m_connectionDate = 0;
+  };
+
+  CountersPage();
+  ~CountersPage();
+
+  // The daemon side: replaces any page with the same name.
+  bool create(const QString& name);
+  void publish(const Counters& counters);
+
+  // Lets the members of the group read the page. The page has a single
+  // group: the readers which already mapped it keep reading it.
+  bool allowGroup(uint gid);
+
+  // The client side. read() returns false if the page has not been updated
+  // for `maxAgeMsec` milliseconds: the daemon is gone.
+  bool open(const QString& name);
+  bool read(Counters& counters, qint64 maxAgeMsec) const;
+
+  bool isOpen() const { return m_page != nullptr; }
+  void close();
+
+ private:
+  struct Page;
+  Page* m_page = nullptr;
+  bool m_owner = false;
+  // The daemon keeps the page open to change its group.
+  int m_fd = -1;
+  QByteArray m_name;
+};
+
+#endif  // COUNTERSPAGE_H
@@ -8,6 +8,8 @@
 #include "loghandler.h"
 
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -15,7 +17,17 @@
 #include <QTimer>
 
 constexpr const char* JSON_ALLOWEDIPADDRESSRANGES = "allowedIPAddressRanges";
-constexpr int HANDSHAKE_POLL_MSEC = 250;
+constexpr const char* JSON_ALLOWEDIPADDRESSRANGES_PACKED =
+    "allowedIPAddressRangesPacked";
+constexpr int PEER_STATUS_CACHE_MSEC = 15;
+
+// How long a server switch waits for the handshake of the new peer before
+// moving the traffic to it anyway.
+constexpr int SWITCH_HANDSHAKE_TIMEOUT_MSEC = 10000;
+
+// Bounds of the interval requested by the status subscribers.
+constexpr int STATUS_INTERVAL_MIN_MSEC = 100;
+constexpr int STATUS_INTERVAL_MAX_MSEC = 60000;
 
 namespace {
 
@@ -23,6 +35,9 @@ Logger logger(LOG_MAIN, "Daemon");
 
 Daemon* s_daemon = nullptr;
 
+QElapsedTimer s_startupClock;
+QList<QPair<QString, qint64>> s_startupTrace;
+
 }  // namespace
 
 Daemon::Daemon(QObject* parent) : QObject(parent) {
@@ -33,8 +48,20 @@ Daemon::Daemon(QObject* parent) : QObject(parent) {
   Q_ASSERT(s_daemon == nullptr);
   s_daemon = this;
 
-  m_handshakeTimer.setSingleShot(true);
-  connect(&m_handshakeTimer, &QTimer::timeout, this, &Daemon::checkHandshake);
+  m_handshakeWatcher = new HandshakeWatcher(this, [this]() {
+    Q_ASSERT(wgutils() != nullptr);
+    return peerStatus();
+  });
+  connect(m_handshakeWatcher, &HandshakeWatcher::handshakeCompleted, this,
+          &Daemon::handshakeCompleted);
+
+  m_switchTimer.setSingleShot(true);
+  connect(&m_switchTimer, &QTimer::timeout, this, &Daemon::switchTimeout);
+
+  connect(&m_statusTimer, &QTimer::timeout, this, &Daemon::pushStatus);
+
+  // Each fetch of the peer stats updates the counters page.
+  connect(&m_countersTimer, &QTimer::timeout, this, [this]() { peerStatus(); });
 }
 
 Daemon::~Daemon() {
@@ -66,6 +93,34 @@ bool Daemon::activate(const InterfaceConfig& config) {
   // At the end, if the activation succeds, the `connected` signal is emitted.
   logger.debug() << "Activating interface";
 
+  // The client sends the same configuration again when it retries or
+  // reconnects: nothing to change.
+  QByteArray hash = fingerprint(config);
+  if (m_connections.contains(config.m_hopindex) &&
+      m_connections.value(config.m_hopindex).m_fingerprint == hash &&
+      wgutils()->interfaceExists()) {
+    logger.debug() << "Configuration unchanged for hop" << config.m_hopindex;
+    ++m_activationCacheHits;
+
+    // The handshake watcher emits the signal if the peer is not ready yet.
+    if (m_connections.value(config.m_hopindex).m_date.isValid()) {
+      int hopindex = config.m_hopindex;
+      QString pubkey = config.m_serverPublicKey;
+      QTimer::singleShot(0, this, [this, hopindex, pubkey]() {
+        if (m_connections.contains(hopindex) &&
+            m_connections.value(hopindex).m_config.m_serverPublicKey ==
+                pubkey) {
+          emit connected(pubkey);
+        }
+      });
+    }
+    return true;
+  }
+
+  connect(wgutils(), &WireguardUtils::peerEndpointFailed, this,
+          &Daemon::peerEndpointFailed, Qt::UniqueConnection);
+  wgutils()->prefetchPeerEndpoint(config);
+
   if (m_connections.contains(config.m_hopindex)) {
     if (supportServerSwitching(config)) {
       logger.debug() << "Already connected. Server switching supported.";
@@ -73,8 +128,8 @@ bool Daemon::activate(const InterfaceConfig& config) {
       if (!switchServer(config)) {
         return false;
       }
-      m_connections[config.m_hopindex] = ConnectionState(config);
-      m_handshakeTimer.start(HANDSHAKE_POLL_MSEC);
+      m_peerStatusTimer.invalidate();
+      m_handshakeWatcher->watch(config.m_hopindex, config.m_serverPublicKey);
       return true;
     }
 
@@ -89,6 +144,34 @@ bool Daemon::activate(const InterfaceConfig& config) {
 
   prepareActivation(config);
 
+  // configureHop() undoes its own failures, but the routes.
+  beginRouteBatch();
+  bool configured = configureHop(config);
+  QList<IPAddress> failedRoutes = commitRouteBatch();
+  if (!configured) {
+    deleteHopRoutes(config);
+    return false;
+  }
+
+  bool ok = failedRoutes.isEmpty();
+  for (const IPAddress& ip : failedRoutes) {
+    logger.debug() << "Routing configuration failed for" << ip.toString();
+  }
+
+  if (ok) {
+    ok = startHop(config, hash);
+  }
+  if (!ok) {
+    rollbackHop(config);
+  }
+  return ok;
+}
+
+// Configures the interface, the peer and the routes of a new hop. Within a
+// route batch, the routes are only queued. On failure, what has been done
+// is undone but the routes: the caller deletes them with deleteHopRoutes(),
+// once the route batch is committed.
+bool Daemon::configureHop(const InterfaceConfig& config) {
   // Bring up the wireguard interface if not already done.
   if (!wgutils()->interfaceExists()) {
     if (!wgutils()->addInterface(config)) {
@@ -111,29 +194,19 @@ bool Daemon::activate(const InterfaceConfig& config) {
   // Add the peer to this interface.
   if (!wgutils()->updatePeer(config)) {
     logger.error() << "Peer creation failed.";
+    releaseHop(config, false);
     return false;
   }
 
-  if ((config.m_hopindex == 0) && supportDnsUtils()) {
-    QList<QHostAddress> resolvers;
-    resolvers.append(QHostAddress(config.m_dnsServer));
-
-    // If the DNS is not the Gateway, it's a user defined DNS
-    // thus, not add any other :)
-    if (config.m_dnsServer == config.m_serverIpv4Gateway) {
-      resolvers.append(QHostAddress(config.m_serverIpv6Gateway));
-    }
-
-    if (!dnsutils()->updateResolvers(wgutils()->interfaceName(), resolvers)) {
-      return false;
-    }
+  if ((config.m_hopindex == 0) && !updateResolvers(config)) {
+    releaseHop(config, false);
+    return false;
   }
 
   if (supportIPUtils()) {
-    if (!iputils()->addInterfaceIPs(config)) {
-      return false;
-    }
-    if (!iputils()->setMTUAndUp(config)) {
+    if (!iputils()->addInterfaceIPs(config) ||
+        !iputils()->setMTUAndUp(config)) {
+      releaseHop(config, config.m_hopindex == 0);
       return false;
     }
   }
@@ -142,18 +215,195 @@ bool Daemon::activate(const InterfaceConfig& config) {
   for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
     if (!wgutils()->updateRoutePrefix(ip, config.m_hopindex)) {
       logger.debug() << "Routing configuration failed for" << ip.toString();
+      releaseHop(config, config.m_hopindex == 0);
       return false;
     }
   }
 
+  return true;
+}
+
+// Brings up a hop whose routes are in place, and starts watching its peer.
+bool Daemon::startHop(const InterfaceConfig& config, const QByteArray& hash) {
   bool status = run(Up, config);
   logger.debug() << "Connection status:" << status;
-  if (status) {
-    m_connections[config.m_hopindex] = ConnectionState(config);
-    m_handshakeTimer.start(HANDSHAKE_POLL_MSEC);
+  if (!status) {
+    return false;
+  }
+
+  m_connections[config.m_hopindex] = ConnectionState(config);
+  m_connections[config.m_hopindex].m_fingerprint = hash;
+  m_peerStatusTimer.invalidate();
+  m_handshakeWatcher->watch(config.m_hopindex, config.m_serverPublicKey);
+  updateStatusTimer();
+  updateCountersTimer();
+  return true;
+}
+
+// Removes the routes, the peer and the exclusions of a hop which has been
+// configured but not started. The interface is left in place.
+void Daemon::rollbackHop(const InterfaceConfig& config) {
+  logger.warning() << "Rolling back the configuration of hop"
+                   << config.m_hopindex;
+  deleteHopRoutes(config);
+  releaseHop(config, config.m_hopindex == 0);
+}
+
+// The routes are deleted in their own batch: a failure to delete them is not
+// a failure of the hops configured in another batch.
+void Daemon::deleteHopRoutes(const InterfaceConfig& config) {
+  Q_ASSERT(m_routeBatchDepth == 0);
+
+  beginRouteBatch();
+  for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
+    wgutils()->deleteRoutePrefix(ip, config.m_hopindex);
+  }
+  commitRouteBatch();
+}
+
+// Removes the peer and the exclusions of a hop which has not been started.
+// The resolvers are restored only if this hop has set them.
+void Daemon::releaseHop(const InterfaceConfig& config, bool resolversUpdated) {
+  Q_ASSERT(!m_connections.contains(config.m_hopindex));
+  wgutils()->deletePeer(config);
+
+  if (resolversUpdated && supportDnsUtils()) {
+    dnsutils()->restoreResolvers();
   }
 
-  return status;
+  for (const QString& i : config.m_excludedAddresses) {
+    QHostAddress address(i);
+    if (!m_excludedAddrSet.contains(address)) {
+      continue;
+    }
+    if (--m_excludedAddrSet[address] > 0) {
+      continue;
+    }
+    wgutils()->deleteExclusionRoute(address);
+    m_excludedAddrSet.remove(address);
+  }
+}
+
+bool Daemon::activateHops(const QList<InterfaceConfig>& configs,
+                          QList<bool>& results) {
+  Q_ASSERT(wgutils() != nullptr);
+  logger.debug() << "Activating" << configs.count() << "hops";
+  results.clear();
+
+  // Resolve all the endpoints while the interface is configured. The inner
+  // hops don't need to wait for the outer handshakes: their first packets
+  // are queued by the outer peers until their sessions are ready.
+  for (const InterfaceConfig& config : configs) {
+    wgutils()->prefetchPeerEndpoint(config);
+  }
+
+  // The interface is recreated when the server switching is not possible:
+  // do it before queueing any route.
+  for (const InterfaceConfig& config : configs) {
+    if (m_connections.contains(config.m_hopindex) &&
+        !supportServerSwitching(config)) {
+      logger.warning() << "Already connected. Server switching not supported.";
+      if (!deactivate(false)) {
+        return false;
+      }
+      break;
+    }
+  }
+
+  // The hops which are already active, or which switch server, are handled
+  // one by one. The new ones are configured first, then their routes are
+  // applied all at once, and only then are they brought up.
+  QList<int> newHops;
+  for (int i = 0; i < configs.count(); ++i) {
+    const InterfaceConfig& config = configs[i];
+    results.append(false);
+    if (m_connections.contains(config.m_hopindex)) {
+      results[i] = activate(config);
+    } else {
+      newHops.append(i);
+    }
+  }
+
+  if (newHops.isEmpty()) {
+    return !results.contains(false);
+  }
+
+  connect(wgutils(), &WireguardUtils::peerEndpointFailed, this,
+          &Daemon::peerEndpointFailed, Qt::UniqueConnection);
+
+  // configureHop() undoes its own failures, but the routes. They are deleted
+  // once the batch deciding the result of each hop is committed.
+  QList<bool> configured;
+  beginRouteBatch();
+  for (int i : newHops) {
+    prepareActivation(configs[i]);
+    configured.append(configureHop(configs[i]));
+  }
+  QList<IPAddress> failedRoutes = commitRouteBatch();
+
+  for (int n = 0; n < newHops.count(); ++n) {
+    const InterfaceConfig& config = configs[newHops[n]];
+    if (!configured[n]) {
+      deleteHopRoutes(config);
+      continue;
+    }
+
+    // A failed route fails every hop using that prefix.
+    bool ok = true;
+    for (const IPAddress& ip : failedRoutes) {
+      if (config.m_allowedIPAddressRanges.contains(ip)) {
+        logger.debug() << "Routing configuration failed for" << ip.toString();
+        ok = false;
+      }
+    }
+
+    if (ok) {
+      ok = startHop(config, fingerprint(config));
+    }
+    if (!ok) {
+      rollbackHop(config);
+    }
+    results[newHops[n]] = ok;
+  }
+
+  return !results.contains(false);
+}
+
+bool Daemon::updateResolvers(const InterfaceConfig& config) {
+  if (!supportDnsUtils()) {
+    return true;
+  }
+
+  QList<QHostAddress> resolvers;
+  resolvers.append(QHostAddress(config.m_dnsServer));
+
+  // If the DNS is not the Gateway, it's a user defined DNS
+  // thus, not add any other :)
+  if (config.m_dnsServer == config.m_serverIpv4Gateway) {
+    resolvers.append(QHostAddress(config.m_serverIpv6Gateway));
+  }
+
+  return dnsutils()->updateResolvers(wgutils()->interfaceName(), resolvers);
+}
+
+// static
+QByteArray Daemon::fingerprint(const InterfaceConfig& config) {
+  QByteArray data;
+  {
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << config.m_hopindex << config.m_privateKey
+           << config.m_deviceIpv4Address << config.m_deviceIpv6Address
+           << config.m_serverIpv4Gateway << config.m_serverIpv6Gateway
+           << config.m_serverPublicKey << config.m_serverIpv4AddrIn
+           << config.m_serverIpv6AddrIn << config.m_dnsServer
+           << config.m_serverPort;
+    stream << config.m_allowedIPAddressRanges.count();
+    for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
+      stream << ip.toString();
+    }
+    stream << config.m_excludedAddresses << config.m_vpnDisabledApps;
+  }
+  return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
 }
 
 // static
@@ -235,7 +485,19 @@ bool Daemon::parseConfig(const QJsonObject& obj, InterfaceConfig& config) {
     config.m_hopindex = value.toInt();
   }
 
-  if (!obj.contains(JSON_ALLOWEDIPADDRESSRANGES)) {
+  if (obj.contains(JSON_ALLOWEDIPADDRESSRANGES_PACKED)) {
+    QJsonValue value = obj.value(JSON_ALLOWEDIPADDRESSRANGES_PACKED);
+    if (!value.isString()) {
+      logger.error() << JSON_ALLOWEDIPADDRESSRANGES_PACKED << "is not a string";
+      return false;
+    }
+
+    QByteArray packed = QByteArray::fromBase64(value.toString().toLatin1());
+    if (!IPAddress::unpackList(packed, config.m_allowedIPAddressRanges)) {
+      logger.error() << JSON_ALLOWEDIPADDRESSRANGES_PACKED << "is invalid";
+      return false;
+    }
+  } else if (!obj.contains(JSON_ALLOWEDIPADDRESSRANGES)) {
     logger.error() << JSON_ALLOWEDIPADDRESSRANGES
                    << "missing in the jsonconfig input";
     return false;
@@ -280,15 +542,15 @@ bool Daemon::parseConfig(const QJsonObject& obj, InterfaceConfig& config) {
       config.m_allowedIPAddressRanges.append(
           IPAddress(QHostAddress(address.toString()), range.toInt()));
     }
-
-    // Sort allowed IPs by decreasing prefix length.
-    std::sort(config.m_allowedIPAddressRanges.begin(),
-              config.m_allowedIPAddressRanges.end(),
-              [&](const IPAddress& a, const IPAddress& b) -> bool {
-                return a.prefixLength() > b.prefixLength();
-              });
   }
 
+  // Sort allowed IPs by decreasing prefix length.
+  std::sort(config.m_allowedIPAddressRanges.begin(),
+            config.m_allowedIPAddressRanges.end(),
+            [&](const IPAddress& a, const IPAddress& b) -> bool {
+              return a.prefixLength() > b.prefixLength();
+            });
+
   if (!parseStringList(obj, "excludedAddresses", config.m_excludedAddresses)) {
     return false;
   }
@@ -301,6 +563,13 @@ bool Daemon::parseConfig(const QJsonObject& obj, InterfaceConfig& config) {
 bool Daemon::deactivate(bool emitSignals) {
   Q_ASSERT(wgutils() != nullptr);
 
+  m_handshakeWatcher->clear();
+  m_peerStatusTimer.invalidate();
+
+  // The standby peers go away with the interface.
+  m_pendingSwitches.clear();
+  m_switchTimer.stop();
+
   // Deactivate the main interface.
   if (m_connections.contains(0)) {
     const ConnectionState& state = m_connections.value(0);
@@ -326,9 +595,11 @@ bool Daemon::deactivate(bool emitSignals) {
   for (const ConnectionState& state : m_connections.values()) {
     const InterfaceConfig& config = state.m_config;
     logger.debug() << "Deleting routes for hop" << config.m_hopindex;
+    beginRouteBatch();
     for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
       wgutils()->deleteRoutePrefix(ip, config.m_hopindex);
     }
+    commitRouteBatch();
     wgutils()->deletePeer(config);
   }
 
@@ -344,15 +615,22 @@ bool Daemon::deactivate(bool emitSignals) {
   }
 
   m_connections.clear();
+  updateStatusTimer();
+  updateCountersTimer();
   return true;
 }
 
-QString Daemon::logs() {
+QString Daemon::logs() { return logs(metrics()); }
+
+// static
+QString Daemon::logs(const QJsonObject& metrics) {
   QString output;
 
   {
     QTextStream out(&output);
     LogHandler::writeLogs(out);
+    out << "Daemon metrics: "
+        << QJsonDocument(metrics).toJson(QJsonDocument::Compact) << "\n";
   }
 
   return output;
@@ -360,6 +638,187 @@ QString Daemon::logs() {
 
 void Daemon::cleanLogs() { LogHandler::instance()->cleanupLogs(); }
 
+// static
+void Daemon::traceStartup(const QString& phase) {
+  if (!s_startupClock.isValid()) {
+    s_startupClock.start();
+  }
+
+  qint64 usec = s_startupClock.nsecsElapsed() / 1000;
+  logger.info() << "Startup phase" << phase << "completed after"
+                << usec / 1000 << "ms";
+  s_startupTrace.append(qMakePair(phase, usec));
+}
+
+QJsonObject Daemon::metrics() const {
+  QJsonObject json;
+
+  QJsonArray startup;
+  for (const QPair<QString, qint64>& phase : s_startupTrace) {
+    QJsonObject obj;
+    obj.insert("phase", phase.first);
+    obj.insert("usec", (double)phase.second);
+    startup.append(obj);
+  }
+  json.insert("startup", startup);
+  json.insert("timeToFirstHandshake",
+              m_handshakeWatcher->timeToFirstHandshake().toJson());
+  json.insert("activationCacheHits", (double)m_activationCacheHits);
+  return json;
+}
+
+void Daemon::subscribeStatus(const QString& subscriber, int intervalMsec) {
+  logger.debug() << "Status subscription every" << intervalMsec << "msec";
+  m_statusSubscribers.insert(
+      subscriber, qBound(STATUS_INTERVAL_MIN_MSEC, intervalMsec,
+                         STATUS_INTERVAL_MAX_MSEC));
+  updateStatusTimer();
+}
+
+void Daemon::unsubscribeStatus(const QString& subscriber) {
+  if (m_statusSubscribers.remove(subscriber)) {
+    logger.debug() << "Status subscription removed";
+    updateStatusTimer();
+  }
+}
+
+// The status is pushed only while somebody is interested in it.
+void Daemon::updateStatusTimer() {
+  if (m_statusSubscribers.isEmpty() || !m_connections.contains(0)) {
+    m_statusTimer.stop();
+    return;
+  }
+
+  int interval = STATUS_INTERVAL_MAX_MSEC;
+  for (int value : m_statusSubscribers) {
+    interval = qMin(interval, value);
+  }
+
+  if (!m_statusTimer.isActive()) {
+    // The first signal reports no bytes: it sets the reference counters.
+    m_statusPubkey.clear();
+    pushStatus();
+  } else if (m_statusTimer.interval() == interval) {
+    return;
+  }
+  m_statusTimer.start(interval);
+}
+
+void Daemon::pushStatus() {
+  WireguardUtils::PeerStatus status;
+  if (!mainPeerStatus(status)) {
+    return;
+  }
+
+  // The counters of a new peer start from zero.
+  if (m_statusPubkey.isEmpty()) {
+    m_statusTxBytes = status.m_txBytes;
+    m_statusRxBytes = status.m_rxBytes;
+  } else if (m_statusPubkey != status.m_pubkey ||
+             status.m_txBytes < m_statusTxBytes ||
+             status.m_rxBytes < m_statusRxBytes) {
+    m_statusTxBytes = 0;
+    m_statusRxBytes = 0;
+  }
+  m_statusPubkey = status.m_pubkey;
+
+  qint64 handshakeAge = -1;
+  if (status.m_handshake > 0) {
+    handshakeAge =
+        (QDateTime::currentMSecsSinceEpoch() - status.m_handshake) / 1000;
+  }
+
+  const InterfaceConfig& config = m_connections.value(0).m_config;
+  emit statusChanged(config.m_serverIpv4Gateway, config.m_deviceIpv4Address,
+                     status.m_txBytes - m_statusTxBytes,
+                     status.m_rxBytes - m_statusRxBytes, handshakeAge);
+  m_statusTxBytes = status.m_txBytes;
+  m_statusRxBytes = status.m_rxBytes;
+}
+
+bool Daemon::publishCounters(const QString& name) {
+  return m_countersPage.create(name);
+}
+
+bool Daemon::subscribeCounters(const QString& subscriber, uint gid) {
+  if (!m_countersPage.isOpen() || !m_countersPage.allowGroup(gid)) {
+    return false;
+  }
+
+  logger.debug() << "Counters subscription";
+  m_countersSubscribers.insert(subscriber);
+  updateCountersTimer();
+  return true;
+}
+
+void Daemon::unsubscribeCounters(const QString& subscriber) {
+  if (m_countersSubscribers.remove(subscriber)) {
+    logger.debug() << "Counters subscription removed";
+    updateCountersTimer();
+  }
+}
+
+// Without any reader, the page is only updated by the stats fetched for
+// other reasons.
+void Daemon::updateCountersTimer() {
+  if (!m_countersPage.isOpen()) {
+    return;
+  }
+
+  if (!m_connections.contains(0) || m_countersSubscribers.isEmpty()) {
+    m_countersTimer.stop();
+    updateCounters();
+    return;
+  }
+
+  if (!m_countersTimer.isActive()) {
+    m_countersTimer.start(COUNTERS_PAGE_INTERVAL_MSEC);
+    m_peerStatusTimer.invalidate();
+    peerStatus();
+  }
+}
+
+// Publishes the counters of the main peer from the last stats fetch.
+void Daemon::updateCounters() {
+  if (!m_countersPage.isOpen()) {
+    return;
+  }
+
+  CountersPage::Counters counters;
+  if (m_connections.contains(0)) {
+    const ConnectionState& connection = m_connections.value(0);
+    for (const WireguardUtils::PeerStatus& peer : m_peerStatus) {
+      if (peer.m_pubkey != connection.m_config.m_serverPublicKey) {
+        continue;
+      }
+      counters.m_connected = true;
+      counters.m_txBytes = peer.m_txBytes;
+      counters.m_rxBytes = peer.m_rxBytes;
+      counters.m_handshake = peer.m_handshake;
+      if (connection.m_date.isValid()) {
+        counters.m_connectionDate = connection.m_date.toMSecsSinceEpoch();
+      }
+      break;
+    }
+  }
+
+  m_countersPage.publish(counters);
+}
+
+void Daemon::beginRouteBatch() {
+  if (m_routeBatchDepth++ == 0) {
+    wgutils()->beginRouteBatch();
+  }
+}
+
+QList<IPAddress> Daemon::commitRouteBatch() {
+  Q_ASSERT(m_routeBatchDepth > 0);
+  if (--m_routeBatchDepth > 0) {
+    return QList<IPAddress>();
+  }
+  return wgutils()->commitRouteBatch();
+}
+
 bool Daemon::supportServerSwitching(const InterfaceConfig& config) const {
   if (!m_connections.contains(config.m_hopindex)) {
     return false;
@@ -379,12 +838,32 @@ bool Daemon::switchServer(const InterfaceConfig& config) {
 
   logger.debug() << "Switching server for hop" << config.m_hopindex;
 
+  // Complete the previous switch before starting a new one.
+  if (m_pendingSwitches.contains(config.m_hopindex) &&
+      !completeSwitch(config.m_hopindex)) {
+    return false;
+  }
+
   Q_ASSERT(m_connections.contains(config.m_hopindex));
-  const InterfaceConfig& lastConfig =
-      m_connections.value(config.m_hopindex).m_config;
+  const ConnectionState lastState = m_connections.value(config.m_hopindex);
+  const InterfaceConfig& lastConfig = lastState.m_config;
+
+  // The new peer takes the traffic only once its handshake is completed,
+  // unless it is the same peer.
+  bool makeBeforeBreak =
+      wgutils()->supportStandbyPeer() &&
+      config.m_serverPublicKey != lastConfig.m_serverPublicKey;
+
+  // Only the parts of the configuration which have changed are applied. If
+  // any of them fails, the configuration is not cached, and the next
+  // activation applies it again.
+  bool complete = true;
 
   // Configure routing for new excluded addresses.
   for (const QString& i : config.m_excludedAddresses) {
+    if (lastConfig.m_excludedAddresses.contains(i)) {
+      continue;
+    }
     QHostAddress address(i);
     if (m_excludedAddrSet.contains(address)) {
       m_excludedAddrSet[address]++;
@@ -394,20 +873,153 @@ bool Daemon::switchServer(const InterfaceConfig& config) {
     m_excludedAddrSet[address] = 1;
   }
 
-  // Activate the new peer and its routes.
-  if (!wgutils()->updatePeer(config)) {
-    logger.error() << "Server switch failed to update the wireguard interface";
+  // Activate the new peer. The standby peer has no allowed-IPs yet: the
+  // routes of the new prefixes are only added once it is promoted, so that
+  // their traffic is never sent to an interface without a peer for it.
+  bool peerChanged =
+      config.m_serverPublicKey != lastConfig.m_serverPublicKey ||
+      config.m_serverIpv4AddrIn != lastConfig.m_serverIpv4AddrIn ||
+      config.m_serverIpv6AddrIn != lastConfig.m_serverIpv6AddrIn ||
+      config.m_serverPort != lastConfig.m_serverPort ||
+      config.m_allowedIPAddressRanges != lastConfig.m_allowedIPAddressRanges;
+  if (makeBeforeBreak) {
+    if (!wgutils()->addStandbyPeer(config)) {
+      logger.error() << "Server switch failed to add the standby peer";
+      releaseExclusions(lastConfig, config);
+      return false;
+    }
+  } else {
+    if (peerChanged && !wgutils()->updatePeer(config)) {
+      logger.error()
+          << "Server switch failed to update the wireguard interface";
+      releaseExclusions(lastConfig, config);
+      return false;
+    }
+    if (!addNewRoutes(config, lastConfig)) {
+      complete = false;
+    }
+  }
+
+  if (config.m_hopindex == 0 && config.m_dnsServer != lastConfig.m_dnsServer &&
+      !updateResolvers(config)) {
+    logger.error() << "Server switch failed to update the DNS";
+    complete = false;
+  }
+
+  if (makeBeforeBreak) {
+    m_pendingSwitches.insert(config.m_hopindex, lastState);
+    if (!m_switchTimer.isActive()) {
+      m_switchTimer.start(SWITCH_HANDSHAKE_TIMEOUT_MSEC);
+    }
+    m_connections[config.m_hopindex] = ConnectionState(config);
+    if (complete) {
+      m_connections[config.m_hopindex].m_fingerprint = fingerprint(config);
+    }
+    return true;
+  }
+
+  releaseConfig(config, lastConfig);
+
+  // Remove the old peer if it is no longer necessary.
+  if (config.m_serverPublicKey != lastConfig.m_serverPublicKey) {
+    if (!wgutils()->deletePeer(lastConfig)) {
+      return false;
+    }
+  }
+
+  m_connections[config.m_hopindex] = ConnectionState(config);
+  if (complete) {
+    m_connections[config.m_hopindex].m_fingerprint = fingerprint(config);
+  }
+  return true;
+}
+
+// Moves the traffic of the hop to the new peer, and removes the previous one.
+// If the new peer cannot be promoted, the previous one keeps the traffic and
+// the previous state of the hop is restored.
+bool Daemon::completeSwitch(int hopindex) {
+  Q_ASSERT(m_pendingSwitches.contains(hopindex));
+  Q_ASSERT(m_connections.contains(hopindex));
+
+  ConnectionState lastState = m_pendingSwitches.take(hopindex);
+  const InterfaceConfig& lastConfig = lastState.m_config;
+  if (m_pendingSwitches.isEmpty()) {
+    m_switchTimer.stop();
+  }
+
+  ConnectionState& state = m_connections[hopindex];
+  const InterfaceConfig config = state.m_config;
+  logger.debug() << "Completing the server switch for hop" << hopindex;
+
+  if (!wgutils()->promoteStandbyPeer(config, lastConfig)) {
+    logger.error() << "Server switch failed to promote the new peer";
+    wgutils()->deletePeer(config);
+    releaseExclusions(lastConfig, config);
+    if (hopindex == 0 && config.m_dnsServer != lastConfig.m_dnsServer) {
+      updateResolvers(lastConfig);
+    }
+    state = lastState;
+    m_handshakeWatcher->watch(hopindex, lastConfig.m_serverPublicKey);
+    m_peerStatusTimer.invalidate();
     return false;
   }
+  m_peerStatusTimer.invalidate();
+
+  // The new peer has its allowed-IPs: their routes can be added.
+  if (!addNewRoutes(config, lastConfig)) {
+    state.m_fingerprint.clear();
+  }
+
+  releaseConfig(config, lastConfig);
+  return true;
+}
+
+// Adds the routes of the prefixes which are new in the configuration of a
+// hop.
+bool Daemon::addNewRoutes(const InterfaceConfig& config,
+                          const InterfaceConfig& lastConfig) {
+  bool ok = true;
+  beginRouteBatch();
   for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
+    if (lastConfig.m_allowedIPAddressRanges.contains(ip)) {
+      continue;
+    }
     if (!wgutils()->updateRoutePrefix(ip, config.m_hopindex)) {
       logger.error() << "Server switch failed to update the routing table";
+      ok = false;
       break;
     }
   }
+  for (const IPAddress& ip : commitRouteBatch()) {
+    logger.error() << "Server switch failed to update the route for"
+                   << ip.toString();
+    ok = false;
+  }
+  return ok;
+}
+
+// Removes the exclusions and the routes of the previous configuration of a
+// hop, which are not used by the new one.
+void Daemon::releaseConfig(const InterfaceConfig& config,
+                           const InterfaceConfig& lastConfig) {
+  releaseExclusions(config, lastConfig);
+  beginRouteBatch();
+  for (const IPAddress& ip : lastConfig.m_allowedIPAddressRanges) {
+    if (!config.m_allowedIPAddressRanges.contains(ip)) {
+      wgutils()->deleteRoutePrefix(ip, config.m_hopindex);
+    }
+  }
+  commitRouteBatch();
+}
 
-  // Remove routing entries for the old peer.
+// Removes the exclusions of the previous configuration of a hop, which are
+// not used by the new one.
+void Daemon::releaseExclusions(const InterfaceConfig& config,
+                               const InterfaceConfig& lastConfig) {
   for (const QString& i : lastConfig.m_excludedAddresses) {
+    if (config.m_excludedAddresses.contains(i)) {
+      continue;
+    }
     QHostAddress address(i);
     Q_ASSERT(m_excludedAddrSet.contains(address));
     if (m_excludedAddrSet[address] > 1) {
@@ -417,87 +1029,118 @@ bool Daemon::switchServer(const InterfaceConfig& config) {
     wgutils()->deleteExclusionRoute(address);
     m_excludedAddrSet.remove(address);
   }
-  for (const IPAddress& ip : lastConfig.m_allowedIPAddressRanges) {
-    if (!config.m_allowedIPAddressRanges.contains(ip)) {
-      wgutils()->deleteRoutePrefix(ip, config.m_hopindex);
-    }
-  }
+}
 
-  // Remove the old peer if it is no longer necessary.
-  if (config.m_serverPublicKey != lastConfig.m_serverPublicKey) {
-    if (!wgutils()->deletePeer(lastConfig)) {
-      return false;
+void Daemon::switchTimeout() {
+  logger.warning() << "No handshake from the new peers: switching anyway";
+  bool failed = false;
+  for (int hopindex : m_pendingSwitches.keys()) {
+    if (!completeSwitch(hopindex)) {
+      failed = true;
     }
   }
-
-  m_connections[config.m_hopindex] = ConnectionState(config);
-  return true;
+  if (failed) {
+    emit backendFailure();
+  }
 }
 
 QJsonObject Daemon::getStatus() {
   Q_ASSERT(wgutils() != nullptr);
-  QJsonObject json;
   logger.debug() << "Status request";
 
-  if (!m_connections.contains(0) || !wgutils()->interfaceExists()) {
-    json.insert("connected", QJsonValue(false));
-    return json;
+  WireguardUtils::PeerStatus status;
+  if (!wgutils()->interfaceExists() || !mainPeerStatus(status)) {
+    return statusJson(ConnectionState(), nullptr);
   }
 
-  const ConnectionState& connection = m_connections.value(0);
-  QList<WireguardUtils::PeerStatus> peers = wgutils()->getPeerStatus();
-  for (WireguardUtils::PeerStatus status : peers) {
-    if (status.m_pubkey != connection.m_config.m_serverPublicKey) {
-      continue;
-    }
-    json.insert("connected", QJsonValue(true));
-    json.insert("serverIpv4Gateway",
-                QJsonValue(connection.m_config.m_serverIpv4Gateway));
-    json.insert("deviceIpv4Address",
-                QJsonValue(connection.m_config.m_deviceIpv4Address));
-    json.insert("date", connection.m_date.toString());
-    json.insert("txBytes", QJsonValue(status.m_txBytes));
-    json.insert("rxBytes", QJsonValue(status.m_rxBytes));
+  return statusJson(m_connections.value(0), &status);
+}
+
+// static
+QJsonObject Daemon::statusJson(const ConnectionState& connection,
+                               const WireguardUtils::PeerStatus* status) {
+  QJsonObject json;
+  if (!status) {
+    json.insert("connected", QJsonValue(false));
     return json;
   }
 
-  json.insert("connected", QJsonValue(false));
+  json.insert("connected", QJsonValue(true));
+  json.insert("serverIpv4Gateway",
+              QJsonValue(connection.m_config.m_serverIpv4Gateway));
+  json.insert("deviceIpv4Address",
+              QJsonValue(connection.m_config.m_deviceIpv4Address));
+  json.insert("date", connection.m_date.toString());
+  json.insert("txBytes", QJsonValue(status->m_txBytes));
+  json.insert("rxBytes", QJsonValue(status->m_rxBytes));
   return json;
 }
 
-void Daemon::checkHandshake() {
+// The status of the peer of the main hop. Returns false if the VPN is not
+// active.
+bool Daemon::mainPeerStatus(WireguardUtils::PeerStatus& status) {
+  if (!m_connections.contains(0)) {
+    return false;
+  }
+
+  const QString& pubkey = m_connections.value(0).m_config.m_serverPublicKey;
+  for (const WireguardUtils::PeerStatus& peer : peerStatus()) {
+    if (peer.m_pubkey == pubkey) {
+      status = peer;
+      return true;
+    }
+  }
+  return false;
+}
+
+QList<WireguardUtils::PeerStatus> Daemon::peerStatus() {
   Q_ASSERT(wgutils() != nullptr);
 
-  logger.debug() << "Checking for handshake...";
+  if (!m_peerStatusTimer.isValid() ||
+      m_peerStatusTimer.hasExpired(PEER_STATUS_CACHE_MSEC)) {
+    m_peerStatus = wgutils()->getPeerStatus();
+    m_peerStatusTimer.start();
+    updateCounters();
+  }
 
-  int pendingHandshakes = 0;
-  QList<WireguardUtils::PeerStatus> peers = wgutils()->getPeerStatus();
-  for (ConnectionState& connection : m_connections) {
-    const InterfaceConfig& config = connection.m_config;
-    if (connection.m_date.isValid()) {
-      continue;
-    }
-    logger.debug() << "awaiting"
-                   << WireguardUtils::printableKey(config.m_serverPublicKey);
+  return m_peerStatus;
+}
 
-    // Check if the handshake has completed.
-    for (const WireguardUtils::PeerStatus& status : peers) {
-      if (config.m_serverPublicKey != status.m_pubkey) {
-        continue;
-      }
-      if (status.m_handshake != 0) {
-        connection.m_date.setMSecsSinceEpoch(status.m_handshake);
-        emit connected(status.m_pubkey);
-      }
+void Daemon::peerEndpointFailed(const QString& pubkey) {
+  bool active = false;
+  for (const ConnectionState& connection : qAsConst(m_connections)) {
+    if (connection.m_config.m_serverPublicKey == pubkey) {
+      logger.error() << "The endpoint of hop" << connection.m_config.m_hopindex
+                     << "could not be resolved";
+      active = true;
     }
+  }
 
-    if (!connection.m_date.isValid()) {
-      pendingHandshakes++;
-    }
+  // The peer cannot complete any handshake.
+  if (active) {
+    emit backendFailure();
+    deactivate();
+  }
+}
+
+void Daemon::handshakeCompleted(int hopindex, const QString& pubkey,
+                                qint64 handshake) {
+  if (!m_connections.contains(hopindex)) {
+    return;
+  }
+
+  ConnectionState& connection = m_connections[hopindex];
+  if (connection.m_config.m_serverPublicKey != pubkey ||
+      connection.m_date.isValid()) {
+    return;
   }
 
-  // Check again if there were connections that haven't completed a handshake.
-  if (pendingHandshakes > 0) {
-    m_handshakeTimer.start(HANDSHAKE_POLL_MSEC);
+  // The new peer of a server switch is ready to take the traffic.
+  if (m_pendingSwitches.contains(hopindex) && !completeSwitch(hopindex)) {
+    emit backendFailure();
+    return;
   }
+
+  connection.m_date.setMSecsSinceEpoch(handshake);
+  emit connected(pubkey);
 }
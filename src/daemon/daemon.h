@@ -5,12 +5,16 @@
 #ifndef DAEMON_H
 #define DAEMON_H
 
+#include "counterspage.h"
 #include "dnsutils.h"
+#include "handshakewatcher.h"
 #include "interfaceconfig.h"
 #include "iputils.h"
 #include "wireguardutils.h"
 
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QSet>
 #include <QTimer>
 
 class Daemon : public QObject {
@@ -29,7 +33,17 @@ class Daemon : public QObject {
 
   static bool parseConfig(const QJsonObject& obj, InterfaceConfig& config);
 
+  // A hash of the whole configuration. An activation with the fingerprint of
+  // the current configuration of the hop has nothing to change.
+  static QByteArray fingerprint(const InterfaceConfig& config);
+
   virtual bool activate(const InterfaceConfig& config);
+  // Activates several hops at once, the outermost first. The routes of all
+  // the new hops are committed together before any of them is brought up;
+  // a hop whose routes fail is rolled back. The result of each hop is stored
+  // in `results`, in the same order as `configs`.
+  bool activateHops(const QList<InterfaceConfig>& configs,
+                    QList<bool>& results);
   virtual bool deactivate(bool emitSignals = true);
   virtual QJsonObject getStatus();
 
@@ -38,31 +52,91 @@ class Daemon : public QObject {
       Q_UNUSED(config)};
 
   QString logs();
+  // The logs followed by the given metrics. This can be called from any
+  // thread.
+  static QString logs(const QJsonObject& metrics);
   void cleanLogs();
 
+  virtual QJsonObject metrics() const;
+
+  // Records the end of a startup phase, with the time since the first one.
+  // The phases are logged, and reported in the metrics.
+  static void traceStartup(const QString& phase);
+
+  // The subscribers receive a statusChanged signal every `intervalMsec`
+  // milliseconds (the shortest interval requested by any of them), while the
+  // main hop is active. Subscribing again updates the interval.
+  void subscribeStatus(const QString& subscriber, int intervalMsec);
+  void unsubscribeStatus(const QString& subscriber);
+
+  // Publishes the counters of the main peer in a shared memory page, for
+  // the clients able to map it.
+  bool publishCounters(const QString& name);
+
+  // Lets the subscriber, a member of the group `gid`, read the counters
+  // page. The page is updated while the main hop is active and somebody is
+  // subscribed. Returns false if there is no page.
+  bool subscribeCounters(const QString& subscriber, uint gid);
+  void unsubscribeCounters(const QString& subscriber);
+
  signals:
   void connected(const QString& pubkey);
   void disconnected();
   void backendFailure();
 
+  // The bytes transmitted and received since the previous statusChanged
+  // signal, and the age of the last handshake in seconds (-1 if none).
+  void statusChanged(const QString& serverIpv4Gateway,
+                     const QString& deviceIpv4Address, qulonglong txBytes,
+                     qulonglong rxBytes, qlonglong handshakeAge);
+
  protected:
   virtual bool run(Op op, const InterfaceConfig& config) {
     Q_UNUSED(op);
     Q_UNUSED(config);
     return true;
   }
+  bool configureHop(const InterfaceConfig& config);
+  bool startHop(const InterfaceConfig& config, const QByteArray& hash);
+  void rollbackHop(const InterfaceConfig& config);
+  void deleteHopRoutes(const InterfaceConfig& config);
+  void releaseHop(const InterfaceConfig& config, bool resolversUpdated);
   virtual bool supportServerSwitching(const InterfaceConfig& config) const;
   virtual bool switchServer(const InterfaceConfig& config);
+  bool completeSwitch(int hopindex);
+  void releaseConfig(const InterfaceConfig& config,
+                     const InterfaceConfig& lastConfig);
+  void releaseExclusions(const InterfaceConfig& config,
+                         const InterfaceConfig& lastConfig);
+  bool addNewRoutes(const InterfaceConfig& config,
+                    const InterfaceConfig& lastConfig);
+  void switchTimeout();
+  void updateStatusTimer();
+  void pushStatus();
+  void updateCountersTimer();
+  void updateCounters();
   virtual WireguardUtils* wgutils() const = 0;
   virtual bool supportIPUtils() const { return false; }
   virtual IPUtils* iputils() { return nullptr; }
   virtual bool supportDnsUtils() const { return false; }
   virtual DnsUtils* dnsutils() { return nullptr; }
+  bool updateResolvers(const InterfaceConfig& config);
 
   static bool parseStringList(const QJsonObject& obj, const QString& name,
                               QStringList& list);
 
-  void checkHandshake();
+  // The peer status, shared by the handshake checks and the status
+  // requests for a short time.
+  QList<WireguardUtils::PeerStatus> peerStatus();
+  bool mainPeerStatus(WireguardUtils::PeerStatus& status);
+  void handshakeCompleted(int hopindex, const QString& pubkey,
+                          qint64 handshake);
+  void peerEndpointFailed(const QString& pubkey);
+
+  // Nested route batches are merged into the outermost one, which applies
+  // all the updates when it is committed.
+  void beginRouteBatch();
+  QList<IPAddress> commitRouteBatch();
 
   class ConnectionState {
    public:
@@ -70,10 +144,40 @@ class Daemon : public QObject {
     ConnectionState(const InterfaceConfig& config) { m_config = config; }
     QDateTime m_date;
     InterfaceConfig m_config;
+    // Empty if the configuration has not been fully applied.
+    QByteArray m_fingerprint;
   };
   QMap<int, ConnectionState> m_connections;
+
+  // The result of getStatus(), for the main hop and the status of its peer,
+  // or null if the VPN is not active. This can be called from any thread.
+  static QJsonObject statusJson(const ConnectionState& connection,
+                                const WireguardUtils::PeerStatus* status);
+
   QHash<QHostAddress, int> m_excludedAddrSet;
-  QTimer m_handshakeTimer;
+  HandshakeWatcher* m_handshakeWatcher = nullptr;
+  int m_routeBatchDepth = 0;
+  quint64 m_activationCacheHits = 0;
+
+  // The previous state of the hops whose new peer is waiting for its first
+  // handshake. It is restored if the new peer cannot take over.
+  QMap<int, ConnectionState> m_pendingSwitches;
+  QTimer m_switchTimer;
+
+  QList<WireguardUtils::PeerStatus> m_peerStatus;
+  QElapsedTimer m_peerStatusTimer;
+
+  // The status subscribers, with their interval, and the counters of the
+  // last statusChanged signal.
+  QMap<QString, int> m_statusSubscribers;
+  QTimer m_statusTimer;
+  QString m_statusPubkey;
+  qint64 m_statusTxBytes = 0;
+  qint64 m_statusRxBytes = 0;
+
+  CountersPage m_countersPage;
+  QSet<QString> m_countersSubscribers;
+  QTimer m_countersTimer;
 };
 
 #endif  // DAEMON_H
@@ -0,0 +1,57 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "daemonframe.h"
+#include "framereader.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+constexpr int DaemonFrame::HEADER_SIZE;
+constexpr quint32 DaemonFrame::MAX_PAYLOAD_SIZE;
+constexpr int DaemonFrame::CHUNK_SIZE;
+
+// static
+QByteArray DaemonFrame::encode(quint32 id, quint8 flags,
+                               const QByteArray& payload) {
+  Q_ASSERT(quint32(payload.length()) <= MAX_PAYLOAD_SIZE);
+
+  QByteArray frame(HEADER_SIZE, Qt::Uninitialized);
+  qToBigEndian<quint32>(payload.length(), frame.data());
+  qToBigEndian<quint32>(id, frame.data() + 4);
+  frame[8] = static_cast<char>(flags);
+  frame.append(payload);
+  return frame;
+}
+
+// static
+QByteArray DaemonFrame::encode(quint32 id, const QJsonObject& json) {
+  return encode(id, Json, QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+// static
+DaemonFrame::ReadResult DaemonFrame::read(FrameReader& reader,
+                                          DaemonFrame& frame) {
+  QByteArray header;
+  if (!reader.peek(HEADER_SIZE, header)) {
+    return Incomplete;
+  }
+
+  quint32 length = qFromBigEndian<quint32>(header.constData());
+  if (length > MAX_PAYLOAD_SIZE) {
+    return Invalid;
+  }
+
+  if (reader.pendingSize() < HEADER_SIZE + int(length)) {
+    return Incomplete;
+  }
+
+  frame.m_id = qFromBigEndian<quint32>(header.constData() + 4);
+  frame.m_flags = static_cast<quint8>(header.at(8));
+
+  reader.read(HEADER_SIZE, header);
+  reader.read(length, frame.m_payload);
+  return Complete;
+}
@@ -0,0 +1,59 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef DAEMONFRAME_H
+#define DAEMONFRAME_H
+
+#include <QByteArray>
+
+class FrameReader;
+class QJsonObject;
+
+// A frame of the binary framing of the daemon local socket, negotiated with
+// the "binary" command (see DAEMON_PROTOCOL_VERSION_BINARY_FRAMING).
+//
+// Each frame is made of a 9-byte header followed by the payload:
+// - the length of the payload, as a big-endian uint32,
+// - the request ID, as a big-endian uint32,
+// - the flags.
+//
+// A response has the ID of its request, and the messages sent by the daemon
+// on its own (connected, statusChanged, ...) have the ID 0. A response can be
+// split in several frames, which can be interleaved with the frames of other
+// requests.
+class DaemonFrame final {
+ public:
+  enum Flag : quint8 {
+    // The payload is a JSON object. Otherwise, it is binary data.
+    Json = 0x01,
+    // More frames follow with the same request ID.
+    More = 0x02,
+  };
+
+  enum ReadResult {
+    Complete,
+    Incomplete,
+    Invalid,
+  };
+
+  static constexpr int HEADER_SIZE = 9;
+  static constexpr quint32 MAX_PAYLOAD_SIZE = 1024 * 1024;
+
+  // The size of the frames when a large response is streamed.
+  static constexpr int CHUNK_SIZE = 16 * 1024;
+
+  static QByteArray encode(quint32 id, quint8 flags,
+                           const QByteArray& payload);
+  static QByteArray encode(quint32 id, const QJsonObject& json);
+
+  // Reads the next frame. The payload is a view of the reader buffer, valid
+  // until the next append.
+  static ReadResult read(FrameReader& reader, DaemonFrame& frame);
+
+  quint32 m_id = 0;
+  quint8 m_flags = 0;
+  QByteArray m_payload;
+};
+
+#endif  // DAEMONFRAME_H
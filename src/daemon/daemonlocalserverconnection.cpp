@@ -4,6 +4,8 @@
 
 #include "daemonlocalserverconnection.h"
 #include "daemon.h"
+#include "daemonframe.h"
+#include "daemonprotocol.h"
 #include "leakdetector.h"
 #include "logger.h"
 
@@ -12,9 +14,20 @@
 #include <QJsonObject>
 #include <QJsonValue>
 
+#if defined(Q_OS_MACOS)
+#  include <unistd.h>
+#elif defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)
+#  include <sys/socket.h>
+#endif
+
 namespace {
 Logger logger(LOG_MAIN, "DaemonLocalServerConnection");
-}
+
+// The chunks of the streamed responses are not written while this amount of
+// data is waiting to be sent, so that the other responses are not queued
+// behind them.
+constexpr qint64 STREAM_HIGH_WATERMARK = 64 * 1024;
+}  // namespace
 
 DaemonLocalServerConnection::DaemonLocalServerConnection(QObject* parent,
                                                          QLocalSocket* socket)
@@ -28,6 +41,8 @@ DaemonLocalServerConnection::DaemonLocalServerConnection(QObject* parent,
 
   connect(m_socket, &QLocalSocket::readyRead, this,
           &DaemonLocalServerConnection::readData);
+  connect(m_socket, &QLocalSocket::bytesWritten, this,
+          &DaemonLocalServerConnection::flushStreams);
 
   Daemon* daemon = Daemon::instance();
   connect(daemon, &Daemon::connected, this,
@@ -36,12 +51,21 @@ DaemonLocalServerConnection::DaemonLocalServerConnection(QObject* parent,
           &DaemonLocalServerConnection::disconnected);
   connect(daemon, &Daemon::backendFailure, this,
           &DaemonLocalServerConnection::backendFailure);
+  connect(daemon, &Daemon::statusChanged, this,
+          &DaemonLocalServerConnection::statusChanged);
 }
 
 DaemonLocalServerConnection::~DaemonLocalServerConnection() {
   MVPN_COUNT_DTOR(DaemonLocalServerConnection);
 
   logger.debug() << "Connection released";
+
+  if (m_statusSubscribed) {
+    Daemon::instance()->unsubscribeStatus(subscriberId());
+  }
+  if (m_countersSubscribed) {
+    Daemon::instance()->unsubscribeCounters(subscriberId());
+  }
 }
 
 void DaemonLocalServerConnection::readData() {
@@ -49,37 +73,63 @@ void DaemonLocalServerConnection::readData() {
 
   Q_ASSERT(m_socket);
 
+  // The framing can change in the middle of the buffer, after the "binary"
+  // command.
   while (true) {
-    int pos = m_buffer.indexOf("\n");
-    if (pos == -1) {
-      QByteArray input = m_socket->readAll();
-      if (input.isEmpty()) {
-        break;
-      }
-      m_buffer.append(input);
+    if (m_binary ? readFrame() : readLine()) {
       continue;
     }
 
-    QByteArray line = m_buffer.left(pos);
-    m_buffer.remove(0, pos + 1);
-
-    QByteArray command(line);
-    command = command.trimmed();
-
-    if (command.isEmpty()) {
-      continue;
+    QByteArray input = m_socket->readAll();
+    if (input.isEmpty()) {
+      break;
     }
+    m_reader.append(input);
+  }
+}
+
+bool DaemonLocalServerConnection::readLine() {
+  QByteArray command;
+  if (!m_reader.readLine(command)) {
+    return false;
+  }
 
+  if (!command.isEmpty()) {
     parseCommand(command);
   }
+  return true;
+}
+
+bool DaemonLocalServerConnection::readFrame() {
+  DaemonFrame frame;
+  DaemonFrame::ReadResult result = DaemonFrame::read(m_reader, frame);
+  if (result == DaemonFrame::Incomplete) {
+    return false;
+  }
+
+  if (result == DaemonFrame::Invalid) {
+    logger.error() << "Invalid frame";
+    m_socket->close();
+    return false;
+  }
+
+  if (frame.m_flags != DaemonFrame::Json) {
+    logger.warning() << "Unexpected frame flags:" << frame.m_flags;
+    return true;
+  }
+
+  parseCommand(frame.m_payload, frame.m_id);
+  return true;
 }
 
-void DaemonLocalServerConnection::parseCommand(const QByteArray& data) {
+void DaemonLocalServerConnection::parseCommand(const QByteArray& data,
+                                               quint32 id) {
   logger.debug() << "Command received:" << data.left(20);
 
   QJsonDocument json = QJsonDocument::fromJson(data);
   if (!json.isObject()) {
     logger.error() << "Invalid input";
+    writeResult(id, QString(), false);
     return;
   }
 
@@ -87,6 +137,7 @@ void DaemonLocalServerConnection::parseCommand(const QByteArray& data) {
   QJsonValue typeValue = obj.value("type");
   if (!typeValue.isString()) {
     logger.warning() << "No type command. Ignoring request.";
+    writeResult(id, QString(), false);
     return;
   }
 
@@ -95,11 +146,14 @@ void DaemonLocalServerConnection::parseCommand(const QByteArray& data) {
     InterfaceConfig config;
     if (!Daemon::parseConfig(obj, config)) {
       logger.error() << "Invalid configuration";
+      writeResult(id, type, false);
       emit disconnected();
       return;
     }
 
-    if (!Daemon::instance()->activate(config)) {
+    bool result = Daemon::instance()->activate(config);
+    writeResult(id, type, result);
+    if (!result) {
       logger.error() << "Failed to activate the interface";
       emit disconnected();
     }
@@ -107,33 +161,100 @@ void DaemonLocalServerConnection::parseCommand(const QByteArray& data) {
   }
 
   if (type == "deactivate") {
-    Daemon::instance()->deactivate();
+    writeResult(id, type, Daemon::instance()->deactivate());
     return;
   }
 
   if (type == "status") {
     QJsonObject obj = Daemon::instance()->getStatus();
     obj.insert("type", "status");
-    m_socket->write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
-    m_socket->write("\n");
+    write(obj, id);
+    return;
+  }
+
+  if (type == "subscribeStatus") {
+    QJsonValue interval = obj.value("interval");
+    if (!interval.isDouble()) {
+      logger.error() << "Invalid JSON for subscribeStatus - interval expected";
+      writeResult(id, type, false);
+      return;
+    }
+    m_statusSubscribed = true;
+    Daemon::instance()->subscribeStatus(subscriberId(), interval.toInt());
+    writeResult(id, type, true);
+    return;
+  }
+
+  if (type == "unsubscribeStatus") {
+    m_statusSubscribed = false;
+    Daemon::instance()->unsubscribeStatus(subscriberId());
+    if (m_countersSubscribed) {
+      m_countersSubscribed = false;
+      Daemon::instance()->unsubscribeCounters(subscriberId());
+    }
+    writeResult(id, type, true);
+    return;
+  }
+
+  // The counters page is readable by the group of the client.
+  if (type == "subscribeCounters") {
+    uint gid = 0;
+    if (!peerGroup(gid)) {
+      logger.error() << "Unknown group for the counters subscription";
+      writeResult(id, type, false);
+      return;
+    }
+    bool subscribed =
+        Daemon::instance()->subscribeCounters(subscriberId(), gid);
+    m_countersSubscribed = m_countersSubscribed || subscribed;
+    writeResult(id, type, subscribed);
     return;
   }
 
   if (type == "logs") {
+    if (m_binary) {
+      writeStream(id, Daemon::instance()->logs().toUtf8());
+      return;
+    }
+
     QJsonObject obj;
     obj.insert("type", "logs");
     obj.insert("logs", Daemon::instance()->logs().replace("\n", "|"));
-    m_socket->write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
-    m_socket->write("\n");
+    write(obj);
+    return;
+  }
+
+  if (type == "version") {
+    QJsonObject obj;
+    obj.insert("type", "version");
+    obj.insert("version", DAEMON_PROTOCOL_VERSION);
+    write(obj, id);
+    return;
+  }
+
+  if (type == "binary") {
+    if (m_binary) {
+      logger.warning() << "Binary framing already enabled";
+      writeResult(id, type, false);
+      return;
+    }
+
+    // The acknowledgment is the last line: what follows is framed.
+    QJsonObject obj;
+    obj.insert("type", "binary");
+    write(obj);
+    m_binary = true;
     return;
   }
 
   if (type == "cleanlogs") {
     Daemon::instance()->cleanLogs();
+    writeResult(id, type, true);
     return;
   }
 
   logger.warning() << "Invalid command:" << type;
+  writeResult(id, type, false);
 }
 
 void DaemonLocalServerConnection::connected(const QString& pubkey) {
@@ -155,7 +276,107 @@ void DaemonLocalServerConnection::backendFailure() {
   write(obj);
 }
 
-void DaemonLocalServerConnection::write(const QJsonObject& obj) {
+void DaemonLocalServerConnection::statusChanged(
+    const QString& serverIpv4Gateway, const QString& deviceIpv4Address,
+    qulonglong txBytes, qulonglong rxBytes, qlonglong handshakeAge) {
+  if (!m_statusSubscribed) {
+    return;
+  }
+
+  QJsonObject obj;
+  obj.insert("type", "statusChanged");
+  obj.insert("serverIpv4Gateway", QJsonValue(serverIpv4Gateway));
+  obj.insert("deviceIpv4Address", QJsonValue(deviceIpv4Address));
+  obj.insert("txBytes", QJsonValue(qint64(txBytes)));
+  obj.insert("rxBytes", QJsonValue(qint64(rxBytes)));
+  obj.insert("handshakeAge", QJsonValue(handshakeAge));
+  write(obj);
+}
+
+// Identifies this connection among the status subscribers.
+QString DaemonLocalServerConnection::subscriberId() const {
+  return QString("local-%1").arg(reinterpret_cast<quintptr>(this), 0, 16);
+}
+
+// The group of the process at the other end of the socket.
+bool DaemonLocalServerConnection::peerGroup(uint& gid) const {
+#if defined(Q_OS_MACOS) || (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID))
+  int fd = static_cast<int>(m_socket->socketDescriptor());
+#endif
+#if defined(Q_OS_MACOS)
+  uid_t uid;
+  gid_t group;
+  if (getpeereid(fd, &uid, &group) != 0) {
+    return false;
+  }
+  gid = group;
+  return true;
+#elif defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    return false;
+  }
+  gid = cred.gid;
+  return true;
+#else
+  Q_UNUSED(gid);
+  return false;
+#endif
+}
+
+void DaemonLocalServerConnection::write(const QJsonObject& obj, quint32 id) {
+  if (m_binary) {
+    m_socket->write(DaemonFrame::encode(id, obj));
+    return;
+  }
+
   m_socket->write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
   m_socket->write("\n");
 }
+
+// Reports the result of a command without data. Only the framed requests,
+// which have an ID, get it.
+void DaemonLocalServerConnection::writeResult(quint32 id,
+                                              const QString& command,
+                                              bool result) {
+  if (!m_binary || id == 0) {
+    return;
+  }
+
+  QJsonObject obj;
+  obj.insert("type", "result");
+  obj.insert("command", command);
+  obj.insert("result", result);
+  write(obj, id);
+}
+
+void DaemonLocalServerConnection::writeStream(quint32 id,
+                                              const QByteArray& data) {
+  Q_ASSERT(m_binary);
+  m_streams.append(Stream{id, data, 0});
+  flushStreams();
+}
+
+// Writes the chunks of the pending streams in turn, while the socket is not
+// congested.
+void DaemonLocalServerConnection::flushStreams() {
+  while (!m_streams.isEmpty() &&
+         m_socket->bytesToWrite() < STREAM_HIGH_WATERMARK) {
+    Stream stream = m_streams.takeFirst();
+
+    int length =
+        qMin(DaemonFrame::CHUNK_SIZE, stream.m_data.length() - stream.m_offset);
+    bool last = stream.m_offset + length == stream.m_data.length();
+
+    m_socket->write(DaemonFrame::encode(
+        stream.m_id, last ? 0 : DaemonFrame::More,
+        QByteArray::fromRawData(stream.m_data.constData() + stream.m_offset,
+                                length)));
+
+    if (!last) {
+      stream.m_offset += length;
+      m_streams.append(stream);
+    }
+  }
+}
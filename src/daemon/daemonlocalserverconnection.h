@@ -5,6 +5,9 @@
 #ifndef DAEMONLOCALSERVERCONNECTION_H
 #define DAEMONLOCALSERVERCONNECTION_H
 
+#include "framereader.h"
+
+#include <QList>
 #include <QObject>
 
 class QLocalSocket;
@@ -18,19 +21,44 @@ class DaemonLocalServerConnection final : public QObject {
 
  private:
   void readData();
+  bool readLine();
+  bool readFrame();
 
-  void parseCommand(const QByteArray& json);
+  void parseCommand(const QByteArray& json, quint32 id = 0);
 
   void connected(const QString& pubkey);
   void disconnected();
   void backendFailure();
+  void statusChanged(const QString& serverIpv4Gateway,
+                     const QString& deviceIpv4Address, qulonglong txBytes,
+                     qulonglong rxBytes, qlonglong handshakeAge);
+
+  QString subscriberId() const;
+  bool peerGroup(uint& gid) const;
 
-  void write(const QJsonObject& obj);
+  void write(const QJsonObject& obj, quint32 id = 0);
+  void writeResult(quint32 id, const QString& command, bool result);
+  void writeStream(quint32 id, const QByteArray& data);
+  void flushStreams();
 
  private:
   QLocalSocket* m_socket = nullptr;
 
-  QByteArray m_buffer;
+  FrameReader m_reader;
+
+  // Set when the client has switched to the binary framing.
+  bool m_binary = false;
+
+  // The large responses being sent in chunks, in binary mode.
+  struct Stream {
+    quint32 m_id;
+    QByteArray m_data;
+    int m_offset;
+  };
+  QList<Stream> m_streams;
+
+  bool m_statusSubscribed = false;
+  bool m_countersSubscribed = false;
 };
 
 #endif  // DAEMONLOCALSERVERCONNECTION_H
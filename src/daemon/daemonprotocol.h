@@ -0,0 +1,50 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef DAEMONPROTOCOL_H
+#define DAEMONPROTOCOL_H
+
+// Versions of the protocol between the client and the daemon. The daemon
+// reports its version (via DBus on Linux, via the "version" command on the
+// local socket), and the client enables the optional features accordingly.
+// Keep DAEMON_PROTOCOL_VERSION in sync with DBUS_PROTOCOL_VERSION in
+// version.pri.
+
+constexpr int DAEMON_PROTOCOL_VERSION = 8;
+
+// The oldest version the client is able to talk to.
+constexpr int DAEMON_PROTOCOL_VERSION_MIN = 1;
+
+// Version 2: the allowed IP address ranges can be sent in the packed binary
+// encoding (see IPAddress::packList()).
+constexpr int DAEMON_PROTOCOL_VERSION_PACKED_RANGES = 2;
+
+// Version 3: all the hops of a multi-hop connection can be activated with a
+// single request (activateMultihop via DBus).
+constexpr int DAEMON_PROTOCOL_VERSION_MULTIHOP_BATCH = 3;
+
+// Version 4: the client can subscribe to the status, which is then pushed by
+// the daemon at the requested interval (statusChanged).
+constexpr int DAEMON_PROTOCOL_VERSION_STATUS_STREAM = 4;
+
+// Version 5: the status is available as a typed DBus structure
+// (connectionStatus), instead of a JSON string.
+constexpr int DAEMON_PROTOCOL_VERSION_TYPED_STATUS = 5;
+
+// Version 6: the local socket can switch from newline-delimited JSON to
+// length-prefixed frames carrying request IDs (see DaemonFrame), with the
+// "binary" command. The logs are then streamed in binary chunks.
+constexpr int DAEMON_PROTOCOL_VERSION_BINARY_FRAMING = 6;
+
+// Version 7: with the binary framing, every request gets a response with its
+// ID. The commands without data reply with a "result" message.
+constexpr int DAEMON_PROTOCOL_VERSION_REQUEST_RESULT = 7;
+
+// Version 8: the client can subscribe to the counters page (see
+// CountersPage), which the daemon then lets it read and keeps up to date
+// until the client unsubscribes from the status. On the local socket, this
+// requires the binary framing.
+constexpr int DAEMON_PROTOCOL_VERSION_COUNTERS_PAGE = 8;
+
+#endif  // DAEMONPROTOCOL_H
@@ -0,0 +1,97 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "handshakewatcher.h"
+#include "leakdetector.h"
+#include "logger.h"
+
+// The delay before each check, since the last call to watch(). The last
+// value is used for all the following checks.
+constexpr int HANDSHAKE_POLL_SCHEDULE_MSEC[] = {20,  30,  50, 100,
+                                                150, 250, 500};
+constexpr int HANDSHAKE_POLL_SCHEDULE_LENGTH =
+    sizeof(HANDSHAKE_POLL_SCHEDULE_MSEC) /
+    sizeof(HANDSHAKE_POLL_SCHEDULE_MSEC[0]);
+
+namespace {
+Logger logger(LOG_MAIN, "HandshakeWatcher");
+}
+
+HandshakeWatcher::HandshakeWatcher(QObject* parent, Fetcher&& fetcher)
+    : QObject(parent), m_fetcher(std::move(fetcher)) {
+  MVPN_COUNT_CTOR(HandshakeWatcher);
+
+  m_timer.setSingleShot(true);
+  connect(&m_timer, &QTimer::timeout, this, &HandshakeWatcher::check);
+}
+
+HandshakeWatcher::~HandshakeWatcher() { MVPN_COUNT_DTOR(HandshakeWatcher); }
+
+void HandshakeWatcher::watch(int hopindex, const QString& pubkey) {
+  logger.debug() << "Waiting for the handshake of hop" << hopindex;
+
+  Pending& pending = m_pending[hopindex];
+  pending.m_pubkey = pubkey;
+  pending.m_timer.start();
+
+  // A new peer restarts the schedule from the shortest delay.
+  m_attempt = 0;
+  schedule();
+}
+
+void HandshakeWatcher::clear() {
+  m_pending.clear();
+  m_timer.stop();
+}
+
+void HandshakeWatcher::schedule() {
+  int index = qMin(m_attempt, HANDSHAKE_POLL_SCHEDULE_LENGTH - 1);
+  m_timer.start(HANDSHAKE_POLL_SCHEDULE_MSEC[index]);
+}
+
+void HandshakeWatcher::check() {
+  if (m_pending.isEmpty()) {
+    return;
+  }
+
+  QList<WireguardUtils::PeerStatus> peers = m_fetcher();
+
+  // The signals are emitted at the end, because the receivers might call
+  // watch() or clear().
+  QList<QPair<int, WireguardUtils::PeerStatus>> completed;
+
+  auto i = m_pending.begin();
+  while (i != m_pending.end()) {
+    const WireguardUtils::PeerStatus* found = nullptr;
+    for (const WireguardUtils::PeerStatus& status : peers) {
+      if (status.m_pubkey == i.value().m_pubkey && status.m_handshake != 0) {
+        found = &status;
+        break;
+      }
+    }
+
+    if (!found) {
+      ++i;
+      continue;
+    }
+
+    qint64 elapsed = i.value().m_timer.nsecsElapsed() / 1000;
+    logger.debug() << "Handshake completed for hop" << i.key() << "after"
+                   << elapsed / 1000 << "ms";
+    m_timeToFirstHandshake.record(elapsed);
+
+    completed.append(qMakePair(i.key(), *found));
+    i = m_pending.erase(i);
+  }
+
+  if (!m_pending.isEmpty()) {
+    ++m_attempt;
+    schedule();
+  }
+
+  for (const auto& pair : completed) {
+    emit handshakeCompleted(pair.first, pair.second.m_pubkey,
+                            pair.second.m_handshake);
+  }
+}
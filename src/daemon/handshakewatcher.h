@@ -0,0 +1,66 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef HANDSHAKEWATCHER_H
+#define HANDSHAKEWATCHER_H
+
+#include "latencyhistogram.h"
+#include "wireguardutils.h"
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QObject>
+#include <QPair>
+#include <QTimer>
+
+#include <functional>
+
+// Waits for the first handshake of the peers added with watch(). The peer
+// stats are checked often right after the activation, when the handshake is
+// most likely to complete, and then less and less frequently. A single stats
+// fetch is shared by all the pending peers.
+class HandshakeWatcher final : public QObject {
+  Q_OBJECT
+  Q_DISABLE_COPY_MOVE(HandshakeWatcher)
+
+ public:
+  typedef std::function<QList<WireguardUtils::PeerStatus>()> Fetcher;
+
+  HandshakeWatcher(QObject* parent, Fetcher&& fetcher);
+  ~HandshakeWatcher();
+
+  // Starts waiting for the handshake of the peer used by this hop. This
+  // replaces any previous peer for the same hop.
+  void watch(int hopindex, const QString& pubkey);
+  void clear();
+
+  bool isWatching() const { return !m_pending.isEmpty(); }
+
+  // Time from watch() to the detection of the handshake, in microseconds.
+  const LatencyHistogram& timeToFirstHandshake() const {
+    return m_timeToFirstHandshake;
+  }
+
+ signals:
+  void handshakeCompleted(int hopindex, const QString& pubkey,
+                          qint64 handshake);
+
+ private:
+  void check();
+  void schedule();
+
+ private:
+  struct Pending {
+    QString m_pubkey;
+    QElapsedTimer m_timer;
+  };
+
+  Fetcher m_fetcher;
+  QMap<int, Pending> m_pending;
+  QTimer m_timer;
+  int m_attempt = 0;
+  LatencyHistogram m_timeToFirstHandshake;
+};
+
+#endif  // HANDSHAKEWATCHER_H
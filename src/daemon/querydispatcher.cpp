@@ -0,0 +1,86 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "querydispatcher.h"
+#include "leakdetector.h"
+#include "logger.h"
+
+#include <QMutexLocker>
+#include <QRunnable>
+
+// The queries taking longer than this, including the wait for a worker, are
+// logged.
+constexpr qint64 SLOW_QUERY_MSEC = 1000;
+
+namespace {
+Logger logger(LOG_MAIN, "QueryDispatcher");
+}
+
+QueryDispatcher::QueryDispatcher(int threads) {
+  MVPN_COUNT_CTOR(QueryDispatcher);
+
+  m_pool.setMaxThreadCount(threads);
+  m_clock.start();
+}
+
+QueryDispatcher::~QueryDispatcher() {
+  MVPN_COUNT_DTOR(QueryDispatcher);
+  m_pool.waitForDone();
+}
+
+void QueryDispatcher::dispatch(const QString& name,
+                               std::function<void()>&& query) {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_maxDepth = qMax(m_maxDepth, ++m_depth);
+  }
+
+  qint64 queued = m_clock.nsecsElapsed();
+  m_pool.start(
+      QRunnable::create([this, name, queued, query = std::move(query)]() {
+        qint64 started = m_clock.nsecsElapsed();
+        query();
+        finished(name, queued, started);
+      }));
+}
+
+void QueryDispatcher::finished(const QString& name, qint64 queued,
+                               qint64 started) {
+  qint64 now = m_clock.nsecsElapsed();
+
+  QMutexLocker locker(&m_mutex);
+  --m_depth;
+
+  Stats& stats = m_stats[name];
+  stats.m_wait.record((started - queued) / 1000);
+  stats.m_run.record((now - started) / 1000);
+
+  qint64 elapsedMsec = (now - queued) / 1000000;
+  if (elapsedMsec > SLOW_QUERY_MSEC) {
+    logger.warning() << "Slow query:" << name << elapsedMsec << "ms";
+  }
+}
+
+int QueryDispatcher::queueDepth() const {
+  QMutexLocker locker(&m_mutex);
+  return m_depth;
+}
+
+QJsonObject QueryDispatcher::metrics() const {
+  QMutexLocker locker(&m_mutex);
+
+  QJsonObject queries;
+  for (auto i = m_stats.constBegin(); i != m_stats.constEnd(); ++i) {
+    QJsonObject obj;
+    obj.insert("wait", i->m_wait.toJson());
+    obj.insert("run", i->m_run.toJson());
+    queries.insert(i.key(), obj);
+  }
+
+  QJsonObject json;
+  json.insert("queueDepth", m_depth);
+  json.insert("maxQueueDepth", m_maxDepth);
+  json.insert("queries", queries);
+  return json;
+}
@@ -0,0 +1,58 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef QUERYDISPATCHER_H
+#define QUERYDISPATCHER_H
+
+#include "latencyhistogram.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+#include <functional>
+
+// Runs the read-only queries of the daemon on a small pool of worker
+// threads, so that a slow one (a log export, a netlink dump) doesn't delay
+// the commands and the events handled by the main thread. The queries must
+// only use the state captured when they are dispatched, or state with its
+// own lock: the mutations stay serialized on the main thread. The time spent
+// waiting for a worker and running is recorded per query.
+class QueryDispatcher final {
+  Q_DISABLE_COPY_MOVE(QueryDispatcher)
+
+ public:
+  explicit QueryDispatcher(int threads);
+  ~QueryDispatcher();
+
+  void dispatch(const QString& name, std::function<void()>&& query);
+
+  // The queries waiting for a worker or running.
+  int queueDepth() const;
+
+  void waitForDone() { m_pool.waitForDone(); }
+
+  QJsonObject metrics() const;
+
+ private:
+  void finished(const QString& name, qint64 queued, qint64 started);
+
+  struct Stats {
+    LatencyHistogram m_wait;
+    LatencyHistogram m_run;
+  };
+
+  QThreadPool m_pool;
+  QElapsedTimer m_clock;
+
+  mutable QMutex m_mutex;
+  int m_depth = 0;
+  int m_maxDepth = 0;
+  QHash<QString, Stats> m_stats;
+};
+
+#endif  // QUERYDISPATCHER_H
@@ -37,16 +37,52 @@ class WireguardUtils : public QObject {
   virtual bool addInterface(const InterfaceConfig& config) = 0;
   virtual bool deleteInterface() = 0;
 
+  // Called at the beginning of the activation, so that the endpoint of the
+  // peer can be resolved while the rest of the interface is configured.
+  virtual void prefetchPeerEndpoint(const InterfaceConfig& config) {
+    Q_UNUSED(config);
+  }
   virtual bool updatePeer(const InterfaceConfig& config) = 0;
   virtual bool deletePeer(const InterfaceConfig& config) = 0;
+
+  // Make-before-break server switching. The new peer is added without any
+  // allowed-IP, so the traffic keeps flowing through the current peer while
+  // the new one completes its handshake. Then the allowed-IPs are moved to
+  // the new peer, and the previous one is removed, in a single update.
+  virtual bool supportStandbyPeer() const { return false; }
+  virtual bool addStandbyPeer(const InterfaceConfig& config) {
+    Q_UNUSED(config);
+    return false;
+  }
+  virtual bool promoteStandbyPeer(const InterfaceConfig& config,
+                                  const InterfaceConfig& previous) {
+    Q_UNUSED(config);
+    Q_UNUSED(previous);
+    return false;
+  }
+
   virtual QList<PeerStatus> getPeerStatus() = 0;
 
   virtual bool updateRoutePrefix(const IPAddress& prefix, int hopindex) = 0;
   virtual bool deleteRoutePrefix(const IPAddress& prefix, int hopindex) = 0;
 
+  // Between beginRouteBatch() and commitRouteBatch(), the platforms which
+  // support it queue the route updates and apply them all at once. The
+  // commit returns the prefixes which have not been applied.
+  virtual void beginRouteBatch() {}
+  virtual QList<IPAddress> commitRouteBatch() { return QList<IPAddress>(); }
+
   virtual bool addExclusionRoute(const QHostAddress& address) = 0;
   virtual bool deleteExclusionRoute(const QHostAddress& address) = 0;
 
+ signals:
+  // The platforms resolving the endpoints in the background configure the
+  // peer first, and its endpoint later. This is emitted if the endpoint
+  // could not be resolved.
+  void peerEndpointFailed(const QString& pubkey);
+
+ public:
+
   // static
   static QString printableKey(const QString& pubkey) {
     if (pubkey.length() < 12) {
@@ -6,6 +6,7 @@
 #include "features/featurecustomdns.h"
 #include "features/featurelocalareaaccess.h"
 #include "ipaddress.h"
+#include "ipaddressclassifier.h"
 #include "logger.h"
 #include "rfc/rfc1918.h"
 #include "rfc/rfc4193.h"
@@ -17,7 +18,32 @@
 
 namespace {
 Logger logger(LOG_NETWORKING, "DNSHelper");
+
+enum DNSAddressCategory {
+  DNSLoopback,
+  DNSMullvad,
+  DNSLocalNetwork,
+};
+
+const IPAddressClassifier& dnsClassifier() {
+  // Destroyed after the leak detector has reported: not tracked.
+  static IPAddressClassifier classifier(IPAddressClassifier::Uncounted);
+  static bool initialized = []() {
+    classifier.addRanges({RFC5735::ipv4LoopbackAddressBlock(),
+                          RFC4291::ipv6LoopbackAddressBlock()},
+                         DNSLoopback);
+    // 100.64.0.0/24
+    classifier.addRange(IPAddress(QHostAddress(quint32(0x64400000)), 24),
+                        DNSMullvad);
+    QList<IPAddress> localNetworks = RFC1918::ipv4();
+    localNetworks.append(RFC4193::ipv6());
+    classifier.addRanges(localNetworks, DNSLocalNetwork);
+    return true;
+  }();
+  Q_UNUSED(initialized);
+  return classifier;
 }
+}  // namespace
 
 // Returns the DNS Server the user asked for in the Settings;
 constexpr const char* MULLVAD_BLOCK_ADS_DNS = "100.64.0.1";
@@ -63,8 +89,7 @@ QString DNSHelper::getDNS(const QString& fallback) {
 
 // static
 bool DNSHelper::isMullvadDNS(const QString& address) {
-  IPAddress mullvadAddresses = IPAddress("100.64.0.0/24");
-  return mullvadAddresses.contains(QHostAddress(address));
+  return dnsClassifier().classify(QHostAddress(address)) == DNSMullvad;
 }
 
 // static
@@ -80,8 +105,8 @@ bool DNSHelper::validateUserDNS(const QString& dns) {
     return false;
   }
 #if defined(MVPN_ANDROID) || defined(MVPN_IOS)
-  // Android/IOS rejects loopback as dns
-  if (address.isLoopback()) {
+  // Android/IOS rejects loopback (RFC 5735) as dns
+  if (dnsClassifier().classify(address) == DNSLoopback) {
     return false;
   }
 #endif
@@ -106,20 +131,19 @@ bool DNSHelper::shouldExcludeDNS() {
   }
 
   QHostAddress dnsAddress(dns);
+  int category = dnsClassifier().classify(dnsAddress);
 
   // No need to filter out loopback ip addresses
-  if (RFC5735::ipv4LoopbackAddressBlock().contains(dnsAddress) ||
-      RFC4291::ipv6LoopbackAddressBlock().contains(dnsAddress)) {
+  if (category == DNSLoopback) {
     return false;
   }
 
   // Edge-case: the DNS is a mullvad one.
-  if (isMullvadDNS(dns)) {
+  if (category == DNSMullvad) {
     return false;
   }
 
-  bool isLocalDNS =
-      RFC1918::contains(dnsAddress) || RFC4193::contains(dnsAddress);
+  bool isLocalDNS = category == DNSLocalNetwork;
   if (!FeatureLocalAreaAccess::instance()->isSupported() && isLocalDNS) {
     // In case we cant use lan access, we must exclude it (the platform already
     // does the magic for us).
@@ -0,0 +1,112 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "framereader.h"
+#include "leakdetector.h"
+
+#include <cstring>
+
+namespace {
+
+// The consumed data is removed from the buffer when it is at least this size
+// and larger than the pending data, to keep the memmove cheap.
+constexpr int COMPACT_THRESHOLD = 4096;
+
+constexpr int INITIAL_CAPACITY = 4096;
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+         c == '\r';
+}
+
+}  // namespace
+
+FrameReader::FrameReader() {
+  MVPN_COUNT_CTOR(FrameReader);
+
+  // Reserving keeps the capacity when the buffer is emptied.
+  m_buffer.reserve(INITIAL_CAPACITY);
+}
+
+FrameReader::~FrameReader() { MVPN_COUNT_DTOR(FrameReader); }
+
+void FrameReader::append(const QByteArray& data) {
+  compact();
+  m_buffer.append(data);
+}
+
+void FrameReader::compact() {
+  if (m_offset == 0) {
+    return;
+  }
+
+  if (m_offset == m_buffer.size()) {
+    m_buffer.resize(0);
+    m_offset = 0;
+    m_scanned = 0;
+    return;
+  }
+
+  if (m_offset < COMPACT_THRESHOLD || m_offset < pendingSize()) {
+    return;
+  }
+
+  m_buffer.remove(0, m_offset);
+  m_scanned -= m_offset;
+  m_offset = 0;
+}
+
+bool FrameReader::readLine(QByteArray& line) {
+  Q_ASSERT(m_scanned >= m_offset);
+
+  const char* data = m_buffer.constData();
+  const char* end = static_cast<const char*>(
+      memchr(data + m_scanned, '\n', m_buffer.size() - m_scanned));
+  if (!end) {
+    m_scanned = m_buffer.size();
+    return false;
+  }
+
+  int begin = m_offset;
+  int last = end - data;
+
+  m_offset = last + 1;
+  m_scanned = m_offset;
+
+  while (begin < last && isSpace(data[begin])) {
+    ++begin;
+  }
+  while (last > begin && isSpace(data[last - 1])) {
+    --last;
+  }
+
+  line = QByteArray::fromRawData(data + begin, last - begin);
+  return true;
+}
+
+bool FrameReader::read(int length, QByteArray& data) {
+  if (!peek(length, data)) {
+    return false;
+  }
+
+  m_offset += length;
+  m_scanned = qMax(m_scanned, m_offset);
+  return true;
+}
+
+bool FrameReader::peek(int length, QByteArray& data) const {
+  Q_ASSERT(length >= 0);
+
+  if (pendingSize() < length) {
+    return false;
+  }
+
+  data = QByteArray::fromRawData(m_buffer.constData() + m_offset, length);
+  return true;
+}
+
+QByteArray FrameReader::pending() const {
+  return QByteArray::fromRawData(m_buffer.constData() + m_offset,
+                                 pendingSize());
+}
@@ -0,0 +1,55 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <QByteArray>
+
+// Buffers the data received from a stream and splits it in frames: lines, or
+// blocks of a known length. The consumed data is tracked with an offset, and
+// the buffer is compacted only when the consumed part is large enough.
+//
+// The frames are returned as raw views of the internal buffer, without any
+// copy. A view is valid until the next call to append().
+class FrameReader final {
+  Q_DISABLE_COPY_MOVE(FrameReader)
+
+ public:
+  FrameReader();
+  ~FrameReader();
+
+  void append(const QByteArray& data);
+
+  // Returns the next line, without the trailing '\n' and with the leading and
+  // trailing whitespaces removed. Returns false if no complete line has been
+  // received yet.
+  bool readLine(QByteArray& line);
+
+  // Returns the next `length` bytes, if they have been received.
+  bool read(int length, QByteArray& data);
+
+  // Like read(), without consuming the data.
+  bool peek(int length, QByteArray& data) const;
+
+  // The data received but not consumed yet.
+  QByteArray pending() const;
+  int pendingSize() const { return m_buffer.size() - m_offset; }
+  bool isEmpty() const { return pendingSize() == 0; }
+
+ private:
+  void compact();
+
+ private:
+  QByteArray m_buffer;
+
+  // The beginning of the data not consumed yet.
+  int m_offset = 0;
+
+  // Where to continue searching for the end of the line: the bytes before
+  // this position have already been scanned.
+  int m_scanned = 0;
+};
+
+#endif  // FRAMEREADER_H
@@ -8,8 +8,48 @@
 
 #include <QtMath>
 
+#include <algorithm>
+
 namespace {
 Logger logger(LOG_NETWORKING, "IPAddress");
+
+// Orders the addresses by protocol first, and then numerically.
+bool addressLessThan(const QHostAddress& a, const QHostAddress& b) {
+  if (a.protocol() != b.protocol()) {
+    return a.protocol() < b.protocol();
+  }
+
+  if (a.protocol() == QAbstractSocket::IPv4Protocol) {
+    return a.toIPv4Address() < b.toIPv4Address();
+  }
+
+  Q_IPV6ADDR rawA = a.toIPv6Address();
+  Q_IPV6ADDR rawB = b.toIPv6Address();
+  return memcmp(&rawA, &rawB, sizeof(Q_IPV6ADDR)) < 0;
+}
+
+// Returns the same prefix with the host bits cleared.
+IPAddress normalize(const IPAddress& ip) {
+  if (ip.type() == QAbstractSocket::IPv4Protocol) {
+    return IPAddress(QHostAddress(ip.address().toIPv4Address() &
+                                  ip.netmask().toIPv4Address()),
+                     ip.prefixLength());
+  }
+
+  Q_IPV6ADDR rawAddress = ip.address().toIPv6Address();
+  Q_IPV6ADDR rawNetmask = ip.netmask().toIPv6Address();
+  for (int i = 0; i < 16; ++i) {
+    rawAddress[i] &= rawNetmask[i];
+  }
+  return IPAddress(QHostAddress(rawAddress), ip.prefixLength());
+}
+
+// Family byte, prefix length and address of the packed ranges.
+constexpr quint8 PACKED_FAMILY_IPV4 = 4;
+constexpr quint8 PACKED_FAMILY_IPV6 = 6;
+constexpr int PACKED_HEADER_SIZE = 2;
+constexpr int PACKED_IPV4_SIZE = PACKED_HEADER_SIZE + 4;
+constexpr int PACKED_IPV6_SIZE = PACKED_HEADER_SIZE + 16;
 }  // namespace
 
 IPAddress::IPAddress() { MVPN_COUNT_CTOR(IPAddress); }
@@ -261,6 +301,142 @@ QList<IPAddress> IPAddress::excludeAddresses(
   return results;
 }
 
+// static
+QList<IPAddress> IPAddress::aggregate(const QList<IPAddress>& list) {
+  QList<IPAddress> sorted;
+  sorted.reserve(list.length());
+  for (const IPAddress& ip : list) {
+    if (ip.type() == QAbstractSocket::IPv4Protocol ||
+        ip.type() == QAbstractSocket::IPv6Protocol) {
+      sorted.append(normalize(ip));
+    }
+  }
+
+  // By address, and the biggest prefix first: a prefix can only be covered
+  // by one of those preceding it.
+  std::sort(sorted.begin(), sorted.end(),
+            [](const IPAddress& a, const IPAddress& b) {
+              if (a.address() != b.address()) {
+                return addressLessThan(a.address(), b.address());
+              }
+              return a.prefixLength() < b.prefixLength();
+            });
+
+  QList<IPAddress> result;
+  for (const IPAddress& ip : sorted) {
+    // Skip the covered prefixes. The sorting guarantees that the last one is
+    // the only one which can cover this.
+    if (!result.isEmpty() && ip.subnetOf(result.last())) {
+      continue;
+    }
+
+    result.append(ip);
+
+    // Merge the siblings. The parent can be the sibling of the previous one.
+    while (result.length() >= 2) {
+      const IPAddress& a = result[result.length() - 2];
+      const IPAddress& b = result.last();
+      if (a.type() != b.type() || a.prefixLength() != b.prefixLength() ||
+          a.prefixLength() == 0) {
+        break;
+      }
+
+      IPAddress parent(a.address(), a.prefixLength() - 1);
+      QList<IPAddress> sn = parent.subnets();
+      if (sn[0] != a || sn[1] != b) {
+        break;
+      }
+
+      result.removeLast();
+      result.last() = parent;
+    }
+  }
+
+  return result;
+}
+
+// static
+QByteArray IPAddress::packList(const QList<IPAddress>& list) {
+  QByteArray data;
+  data.reserve(list.length() * PACKED_IPV6_SIZE);
+
+  for (const IPAddress& ip : list) {
+    if (ip.type() == QAbstractSocket::IPv4Protocol) {
+      quint32 address = ip.address().toIPv4Address();
+      char raw[PACKED_IPV4_SIZE] = {
+          (char)PACKED_FAMILY_IPV4, (char)ip.prefixLength(),
+          (char)(address >> 24),    (char)(address >> 16),
+          (char)(address >> 8),     (char)address};
+      data.append(raw, sizeof(raw));
+    } else if (ip.type() == QAbstractSocket::IPv6Protocol) {
+      Q_IPV6ADDR raw = ip.address().toIPv6Address();
+      data.append((char)PACKED_FAMILY_IPV6);
+      data.append((char)ip.prefixLength());
+      data.append(reinterpret_cast<const char*>(&raw), sizeof(raw));
+    }
+  }
+
+  return data;
+}
+
+// static
+bool IPAddress::unpackList(const QByteArray& data, QList<IPAddress>& list) {
+  const quint8* ptr = reinterpret_cast<const quint8*>(data.constData());
+  const quint8* end = ptr + data.length();
+
+  list.reserve(list.length() + data.length() / PACKED_IPV6_SIZE);
+
+  while (ptr < end) {
+    if (end - ptr < PACKED_HEADER_SIZE) {
+      logger.error() << "Truncated packed range";
+      return false;
+    }
+
+    quint8 family = ptr[0];
+    int prefixLength = ptr[1];
+    const quint8* raw = ptr + PACKED_HEADER_SIZE;
+
+    switch (family) {
+      case PACKED_FAMILY_IPV4: {
+        if (end - ptr < PACKED_IPV4_SIZE) {
+          logger.error() << "Truncated packed range";
+          return false;
+        }
+        if (prefixLength > 32) {
+          logger.error() << "Invalid packed IPv4 prefix length";
+          return false;
+        }
+
+        quint32 address = ((quint32)raw[0] << 24) | ((quint32)raw[1] << 16) |
+                          ((quint32)raw[2] << 8) | (quint32)raw[3];
+        list.append(IPAddress(QHostAddress(address), prefixLength));
+        ptr += PACKED_IPV4_SIZE;
+        break;
+      }
+
+      case PACKED_FAMILY_IPV6:
+        if (end - ptr < PACKED_IPV6_SIZE) {
+          logger.error() << "Truncated packed range";
+          return false;
+        }
+        if (prefixLength > 128) {
+          logger.error() << "Invalid packed IPv6 prefix length";
+          return false;
+        }
+
+        list.append(IPAddress(QHostAddress(raw), prefixLength));
+        ptr += PACKED_IPV6_SIZE;
+        break;
+
+      default:
+        logger.error() << "Invalid packed address family" << family;
+        return false;
+    }
+  }
+
+  return true;
+}
+
 QList<IPAddress> IPAddress::excludeAddresses(const IPAddress& ip) const {
   QList<IPAddress> sn = subnets();
   Q_ASSERT(sn.length() >= 2);
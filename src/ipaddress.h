@@ -12,6 +12,17 @@ class IPAddress final {
   static QList<IPAddress> excludeAddresses(const QList<IPAddress>& sourceList,
                                            const QList<IPAddress>& excludeList);
 
+  // Returns the minimal list of prefixes covering exactly the same addresses:
+  // the prefixes covered by other prefixes are removed, and sibling prefixes
+  // are merged into their parent.
+  static QList<IPAddress> aggregate(const QList<IPAddress>& list);
+
+  // Compact binary encoding of a list of ranges. Each range is the address
+  // family (4 or 6), the prefix length and the address in network order: 6
+  // bytes for IPv4 and 18 bytes for IPv6.
+  static QByteArray packList(const QList<IPAddress>& list);
+  static bool unpackList(const QByteArray& data, QList<IPAddress>& list);
+
   IPAddress();
   IPAddress(const QString& ip);
   IPAddress(const QHostAddress& address);
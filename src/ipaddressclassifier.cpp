@@ -0,0 +1,220 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ipaddressclassifier.h"
+#include "leakdetector.h"
+
+#include <algorithm>
+
+using Key128 = IPAddressClassifier::Key128;
+
+namespace {
+
+bool isMax(quint32 key) { return key == 0xFFFFFFFF; }
+bool isMax(const Key128& key) {
+  return key.high == ~quint64(0) && key.low == ~quint64(0);
+}
+
+quint32 next(quint32 key) { return key + 1; }
+Key128 next(const Key128& key) {
+  Key128 n = key;
+  if (++n.low == 0) ++n.high;
+  return n;
+}
+
+Key128 toKey128(const Q_IPV6ADDR& address) {
+  Key128 key = {0, 0};
+  for (int i = 0; i < 8; ++i) {
+    key.high = (key.high << 8) | address[i];
+    key.low = (key.low << 8) | address[i + 8];
+  }
+  return key;
+}
+
+// Appends a new interval, merging it with the previous ones when possible.
+template <typename K>
+void emitInterval(QVector<K>& starts, QVector<int>& categories, const K& start,
+                  int category) {
+  if (!starts.isEmpty() && starts.last() == start) {
+    categories.last() = category;
+    if (categories.length() > 1 &&
+        categories[categories.length() - 2] == category) {
+      starts.removeLast();
+      categories.removeLast();
+    }
+    return;
+  }
+
+  if (!categories.isEmpty() && categories.last() == category) {
+    return;
+  }
+
+  starts.append(start);
+  categories.append(category);
+}
+
+// The ranges are CIDR blocks: two ranges are either disjoint or nested. We
+// sweep them ordered by start (and by size, the biggest first), keeping the
+// stack of the ranges containing the current point.
+template <typename K, typename R>
+void flatten(QVector<R> ranges, QVector<K>& starts, QVector<int>& categories) {
+  starts.clear();
+  categories.clear();
+
+  std::stable_sort(ranges.begin(), ranges.end(), [](const R& a, const R& b) {
+    if (a.start == b.start) return b.end < a.end;
+    return a.start < b.start;
+  });
+
+  emitInterval(starts, categories, K(), IPAddressClassifier::Unclassified);
+
+  QVector<R> stack;
+  auto pop = [&]() {
+    R range = stack.takeLast();
+    if (!isMax(range.end)) {
+      emitInterval(starts, categories, next(range.end),
+                   stack.isEmpty() ? IPAddressClassifier::Unclassified
+                                   : stack.last().category);
+    }
+  };
+
+  for (const R& range : ranges) {
+    while (!stack.isEmpty() && stack.last().end < range.start) {
+      pop();
+    }
+
+    emitInterval(starts, categories, range.start, range.category);
+    stack.append(range);
+  }
+
+  while (!stack.isEmpty()) {
+    pop();
+  }
+}
+
+// Returns the index of the last start <= key. The first start is always the
+// minimum value, so the result is always valid. The loop has a fixed number
+// of iterations for a given table size, and the compiler can turn the body
+// into a conditional move.
+template <typename K>
+int lookup(const QVector<K>& starts, const K& key) {
+  Q_ASSERT(!starts.isEmpty());
+
+  const K* base = starts.constData();
+  int length = starts.length();
+  while (length > 1) {
+    int half = length / 2;
+    base = (base[half] <= key) ? base + half : base;
+    length -= half;
+  }
+
+  return base - starts.constData();
+}
+
+}  // namespace
+
+constexpr int IPAddressClassifier::Unclassified;
+
+IPAddressClassifier::IPAddressClassifier() {
+  MVPN_COUNT_CTOR(IPAddressClassifier);
+  rebuild();
+}
+
+IPAddressClassifier::IPAddressClassifier(const IPAddressClassifier& other)
+    : m_ipv4Ranges(other.m_ipv4Ranges),
+      m_ipv6Ranges(other.m_ipv6Ranges),
+      m_ipv4Starts(other.m_ipv4Starts),
+      m_ipv4Categories(other.m_ipv4Categories),
+      m_ipv6Starts(other.m_ipv6Starts),
+      m_ipv6Categories(other.m_ipv6Categories) {
+  MVPN_COUNT_CTOR(IPAddressClassifier);
+}
+
+IPAddressClassifier::IPAddressClassifier(UncountedTag) : m_counted(false) {
+  rebuild();
+}
+
+IPAddressClassifier::~IPAddressClassifier() {
+  if (m_counted) {
+    MVPN_COUNT_DTOR(IPAddressClassifier);
+  }
+}
+
+IPAddressClassifier& IPAddressClassifier::operator=(
+    const IPAddressClassifier& other) {
+  m_ipv4Ranges = other.m_ipv4Ranges;
+  m_ipv6Ranges = other.m_ipv6Ranges;
+  m_ipv4Starts = other.m_ipv4Starts;
+  m_ipv4Categories = other.m_ipv4Categories;
+  m_ipv6Starts = other.m_ipv6Starts;
+  m_ipv6Categories = other.m_ipv6Categories;
+  return *this;
+}
+
+void IPAddressClassifier::addRange(const IPAddress& range, int category) {
+  appendRange(range, category);
+  rebuild();
+}
+
+void IPAddressClassifier::addRanges(const QList<IPAddress>& ranges,
+                                    int category) {
+  for (const IPAddress& range : ranges) {
+    appendRange(range, category);
+  }
+  rebuild();
+}
+
+void IPAddressClassifier::appendRange(const IPAddress& range, int category) {
+  Q_ASSERT(category != Unclassified);
+
+  if (range.type() == QAbstractSocket::IPv4Protocol) {
+    quint32 start = range.address().toIPv4Address();
+    quint32 hostmask = range.prefixLength() >= 32
+                           ? 0
+                           : (0xFFFFFFFF >> range.prefixLength());
+    start &= ~hostmask;
+    m_ipv4Ranges.append({start, start | hostmask, category});
+    return;
+  }
+
+  Q_ASSERT(range.type() == QAbstractSocket::IPv6Protocol);
+
+  int prefixLength = range.prefixLength();
+  quint64 highHostmask =
+      prefixLength >= 64 ? 0 : (~quint64(0) >> prefixLength);
+  quint64 lowHostmask =
+      prefixLength <= 64
+          ? ~quint64(0)
+          : (prefixLength >= 128 ? 0 : (~quint64(0) >> (prefixLength - 64)));
+
+  Key128 start = toKey128(range.address().toIPv6Address());
+  start.high &= ~highHostmask;
+  start.low &= ~lowHostmask;
+  Key128 end = {start.high | highHostmask, start.low | lowHostmask};
+  m_ipv6Ranges.append({start, end, category});
+}
+
+void IPAddressClassifier::rebuild() {
+  flatten(m_ipv4Ranges, m_ipv4Starts, m_ipv4Categories);
+  flatten(m_ipv6Ranges, m_ipv6Starts, m_ipv6Categories);
+}
+
+int IPAddressClassifier::classify(const QHostAddress& address) const {
+  switch (address.protocol()) {
+    case QAbstractSocket::IPv4Protocol:
+      return classifyIPv4(address.toIPv4Address());
+    case QAbstractSocket::IPv6Protocol:
+      return classifyIPv6(address.toIPv6Address());
+    default:
+      return Unclassified;
+  }
+}
+
+int IPAddressClassifier::classifyIPv4(quint32 address) const {
+  return m_ipv4Categories.at(lookup(m_ipv4Starts, address));
+}
+
+int IPAddressClassifier::classifyIPv6(const Q_IPV6ADDR& address) const {
+  return m_ipv6Categories.at(lookup(m_ipv6Starts, toKey128(address)));
+}
@@ -0,0 +1,90 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef IPADDRESSCLASSIFIER_H
+#define IPADDRESSCLASSIFIER_H
+
+#include "ipaddress.h"
+
+#include <QHostAddress>
+#include <QList>
+#include <QVector>
+
+// Answers the question "in which of these ranges is this address?". The
+// ranges are flattened into a sorted table of disjoint intervals (one for
+// IPv4 and one for IPv6), so that each lookup is a binary search with no
+// allocation. When ranges overlap, the most specific one wins; for identical
+// ranges, the last one added wins.
+class IPAddressClassifier final {
+ public:
+  static constexpr int Unclassified = -1;
+
+  IPAddressClassifier();
+  IPAddressClassifier(const IPAddressClassifier& other);
+  ~IPAddressClassifier();
+
+  // The leak detector doesn't track this classifier. This is for the
+  // function-local statics, which are destroyed after it has reported.
+  enum UncountedTag { Uncounted };
+  explicit IPAddressClassifier(UncountedTag);
+
+  IPAddressClassifier& operator=(const IPAddressClassifier& other);
+
+  // Each call rebuilds the lookup tables: prefer addRanges() for big lists.
+  void addRange(const IPAddress& range, int category);
+  void addRanges(const QList<IPAddress>& ranges, int category);
+
+  int classify(const QHostAddress& address) const;
+  int classifyIPv4(quint32 address) const;
+  int classifyIPv6(const Q_IPV6ADDR& address) const;
+
+  bool contains(const QHostAddress& address) const {
+    return classify(address) != Unclassified;
+  }
+
+  // Number of disjoint intervals in the lookup tables.
+  int intervalCount() const {
+    return m_ipv4Starts.length() + m_ipv6Starts.length();
+  }
+
+ public:
+  struct Key128 {
+    quint64 high;
+    quint64 low;
+
+    bool operator<(const Key128& other) const {
+      return high < other.high || (high == other.high && low < other.low);
+    }
+    bool operator<=(const Key128& other) const { return !(other < *this); }
+    bool operator==(const Key128& other) const {
+      return high == other.high && low == other.low;
+    }
+  };
+
+ private:
+  void appendRange(const IPAddress& range, int category);
+  void rebuild();
+
+ private:
+  template <typename K>
+  struct Range {
+    K start;
+    K end;
+    int category;
+  };
+
+  QVector<Range<quint32>> m_ipv4Ranges;
+  QVector<Range<Key128>> m_ipv6Ranges;
+
+  // Each interval starts at m_*Starts[i] and ends before m_*Starts[i + 1].
+  QVector<quint32> m_ipv4Starts;
+  QVector<int> m_ipv4Categories;
+  QVector<Key128> m_ipv6Starts;
+  QVector<int> m_ipv6Categories;
+
+  // Not copied: it belongs to this instance.
+  bool m_counted = true;
+};
+
+#endif  // IPADDRESSCLASSIFIER_H
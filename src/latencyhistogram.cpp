@@ -0,0 +1,83 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "latencyhistogram.h"
+
+#include <QtAlgorithms>
+
+#include <cmath>
+
+constexpr int LatencyHistogram::BUCKETS;
+
+// static
+int LatencyHistogram::bucketFor(qint64 usec) {
+  if (usec <= 0) {
+    return 0;
+  }
+
+  int bucket = 64 - qCountLeadingZeroBits(quint64(usec));
+  return qMin(bucket, BUCKETS - 1);
+}
+
+void LatencyHistogram::record(qint64 usec) {
+  if (usec < 0) {
+    usec = 0;
+  }
+
+  ++m_buckets[bucketFor(usec)];
+
+  if (m_count == 0 || usec < m_min) {
+    m_min = usec;
+  }
+  if (usec > m_max) {
+    m_max = usec;
+  }
+
+  ++m_count;
+  m_sum += usec;
+}
+
+void LatencyHistogram::clear() { *this = LatencyHistogram(); }
+
+qint64 LatencyHistogram::mean() const {
+  return m_count ? m_sum / (qint64)m_count : 0;
+}
+
+quint64 LatencyHistogram::bucketCount(int bucket) const {
+  Q_ASSERT(bucket >= 0 && bucket < BUCKETS);
+  return m_buckets[bucket];
+}
+
+qint64 LatencyHistogram::percentile(double percent) const {
+  if (m_count == 0) {
+    return 0;
+  }
+
+  // Nearest-rank method.
+  double fraction = qBound(0.0, percent, 100.0) / 100.0;
+  quint64 rank = qMax(quint64(1), quint64(std::ceil(m_count * fraction)));
+
+  quint64 seen = 0;
+  for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+    seen += m_buckets[bucket];
+    if (seen >= rank) {
+      qint64 upper = bucket == 0 ? 0 : (qint64(1) << bucket) - 1;
+      return qBound(m_min, upper, m_max);
+    }
+  }
+
+  return m_max;
+}
+
+QJsonObject LatencyHistogram::toJson() const {
+  QJsonObject obj;
+  obj.insert("count", (double)m_count);
+  obj.insert("min", (double)m_min);
+  obj.insert("mean", (double)mean());
+  obj.insert("p50", (double)percentile(50));
+  obj.insert("p90", (double)percentile(90));
+  obj.insert("p99", (double)percentile(99));
+  obj.insert("max", (double)m_max);
+  return obj;
+}
@@ -0,0 +1,45 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QJsonObject>
+#include <QtGlobal>
+
+// A fixed-size histogram of latencies, in microseconds. The buckets grow
+// exponentially: bucket 0 is for 0us and bucket N is for [2^(N-1), 2^N)us.
+// Recording a sample is cheap and never allocates, so this can be used in the
+// hot paths.
+
+class LatencyHistogram final {
+ public:
+  static constexpr int BUCKETS = 32;
+
+  void record(qint64 usec);
+  void clear();
+
+  quint64 count() const { return m_count; }
+  qint64 min() const { return m_min; }
+  qint64 max() const { return m_max; }
+  qint64 mean() const;
+
+  // Returns an upper bound of the given percentile (0-100). The result is
+  // the upper limit of the bucket containing it, capped to max().
+  qint64 percentile(double percent) const;
+
+  quint64 bucketCount(int bucket) const;
+  static int bucketFor(qint64 usec);
+
+  QJsonObject toJson() const;
+
+ private:
+  quint64 m_buckets[BUCKETS] = {};
+  quint64 m_count = 0;
+  qint64 m_sum = 0;
+  qint64 m_min = 0;
+  qint64 m_max = 0;
+};
+
+#endif  // LATENCYHISTOGRAM_H
@@ -3,6 +3,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "localsocketcontroller.h"
+#include "daemon/daemonframe.h"
 #include "errorhandler.h"
 #include "ipaddress.h"
 #include "leakdetector.h"
@@ -11,6 +12,7 @@
 #include "models/keys.h"
 #include "models/server.h"
 #include "mozillavpn.h"
+#include "pendingrequests.h"
 #include "settingsholder.h"
 
 #include <QDir>
@@ -24,7 +26,46 @@
 
 namespace {
 Logger logger(LOG_CONTROLLER, "LocalSocketController");
+
+constexpr int REQUEST_TIMEOUT_MSEC = 10000;
+
+// The logs can be large, and are collected from the disk.
+constexpr int LOGS_TIMEOUT_MSEC = 30000;
+
+bool parseStatus(const QJsonObject& obj, QString& serverIpv4Gateway,
+                 QString& deviceIpv4Address, uint64_t& txBytes,
+                 uint64_t& rxBytes) {
+  QJsonValue serverIpv4GatewayValue = obj.value("serverIpv4Gateway");
+  if (!serverIpv4GatewayValue.isString()) {
+    logger.error() << "Unexpected serverIpv4Gateway value";
+    return false;
+  }
+
+  QJsonValue deviceIpv4AddressValue = obj.value("deviceIpv4Address");
+  if (!deviceIpv4AddressValue.isString()) {
+    logger.error() << "Unexpected deviceIpv4Address value";
+    return false;
+  }
+
+  QJsonValue txBytesValue = obj.value("txBytes");
+  if (!txBytesValue.isDouble()) {
+    logger.error() << "Unexpected txBytes value";
+    return false;
+  }
+
+  QJsonValue rxBytesValue = obj.value("rxBytes");
+  if (!rxBytesValue.isDouble()) {
+    logger.error() << "Unexpected rxBytes value";
+    return false;
+  }
+
+  serverIpv4Gateway = serverIpv4GatewayValue.toString();
+  deviceIpv4Address = deviceIpv4AddressValue.toString();
+  txBytes = txBytesValue.toDouble();
+  rxBytes = rxBytesValue.toDouble();
+  return true;
 }
+}  // namespace
 
 LocalSocketController::LocalSocketController() {
   MVPN_COUNT_CTOR(LocalSocketController);
@@ -38,6 +79,10 @@ LocalSocketController::LocalSocketController() {
           &LocalSocketController::errorOccurred);
   connect(m_socket, &QLocalSocket::readyRead, this,
           &LocalSocketController::readData);
+
+  m_requests = new PendingRequests(this);
+  connect(m_requests, &PendingRequests::timedOut, this,
+          &LocalSocketController::requestTimedOut);
 }
 
 LocalSocketController::~LocalSocketController() {
@@ -53,6 +98,9 @@ void LocalSocketController::errorOccurred(
   }
 
   m_state = eDisconnected;
+  m_requests->clear();
+  cancelLogRequests();
+
   MozillaVPN::instance()->errorHandle(ErrorHandler::ControllerError);
   emit disconnected();
 }
@@ -82,6 +130,13 @@ void LocalSocketController::initialize(const Device* device, const Keys* keys) {
 void LocalSocketController::daemonConnected() {
   logger.debug() << "Daemon connected";
   Q_ASSERT(m_state == eInitializing);
+
+  // The commands are processed in order: the version reply, if any, is
+  // received before the status one.
+  QJsonObject json;
+  json.insert("type", "version");
+  write(json);
+
   checkStatus();
 }
 
@@ -160,16 +215,23 @@ void LocalSocketController::activateNext() {
     json.insert("dnsServer", QJsonValue(hop.m_dnsServer.toString()));
   }
 
-  QJsonArray allowedIPAddesses;
-  for (const IPAddress& i : hop.m_allowedIPAddressRanges) {
-    QJsonObject range;
-    range.insert("address", QJsonValue(i.address().toString()));
-    range.insert("range", QJsonValue((double)i.prefixLength()));
-    range.insert("isIpv6",
-                 QJsonValue(i.type() == QAbstractSocket::IPv6Protocol));
-    allowedIPAddesses.append(range);
-  };
-  json.insert("allowedIPAddressRanges", allowedIPAddesses);
+  if (m_daemonVersion >= DAEMON_PROTOCOL_VERSION_PACKED_RANGES) {
+    json.insert("allowedIPAddressRangesPacked",
+                QJsonValue(QString::fromLatin1(
+                    IPAddress::packList(hop.m_allowedIPAddressRanges)
+                        .toBase64())));
+  } else {
+    QJsonArray allowedIPAddesses;
+    for (const IPAddress& i : hop.m_allowedIPAddressRanges) {
+      QJsonObject range;
+      range.insert("address", QJsonValue(i.address().toString()));
+      range.insert("range", QJsonValue((double)i.prefixLength()));
+      range.insert("isIpv6",
+                   QJsonValue(i.type() == QAbstractSocket::IPv6Protocol));
+      allowedIPAddesses.append(range);
+    };
+    json.insert("allowedIPAddressRanges", allowedIPAddesses);
+  }
 
   QJsonArray excludedAddresses;
   for (const auto& address : hop.m_excludedAddresses) {
@@ -183,7 +245,29 @@ void LocalSocketController::activateNext() {
   }
   json.insert("vpnDisabledApps", splitTunnelApps);
 
-  write(json);
+  write(json, [this](const QJsonObject& reply) { activateReply(reply); });
+}
+
+// The daemon reports the disconnection after a failed activation.
+void LocalSocketController::activateReply(const QJsonObject& reply) {
+  // Without a reply in time, the daemon reports the connection or the
+  // failure later.
+  if (reply.isEmpty()) {
+    return;
+  }
+
+  if (reply.value("type").toString() != "result") {
+    handleMessage(reply);
+    return;
+  }
+
+  if (reply.value("result").toBool()) {
+    return;
+  }
+
+  logger.error() << "Activation failed";
+  m_activationQueue.clear();
+  MozillaVPN::instance()->errorHandle(ErrorHandler::ControllerError);
 }
 
 void LocalSocketController::deactivate(Reason reason) {
@@ -219,35 +303,105 @@ void LocalSocketController::checkStatus() {
   }
 }
 
+bool LocalSocketController::requestStatus(StatusCallback&& a_callback) {
+  // The replies can only be told apart with the request IDs.
+  if (m_state != eReady || !m_binaryRequested) {
+    return false;
+  }
+
+  logger.debug() << "Request status";
+
+  StatusCallback callback = std::move(a_callback);
+  QJsonObject json;
+  json.insert("type", "status");
+  write(json, [callback](const QJsonObject& reply) {
+    QString serverIpv4Gateway;
+    QString deviceIpv4Address;
+    uint64_t txBytes = 0;
+    uint64_t rxBytes = 0;
+    if (!reply.isEmpty() && !parseStatus(reply, serverIpv4Gateway,
+                                         deviceIpv4Address, txBytes, rxBytes)) {
+      serverIpv4Gateway.clear();
+      deviceIpv4Address.clear();
+    }
+    callback(serverIpv4Gateway, deviceIpv4Address, txBytes, rxBytes);
+  });
+  return true;
+}
+
+bool LocalSocketController::subscribeStatus(int intervalMsec) {
+  if (m_state != eReady ||
+      m_daemonVersion < DAEMON_PROTOCOL_VERSION_STATUS_STREAM) {
+    return false;
+  }
+
+  logger.debug() << "Subscribe status";
+
+  QJsonObject json;
+  json.insert("type", "subscribeStatus");
+  json.insert("interval", intervalMsec);
+  write(json);
+  return true;
+}
+
+void LocalSocketController::unsubscribeStatus() {
+  if (m_state != eReady) {
+    return;
+  }
+
+  logger.debug() << "Unsubscribe status";
+
+  QJsonObject json;
+  json.insert("type", "unsubscribeStatus");
+  write(json);
+}
+
+// The outcome comes in the "result" reply, with the binary framing only.
+bool LocalSocketController::subscribeCounters() {
+  if (m_state != eReady || !m_binaryRequested ||
+      m_daemonVersion < DAEMON_PROTOCOL_VERSION_COUNTERS_PAGE) {
+    return false;
+  }
+
+  logger.debug() << "Subscribe counters";
+
+  QJsonObject json;
+  json.insert("type", "subscribeCounters");
+  write(json, [this](const QJsonObject& reply) {
+    emit countersSubscribed(reply.value("type").toString() == "result" &&
+                            reply.value("result").toBool());
+  });
+  return true;
+}
+
 void LocalSocketController::getBackendLogs(
     std::function<void(const QString&)>&& a_callback) {
   logger.debug() << "Backend logs";
 
-  if (m_logCallback) {
-    m_logCallback("");
-    m_logCallback = nullptr;
-  }
-
   if (m_state != eReady) {
     std::function<void(const QString&)> callback = a_callback;
     callback("");
     return;
   }
 
-  m_logCallback = std::move(a_callback);
+  // Without request IDs, only the last request gets the response.
+  if (!m_binaryRequested && m_logRequests.contains(0)) {
+    m_logRequests.take(0).m_callback("");
+  }
 
   QJsonObject json;
   json.insert("type", "logs");
-  write(json);
+  quint32 id = write(json);
+
+  LogRequest request;
+  request.m_callback = std::move(a_callback);
+  m_logRequests.insert(id, request);
 }
 
 void LocalSocketController::cleanupBackendLogs() {
   logger.debug() << "Cleanup logs";
 
-  if (m_logCallback) {
-    m_logCallback("");
-    m_logCallback = nullptr;
-  }
+  cancelLogRequests();
 
   if (m_state != eReady) {
     return;
@@ -264,26 +418,90 @@ void LocalSocketController::readData() {
   Q_ASSERT(m_socket);
   Q_ASSERT(m_state == eInitializing || m_state == eReady);
   QByteArray input = m_socket->readAll();
-  m_buffer.append(input);
+  m_reader.append(input);
 
-  while (true) {
-    int pos = m_buffer.indexOf("\n");
-    if (pos == -1) {
-      break;
-    }
+  // The framing changes in the middle of the buffer when the "binary"
+  // acknowledgment is received.
+  while (m_binary ? readFrame() : readLine()) {
+  }
+}
 
-    QByteArray line = m_buffer.left(pos);
-    m_buffer.remove(0, pos + 1);
+bool LocalSocketController::readLine() {
+  QByteArray command;
+  if (!m_reader.readLine(command)) {
+    return false;
+  }
+
+  if (!command.isEmpty()) {
+    parseCommand(command);
+  }
+  return true;
+}
+
+bool LocalSocketController::readFrame() {
+  DaemonFrame frame;
+  DaemonFrame::ReadResult result = DaemonFrame::read(m_reader, frame);
+  if (result == DaemonFrame::Incomplete) {
+    return false;
+  }
 
-    QByteArray command(line);
-    command = command.trimmed();
+  if (result == DaemonFrame::Invalid) {
+    logger.error() << "Invalid frame";
+    m_socket->close();
+    return false;
+  }
 
-    if (command.isEmpty()) {
-      continue;
+  if (frame.m_flags == DaemonFrame::Json) {
+    QJsonDocument json = QJsonDocument::fromJson(frame.m_payload);
+    if (!json.isObject()) {
+      logger.error() << "Invalid JSON - object expected";
+      return true;
     }
 
-    parseCommand(command);
+    // A reply goes to the handler of its request.
+    if (frame.m_id && m_requests->finish(frame.m_id, json.object())) {
+      return true;
+    }
+    handleMessage(json.object());
+    return true;
+  }
+
+  // The logs are the only binary response. The chunks of a request which has
+  // been cancelled or has timed out are dropped.
+  auto i = m_logRequests.find(frame.m_id);
+  if (frame.m_flags & DaemonFrame::Json || i == m_logRequests.end()) {
+    logger.debug() << "Ignoring frame for request" << frame.m_id;
+    return true;
   }
+
+  i->m_buffer.append(frame.m_payload);
+  if (!(frame.m_flags & DaemonFrame::More)) {
+    m_requests->finish(frame.m_id);
+    LogRequest request = m_logRequests.take(frame.m_id);
+    request.m_callback(QString::fromUtf8(request.m_buffer));
+  }
+  return true;
+}
+
+void LocalSocketController::cancelLogRequests() {
+  QHash<quint32, LogRequest> requests;
+  requests.swap(m_logRequests);
+
+  for (const LogRequest& request : requests) {
+    request.m_callback("");
+  }
+}
+
+void LocalSocketController::requestTimedOut(quint32 id,
+                                            const QString& command) {
+  Q_UNUSED(command);
+  if (m_logRequests.contains(id)) {
+    m_logRequests.take(id).m_callback("");
+  }
+}
+
+QJsonObject LocalSocketController::metrics() const {
+  return m_requests->metrics();
 }
 
 void LocalSocketController::parseCommand(const QByteArray& command) {
@@ -295,7 +513,10 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
     return;
   }
 
-  QJsonObject obj = json.object();
+  handleMessage(json.object());
+}
+
+void LocalSocketController::handleMessage(const QJsonObject& obj) {
   QJsonValue typeValue = obj.value("type");
   if (!typeValue.isString()) {
     logger.error() << "Invalid JSON - no type";
@@ -304,6 +525,41 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
 
   QString type = typeValue.toString();
 
+  if (type == "version") {
+    QJsonValue version = obj.value("version");
+    if (!version.isDouble()) {
+      logger.error() << "Invalid JSON for version - version expected";
+      return;
+    }
+
+    m_daemonVersion = version.toInt();
+    logger.debug() << "Daemon protocol version:" << m_daemonVersion;
+
+    // The binary framing is used only when all the requests get a response:
+    // they can then all be tracked.
+    if (m_daemonVersion >= DAEMON_PROTOCOL_VERSION_REQUEST_RESULT &&
+        !m_binaryRequested) {
+      QJsonObject json;
+      json.insert("type", "binary");
+      write(json);
+      m_binaryRequested = true;
+    }
+    return;
+  }
+
+  if (type == "binary") {
+    logger.debug() << "Binary framing enabled";
+    m_binary = true;
+    return;
+  }
+
+  if (type == "result") {
+    if (!obj.value("result").toBool()) {
+      logger.error() << "Command failed:" << obj.value("command").toString();
+    }
+    return;
+  }
+
   if (m_state == eInitializing && type == "status") {
     m_state = eReady;
 
@@ -338,33 +594,32 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
   }
 
   if (type == "status") {
-    QJsonValue serverIpv4Gateway = obj.value("serverIpv4Gateway");
-    if (!serverIpv4Gateway.isString()) {
-      logger.error() << "Unexpected serverIpv4Gateway value";
-      return;
+    QString serverIpv4Gateway;
+    QString deviceIpv4Address;
+    uint64_t txBytes = 0;
+    uint64_t rxBytes = 0;
+    if (parseStatus(obj, serverIpv4Gateway, deviceIpv4Address, txBytes,
+                    rxBytes)) {
+      emit statusUpdated(serverIpv4Gateway, deviceIpv4Address, txBytes,
+                         rxBytes);
     }
+    return;
+  }
 
+  if (type == "statusChanged") {
+    QJsonValue serverIpv4Gateway = obj.value("serverIpv4Gateway");
     QJsonValue deviceIpv4Address = obj.value("deviceIpv4Address");
-    if (!deviceIpv4Address.isString()) {
-      logger.error() << "Unexpected deviceIpv4Address value";
-      return;
-    }
-
     QJsonValue txBytes = obj.value("txBytes");
-    if (!txBytes.isDouble()) {
-      logger.error() << "Unexpected txBytes value";
-      return;
-    }
-
     QJsonValue rxBytes = obj.value("rxBytes");
-    if (!rxBytes.isDouble()) {
-      logger.error() << "Unexpected rxBytes value";
+    if (!serverIpv4Gateway.isString() || !deviceIpv4Address.isString() ||
+        !txBytes.isDouble() || !rxBytes.isDouble()) {
+      logger.error() << "Invalid JSON for statusChanged";
       return;
     }
 
-    emit statusUpdated(serverIpv4Gateway.toString(),
-                       deviceIpv4Address.toString(), txBytes.toDouble(),
-                       rxBytes.toDouble());
+    emit statusStreamed(serverIpv4Gateway.toString(),
+                        deviceIpv4Address.toString(), txBytes.toDouble(),
+                        rxBytes.toDouble());
     return;
   }
 
@@ -403,22 +658,44 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
 
   if (type == "logs") {
     // We don't care if we are not waiting for logs.
-    if (!m_logCallback) {
+    if (!m_logRequests.contains(0)) {
       return;
     }
 
     QJsonValue logs = obj.value("logs");
-    m_logCallback(logs.isString() ? logs.toString().replace("|", "\n")
-                                  : QString());
-    m_logCallback = nullptr;
+    m_logRequests.take(0).m_callback(
+        logs.isString() ? logs.toString().replace("|", "\n") : QString());
     return;
   }
 
-  logger.warning() << "Invalid command received:" << command;
+  logger.warning() << "Invalid command received:" << type;
 }
 
-void LocalSocketController::write(const QJsonObject& json) {
+// Returns the ID of the request, or 0 before the binary framing.
+quint32 LocalSocketController::write(const QJsonObject& json,
+                                     PendingRequests::Handler&& handler) {
   Q_ASSERT(m_socket);
+
+  if (m_binaryRequested) {
+    QString type = json.value("type").toString();
+    if (!handler) {
+      handler = [this, type](const QJsonObject& reply) {
+        if (!reply.isEmpty()) {
+          handleMessage(reply);
+        } else if (type == "status" && m_state == eReady) {
+          // Unblock the callers waiting for the status.
+          emit statusUpdated(QString(), QString(), 0, 0);
+        }
+      };
+    }
+    quint32 id = m_requests->start(
+        type, type == "logs" ? LOGS_TIMEOUT_MSEC : REQUEST_TIMEOUT_MSEC,
+        std::move(handler));
+    m_socket->write(DaemonFrame::encode(id, json));
+    return id;
+  }
+
   m_socket->write(QJsonDocument(json).toJson(QJsonDocument::Compact));
   m_socket->write("\n");
+  return 0;
 }
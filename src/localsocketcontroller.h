@@ -6,8 +6,12 @@
 #define LOCALSOCKETCONTROLLER_H
 
 #include "controllerimpl.h"
+#include "daemon/daemonprotocol.h"
+#include "framereader.h"
+#include "pendingrequests.h"
 
 #include <functional>
+#include <QHash>
 #include <QLocalSocket>
 #include <QHostAddress>
 
@@ -33,18 +37,38 @@ class LocalSocketController final : public ControllerImpl {
 
   void checkStatus() override;
 
+  bool requestStatus(StatusCallback&& callback) override;
+
+  bool subscribeStatus(int intervalMsec) override;
+
+  void unsubscribeStatus() override;
+
+  bool subscribeCounters() override;
+
   void getBackendLogs(std::function<void(const QString&)>&& callback) override;
 
   void cleanupBackendLogs() override;
 
+  QJsonObject metrics() const override;
+
  private:
   void activateNext();
   void daemonConnected();
   void errorOccurred(QLocalSocket::LocalSocketError socketError);
   void readData();
+  bool readLine();
+  bool readFrame();
   void parseCommand(const QByteArray& command);
+  void handleMessage(const QJsonObject& obj);
+  void activateReply(const QJsonObject& reply);
 
-  void write(const QJsonObject& json);
+  void cancelLogRequests();
+  void requestTimedOut(quint32 id, const QString& command);
+
+  // With the binary framing, the reply to the request is passed to
+  // `handler`, or handled as any other message without one.
+  quint32 write(const QJsonObject& json,
+                PendingRequests::Handler&& handler = nullptr);
 
  private:
   enum {
@@ -70,9 +94,27 @@ class LocalSocketController final : public ControllerImpl {
 
   QLocalSocket* m_socket = nullptr;
 
-  QByteArray m_buffer;
+  FrameReader m_reader;
+
+  // Protocol version of the daemon. Daemons not supporting the "version"
+  // command do not reply to it: they are at the minimum version.
+  int m_daemonVersion = DAEMON_PROTOCOL_VERSION_MIN;
+
+  // The binary framing is used for the commands once requested, and for the
+  // daemon messages once acknowledged.
+  bool m_binaryRequested = false;
+  bool m_binary = false;
 
-  std::function<void(const QString&)> m_logCallback = nullptr;
+  // The requests in flight, with the binary framing.
+  PendingRequests* m_requests = nullptr;
+
+  // The log requests, by request ID. Without the binary framing, there is at
+  // most one, with the ID 0. The chunks received so far are buffered.
+  struct LogRequest {
+    std::function<void(const QString&)> m_callback;
+    QByteArray m_buffer;
+  };
+  QHash<quint32, LogRequest> m_logRequests;
 };
 
 #endif  // LOCALSOCKETCONTROLLER_H
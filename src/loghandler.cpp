@@ -241,25 +241,29 @@ bool LogHandler::matchLogLevel(const Log& log,
 
 // static
 void LogHandler::writeLogs(QTextStream& out) {
-  MutexLocker lock(&s_mutex);
-
-  if (!s_instance || !s_instance->m_logFile) {
-    return;
-  }
-
-  QString logFileName = s_instance->m_logFile->fileName();
-  s_instance->closeLogFile(lock);
+  QString logFileName;
+  qint64 logFileSize = 0;
 
   {
-    QFile file(logFileName);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    MutexLocker lock(&s_mutex);
+
+    if (!s_instance || !s_instance->m_logFile) {
       return;
     }
 
-    out << file.readAll();
+    s_instance->m_output->flush();
+    logFileName = s_instance->m_logFile->fileName();
+    logFileSize = s_instance->m_logFile->size();
+  }
+
+  // The file is read without the lock, so that the other threads keep
+  // logging meanwhile. What they append after the snapshot is left out.
+  QFile file(logFileName);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    return;
   }
 
-  s_instance->openLogFile(lock);
+  out << file.read(logFileSize);
 }
 
 // static
@@ -69,6 +69,7 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QGuiApplication>
+#include <QJsonDocument>
 #include <QLocale>
 #include <QQmlApplicationEngine>
 #include <QScreen>
@@ -1205,6 +1206,10 @@ void MozillaVPN::serializeLogs(QTextStream* out,
           *out << "No logs from the backend.";
         }
         *out << Qt::endl;
+        *out << "==== BACKEND REQUESTS ====" << Qt::endl;
+        *out << QJsonDocument(
+                    MozillaVPN::instance()->controller()->backendMetrics())
+                    .toJson(QJsonDocument::Indented);
         *out << "==== SETTINGS ====" << Qt::endl;
         *out << SettingsHolder::instance()->getReport();
         *out << "==== DEVICE ====" << Qt::endl;
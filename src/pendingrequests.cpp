@@ -0,0 +1,121 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pendingrequests.h"
+#include "leakdetector.h"
+#include "logger.h"
+
+#include <QList>
+
+namespace {
+Logger logger(LOG_CONTROLLER, "PendingRequests");
+}
+
+PendingRequests::PendingRequests(QObject* parent) : QObject(parent) {
+  MVPN_COUNT_CTOR(PendingRequests);
+
+  m_clock.start();
+
+  m_timer.setSingleShot(true);
+  connect(&m_timer, &QTimer::timeout, this, &PendingRequests::checkDeadlines);
+}
+
+PendingRequests::~PendingRequests() { MVPN_COUNT_DTOR(PendingRequests); }
+
+quint32 PendingRequests::start(const QString& command, int timeoutMsec,
+                               Handler&& handler) {
+  quint32 id = m_nextId;
+  do {
+    if (++m_nextId == 0) {
+      m_nextId = 1;
+    }
+  } while (m_requests.contains(m_nextId));
+
+  qint64 now = m_clock.elapsed();
+  m_requests.insert(id, Request{command, m_clock.nsecsElapsed(),
+                                timeoutMsec > 0 ? now + timeoutMsec : 0,
+                                std::move(handler)});
+
+  if (timeoutMsec > 0) {
+    scheduleTimer();
+  }
+  return id;
+}
+
+bool PendingRequests::finish(quint32 id, const QJsonObject& reply) {
+  auto i = m_requests.find(id);
+  if (i == m_requests.end()) {
+    return false;
+  }
+
+  m_stats[i->m_command].m_latency.record(
+      (m_clock.nsecsElapsed() - i->m_start) / 1000);
+  Handler handler = std::move(i->m_handler);
+  m_requests.erase(i);
+
+  // The handler can start new requests.
+  if (handler) {
+    handler(reply);
+  }
+  return true;
+}
+
+void PendingRequests::clear() {
+  m_requests.clear();
+  m_timer.stop();
+}
+
+void PendingRequests::checkDeadlines() {
+  qint64 now = m_clock.elapsed();
+
+  QList<QPair<quint32, Request>> expired;
+  for (auto i = m_requests.begin(); i != m_requests.end();) {
+    if (i->m_deadline == 0 || i->m_deadline > now) {
+      ++i;
+      continue;
+    }
+
+    ++m_stats[i->m_command].m_timeouts;
+    expired.append(qMakePair(i.key(), i.value()));
+    i = m_requests.erase(i);
+  }
+
+  scheduleTimer();
+
+  // The handlers can start new requests.
+  for (const QPair<quint32, Request>& request : expired) {
+    logger.warning() << "Request" << request.first << "timed out:"
+                     << request.second.m_command;
+    emit timedOut(request.first, request.second.m_command);
+    if (request.second.m_handler) {
+      request.second.m_handler(QJsonObject());
+    }
+  }
+}
+
+void PendingRequests::scheduleTimer() {
+  qint64 next = 0;
+  for (const Request& request : m_requests) {
+    if (request.m_deadline && (!next || request.m_deadline < next)) {
+      next = request.m_deadline;
+    }
+  }
+
+  if (!next) {
+    m_timer.stop();
+    return;
+  }
+
+  m_timer.start(qMax(qint64(0), next - m_clock.elapsed()));
+}
+
+QJsonObject PendingRequests::metrics() const {
+  QJsonObject json;
+  for (auto i = m_stats.constBegin(); i != m_stats.constEnd(); ++i) {
+    QJsonObject obj = i->m_latency.toJson();
+    obj.insert("timeouts", (double)i->m_timeouts);
+    json.insert(i.key(), obj);
+  }
+  return json;
+}
@@ -0,0 +1,81 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef PENDINGREQUESTS_H
+#define PENDINGREQUESTS_H
+
+#include "latencyhistogram.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QTimer>
+
+#include <functional>
+
+// Keeps track of the requests sent to the backend service and waiting for a
+// response. Each request has its own ID and deadline, so that several
+// requests can be in flight at the same time and time out individually. The
+// latency of the completed requests is recorded per command.
+class PendingRequests final : public QObject {
+  Q_OBJECT
+  Q_DISABLE_COPY_MOVE(PendingRequests)
+
+ public:
+  // Receives the response to a request, or an empty object if the request
+  // times out.
+  using Handler = std::function<void(const QJsonObject& reply)>;
+
+  explicit PendingRequests(QObject* parent);
+  ~PendingRequests();
+
+  // Returns the ID of the new request. The ID is never 0. With a timeout of
+  // 0, the request never times out.
+  quint32 start(const QString& command, int timeoutMsec,
+                Handler&& handler = nullptr);
+
+  // Records the response to a request, and passes it to the handler of the
+  // request. Returns false if the request is unknown or has already timed
+  // out.
+  bool finish(quint32 id, const QJsonObject& reply = QJsonObject());
+
+  bool contains(quint32 id) const { return m_requests.contains(id); }
+  int count() const { return m_requests.count(); }
+
+  // Forgets the requests in flight, without emitting timedOut or calling
+  // their handlers.
+  void clear();
+
+  QJsonObject metrics() const;
+
+ signals:
+  void timedOut(quint32 id, const QString& command);
+
+ private:
+  void checkDeadlines();
+  void scheduleTimer();
+
+ private:
+  struct Request {
+    QString m_command;
+    qint64 m_start;
+    // In milliseconds since m_clock started. 0 means no deadline.
+    qint64 m_deadline;
+    Handler m_handler;
+  };
+  QHash<quint32, Request> m_requests;
+
+  struct Stats {
+    LatencyHistogram m_latency;
+    quint64 m_timeouts = 0;
+  };
+  QHash<QString, Stats> m_stats;
+
+  QElapsedTimer m_clock;
+  QTimer m_timer;
+  quint32 m_nextId = 1;
+};
+
+#endif  // PENDINGREQUESTS_H
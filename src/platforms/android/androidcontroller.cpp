@@ -200,7 +200,8 @@ void AndroidController::activate(const QList<Server>& serverList,
   foreach (auto addr, excludedAddresses) {
     excludedIPs.append(IPAddress(addr));
   }
-  foreach (auto item, IPAddress::excludeAddresses(allowedIPs, excludedIPs)) {
+  foreach (auto item, IPAddress::aggregate(IPAddress::excludeAddresses(
+                          allowedIPs, excludedIPs))) {
     fullAllowedIPs.append(QJsonValue(item.toString()));
   }
 
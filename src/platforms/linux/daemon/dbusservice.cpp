@@ -10,36 +10,110 @@
 #include "polkithelper.h"
 
 #include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusReply>
+#include <QDBusServiceWatcher>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QMutexLocker>
+
+#include <pwd.h>
 
 namespace {
 Logger logger(LOG_LINUX, "DBusService");
-}
+
+// A running application, as seen by the runningApps query.
+struct RunningApp {
+  QString m_name;
+  int m_rootpid;
+  QString m_state;
+  QList<int> m_pids;
+};
+}  // namespace
+
+// The worker threads running the read-only queries.
+constexpr int QUERY_THREADS = 2;
 
 constexpr const char* APP_STATE_ACTIVE = "active";
 constexpr const char* APP_STATE_EXCLUDED = "excluded";
 constexpr const char* APP_STATE_BLOCKED = "blocked";
 
-DBusService::DBusService(QObject* parent) : Daemon(parent) {
+DBusService::DBusService(QObject* parent)
+    : Daemon(parent), m_queries(QUERY_THREADS) {
   MVPN_COUNT_CTOR(DBusService);
 
   m_wgutils = new WireguardUtilsLinux(this);
-  m_apptracker = new AppTracker(this);
-  m_pidtracker = new PidTracker(this);
 
-  connect(m_apptracker, SIGNAL(appLaunched(const QString&, int)), this,
-          SLOT(appLaunched(const QString&, int)));
-  connect(m_pidtracker, SIGNAL(terminated(const QString&, int)), this,
-          SLOT(appTerminated(const QString&, int)));
+  // The status subscriptions end when the client leaves the bus.
+  m_statusWatcher = new QDBusServiceWatcher(
+      QString(), QDBusConnection::systemBus(),
+      QDBusServiceWatcher::WatchForUnregistration, this);
+  connect(m_statusWatcher, &QDBusServiceWatcher::serviceUnregistered, this,
+          &DBusService::subscriberGone);
 
   if (!removeInterfaceIfExists()) {
     qFatal("Interface `%s` exists and cannot be removed. Cannot proceed!",
            WG_INTERFACE);
   }
+
+  publishCounters(COUNTERS_PAGE_NAME);
+
+  // The rest is set up by the first call which needs it, see deferredInit().
 }
 
-DBusService::~DBusService() { MVPN_COUNT_DTOR(DBusService); }
+DBusService::~DBusService() {
+  MVPN_COUNT_DTOR(DBusService);
+  m_queries.waitForDone();
+}
+
+// Runs a read-only query on the worker pool, and sends its result as the
+// reply to the current D-Bus call. The query must not touch the state of the
+// daemon: it gets a copy of what it needs. Outside of D-Bus, the query runs
+// right away.
+template <typename T>
+T DBusService::runQuery(const QString& name, std::function<T()>&& query) {
+  if (!calledFromDBus()) {
+    return query();
+  }
+
+  setDelayedReply(true);
+  QDBusMessage request = message();
+  m_queries.dispatch(name, [request, query = std::move(query)]() {
+    QDBusConnection::systemBus().send(
+        request.createReply(QVariant::fromValue(query())));
+  });
+  return T();
+}
+
+// The counters of the peer, read on the worker threads without going
+// through the wireguard utils of the main thread.
+bool DBusService::queryPeerStatus(const QString& pubkey,
+                                  WireguardUtils::PeerStatus& status) {
+  QList<WireguardUtils::PeerStatus> peers;
+  {
+    QMutexLocker locker(&m_queryStatsMutex);
+    if (!m_queryStats.fetch(WG_INTERFACE, peers)) {
+      peers = WireguardUtilsLinux::readPeerStatus();
+    }
+  }
+
+  for (const WireguardUtils::PeerStatus& peer : peers) {
+    if (peer.m_pubkey == pubkey) {
+      status = peer;
+      return true;
+    }
+  }
+  return false;
+}
+
+QJsonObject DBusService::metrics() const {
+  QJsonObject json = Daemon::metrics();
+  json.insert("queries", m_queries.metrics());
+  return json;
+}
 
 IPUtils* DBusService::iputils() {
   if (!m_iputils) {
@@ -55,6 +129,38 @@ DnsUtils* DBusService::dnsutils() {
   return m_dnsutils;
 }
 
+// The netfilter tables, the cgroups and the application tracking are only
+// needed to activate the VPN or to update the firewall. They are set up by
+// the first of these calls, so that the version and status requests sent at
+// startup are not delayed.
+void DBusService::deferredInit() {
+  if (m_initialized) {
+    return;
+  }
+  m_initialized = true;
+
+  startAppTracking();
+  m_wgutils->initialize();
+  traceStartup("initialized");
+}
+
+// The application tracking is only used by the split tunnelling. It starts
+// when it is first needed.
+void DBusService::startAppTracking() {
+  if (m_pidtracker) {
+    return;
+  }
+
+  m_apptracker = new AppTracker(this);
+  m_pidtracker = new PidTracker(this);
+
+  connect(m_apptracker, SIGNAL(appLaunched(const QString&, int)), this,
+          SLOT(appLaunched(const QString&, int)));
+  connect(m_pidtracker, SIGNAL(terminated(const QString&, int)), this,
+          SLOT(appTerminated(const QString&, int)));
+  traceStartup("apptracking");
+}
+
 void DBusService::setAdaptor(DbusAdaptor* adaptor) {
   Q_ASSERT(!m_adaptor);
   m_adaptor = adaptor;
@@ -91,22 +197,79 @@ bool DBusService::activate(const QString& jsonConfig) {
     return false;
   }
 
-  QJsonObject obj = json.object();
-
   InterfaceConfig config;
+  if (!parseHopConfig(json.object(), config)) {
+    return false;
+  }
+
+  deferredInit();
+  return Daemon::activate(config);
+}
+
+// The input is an object with the list of the hop configurations, ordered
+// from the outermost, in the same format used by activate(). The output
+// reports the status of each of them.
+QString DBusService::activateMultihop(const QString& jsonConfig) {
+  logger.debug() << "Activate multihop";
+
+  QJsonObject output;
+  output.insert("status", QJsonValue(false));
+
+  if (!PolkitHelper::instance()->checkAuthorization(
+          "org.mozilla.vpn.activate")) {
+    logger.error() << "Polkit rejected";
+    return QString(QJsonDocument(output).toJson(QJsonDocument::Compact));
+  }
+
+  QJsonDocument json = QJsonDocument::fromJson(jsonConfig.toLocal8Bit());
+  QJsonValue hops = json.object().value("hops");
+  if (!json.isObject() || !hops.isArray() || hops.toArray().isEmpty()) {
+    logger.error() << "Invalid input";
+    return QString(QJsonDocument(output).toJson(QJsonDocument::Compact));
+  }
+
+  QList<InterfaceConfig> configs;
+  for (const QJsonValue& hop : hops.toArray()) {
+    InterfaceConfig config;
+    if (!hop.isObject() || !parseHopConfig(hop.toObject(), config)) {
+      return QString(QJsonDocument(output).toJson(QJsonDocument::Compact));
+    }
+    configs.append(config);
+  }
+
+  deferredInit();
+
+  QList<bool> results;
+  bool status = Daemon::activateHops(configs, results);
+
+  QJsonArray hopResults;
+  for (int i = 0; i < results.count(); ++i) {
+    QJsonObject result;
+    result.insert("hopindex", QJsonValue(configs[i].m_hopindex));
+    result.insert("status", QJsonValue(results[i]));
+    hopResults.append(result);
+  }
+  output.insert("status", QJsonValue(status));
+  output.insert("hops", hopResults);
+  return QString(QJsonDocument(output).toJson(QJsonDocument::Compact));
+}
+
+bool DBusService::parseHopConfig(const QJsonObject& obj,
+                                 InterfaceConfig& config) {
   if (!parseConfig(obj, config)) {
     logger.error() << "Invalid configuration";
     return false;
   }
 
-  if (obj.contains("vpnDisabledApps")) {
-    QJsonArray disabledApps = obj["vpnDisabledApps"].toArray();
-    for (const QJsonValue& app : disabledApps) {
-      firewallApp(app.toString(), APP_STATE_EXCLUDED);
+  if (!config.m_vpnDisabledApps.isEmpty()) {
+    QMap<QString, QString> states;
+    for (const QString& app : config.m_vpnDisabledApps) {
+      states.insert(app, APP_STATE_EXCLUDED);
     }
+    firewallApps(states);
   }
 
-  return Daemon::activate(config);
+  return true;
 }
 
 bool DBusService::deactivate(bool emitSignals) {
@@ -116,12 +279,98 @@ bool DBusService::deactivate(bool emitSignals) {
 }
 
 QString DBusService::status() {
-  return QString(QJsonDocument(getStatus()).toJson(QJsonDocument::Compact));
+  bool active = m_connections.contains(0);
+  ConnectionState connection = m_connections.value(0);
+
+  return runQuery<QString>("status", [this, active, connection]() {
+    WireguardUtils::PeerStatus status;
+    bool found = active && queryPeerStatus(
+                               connection.m_config.m_serverPublicKey, status);
+    QJsonObject json = statusJson(connection, found ? &status : nullptr);
+    return QString(QJsonDocument(json).toJson(QJsonDocument::Compact));
+  });
+}
+
+DaemonStatus DBusService::connectionStatus() {
+  bool active = m_connections.contains(0);
+  InterfaceConfig config = m_connections.value(0).m_config;
+
+  return runQuery<DaemonStatus>("connectionStatus", [this, active, config]() {
+    DaemonStatus output;
+    WireguardUtils::PeerStatus status;
+    if (!active || !queryPeerStatus(config.m_serverPublicKey, status)) {
+      return output;
+    }
+
+    output.connected = true;
+    output.serverIpv4Gateway = config.m_serverIpv4Gateway;
+    output.deviceIpv4Address = config.m_deviceIpv4Address;
+    output.txBytes = status.m_txBytes;
+    output.rxBytes = status.m_rxBytes;
+    output.handshake = status.m_handshake;
+    return output;
+  });
+}
+
+void DBusService::subscribeStatus(int intervalMsec) {
+  if (!calledFromDBus()) {
+    return;
+  }
+
+  // Each client is identified by its unique bus name.
+  QString subscriber = message().service();
+  logger.debug() << "Status subscription from" << subscriber;
+  m_statusWatcher->addWatchedService(subscriber);
+  Daemon::subscribeStatus(subscriber, intervalMsec);
+}
+
+void DBusService::unsubscribeStatus() {
+  if (!calledFromDBus()) {
+    return;
+  }
+  subscriberGone(message().service());
+}
+
+// The counters page is readable by the primary group of the caller. The
+// subscription ends with the status subscription.
+bool DBusService::subscribeCounters() {
+  if (!calledFromDBus()) {
+    return false;
+  }
+
+  QString subscriber = message().service();
+  QDBusReply<uint> uid = connection().interface()->serviceUid(subscriber);
+  if (!uid.isValid()) {
+    logger.error() << "Unknown user for" << subscriber;
+    return false;
+  }
+
+  struct passwd* pw = getpwuid(uid.value());
+  if (!pw) {
+    logger.error() << "Unknown user" << uid.value();
+    return false;
+  }
+
+  logger.debug() << "Counters subscription from" << subscriber;
+  if (!Daemon::subscribeCounters(subscriber, pw->pw_gid)) {
+    return false;
+  }
+  m_statusWatcher->addWatchedService(subscriber);
+  return true;
+}
+
+void DBusService::subscriberGone(const QString& service) {
+  m_statusWatcher->removeWatchedService(service);
+  Daemon::unsubscribeStatus(service);
+  Daemon::unsubscribeCounters(service);
 }
 
 QString DBusService::getLogs() {
   logger.debug() << "Log request";
-  return Daemon::logs();
+
+  // The metrics are read now: reading the log file is what takes time.
+  QJsonObject json = metrics();
+  return runQuery<QString>("logs", [json]() { return Daemon::logs(json); });
 }
 
 void DBusService::appLaunched(const QString& name, int rootpid) {
@@ -139,47 +388,78 @@ void DBusService::appTerminated(const QString& name, int rootpid) {
 
 /* Get the list of running applications that the firewall knows about. */
 QString DBusService::runningApps() {
-  QJsonArray result;
+  startAppTracking();
+
+  QList<RunningApp> apps;
   for (auto i = m_pidtracker->begin(); i != m_pidtracker->end(); i++) {
     const ProcessGroup* group = *i;
-    QJsonObject appObject;
-    QJsonArray pidList;
-    appObject.insert("name", QJsonValue(group->name));
-    appObject.insert("rootpid", QJsonValue(group->rootpid));
-    appObject.insert("state", QJsonValue(group->state));
-
-    for (auto pid : group->kthreads.keys()) {
-      pidList.append(QJsonValue(pid));
-    }
-
-    appObject.insert("pids", pidList);
-    result.append(appObject);
+    apps.append(RunningApp{group->name, group->rootpid, group->state,
+                           group->kthreads.keys()});
   }
 
-  return QJsonDocument(result).toJson(QJsonDocument::Compact);
+  /* The JSON document is built by a worker. */
+  return runQuery<QString>("runningApps", [apps]() {
+    QJsonArray result;
+    for (const RunningApp& app : apps) {
+      QJsonObject appObject;
+      QJsonArray pidList;
+      appObject.insert("name", QJsonValue(app.m_name));
+      appObject.insert("rootpid", QJsonValue(app.m_rootpid));
+      appObject.insert("state", QJsonValue(app.m_state));
+
+      for (auto pid : app.m_pids) {
+        pidList.append(QJsonValue(pid));
+      }
+
+      appObject.insert("pids", pidList);
+      result.append(appObject);
+    }
+
+    return QString(QJsonDocument(result).toJson(QJsonDocument::Compact));
+  });
 }
 
 /* Update the firewall for running applications matching the application ID. */
 bool DBusService::firewallApp(const QString& appName, const QString& state) {
-  logger.debug() << "Setting" << appName << "to firewall state" << state;
-  m_firewallApps[appName] = state;
-  QString cgroup = getAppStateCgroup(state);
+  return firewallApps({{appName, state}});
+}
 
-  /* Change matching applications' state to excluded */
+/* Update the firewall for running applications matching any of the
+ * application IDs. The PIDs are grouped by their target cgroup, so that each
+ * cgroup is written only once. */
+bool DBusService::firewallApps(const QMap<QString, QString>& states) {
+  deferredInit();
+
+  for (auto i = states.constBegin(); i != states.constEnd(); ++i) {
+    logger.debug() << "Setting" << i.key() << "to firewall state" << i.value();
+    m_firewallApps[i.key()] = i.value();
+  }
+
+  /* The groups already in the right state are moved again: some of their
+   * processes may have joined the group, or left the cgroup, since the last
+   * move. */
+  QHash<QString, QList<int>> moves;
   for (auto i = m_pidtracker->begin(); i != m_pidtracker->end(); i++) {
     ProcessGroup* group = *i;
-    if (group->name != appName) {
+    auto state = states.constFind(group->name);
+    if (state == states.constEnd()) {
       continue;
     }
-    group->state = state;
-    group->moveToCgroup(cgroup);
+    group->state = state.value();
+    moves[getAppStateCgroup(group->state)].append(group->kthreads.keys());
   }
 
-  return true;
+  bool ok = true;
+  for (auto i = moves.constBegin(); i != moves.constEnd(); ++i) {
+    ok = PidTracker::moveToCgroup(i.key(), i.value()) && ok;
+  }
+  return ok;
 }
 
 /* Update the firewall for the application matching the desired PID. */
 bool DBusService::firewallPid(int rootpid, const QString& state) {
+  deferredInit();
+
   ProcessGroup* group = m_pidtracker->group(rootpid);
   if (!group) {
     return false;
@@ -195,9 +475,13 @@ bool DBusService::firewallPid(int rootpid, const QString& state) {
 
 /* Clear the firewall and return all applications to the active state */
 bool DBusService::firewallClear() {
-  const QString cgroup = getAppStateCgroup(APP_STATE_ACTIVE);
-
   m_firewallApps.clear();
+  if (!m_pidtracker) {
+    return true;
+  }
+
+  const QString cgroup = getAppStateCgroup(APP_STATE_ACTIVE);
+  QList<int> pids;
   for (auto i = m_pidtracker->begin(); i != m_pidtracker->end(); i++) {
     ProcessGroup* group = *i;
     if (group->state == APP_STATE_ACTIVE) {
@@ -205,12 +489,12 @@ bool DBusService::firewallClear() {
     }
 
     group->state = APP_STATE_ACTIVE;
-    group->moveToCgroup(cgroup);
+    pids.append(group->kthreads.keys());
 
     logger.debug() << "Setting" << group->name << "PID:" << group->rootpid
                    << "to firewall state" << group->state;
   }
-  return true;
+  return PidTracker::moveToCgroup(cgroup, pids);
 }
 
 QString DBusService::getAppStateCgroup(const QString& state) {
@@ -7,14 +7,23 @@
 
 #include "daemon/daemon.h"
 #include "apptracker.h"
+#include "dbustypeslinux.h"
 #include "iputilslinux.h"
 #include "dnsutilslinux.h"
 #include "pidtracker.h"
+#include "daemon/querydispatcher.h"
+#include "wireguardstatslinux.h"
 #include "wireguardutilslinux.h"
 
+#include <QDBusContext>
+#include <QMutex>
+
+#include <functional>
+
 class DbusAdaptor;
+class QDBusServiceWatcher;
 
-class DBusService final : public Daemon {
+class DBusService final : public Daemon, protected QDBusContext {
   Q_OBJECT
   Q_DISABLE_COPY_MOVE(DBusService)
   Q_CLASSINFO("D-Bus Interface", "org.mozilla.vpn.dbus")
@@ -27,11 +36,22 @@ class DBusService final : public Daemon {
 
   using Daemon::activate;
 
+  // Sets the firewall state of several applications, moving each of their
+  // processes to its new cgroup in a single pass.
+  bool firewallApps(const QMap<QString, QString>& states);
+
+  QJsonObject metrics() const override;
+
  public slots:
   bool activate(const QString& jsonConfig);
+  QString activateMultihop(const QString& jsonConfig);
 
   bool deactivate(bool emitSignals = true) override;
   QString status();
+  DaemonStatus connectionStatus();
+  void subscribeStatus(int intervalMsec);
+  void unsubscribeStatus();
+  bool subscribeCounters();
 
   QString version();
   QString getLogs();
@@ -50,11 +70,20 @@ class DBusService final : public Daemon {
 
  private:
   bool removeInterfaceIfExists();
+  bool parseHopConfig(const QJsonObject& obj, InterfaceConfig& config);
   QString getAppStateCgroup(const QString& state);
+  void startAppTracking();
+  void deferredInit();
+
+  template <typename T>
+  T runQuery(const QString& name, std::function<T()>&& query);
+  bool queryPeerStatus(const QString& pubkey,
+                       WireguardUtils::PeerStatus& status);
 
  private slots:
   void appLaunched(const QString& name, int rootpid);
   void appTerminated(const QString& name, int rootpid);
+  void subscriberGone(const QString& service);
 
  private:
   DbusAdaptor* m_adaptor = nullptr;
@@ -64,7 +93,16 @@ class DBusService final : public Daemon {
 
   AppTracker* m_apptracker = nullptr;
   PidTracker* m_pidtracker = nullptr;
+  bool m_initialized = false;
+  QDBusServiceWatcher* m_statusWatcher = nullptr;
   QMap<QString, QString> m_firewallApps;
+
+  // The peer counters read by the queries, on the worker threads.
+  QMutex m_queryStatsMutex;
+  WireguardStatsLinux m_queryStats;
+
+  // Last, to be destroyed first: its destructor waits for the queries.
+  QueryDispatcher m_queries;
 };
 
 #endif  // DBUSSERVICE_H
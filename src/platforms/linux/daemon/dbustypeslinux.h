@@ -145,6 +145,37 @@ typedef QList<UserData> UserDataList;
 Q_DECLARE_METATYPE(UserData);
 Q_DECLARE_METATYPE(UserDataList);
 
+/* D-Bus metatype for the connectionStatus method of the daemon */
+class DaemonStatus {
+ public:
+  bool connected = false;
+  QString serverIpv4Gateway;
+  QString deviceIpv4Address;
+  quint64 txBytes = 0;
+  quint64 rxBytes = 0;
+  // Time of the last handshake, in milliseconds since the epoch.
+  qint64 handshake = 0;
+
+  friend QDBusArgument& operator<<(QDBusArgument& args,
+                                   const DaemonStatus& data) {
+    args.beginStructure();
+    args << data.connected << data.serverIpv4Gateway << data.deviceIpv4Address
+         << data.txBytes << data.rxBytes << data.handshake;
+    args.endStructure();
+    return args;
+  }
+  friend const QDBusArgument& operator>>(const QDBusArgument& args,
+                                         DaemonStatus& data) {
+    args.beginStructure();
+    args >> data.connected >> data.serverIpv4Gateway >>
+        data.deviceIpv4Address >> data.txBytes >> data.rxBytes >>
+        data.handshake;
+    args.endStructure();
+    return args;
+  }
+};
+Q_DECLARE_METATYPE(DaemonStatus);
+
 class DnsMetatypeRegistrationProxy {
  public:
   DnsMetatypeRegistrationProxy() {
@@ -164,6 +195,8 @@ class DnsMetatypeRegistrationProxy {
     qDBusRegisterMetaType<UserData>();
     qRegisterMetaType<UserDataList>();
     qDBusRegisterMetaType<UserDataList>();
+    qRegisterMetaType<DaemonStatus>();
+    qDBusRegisterMetaType<DaemonStatus>();
   }
 };
 
@@ -0,0 +1,323 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "endpointresolver.h"
+#include "leakdetector.h"
+#include "logger.h"
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QTimer>
+#include <QWaitCondition>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+
+constexpr int ENDPOINT_CACHE_TTL_MSEC = 5 * 60 * 1000;
+constexpr int ENDPOINT_RESOLVE_TIMEOUT_MSEC = 30000;
+constexpr int ENDPOINT_RETRY_MSEC = 1000;
+constexpr int ENDPOINT_RETRY_MAX_MSEC = 20000;
+constexpr int ENDPOINT_RETRIES = 15;
+constexpr int ENDPOINT_RESOLVER_THREADS = 2;
+
+namespace {
+Logger logger(LOG_LINUX, "EndpointResolver");
+
+void setPort(struct sockaddr* sa, int port) {
+  if (sa->sa_family == AF_INET) {
+    reinterpret_cast<struct sockaddr_in*>(sa)->sin_port = htons(port);
+  } else if (sa->sa_family == AF_INET6) {
+    reinterpret_cast<struct sockaddr_in6*>(sa)->sin6_port = htons(port);
+  }
+}
+
+bool fromLiteral(const QString& hostname, struct sockaddr* sa) {
+  QHostAddress address;
+  if (!address.setAddress(hostname)) {
+    return false;
+  }
+
+  if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+    struct sockaddr_in* sin = reinterpret_cast<struct sockaddr_in*>(sa);
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(address.toIPv4Address());
+    return true;
+  }
+
+  if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+    struct sockaddr_in6* sin6 = reinterpret_cast<struct sockaddr_in6*>(sa);
+    Q_IPV6ADDR ip6 = address.toIPv6Address();
+    memset(sin6, 0, sizeof(*sin6));
+    sin6->sin6_family = AF_INET6;
+    memcpy(&sin6->sin6_addr, &ip6, sizeof(ip6));
+    return true;
+  }
+
+  return false;
+}
+
+int getaddrinfoLookup(const QByteArray& hostname,
+                      struct sockaddr_storage* addr) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_protocol = IPPROTO_UDP;
+
+  struct addrinfo* resolved = nullptr;
+  int rv = getaddrinfo(hostname.constData(), nullptr, &hints, &resolved);
+  if (rv) {
+    return rv;
+  }
+
+  rv = EAI_NONAME;
+  for (struct addrinfo* ai = resolved; ai; ai = ai->ai_next) {
+    if ((ai->ai_family == AF_INET &&
+         ai->ai_addrlen == sizeof(struct sockaddr_in)) ||
+        (ai->ai_family == AF_INET6 &&
+         ai->ai_addrlen == sizeof(struct sockaddr_in6))) {
+      memcpy(addr, ai->ai_addr, ai->ai_addrlen);
+      rv = 0;
+      break;
+    }
+  }
+  freeaddrinfo(resolved);
+  return rv;
+}
+}  // namespace
+
+struct EndpointResolver::Lookup {
+  QMutex m_mutex;
+  QWaitCondition m_cond;
+  bool m_done = false;
+  bool m_ok = false;
+  bool m_cancelled = false;
+  int m_retryMsec = 0;
+  struct sockaddr_storage m_addr;
+  QElapsedTimer m_resolved;
+};
+
+EndpointResolver::EndpointResolver(LookupFunction&& lookup)
+    : m_lookup(lookup ? std::move(lookup) : LookupFunction(getaddrinfoLookup)),
+      m_retryMsec(ENDPOINT_RETRY_MSEC),
+      m_timeoutMsec(ENDPOINT_RESOLVE_TIMEOUT_MSEC) {
+  MVPN_COUNT_CTOR(EndpointResolver);
+  m_pool.setMaxThreadCount(ENDPOINT_RESOLVER_THREADS);
+}
+
+EndpointResolver::~EndpointResolver() {
+  MVPN_COUNT_DTOR(EndpointResolver);
+
+  // Interrupt the retries of the pending lookups.
+  for (const QSharedPointer<Lookup>& lookup : m_cache) {
+    QMutexLocker locker(&lookup->m_mutex);
+    lookup->m_cancelled = true;
+    lookup->m_cond.wakeAll();
+  }
+  m_pool.waitForDone();
+}
+
+void EndpointResolver::setTimeouts(int retryMsec, int timeoutMsec) {
+  m_retryMsec = retryMsec;
+  m_timeoutMsec = timeoutMsec;
+}
+
+void EndpointResolver::prefetch(const QString& hostname) {
+  QHostAddress address;
+  if (!address.setAddress(hostname)) {
+    lookup(hostname);
+  }
+}
+
+bool EndpointResolver::resolveNow(const QString& hostname, int port,
+                                  struct sockaddr* sa) {
+  if (!fromLiteral(hostname, sa)) {
+    auto i = m_cache.constFind(hostname);
+    if (i == m_cache.constEnd()) {
+      return false;
+    }
+
+    const QSharedPointer<Lookup>& cached = i.value();
+    QMutexLocker locker(&cached->m_mutex);
+    if (!cached->m_done || !cached->m_ok ||
+        cached->m_resolved.hasExpired(ENDPOINT_CACHE_TTL_MSEC)) {
+      return false;
+    }
+
+    if (cached->m_addr.ss_family == AF_INET) {
+      memcpy(sa, &cached->m_addr, sizeof(struct sockaddr_in));
+    } else {
+      memcpy(sa, &cached->m_addr, sizeof(struct sockaddr_in6));
+    }
+  }
+
+  setPort(sa, port);
+  return true;
+}
+
+void EndpointResolver::resolve(const QString& hostname, int port,
+                               QObject* context, Callback&& callback) {
+  struct sockaddr_storage addr;
+  if (resolveNow(hostname, port, reinterpret_cast<struct sockaddr*>(&addr))) {
+    callback(reinterpret_cast<struct sockaddr*>(&addr));
+    return;
+  }
+
+  // The lookup reports its result with lookupFinished(), after this request
+  // has been registered.
+  quint64 id = ++m_nextRequestId;
+  m_requests.insert(id, Request{lookup(hostname), port, context,
+                                std::move(callback)});
+
+  QTimer::singleShot(m_timeoutMsec, this, [this, id]() {
+    if (m_requests.contains(id)) {
+      logger.error() << "Timed out resolving the address endpoint";
+      finish(id, false);
+    }
+  });
+}
+
+void EndpointResolver::lookupFinished(const QSharedPointer<Lookup>& lookup) {
+  bool ok;
+  {
+    QMutexLocker locker(&lookup->m_mutex);
+    ok = lookup->m_ok;
+  }
+
+  if (!ok) {
+    logger.error() << "Failed to resolve the address endpoint";
+  }
+
+  QList<quint64> ids;
+  for (auto i = m_requests.constBegin(); i != m_requests.constEnd(); ++i) {
+    if (i->m_lookup == lookup) {
+      ids.append(i.key());
+    }
+  }
+
+  for (quint64 id : ids) {
+    finish(id, ok);
+  }
+}
+
+void EndpointResolver::finish(quint64 id, bool ok) {
+  Request request = m_requests.take(id);
+  if (!request.m_context) {
+    return;
+  }
+
+  if (!ok) {
+    request.m_callback(nullptr);
+    return;
+  }
+
+  struct sockaddr_storage addr;
+  {
+    QMutexLocker locker(&request.m_lookup->m_mutex);
+    addr = request.m_lookup->m_addr;
+  }
+  setPort(reinterpret_cast<struct sockaddr*>(&addr), request.m_port);
+  request.m_callback(reinterpret_cast<struct sockaddr*>(&addr));
+}
+
+// Returns the cached lookup for this hostname, or starts a new one if it is
+// missing, failed or expired.
+QSharedPointer<EndpointResolver::Lookup> EndpointResolver::lookup(
+    const QString& hostname) {
+  auto i = m_cache.constFind(hostname);
+  if (i != m_cache.constEnd()) {
+    QSharedPointer<Lookup> cached = i.value();
+    QMutexLocker locker(&cached->m_mutex);
+    if (!cached->m_done ||
+        (cached->m_ok &&
+         !cached->m_resolved.hasExpired(ENDPOINT_CACHE_TTL_MSEC))) {
+      return cached;
+    }
+  }
+
+  logger.debug() << "Resolving" << hostname;
+
+  QSharedPointer<Lookup> pending(new Lookup());
+  pending->m_retryMsec = m_retryMsec;
+  m_cache.insert(hostname, pending);
+  m_pool.start(QRunnable::create(
+      [this, hostname, pending]() { run(this, hostname, pending); }));
+  return pending;
+}
+
+// static
+void EndpointResolver::run(EndpointResolver* resolver, const QString& hostname,
+                           QSharedPointer<Lookup> lookup) {
+  QByteArray name = hostname.toLocal8Bit();
+
+  bool ok = false;
+  struct sockaddr_storage addr;
+  memset(&addr, 0, sizeof(addr));
+  int retries = ENDPOINT_RETRIES;
+
+  for (int timeout = lookup->m_retryMsec;;
+       timeout = std::min(ENDPOINT_RETRY_MAX_MSEC, timeout * 6 / 5)) {
+    int rv = resolver->m_lookup(name, &addr);
+    if (!rv) {
+      ok = true;
+      break;
+    }
+
+    /* The set of return codes that are "permanent failures". All other
+     * possibilities are potentially transient.
+     *
+     * This is according to https://sourceware.org/glibc/wiki/NameResolver which
+     * states: "From the perspective of the application that calls getaddrinfo()
+     * it perhaps doesn't matter that much since EAI_FAIL, EAI_NONAME and
+     * EAI_NODATA are all permanent failure codes and the causes are all
+     * permanent failures in the sense that there is no point in retrying
+     * later."
+     *
+     * So this is what we do, except FreeBSD removed EAI_NODATA some time ago,
+     * so that's conditional.
+     */
+    if (rv == EAI_NONAME || rv == EAI_FAIL ||
+#ifdef EAI_NODATA
+        rv == EAI_NODATA ||
+#endif
+        (retries >= 0 && !retries--)) {
+      logger.error() << "Invalid endpoint" << hostname;
+      break;
+    }
+
+    logger.warning() << "Trying again in" << (timeout / 1000.0) << "seconds";
+
+    QMutexLocker locker(&lookup->m_mutex);
+    if (!lookup->m_cancelled) {
+      lookup->m_cond.wait(&lookup->m_mutex, timeout);
+    }
+    if (lookup->m_cancelled) {
+      break;
+    }
+  }
+
+  {
+    QMutexLocker locker(&lookup->m_mutex);
+    lookup->m_ok = ok;
+    lookup->m_addr = addr;
+    lookup->m_done = true;
+    lookup->m_resolved.start();
+    if (lookup->m_cancelled) {
+      return;
+    }
+  }
+
+  // The resolver waits for the lookups before being destroyed.
+  QMetaObject::invokeMethod(
+      resolver, [resolver, lookup]() { resolver->lookupFinished(lookup); },
+      Qt::QueuedConnection);
+}
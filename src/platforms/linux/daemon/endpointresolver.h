@@ -0,0 +1,84 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef ENDPOINTRESOLVER_H
+#define ENDPOINTRESOLVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QString>
+#include <QThreadPool>
+
+#include <functional>
+
+struct sockaddr;
+struct sockaddr_storage;
+
+// Resolves the peer endpoints on a worker thread, so that getaddrinfo() and
+// its retries never block the daemon. IP literals, and the hostnames resolved
+// recently, are available at once with resolveNow(). The other hostnames are
+// resolved with resolve(), which calls back on the thread of the resolver
+// once the lookup is done, has failed or has timed out.
+class EndpointResolver final : public QObject {
+  Q_OBJECT
+  Q_DISABLE_COPY_MOVE(EndpointResolver)
+
+ public:
+  // One attempt to resolve a hostname. Returns 0, or the getaddrinfo() error.
+  // This is called on a worker thread.
+  using LookupFunction = std::function<int(const QByteArray& hostname,
+                                           struct sockaddr_storage* addr)>;
+
+  // `sa` is a sockaddr_in or a sockaddr_in6 with the port, or null if the
+  // hostname could not be resolved.
+  using Callback = std::function<void(const struct sockaddr* sa)>;
+
+  // Without a lookup function, the hostnames are resolved with getaddrinfo().
+  explicit EndpointResolver(LookupFunction&& lookup = LookupFunction());
+  ~EndpointResolver();
+
+  void prefetch(const QString& hostname);
+
+  // Writes a sockaddr_in or a sockaddr_in6 into `sa`, which must be big
+  // enough for both. Returns false if the hostname has not been resolved
+  // yet: this never waits for a lookup.
+  bool resolveNow(const QString& hostname, int port, struct sockaddr* sa);
+
+  // The callback is not called if the context is destroyed first. It is
+  // called before returning if the endpoint is already known.
+  void resolve(const QString& hostname, int port, QObject* context,
+               Callback&& callback);
+
+  // The delay before the first retry of a lookup, and the limit of the wait
+  // of resolve().
+  void setTimeouts(int retryMsec, int timeoutMsec);
+
+ private:
+  struct Lookup;
+  QSharedPointer<Lookup> lookup(const QString& hostname);
+  static void run(EndpointResolver* resolver, const QString& hostname,
+                  QSharedPointer<Lookup> lookup);
+  void lookupFinished(const QSharedPointer<Lookup>& lookup);
+  void finish(quint64 id, bool ok);
+
+  struct Request {
+    QSharedPointer<Lookup> m_lookup;
+    int m_port;
+    QPointer<QObject> m_context;
+    Callback m_callback;
+  };
+
+  LookupFunction m_lookup;
+  int m_retryMsec;
+  int m_timeoutMsec;
+  quint64 m_nextRequestId = 0;
+  QHash<quint64, Request> m_requests;
+  QHash<QString, QSharedPointer<Lookup>> m_cache;
+  QThreadPool m_pool;
+};
+
+#endif  // ENDPOINTRESOLVER_H
@@ -26,11 +26,17 @@ class CommandLinuxDaemon final : public Command {
   int run(QStringList& tokens) override {
     Q_ASSERT(!tokens.isEmpty());
     LogHandler::setLocation("/var/log");
+    Daemon::traceStartup("main");
 
     return runCommandLineApp([&]() {
+      Daemon::traceStartup("application");
+
+      // The slow subsystems are initialized on first use, after the
+      // registration on the bus.
       DBusService* dbus = new DBusService(qApp);
       DbusAdaptor* adaptor = new DbusAdaptor(dbus);
       dbus->setAdaptor(adaptor);
+      Daemon::traceStartup("service");
 
       QDBusConnection connection = QDBusConnection::systemBus();
       logger.debug() << "Connecting to DBus...";
@@ -42,6 +48,7 @@ class CommandLinuxDaemon final : public Command {
                        << "message:" << connection.lastError().message();
         return 1;
       }
+      Daemon::traceStartup("registered");
 
       SignalHandler sh;
       QObject::connect(&sh, &SignalHandler::quitRequested, [&]() {
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
 #include <sys/select.h>
@@ -207,21 +208,39 @@ void PidTracker::readData() {
 }
 
 bool ProcessGroup::moveToCgroup(const QString& name) {
+  return PidTracker::moveToCgroup(name, kthreads.keys());
+}
+
+// static
+bool PidTracker::moveToCgroup(const QString& cgroup, const QList<int>& pids) {
   /* Do nothing if Cgroups are not supported. */
-  if (name.isNull()) {
+  if (cgroup.isNull() || pids.isEmpty()) {
     return true;
   }
 
-  QString cgProcsFile = name + "/cgroup.procs";
-  FILE* fp = fopen(qPrintable(cgProcsFile), "w");
-  if (!fp) {
+  QString cgProcsFile = cgroup + "/cgroup.procs";
+  int fd = open(qPrintable(cgProcsFile), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    logger.error() << "Failed to open" << cgProcsFile << strerror(errno);
     return false;
   }
 
-  for (auto pid : kthreads.keys()) {
-    fprintf(fp, "%d\n", pid);
-    fflush(fp);
+  /* The kernel accepts a single PID per write. */
+  int failures = 0;
+  char buf[16];
+  for (int pid : pids) {
+    int len = snprintf(buf, sizeof(buf), "%d\n", pid);
+    if (write(fd, buf, len) != len && errno != ESRCH) {
+      /* ESRCH: the process has already exited. */
+      failures++;
+    }
+  }
+  close(fd);
+
+  if (failures > 0) {
+    logger.warning() << "Failed to move" << failures << "processes to"
+                     << cgroup;
+    return false;
   }
-  fclose(fp);
   return true;
 }
@@ -50,6 +50,9 @@ class PidTracker final : public QObject {
   QList<ProcessGroup*>::iterator end() { return m_processGroups.end(); }
   ProcessGroup* group(int pid) { return m_processTree.value(pid); }
 
+  // Moves all the processes to the cgroup, opening its process list once.
+  static bool moveToCgroup(const QString& cgroup, const QList<int>& pids);
+
  signals:
   void pidForked(const QString& name, int parent, int child);
   void pidExited(const QString& name, int pid);
@@ -0,0 +1,355 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "routemonitor.h"
+#include "leakdetector.h"
+#include "logger.h"
+#include "wireguarddevicebuilder.h"
+
+#include <QSocketNotifier>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/fib_rules.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Import wireguard C library for Linux
+#if defined(__cplusplus)
+extern "C" {
+#endif
+#include "../../3rdparty/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#if defined(__cplusplus)
+}
+#endif
+// End import wireguard
+
+/* The routes and rules removed by someone else are restored after a short
+ * delay, to handle a burst of notifications at once.
+ */
+constexpr int RECONCILE_DELAY_MSEC = 200;
+
+constexpr size_t MONITOR_RECV_SIZE = 8192;
+
+namespace {
+Logger logger(LOG_LINUX, "RouteMonitor");
+
+// The index key of a route: the table, the family, the prefix length and the
+// destination address, with the host bits cleared.
+QByteArray makeRouteKey(uint32_t table, int family, int prefixlen,
+                        const void* addr) {
+  int addrlen = (family == AF_INET6) ? 16 : 4;
+  unsigned char dst[16];
+  memcpy(dst, addr, addrlen);
+  for (int i = 0; i < addrlen; ++i) {
+    int bits = prefixlen - i * 8;
+    if (bits <= 0) {
+      dst[i] = 0;
+    } else if (bits < 8) {
+      dst[i] &= 0xff << (8 - bits);
+    }
+  }
+
+  QByteArray key;
+  key.append(reinterpret_cast<const char*>(&table), sizeof(table));
+  key.append(static_cast<char>(family));
+  key.append(static_cast<char>(prefixlen));
+  key.append(reinterpret_cast<const char*>(dst), addrlen);
+  return key;
+}
+}  // namespace
+
+RouteMonitor::RouteMonitor(quint32 table, quint32 fwmark, QObject* parent)
+    : QObject(parent), m_table(table), m_fwmark(fwmark) {
+  MVPN_COUNT_CTOR(RouteMonitor);
+
+  m_reconcileTimer.setSingleShot(true);
+  connect(&m_reconcileTimer, &QTimer::timeout, this, &RouteMonitor::reconcile);
+}
+
+RouteMonitor::~RouteMonitor() {
+  MVPN_COUNT_DTOR(RouteMonitor);
+  stop();
+}
+
+void RouteMonitor::start(int ifindex) {
+  m_ifindex = ifindex;
+  if (m_sock >= 0) {
+    return;
+  }
+
+  m_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                  NETLINK_ROUTE);
+  if (m_sock < 0) {
+    logger.warning() << "Failed to create the route monitor socket:"
+                     << strerror(errno);
+    return;
+  }
+
+  struct sockaddr_nl nladdr;
+  memset(&nladdr, 0, sizeof(nladdr));
+  nladdr.nl_family = AF_NETLINK;
+  if (bind(m_sock, (struct sockaddr*)&nladdr, sizeof(nladdr)) != 0) {
+    logger.warning() << "Failed to bind the route monitor socket:"
+                     << strerror(errno);
+    close(m_sock);
+    m_sock = -1;
+    return;
+  }
+
+  for (int group : {RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE, RTNLGRP_IPV4_RULE,
+                    RTNLGRP_IPV6_RULE}) {
+    if (setsockopt(m_sock, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group,
+                   sizeof(group)) != 0) {
+      logger.warning() << "Failed to join the netlink group" << group << ":"
+                       << strerror(errno);
+    }
+  }
+
+  m_notifier = new QSocketNotifier(m_sock, QSocketNotifier::Read, this);
+  connect(m_notifier, &QSocketNotifier::activated, this,
+          &RouteMonitor::socketReady);
+}
+
+void RouteMonitor::stop() {
+  m_reconcileTimer.stop();
+  m_ifindex = 0;
+
+  m_ownedRoutes.clear();
+  m_ownedRuleFamilies.clear();
+  m_ownedExclusions.clear();
+  m_missingRoutes.clear();
+  m_missingRuleFamilies.clear();
+  m_missingExclusions.clear();
+
+  if (m_notifier) {
+    delete m_notifier;
+    m_notifier = nullptr;
+  }
+  if (m_sock >= 0) {
+    close(m_sock);
+    m_sock = -1;
+  }
+}
+
+QByteArray RouteMonitor::routeKey(const IPAddress& prefix,
+                                  int hopindex) const {
+  wg_allowedip ip;
+  if (!WireguardDeviceBuilder::buildAllowedIp(&ip, prefix)) {
+    return QByteArray();
+  }
+  uint32_t table = (hopindex == 0) ? m_table : RT_TABLE_MAIN;
+  if (ip.family == AF_INET6) {
+    return makeRouteKey(table, ip.family, ip.cidr, &ip.ip6);
+  }
+  return makeRouteKey(table, ip.family, ip.cidr, &ip.ip4);
+}
+
+void RouteMonitor::addRoute(const IPAddress& prefix, int hopindex) {
+  Route route;
+  route.m_prefix = prefix;
+  route.m_hopindex = hopindex;
+  m_ownedRoutes.insert(routeKey(prefix, hopindex), route);
+}
+
+void RouteMonitor::removeRoute(const IPAddress& prefix, int hopindex) {
+  QByteArray key = routeKey(prefix, hopindex);
+  m_ownedRoutes.remove(key);
+  m_missingRoutes.remove(key);
+}
+
+void RouteMonitor::addRules(int family) { m_ownedRuleFamilies.insert(family); }
+
+void RouteMonitor::addExclusion(const QHostAddress& address) {
+  m_ownedExclusions.insert(address);
+}
+
+void RouteMonitor::removeExclusion(const QHostAddress& address) {
+  m_ownedExclusions.remove(address);
+  m_missingExclusions.remove(address);
+}
+
+void RouteMonitor::socketReady() {
+  char buf[MONITOR_RECV_SIZE];
+  for (;;) {
+    ssize_t len = recv(m_sock, buf, sizeof(buf), 0);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+
+    // Some notifications have been dropped: check everything.
+    if (len < 0 && errno == ENOBUFS) {
+      logger.warning() << "Lost routing notifications";
+      for (auto i = m_ownedRoutes.constBegin(); i != m_ownedRoutes.constEnd();
+           ++i) {
+        m_missingRoutes.insert(i.key());
+      }
+      m_missingRuleFamilies = m_ownedRuleFamilies;
+      m_missingExclusions = m_ownedExclusions;
+      if (!m_reconcileTimer.isActive()) {
+        m_reconcileTimer.start(RECONCILE_DELAY_MSEC);
+      }
+      continue;
+    }
+
+    if (len <= 0) {
+      return;
+    }
+
+    int remaining = len;
+    const struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
+    for (; NLMSG_OK(nlmsg, remaining); nlmsg = NLMSG_NEXT(nlmsg, remaining)) {
+      handleMessage(nlmsg);
+    }
+  }
+}
+
+void RouteMonitor::handleMessage(const struct nlmsghdr* nlmsg) {
+  if (nlmsg->nlmsg_type == RTM_DELROUTE) {
+    routeRemoved(nlmsg);
+  } else if (nlmsg->nlmsg_type == RTM_DELRULE) {
+    ruleRemoved(nlmsg);
+  }
+}
+
+void RouteMonitor::routeRemoved(const struct nlmsghdr* nlmsg) {
+  if (m_ownedRoutes.isEmpty() ||
+      nlmsg->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg))) {
+    return;
+  }
+
+  const struct rtmsg* rtm =
+      static_cast<const struct rtmsg*>(NLMSG_DATA(nlmsg));
+  if (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) {
+    return;
+  }
+
+  uint32_t table = rtm->rtm_table;
+  uint32_t oif = 0;
+  unsigned char dst[16];
+  memset(dst, 0, sizeof(dst));
+
+  int remaining = RTM_PAYLOAD(nlmsg);
+  const struct rtattr* attr = RTM_RTA(rtm);
+  for (; RTA_OK(attr, remaining); attr = RTA_NEXT(attr, remaining)) {
+    size_t len = RTA_PAYLOAD(attr);
+    if (attr->rta_type == RTA_TABLE && len == sizeof(table)) {
+      memcpy(&table, RTA_DATA(attr), len);
+    } else if (attr->rta_type == RTA_OIF && len == sizeof(oif)) {
+      memcpy(&oif, RTA_DATA(attr), len);
+    } else if (attr->rta_type == RTA_DST && len <= sizeof(dst)) {
+      memcpy(dst, RTA_DATA(attr), len);
+    }
+  }
+
+  QByteArray key =
+      makeRouteKey(table, rtm->rtm_family, rtm->rtm_dst_len, dst);
+  if (!m_ownedRoutes.contains(key)) {
+    return;
+  }
+
+  // The main table is shared with the other interfaces.
+  if (table == RT_TABLE_MAIN && oif != static_cast<uint32_t>(m_ifindex)) {
+    return;
+  }
+
+  logger.debug() << "Route removed:"
+                 << m_ownedRoutes.value(key).m_prefix.toString();
+  m_missingRoutes.insert(key);
+  if (!m_reconcileTimer.isActive()) {
+    m_reconcileTimer.start(RECONCILE_DELAY_MSEC);
+  }
+}
+
+void RouteMonitor::ruleRemoved(const struct nlmsghdr* nlmsg) {
+  if (nlmsg->nlmsg_len < NLMSG_LENGTH(sizeof(struct fib_rule_hdr))) {
+    return;
+  }
+
+  const struct fib_rule_hdr* rule =
+      static_cast<const struct fib_rule_hdr*>(NLMSG_DATA(nlmsg));
+  uint32_t table = rule->table;
+  uint32_t fwmark = 0;
+  bool suppress = false;
+  bool hasDst = false;
+  unsigned char dst[16];
+  memset(dst, 0, sizeof(dst));
+
+  int remaining = NLMSG_PAYLOAD(nlmsg, sizeof(struct fib_rule_hdr));
+  const struct rtattr* attr = reinterpret_cast<const struct rtattr*>(
+      static_cast<const char*>(NLMSG_DATA(nlmsg)) +
+      NLMSG_ALIGN(sizeof(struct fib_rule_hdr)));
+  for (; RTA_OK(attr, remaining); attr = RTA_NEXT(attr, remaining)) {
+    size_t len = RTA_PAYLOAD(attr);
+    if (attr->rta_type == FRA_TABLE && len == sizeof(table)) {
+      memcpy(&table, RTA_DATA(attr), len);
+    } else if (attr->rta_type == FRA_FWMARK && len == sizeof(fwmark)) {
+      memcpy(&fwmark, RTA_DATA(attr), len);
+    } else if (attr->rta_type == FRA_SUPPRESS_PREFIXLEN) {
+      suppress = true;
+    } else if (attr->rta_type == FRA_DST && len <= sizeof(dst)) {
+      memcpy(dst, RTA_DATA(attr), len);
+      hasDst = true;
+    }
+  }
+
+  bool missing = false;
+  if (hasDst) {
+    QHostAddress address;
+    if (rule->family == AF_INET && rule->dst_len == 32) {
+      uint32_t ip4;
+      memcpy(&ip4, dst, sizeof(ip4));
+      address.setAddress(ntohl(ip4));
+    } else if (rule->family == AF_INET6 && rule->dst_len == 128) {
+      address.setAddress(dst);
+    }
+    if (m_ownedExclusions.contains(address)) {
+      logger.debug() << "Exclusion rule removed:" << address.toString();
+      m_missingExclusions.insert(address);
+      missing = true;
+    }
+  } else if (m_ownedRuleFamilies.contains(rule->family)) {
+    if ((fwmark == m_fwmark && table == m_table) ||
+        (suppress && table == RT_TABLE_MAIN)) {
+      logger.debug() << "Routing rule removed";
+      m_missingRuleFamilies.insert(rule->family);
+      missing = true;
+    }
+  }
+
+  if (missing && !m_reconcileTimer.isActive()) {
+    m_reconcileTimer.start(RECONCILE_DELAY_MSEC);
+  }
+}
+
+void RouteMonitor::reconcile() {
+  m_reconcileTimer.stop();
+
+  QList<Route> routes;
+  for (const QByteArray& key : qAsConst(m_missingRoutes)) {
+    auto i = m_ownedRoutes.constFind(key);
+    if (i != m_ownedRoutes.constEnd()) {
+      routes.append(i.value());
+    }
+  }
+  m_missingRoutes.clear();
+
+  QSet<int> families;
+  families.swap(m_missingRuleFamilies);
+  QSet<QHostAddress> exclusions;
+  exclusions.swap(m_missingExclusions);
+
+  if (!routes.isEmpty()) {
+    emit routesMissing(routes);
+  }
+  for (int family : qAsConst(families)) {
+    emit rulesMissing(family);
+  }
+  for (const QHostAddress& address : qAsConst(exclusions)) {
+    emit exclusionMissing(address);
+  }
+}
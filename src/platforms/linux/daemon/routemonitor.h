@@ -0,0 +1,88 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef ROUTEMONITOR_H
+#define ROUTEMONITOR_H
+
+#include "ipaddress.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+class QSocketNotifier;
+struct nlmsghdr;
+
+// Keeps track of the routes and rules installed by the daemon, and listens
+// to the routing notifications while the interface is up, so that only the
+// ones removed by someone else are restored.
+class RouteMonitor final : public QObject {
+  Q_OBJECT
+  Q_DISABLE_COPY_MOVE(RouteMonitor)
+
+ public:
+  class Route {
+   public:
+    IPAddress m_prefix;
+    int m_hopindex = 0;
+  };
+
+  // The routes of the first hop are in `table`, the ones of the other hops
+  // in the main table. The rules send the packets without the `fwmark` to
+  // `table`.
+  RouteMonitor(quint32 table, quint32 fwmark, QObject* parent = nullptr);
+  ~RouteMonitor();
+
+  // Starts listening to the notifications. The routes in the main table are
+  // only ours if they go through the interface `ifindex`.
+  void start(int ifindex);
+  // Stops listening, and forgets what has been installed.
+  void stop();
+
+  void addRoute(const IPAddress& prefix, int hopindex);
+  void removeRoute(const IPAddress& prefix, int hopindex);
+  void addRules(int family);
+  void addExclusion(const QHostAddress& address);
+  void removeExclusion(const QHostAddress& address);
+
+  // Handles a RTM_DELROUTE or RTM_DELRULE notification.
+  void handleMessage(const struct nlmsghdr* nlmsg);
+
+  // Asks for what has been removed to be restored. This runs shortly after
+  // the removals are notified, to handle a burst of them at once.
+  void reconcile();
+
+ signals:
+  void routesMissing(const QList<RouteMonitor::Route>& routes);
+  void rulesMissing(int family);
+  void exclusionMissing(const QHostAddress& address);
+
+ private:
+  void socketReady();
+  void routeRemoved(const struct nlmsghdr* nlmsg);
+  void ruleRemoved(const struct nlmsghdr* nlmsg);
+  QByteArray routeKey(const IPAddress& prefix, int hopindex) const;
+
+  const quint32 m_table;
+  const quint32 m_fwmark;
+  int m_ifindex = 0;
+
+  // The routes are indexed by table and destination.
+  QHash<QByteArray, Route> m_ownedRoutes;
+  QSet<int> m_ownedRuleFamilies;
+  QSet<QHostAddress> m_ownedExclusions;
+  QSet<QByteArray> m_missingRoutes;
+  QSet<int> m_missingRuleFamilies;
+  QSet<QHostAddress> m_missingExclusions;
+
+  int m_sock = -1;
+  QSocketNotifier* m_notifier = nullptr;
+  QTimer m_reconcileTimer;
+};
+
+#endif  // ROUTEMONITOR_H
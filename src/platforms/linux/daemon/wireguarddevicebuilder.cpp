@@ -0,0 +1,136 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "wireguarddevicebuilder.h"
+#include "ipaddress.h"
+#include "leakdetector.h"
+#include "logger.h"
+
+#include <QtEndian>
+
+#include <net/if.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <cstddef>
+
+// Import wireguard C library for Linux
+#if defined(__cplusplus)
+extern "C" {
+#endif
+#include "../../3rdparty/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#if defined(__cplusplus)
+}
+#endif
+// End import wireguard
+
+namespace {
+Logger logger(LOG_LINUX, "WireguardDeviceBuilder");
+
+constexpr size_t alignUp(size_t size) {
+  return (size + alignof(std::max_align_t) - 1) &
+         ~(alignof(std::max_align_t) - 1);
+}
+}  // namespace
+
+WireguardDeviceBuilder::WireguardDeviceBuilder() {
+  MVPN_COUNT_CTOR(WireguardDeviceBuilder);
+}
+
+WireguardDeviceBuilder::~WireguardDeviceBuilder() {
+  MVPN_COUNT_DTOR(WireguardDeviceBuilder);
+  free(m_block);
+}
+
+wg_device* WireguardDeviceBuilder::reset(const char* name, int peers,
+                                         int allowedips) {
+  Q_ASSERT(peers >= 0 && allowedips >= 0);
+
+  size_t peersOffset = alignUp(sizeof(wg_device));
+  size_t allowedipsOffset = peersOffset + alignUp(peers * sizeof(wg_peer));
+  size_t size = allowedipsOffset + allowedips * sizeof(wg_allowedip);
+
+  // The block only grows: the next switch will likely need as much.
+  if (size > m_capacity) {
+    void* block = realloc(m_block, size);
+    if (!block) {
+      logger.error() << "Allocation failure";
+      m_device = nullptr;
+      return nullptr;
+    }
+    m_block = block;
+    m_capacity = size;
+  }
+  memset(m_block, 0, size);
+
+  char* base = static_cast<char*>(m_block);
+  m_device = reinterpret_cast<wg_device*>(base);
+  m_peers = reinterpret_cast<wg_peer*>(base + peersOffset);
+  m_allowedips = reinterpret_cast<wg_allowedip*>(base + allowedipsOffset);
+  m_maxPeers = peers;
+  m_maxAllowedips = allowedips;
+  m_peerCount = 0;
+  m_allowedipCount = 0;
+
+  strncpy(m_device->name, name, IFNAMSIZ - 1);
+  return m_device;
+}
+
+wg_peer* WireguardDeviceBuilder::addPeer() {
+  Q_ASSERT(m_device);
+  if (m_peerCount >= m_maxPeers) {
+    Q_ASSERT(false);
+    return nullptr;
+  }
+
+  wg_peer* peer = &m_peers[m_peerCount++];
+  if (!m_device->first_peer) {
+    m_device->first_peer = peer;
+  } else {
+    m_device->last_peer->next_peer = peer;
+  }
+  m_device->last_peer = peer;
+  return peer;
+}
+
+bool WireguardDeviceBuilder::addAllowedIp(wg_peer* peer,
+                                          const IPAddress& prefix) {
+  Q_ASSERT(peer);
+  if (m_allowedipCount >= m_maxAllowedips) {
+    Q_ASSERT(false);
+    return false;
+  }
+
+  wg_allowedip* ip = &m_allowedips[m_allowedipCount];
+  if (!buildAllowedIp(ip, prefix)) {
+    return false;
+  }
+  m_allowedipCount++;
+
+  if (!peer->first_allowedip) {
+    peer->first_allowedip = ip;
+  } else {
+    peer->last_allowedip->next_allowedip = ip;
+  }
+  peer->last_allowedip = ip;
+  return true;
+}
+
+// static
+bool WireguardDeviceBuilder::buildAllowedIp(wg_allowedip* ip,
+                                            const IPAddress& prefix) {
+  if (prefix.type() == QAbstractSocket::IPv4Protocol) {
+    ip->family = AF_INET;
+    ip->ip4.s_addr = qToBigEndian(prefix.address().toIPv4Address());
+  } else if (prefix.type() == QAbstractSocket::IPv6Protocol) {
+    Q_IPV6ADDR address = prefix.address().toIPv6Address();
+    ip->family = AF_INET6;
+    memcpy(&ip->ip6, &address, sizeof(ip->ip6));
+  } else {
+    return false;
+  }
+  ip->cidr = prefix.prefixLength();
+  return true;
+}
@@ -0,0 +1,54 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef WIREGUARDDEVICEBUILDER_H
+#define WIREGUARDDEVICEBUILDER_H
+
+#include <QtGlobal>
+
+#include <stddef.h>
+
+class IPAddress;
+struct wg_allowedip;
+struct wg_device;
+struct wg_peer;
+
+// Builds the wg_device structures passed to wg_set_device(). The device, its
+// peers and their allowed-IPs are carved out of a single block, which is
+// kept and reused by the following configurations. The structures must not
+// be released with wg_free_device().
+class WireguardDeviceBuilder final {
+  Q_DISABLE_COPY_MOVE(WireguardDeviceBuilder)
+
+ public:
+  WireguardDeviceBuilder();
+  ~WireguardDeviceBuilder();
+
+  // Starts a new device, with room for the given number of peers and
+  // allowed-IPs. The previous device is discarded. Returns nullptr if the
+  // block cannot be allocated.
+  wg_device* reset(const char* name, int peers, int allowedips);
+
+  // Appends a zeroed peer to the device.
+  wg_peer* addPeer();
+
+  // Appends an allowed-IP to the peer.
+  bool addAllowedIp(wg_peer* peer, const IPAddress& prefix);
+
+  static bool buildAllowedIp(wg_allowedip* ip, const IPAddress& prefix);
+
+ private:
+  void* m_block = nullptr;
+  size_t m_capacity = 0;
+
+  wg_device* m_device = nullptr;
+  wg_peer* m_peers = nullptr;
+  wg_allowedip* m_allowedips = nullptr;
+  int m_maxPeers = 0;
+  int m_maxAllowedips = 0;
+  int m_peerCount = 0;
+  int m_allowedipCount = 0;
+};
+
+#endif  // WIREGUARDDEVICEBUILDER_H
@@ -0,0 +1,133 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "wireguardpeerwriter.h"
+#include "daemon/wireguardutils.h"
+#include "ipaddress.h"
+#include "leakdetector.h"
+#include "logger.h"
+#include "wireguarddevicebuilder.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+// Import wireguard C library for Linux
+#if defined(__cplusplus)
+extern "C" {
+#endif
+#include "../../3rdparty/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#if defined(__cplusplus)
+}
+#endif
+// End import wireguard
+
+namespace {
+Logger logger(LOG_LINUX, "WireguardPeerWriter");
+}  // namespace
+
+constexpr int WireguardPeerWriter::ALLOWEDIPS_PER_UPDATE;
+
+WireguardPeerWriter::WireguardPeerWriter(WireguardDeviceBuilder& builder,
+                                         SetDeviceFunction&& setDevice)
+    : m_builder(builder), m_setDevice(std::move(setDevice)) {
+  MVPN_COUNT_CTOR(WireguardPeerWriter);
+}
+
+WireguardPeerWriter::~WireguardPeerWriter() {
+  MVPN_COUNT_DTOR(WireguardPeerWriter);
+}
+
+bool WireguardPeerWriter::setPeer(const char* ifname, const QString& pubkey,
+                                  const struct sockaddr* endpoint,
+                                  int keepalive,
+                                  const QList<IPAddress>& allowedIPs,
+                                  const QString& removed) {
+  wg_key publicKey;
+  wg_key_from_base64(publicKey, qPrintable(pubkey));
+
+  // Only the first update replaces the existing allowed-IPs and sets the
+  // other peer attributes, the next ones just append to them.
+  int offset = 0;
+  do {
+    int count = qMin(ALLOWEDIPS_PER_UPDATE, allowedIPs.count() - offset);
+    bool last = offset + count >= allowedIPs.count();
+    int peers = (last && !removed.isEmpty()) ? 2 : 1;
+
+    bool ok = false;
+    wg_device* device = m_builder.reset(ifname, peers, count);
+    if (device) {
+      wg_peer* peer = m_builder.addPeer();
+      memcpy(peer->public_key, publicKey, sizeof(wg_key));
+
+      if (offset == 0) {
+        if (endpoint) {
+          memcpy(&peer->endpoint.addr, endpoint,
+                 endpoint->sa_family == AF_INET
+                     ? sizeof(struct sockaddr_in)
+                     : sizeof(struct sockaddr_in6));
+        }
+        peer->persistent_keepalive_interval = keepalive;
+        peer->flags = (wg_peer_flags)(WGPEER_HAS_PUBLIC_KEY |
+                                      WGPEER_REPLACE_ALLOWEDIPS |
+                                      WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL);
+      } else {
+        peer->flags = WGPEER_HAS_PUBLIC_KEY;
+      }
+
+      ok = true;
+      for (int i = offset; ok && i < offset + count; ++i) {
+        if (!m_builder.addAllowedIp(peer, allowedIPs[i])) {
+          logger.error() << "Invalid IP address:" << allowedIPs[i].toString();
+          ok = false;
+        }
+      }
+
+      if (ok && peers > 1) {
+        wg_peer* old = m_builder.addPeer();
+        old->flags = (wg_peer_flags)(WGPEER_HAS_PUBLIC_KEY | WGPEER_REMOVE_ME);
+        wg_key_from_base64(old->public_key, qPrintable(removed));
+      }
+
+      device->flags = (wg_device_flags)0;
+      if (ok && m_setDevice(device) != 0) {
+        logger.error() << "Failed to set the peer"
+                       << WireguardUtils::printableKey(pubkey);
+        ok = false;
+      }
+    }
+
+    if (!ok) {
+      // The first update is all or nothing. After it, the peer has part of
+      // its allowed-IPs only.
+      if (offset > 0) {
+        removePeer(ifname, pubkey);
+      }
+      return false;
+    }
+
+    offset += count;
+  } while (offset < allowedIPs.count());
+
+  return true;
+}
+
+bool WireguardPeerWriter::removePeer(const char* ifname,
+                                     const QString& pubkey) {
+  wg_device* device = m_builder.reset(ifname, 1, 0);
+  if (!device) {
+    return false;
+  }
+
+  wg_peer* peer = m_builder.addPeer();
+  peer->flags = (wg_peer_flags)(WGPEER_HAS_PUBLIC_KEY | WGPEER_REMOVE_ME);
+  wg_key_from_base64(peer->public_key, qPrintable(pubkey));
+
+  device->flags = (wg_device_flags)0;
+  if (m_setDevice(device) != 0) {
+    logger.error() << "Failed to remove the peer"
+                   << WireguardUtils::printableKey(pubkey);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,50 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef WIREGUARDPEERWRITER_H
+#define WIREGUARDPEERWRITER_H
+
+#include <QList>
+#include <QString>
+
+#include <functional>
+
+class IPAddress;
+class WireguardDeviceBuilder;
+struct sockaddr;
+struct wg_device;
+
+// Writes a peer and its allowed-IPs to a wireguard device. Long allowed-IP
+// lists are sent in several updates: if one of them fails after the first,
+// the peer is removed rather than left with a truncated list.
+class WireguardPeerWriter final {
+  Q_DISABLE_COPY_MOVE(WireguardPeerWriter)
+
+ public:
+  // Applies a device configuration: wg_set_device(), except in the tests.
+  using SetDeviceFunction = std::function<int(wg_device*)>;
+
+  // The allowed-IPs are sent in slices, so that the memory used by the
+  // device structures doesn't depend on the size of the list.
+  static constexpr int ALLOWEDIPS_PER_UPDATE = 1024;
+
+  WireguardPeerWriter(WireguardDeviceBuilder& builder,
+                      SetDeviceFunction&& setDevice);
+  ~WireguardPeerWriter();
+
+  // Configures the peer with the given allowed-IPs. The endpoint is left
+  // unset when `endpoint` is null. The `removed` peer, if not empty, is
+  // removed by the last update.
+  bool setPeer(const char* ifname, const QString& pubkey,
+               const struct sockaddr* endpoint, int keepalive,
+               const QList<IPAddress>& allowedIPs, const QString& removed);
+
+  bool removePeer(const char* ifname, const QString& pubkey);
+
+ private:
+  WireguardDeviceBuilder& m_builder;
+  SetDeviceFunction m_setDevice;
+};
+
+#endif  // WIREGUARDPEERWRITER_H
@@ -0,0 +1,346 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "wireguardstatslinux.h"
+#include "leakdetector.h"
+#include "logger.h"
+
+#include <QDeadlineTimer>
+
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+
+/* The WireGuard generic netlink API, from linux/wireguard.h. That header is
+ * missing from older kernel headers, so the values we need are copied here.
+ */
+constexpr const char* WG_GENL_NAME = "wireguard";
+constexpr uint8_t WG_GENL_VERSION = 1;
+constexpr uint8_t WG_CMD_GET_DEVICE = 0;
+constexpr uint16_t WGDEVICE_A_IFNAME = 2;
+constexpr uint16_t WGDEVICE_A_PEERS = 8;
+constexpr uint16_t WGPEER_A_PUBLIC_KEY = 1;
+constexpr uint16_t WGPEER_A_LAST_HANDSHAKE_TIME = 6;
+constexpr uint16_t WGPEER_A_RX_BYTES = 7;
+constexpr uint16_t WGPEER_A_TX_BYTES = 8;
+constexpr int WG_PUBLIC_KEY_LEN = 32;
+
+constexpr size_t GENL_RECV_SIZE = 32768;
+constexpr int GENL_TIMEOUT_MSEC = 1000;
+constexpr int MAX_KEY_NAMES = 64;
+
+namespace {
+Logger logger(LOG_LINUX, "WireguardStatsLinux");
+
+// Calls the callback for each attribute in [data, data + len).
+template <typename F>
+void forEachAttr(const char* data, size_t len, F&& cb) {
+  while (len >= NLA_HDRLEN) {
+    const struct nlattr* attr = reinterpret_cast<const struct nlattr*>(data);
+    if (attr->nla_len < NLA_HDRLEN || attr->nla_len > len) {
+      return;
+    }
+
+    cb(attr->nla_type & NLA_TYPE_MASK, data + NLA_HDRLEN,
+       attr->nla_len - NLA_HDRLEN);
+
+    size_t aligned = NLA_ALIGN(attr->nla_len);
+    if (aligned >= len) {
+      return;
+    }
+    data += aligned;
+    len -= aligned;
+  }
+}
+
+// Appends an attribute to the message, which must have enough room for it.
+void appendAttr(struct nlmsghdr* nlmsg, int type, const void* data,
+                size_t len) {
+  char* buf = reinterpret_cast<char*>(nlmsg) + NLMSG_ALIGN(nlmsg->nlmsg_len);
+  struct nlattr* attr = reinterpret_cast<struct nlattr*>(buf);
+  attr->nla_type = type;
+  attr->nla_len = NLA_HDRLEN + len;
+  memcpy(buf + NLA_HDRLEN, data, len);
+  nlmsg->nlmsg_len = NLMSG_ALIGN(nlmsg->nlmsg_len) + NLA_ALIGN(attr->nla_len);
+}
+
+}  // namespace
+
+WireguardStatsLinux::WireguardStatsLinux() {
+  MVPN_COUNT_CTOR(WireguardStatsLinux);
+
+  m_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+  if (m_sock < 0) {
+    logger.warning() << "Failed to create genetlink socket:" << strerror(errno);
+    return;
+  }
+
+  struct sockaddr_nl nladdr;
+  memset(&nladdr, 0, sizeof(nladdr));
+  nladdr.nl_family = AF_NETLINK;
+  if (bind(m_sock, (struct sockaddr*)&nladdr, sizeof(nladdr)) != 0) {
+    logger.warning() << "Failed to bind genetlink socket:" << strerror(errno);
+    close(m_sock);
+    m_sock = -1;
+    return;
+  }
+
+  m_buffer.resize(GENL_RECV_SIZE);
+}
+
+WireguardStatsLinux::~WireguardStatsLinux() {
+  MVPN_COUNT_DTOR(WireguardStatsLinux);
+  if (m_sock >= 0) {
+    close(m_sock);
+  }
+}
+
+bool WireguardStatsLinux::fetch(const QString& ifname,
+                                QList<WireguardUtils::PeerStatus>& peers) {
+  if (m_sock < 0) {
+    return false;
+  }
+
+  // The wireguard module might be loaded only when the first interface is
+  // created: keep trying until the family is known.
+  if (!m_family && !resolveFamily()) {
+    return false;
+  }
+
+  QByteArray name = ifname.toLocal8Bit();
+  if (name.length() >= IFNAMSIZ) {
+    return false;
+  }
+
+  char buf[NLMSG_SPACE(GENL_HDRLEN + NLA_HDRLEN + IFNAMSIZ)];
+  memset(buf, 0, sizeof(buf));
+  struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
+  struct genlmsghdr* genl = static_cast<struct genlmsghdr*>(NLMSG_DATA(nlmsg));
+  nlmsg->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+  nlmsg->nlmsg_type = m_family;
+  nlmsg->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  genl->cmd = WG_CMD_GET_DEVICE;
+  genl->version = WG_GENL_VERSION;
+  appendAttr(nlmsg, WGDEVICE_A_IFNAME, name.constData(), name.length() + 1);
+
+  QList<WireguardUtils::PeerStatus> result;
+  bool ok = transact(
+      buf, nlmsg->nlmsg_len, true,
+      [&](const struct nlmsghdr* reply) { parseDevice(reply, result); });
+  if (!ok) {
+    return false;
+  }
+
+  peers = result;
+  return true;
+}
+
+void WireguardStatsLinux::parseDevice(
+    const struct nlmsghdr* reply, QList<WireguardUtils::PeerStatus>& peers) {
+  if (reply->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) {
+    return;
+  }
+
+  const char* msgData =
+      static_cast<const char*>(NLMSG_DATA(reply)) + GENL_HDRLEN;
+  size_t msgLen = reply->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+
+  forEachAttr(msgData, msgLen, [&](int type, const char* peersData,
+                                   size_t peersLen) {
+    if (type != WGDEVICE_A_PEERS) {
+      return;
+    }
+
+    forEachAttr(peersData, peersLen, [&](int, const char* peerData,
+                                         size_t peerLen) {
+      const char* key = nullptr;
+      bool hasStats = false;
+      WireguardUtils::PeerStatus status;
+
+      // WGPEER_A_ALLOWEDIPS is skipped: it is the expensive part.
+      forEachAttr(peerData, peerLen, [&](int attrType, const char* data,
+                                         size_t len) {
+        switch (attrType) {
+          case WGPEER_A_PUBLIC_KEY:
+            if (len == WG_PUBLIC_KEY_LEN) {
+              key = data;
+            }
+            break;
+
+          case WGPEER_A_LAST_HANDSHAKE_TIME:
+            if (len == 2 * sizeof(int64_t)) {
+              int64_t timespec[2];
+              memcpy(timespec, data, sizeof(timespec));
+              status.m_handshake = timespec[0] * 1000 + timespec[1] / 1000000;
+              hasStats = true;
+            }
+            break;
+
+          case WGPEER_A_RX_BYTES:
+            if (len == sizeof(uint64_t)) {
+              uint64_t value;
+              memcpy(&value, data, sizeof(value));
+              status.m_rxBytes = value;
+            }
+            break;
+
+          case WGPEER_A_TX_BYTES:
+            if (len == sizeof(uint64_t)) {
+              uint64_t value;
+              memcpy(&value, data, sizeof(value));
+              status.m_txBytes = value;
+            }
+            break;
+
+          default:
+            break;
+        }
+      });
+
+      // When a peer doesn't fit in one message, the next one repeats only
+      // its key and the remaining allowed-IPs.
+      if (!key || !hasStats) {
+        return;
+      }
+
+      status.m_pubkey = keyName(key);
+      peers.append(status);
+    });
+  });
+}
+
+bool WireguardStatsLinux::resolveFamily() {
+  char buf[NLMSG_SPACE(GENL_HDRLEN + NLA_HDRLEN + GENL_NAMSIZ)];
+  memset(buf, 0, sizeof(buf));
+  struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
+  struct genlmsghdr* genl = static_cast<struct genlmsghdr*>(NLMSG_DATA(nlmsg));
+  nlmsg->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+  nlmsg->nlmsg_type = GENL_ID_CTRL;
+  nlmsg->nlmsg_flags = NLM_F_REQUEST;
+  genl->cmd = CTRL_CMD_GETFAMILY;
+  genl->version = 1;
+  appendAttr(nlmsg, CTRL_ATTR_FAMILY_NAME, WG_GENL_NAME,
+             strlen(WG_GENL_NAME) + 1);
+
+  quint16 family = 0;
+  bool ok = transact(buf, nlmsg->nlmsg_len, false,
+                     [&](const struct nlmsghdr* reply) {
+    const char* msgData =
+        static_cast<const char*>(NLMSG_DATA(reply)) + GENL_HDRLEN;
+    size_t msgLen = reply->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    forEachAttr(msgData, msgLen, [&](int type, const char* data, size_t len) {
+      if (type == CTRL_ATTR_FAMILY_ID && len == sizeof(family)) {
+        memcpy(&family, data, sizeof(family));
+      }
+    });
+  });
+
+  if (!ok || !family) {
+    logger.debug() << "The wireguard genetlink family is not available";
+    return false;
+  }
+
+  m_family = family;
+  return true;
+}
+
+// Sends a request and calls the callback for each reply. Replies to older
+// requests, which might have timed out, are ignored.
+bool WireguardStatsLinux::transact(
+    char* buf, size_t len, bool dump,
+    std::function<void(const struct nlmsghdr*)>&& callback) {
+  struct nlmsghdr* request = reinterpret_cast<struct nlmsghdr*>(buf);
+  request->nlmsg_seq = ++m_seq;
+
+  if (send(m_sock, buf, len, 0) != (ssize_t)len) {
+    logger.error() << "Failed to send genetlink request:" << strerror(errno);
+    return false;
+  }
+
+  QDeadlineTimer deadline(GENL_TIMEOUT_MSEC);
+  for (;;) {
+    struct pollfd pfd = {m_sock, POLLIN, 0};
+    int rv = poll(&pfd, 1, (int)deadline.remainingTime());
+    if (rv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rv <= 0) {
+      logger.error() << "Timed out waiting for the genetlink reply";
+      return false;
+    }
+
+    // A dump message can be bigger than the buffer: peek at its real size
+    // first, so that it is never truncated.
+    ssize_t rlen = recv(m_sock, m_buffer.data(), m_buffer.size(),
+                        MSG_PEEK | MSG_TRUNC);
+    if (rlen > m_buffer.size()) {
+      m_buffer.resize(rlen);
+    }
+    if (rlen >= 0) {
+      rlen = recv(m_sock, m_buffer.data(), m_buffer.size(), 0);
+    }
+    if (rlen < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      logger.error() << "Failed to read the genetlink reply:"
+                     << strerror(errno);
+      return false;
+    }
+
+    int remaining = rlen;
+    const struct nlmsghdr* nlmsg =
+        reinterpret_cast<const struct nlmsghdr*>(m_buffer.constData());
+    for (; NLMSG_OK(nlmsg, remaining); nlmsg = NLMSG_NEXT(nlmsg, remaining)) {
+      if (nlmsg->nlmsg_seq != m_seq) {
+        continue;
+      }
+
+      if (nlmsg->nlmsg_type == NLMSG_DONE) {
+        return true;
+      }
+
+      if (nlmsg->nlmsg_type == NLMSG_ERROR) {
+        const struct nlmsgerr* err =
+            static_cast<const struct nlmsgerr*>(NLMSG_DATA(nlmsg));
+        if (err->error != 0) {
+          logger.debug() << "Genetlink request failed:"
+                         << strerror(-err->error);
+          return false;
+        }
+        return true;
+      }
+
+      if (nlmsg->nlmsg_len >= NLMSG_LENGTH(GENL_HDRLEN)) {
+        callback(nlmsg);
+      }
+
+      if (!dump) {
+        return true;
+      }
+    }
+  }
+}
+
+const QString& WireguardStatsLinux::keyName(const char* key) {
+  QByteArray raw = QByteArray::fromRawData(key, WG_PUBLIC_KEY_LEN);
+  auto i = m_keyNames.constFind(raw);
+  if (i != m_keyNames.constEnd()) {
+    return i.value();
+  }
+
+  // Keys change only when the server changes: this is just a safety net.
+  if (m_keyNames.count() >= MAX_KEY_NAMES) {
+    m_keyNames.clear();
+  }
+
+  QByteArray copy(key, WG_PUBLIC_KEY_LEN);
+  return *m_keyNames.insert(copy, QString::fromLatin1(copy.toBase64()));
+}
@@ -0,0 +1,52 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef WIREGUARDSTATSLINUX_H
+#define WIREGUARDSTATSLINUX_H
+
+#include "daemon/wireguardutils.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <functional>
+
+struct nlmsghdr;
+
+// Reads the peer counters and handshake times of a wireguard interface
+// straight from the generic netlink API. Unlike wg_get_device(), the
+// allowed-IPs of the peers are skipped without being parsed, so the cost of
+// a poll doesn't depend on the size of the routing configuration.
+class WireguardStatsLinux final {
+  Q_DISABLE_COPY_MOVE(WireguardStatsLinux)
+
+ public:
+  WireguardStatsLinux();
+  ~WireguardStatsLinux();
+
+  bool fetch(const QString& ifname, QList<WireguardUtils::PeerStatus>& peers);
+
+  // Appends the peers described by a WG_CMD_GET_DEVICE reply. The peers
+  // continued from a previous message, without their stats, are skipped.
+  void parseDevice(const struct nlmsghdr* reply,
+                   QList<WireguardUtils::PeerStatus>& peers);
+
+ private:
+  bool resolveFamily();
+  bool transact(char* buf, size_t len, bool dump,
+                std::function<void(const struct nlmsghdr*)>&& callback);
+  const QString& keyName(const char* key);
+
+  int m_sock = -1;
+  quint16 m_family = 0;
+  quint32 m_seq = 0;
+  QByteArray m_buffer;
+
+  // The base64 encoding of the peer public keys.
+  QHash<QByteArray, QString> m_keyNames;
+};
+
+#endif  // WIREGUARDSTATSLINUX_H
@@ -3,11 +3,15 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "wireguardutilslinux.h"
+#include "daemon/daemon.h"
 #include "leakdetector.h"
 #include "logger.h"
 #include "platforms/linux/linuxdependencies.h"
 
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
 #include <QHostAddress>
+#include <QJsonDocument>
 #include <QScopeGuard>
 
 #include <arpa/inet.h>
@@ -16,7 +20,7 @@
 #include <linux/rtnetlink.h>
 #include <mntent.h>
 #include <net/if.h>
-#include <netdb.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -50,6 +54,21 @@ constexpr const char* VPN_BLOCK_CGROUP = "/mozvpn.block";
 constexpr uint32_t VPN_EXCLUDE_CLASS_ID = 0x00110011;
 constexpr uint32_t VPN_BLOCK_CLASS_ID = 0x00220022;
 
+/* Netlink requests are acknowledged synchronously, with a deadline. Batched
+ * route updates are sent in chunks small enough to fit in the socket buffers,
+ * and each chunk must be acknowledged before the next one is sent.
+ *
+ * The kernel processes the rtnetlink requests in the context of sendto(), so
+ * the acknowledgements are normally queued before we start waiting. The
+ * deadlines only bound how long the main thread can block when the kernel
+ * doesn't reply: per request, and for a whole batch, whatever its number of
+ * chunks.
+ */
+constexpr size_t NETLINK_BATCH_MAX_SIZE = 32768;
+constexpr size_t NETLINK_RECV_SIZE = 8192;
+constexpr int NETLINK_ACK_TIMEOUT_MSEC = 250;
+constexpr int NETLINK_BATCH_TIMEOUT_MSEC = 500;
+
 static void nlmsg_append_attr(struct nlmsghdr* nlmsg, size_t maxlen,
                               int attrtype, const void* attrdata,
                               size_t attrlen);
@@ -63,13 +82,43 @@ void NetfilterLogger(int level, const char* msg) {
   Q_UNUSED(level);
   logger.debug() << "NetfilterGo:" << msg;
 }
+
+const char* nlmsgTypeName(int type) {
+  switch (type) {
+    case RTM_NEWROUTE:
+      return "RTM_NEWROUTE";
+    case RTM_DELROUTE:
+      return "RTM_DELROUTE";
+    case RTM_NEWRULE:
+      return "RTM_NEWRULE";
+    case RTM_DELRULE:
+      return "RTM_DELRULE";
+    default:
+      return "netlink";
+  }
+}
+
+// Deleting something which is already gone is not an error, and neither is
+// creating exclusively something which already exists.
+bool nlmsgErrorIsHarmless(const struct nlmsgerr* err) {
+  if (err->msg.nlmsg_type == RTM_NEWRULE &&
+      (err->msg.nlmsg_flags & NLM_F_EXCL)) {
+    return err->error == -EEXIST;
+  }
+  if (err->msg.nlmsg_type != RTM_DELROUTE &&
+      err->msg.nlmsg_type != RTM_DELRULE) {
+    return false;
+  }
+  return err->error == -ENOENT || err->error == -ESRCH;
+}
+
 }  // namespace
 
 WireguardUtilsLinux::WireguardUtilsLinux(QObject* parent)
-    : WireguardUtils(parent) {
+    : WireguardUtils(parent),
+      m_peerWriter(m_builder, wg_set_device),
+      m_routeMonitor(WG_ROUTE_TABLE, WG_FIREWALL_MARK) {
   MVPN_COUNT_CTOR(WireguardUtilsLinux);
-  NetfilterSetLogger((GoUintptr)&NetfilterLogger);
-  NetfilterCreateTables();
 
   m_nlsock = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE);
   if (m_nlsock < 0) {
@@ -84,28 +133,32 @@ WireguardUtilsLinux::WireguardUtilsLinux(QObject* parent)
     logger.warning() << "Failed to bind netlink socket:" << strerror(errno);
   }
 
+#ifdef NETLINK_CAP_ACK
+  // Don't echo the whole request back in the error messages.
+  int capAck = 1;
+  setsockopt(m_nlsock, SOL_NETLINK, NETLINK_CAP_ACK, &capAck, sizeof(capAck));
+#endif
+
   m_notifier = new QSocketNotifier(m_nlsock, QSocketNotifier::Read, this);
   connect(m_notifier, &QSocketNotifier::activated, this,
           &WireguardUtilsLinux::nlsockReady);
 
-  /* Create control groups for split tunnelling */
-  m_cgroups = LinuxDependencies::findCgroupPath("net_cls");
-  if (!m_cgroups.isNull()) {
-    if (!setupCgroupClass(m_cgroups + VPN_EXCLUDE_CGROUP,
-                          VPN_EXCLUDE_CLASS_ID)) {
-      m_cgroups.clear();
-    } else if (!setupCgroupClass(m_cgroups + VPN_BLOCK_CGROUP,
-                                 VPN_BLOCK_CLASS_ID)) {
-      m_cgroups.clear();
-    }
-  }
+  connect(&m_routeMonitor, &RouteMonitor::routesMissing, this,
+          &WireguardUtilsLinux::restoreRoutes);
+  connect(&m_routeMonitor, &RouteMonitor::rulesMissing, this,
+          &WireguardUtilsLinux::restoreRules);
+  connect(&m_routeMonitor, &RouteMonitor::exclusionMissing, this,
+          &WireguardUtilsLinux::restoreExclusion);
 
   logger.debug() << "WireguardUtilsLinux created.";
 }
 
 WireguardUtilsLinux::~WireguardUtilsLinux() {
   MVPN_COUNT_DTOR(WireguardUtilsLinux);
-  NetfilterRemoveTables();
+  stopRouteMonitor();
+  if (m_initialized) {
+    NetfilterRemoveTables();
+  }
   if (m_nlsock >= 0) {
     close(m_nlsock);
   }
@@ -118,22 +171,51 @@ bool WireguardUtilsLinux::interfaceExists() {
   return currentInterfaces().contains(WG_INTERFACE);
 };
 
+void WireguardUtilsLinux::initialize() {
+  if (m_initialized) {
+    return;
+  }
+  m_initialized = true;
+
+  NetfilterSetLogger((GoUintptr)&NetfilterLogger);
+  NetfilterCreateTables();
+  Daemon::traceStartup("netfilter");
+
+  /* Create control groups for split tunnelling */
+  m_cgroups = LinuxDependencies::findCgroupPath("net_cls");
+  if (!m_cgroups.isNull()) {
+    if (!setupCgroupClass(m_cgroups + VPN_EXCLUDE_CGROUP,
+                          VPN_EXCLUDE_CLASS_ID)) {
+      m_cgroups.clear();
+    } else if (!setupCgroupClass(m_cgroups + VPN_BLOCK_CGROUP,
+                                 VPN_BLOCK_CLASS_ID)) {
+      m_cgroups.clear();
+    }
+  }
+  Daemon::traceStartup("cgroups");
+}
+
 bool WireguardUtilsLinux::addInterface(const InterfaceConfig& config) {
+  initialize();
+
   int code = wg_add_device(WG_INTERFACE);
   if (code != 0) {
     logger.error() << "Adding interface failed:" << strerror(-code);
     return false;
   }
 
-  wg_device* device = static_cast<wg_device*>(calloc(1, sizeof(*device)));
+  // The index is needed by every route, and by the route monitor.
+  m_ifindex = if_nametoindex(WG_INTERFACE);
+  if (m_ifindex <= 0) {
+    logger.error() << "if_nametoindex() failed:" << strerror(errno);
+    return false;
+  }
+
+  wg_device* device = m_builder.reset(WG_INTERFACE, 0, 0);
   if (!device) {
-    logger.error() << "Allocation failure";
     return false;
   }
-  auto guard = qScopeGuard([&] { wg_free_device(device); });
 
-  // Name
-  strncpy(device->name, WG_INTERFACE, IFNAMSIZ);
   // Private Key
   wg_key_from_base64(device->private_key, config.m_privateKey.toLocal8Bit());
 
@@ -157,6 +239,9 @@ bool WireguardUtilsLinux::addInterface(const InterfaceConfig& config) {
                    AF_INET6)) {
     return false;
   }
+  m_routeMonitor.addRules(AF_INET);
+  m_routeMonitor.addRules(AF_INET6);
+  m_routeMonitor.start(m_ifindex);
 
   // Configure firewall rules
   GoString goIfname = {.p = device->name, .n = (ptrdiff_t)strlen(device->name)};
@@ -179,104 +264,121 @@ bool WireguardUtilsLinux::addInterface(const InterfaceConfig& config) {
   return true;
 }
 
-bool WireguardUtilsLinux::updatePeer(const InterfaceConfig& config) {
-  wg_device* device = static_cast<wg_device*>(calloc(1, sizeof(*device)));
-  if (!device) {
-    logger.error() << "Allocation failure";
-    return false;
-  }
-  auto guard = qScopeGuard([&] { wg_free_device(device); });
-
-  wg_peer* peer = static_cast<wg_peer*>(calloc(1, sizeof(*peer)));
-  if (!peer) {
-    logger.error() << "Allocation failure";
-    return false;
-  }
-  device->first_peer = device->last_peer = peer;
+void WireguardUtilsLinux::prefetchPeerEndpoint(const InterfaceConfig& config) {
+  m_resolver.prefetch(config.m_serverIpv4AddrIn);
+}
 
+bool WireguardUtilsLinux::updatePeer(const InterfaceConfig& config) {
   logger.debug() << "Adding peer" << printableKey(config.m_serverPublicKey);
+  return setPeer(config, config.m_allowedIPAddressRanges, nullptr);
+}
 
-  // Public Key
-  wg_key_from_base64(peer->public_key, qPrintable(config.m_serverPublicKey));
-  // Endpoint
-  if (!setPeerEndpoint(&peer->endpoint.addr, config.m_serverIpv4AddrIn,
-                       config.m_serverPort)) {
-    logger.error() << "Failed to set peer endpoint for hop"
-                   << config.m_hopindex;
-    return false;
-  }
+bool WireguardUtilsLinux::addStandbyPeer(const InterfaceConfig& config) {
+  logger.debug() << "Adding standby peer"
+                 << printableKey(config.m_serverPublicKey);
+  return setPeer(config, QList<IPAddress>(), nullptr);
+}
 
-  // HACK: We are running into a crash on Linux due to the address list being
-  // *WAAAY* too long, which we aren't really using anways since the routing
-  // policy rules are doing all the work for us anyways.
-  //
-  // To work around the issue, just set default routes for hopindex zero.
-  if (config.m_hopindex == 0) {
-    if (!config.m_deviceIpv4Address.isNull()) {
-      addPeerPrefix(peer, IPAddress("0.0.0.0/0"));
-    }
-    if (!config.m_deviceIpv6Address.isNull()) {
-      addPeerPrefix(peer, IPAddress("::/0"));
-    }
-  } else {
-    for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
-      bool ok = addPeerPrefix(peer, ip);
-      if (!ok) {
-        logger.error() << "Invalid IP address:" << ip.toString();
-        return false;
-      }
-    }
-  }
+bool WireguardUtilsLinux::promoteStandbyPeer(const InterfaceConfig& config,
+                                             const InterfaceConfig& previous) {
+  logger.debug() << "Promoting peer" << printableKey(config.m_serverPublicKey)
+                 << "replacing" << printableKey(previous.m_serverPublicKey);
+  return setPeer(config, config.m_allowedIPAddressRanges, &previous);
+}
 
-  // Set/update peer
-  strncpy(device->name, WG_INTERFACE, IFNAMSIZ);
-  device->flags = (wg_device_flags)0;
-  peer->persistent_keepalive_interval = WG_KEEPALIVE_PERIOD;
-  peer->flags =
-      (wg_peer_flags)(WGPEER_HAS_PUBLIC_KEY | WGPEER_REPLACE_ALLOWEDIPS |
-                      WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL);
-  if (wg_set_device(device) != 0) {
+// Configures the peer with the given allowed-IPs. The `removed` peer, if
+// any, is removed by the last update.
+bool WireguardUtilsLinux::setPeer(const InterfaceConfig& config,
+                                  const QList<IPAddress>& allowedIPs,
+                                  const InterfaceConfig* removed) {
+  // Without its endpoint, the peer is configured but doesn't start its
+  // handshake until the hostname is resolved.
+  struct sockaddr_storage endpoint;
+  struct sockaddr* sa = reinterpret_cast<struct sockaddr*>(&endpoint);
+  bool hasEndpoint = m_resolver.resolveNow(config.m_serverIpv4AddrIn,
+                                           config.m_serverPort, sa);
+
+  if (!m_peerWriter.setPeer(WG_INTERFACE, config.m_serverPublicKey,
+                            hasEndpoint ? sa : nullptr, WG_KEEPALIVE_PERIOD,
+                            allowedIPs,
+                            removed ? removed->m_serverPublicKey : QString())) {
     logger.error() << "Failed to set the new peer hop" << config.m_hopindex;
+    m_pendingEndpoints.remove(config.m_serverPublicKey);
     return false;
   }
 
+  if (hasEndpoint) {
+    m_pendingEndpoints.remove(config.m_serverPublicKey);
+  } else {
+    resolvePeerEndpoint(config);
+  }
   return true;
 }
 
-bool WireguardUtilsLinux::deletePeer(const InterfaceConfig& config) {
-  wg_device* device = static_cast<wg_device*>(calloc(1, sizeof(*device)));
-  if (!device) {
-    logger.error() << "Allocation failure";
-    return false;
-  }
-  auto guard = qScopeGuard([&] { wg_free_device(device); });
+void WireguardUtilsLinux::resolvePeerEndpoint(const InterfaceConfig& config) {
+  QString pubkey = config.m_serverPublicKey;
+  QString hostname = config.m_serverIpv4AddrIn;
+  m_pendingEndpoints.insert(pubkey, hostname);
+
+  m_resolver.resolve(
+      hostname, config.m_serverPort, this,
+      [this, pubkey, hostname](const struct sockaddr* sa) {
+        // The peer has been removed or reconfigured in the meantime.
+        auto i = m_pendingEndpoints.find(pubkey);
+        if (i == m_pendingEndpoints.end() || i.value() != hostname) {
+          return;
+        }
+        m_pendingEndpoints.erase(i);
+
+        if (!sa || !setPeerEndpoint(pubkey, sa)) {
+          logger.error() << "No endpoint for peer" << printableKey(pubkey);
+          emit peerEndpointFailed(pubkey);
+        }
+      });
+}
 
-  wg_peer* peer = static_cast<wg_peer*>(calloc(1, sizeof(*peer)));
-  if (!peer) {
-    logger.error() << "Allocation failure";
+bool WireguardUtilsLinux::setPeerEndpoint(const QString& pubkey,
+                                          const struct sockaddr* sa) {
+  wg_device* device = m_builder.reset(WG_INTERFACE, 1, 0);
+  if (!device) {
     return false;
   }
-  device->first_peer = device->last_peer = peer;
 
-  logger.debug() << "Removing peer" << printableKey(config.m_serverPublicKey);
-
-  // Public Key
-  peer->flags = (wg_peer_flags)(WGPEER_HAS_PUBLIC_KEY | WGPEER_REMOVE_ME);
-  wg_key_from_base64(peer->public_key, qPrintable(config.m_serverPublicKey));
+  wg_peer* peer = m_builder.addPeer();
+  wg_key_from_base64(peer->public_key, qPrintable(pubkey));
+  peer->flags = WGPEER_HAS_PUBLIC_KEY;
+  memcpy(&peer->endpoint.addr, sa,
+         sa->sa_family == AF_INET ? sizeof(struct sockaddr_in)
+                                  : sizeof(struct sockaddr_in6));
 
-  // Set/update device
-  strncpy(device->name, WG_INTERFACE, IFNAMSIZ);
   device->flags = (wg_device_flags)0;
   if (wg_set_device(device) != 0) {
-    logger.error() << "Failed to remove the peer";
+    logger.error() << "Failed to set the endpoint of peer"
+                   << printableKey(pubkey);
     return false;
   }
 
+  logger.debug() << "Endpoint resolved for peer" << printableKey(pubkey);
   return true;
 }
 
+bool WireguardUtilsLinux::deletePeer(const InterfaceConfig& config) {
+  logger.debug() << "Removing peer" << printableKey(config.m_serverPublicKey);
+  m_pendingEndpoints.remove(config.m_serverPublicKey);
+  return m_peerWriter.removePeer(WG_INTERFACE, config.m_serverPublicKey);
+}
+
 bool WireguardUtilsLinux::deleteInterface() {
-  // Clear firewall rules
+  logNetlinkLatency();
+
+  // Everything is going away: stop restoring it.
+  m_routeMonitor.stop();
+  m_pendingEndpoints.clear();
+  m_ifindex = 0;
+
+  // Clear firewall rules. An interface left by a previous instance of the
+  // daemon might have left its rules too.
+  initialize();
   NetfilterClearTables();
 
   // Clear routing policy rules
@@ -298,6 +400,18 @@ bool WireguardUtilsLinux::deleteInterface() {
 }
 
 QList<WireguardUtils::PeerStatus> WireguardUtilsLinux::getPeerStatus() {
+  QList<WireguardUtils::PeerStatus> peerList;
+
+  // Fast path: read only the peer counters.
+  if (m_stats.fetch(WG_INTERFACE, peerList)) {
+    return peerList;
+  }
+
+  return readPeerStatus();
+}
+
+// static
+QList<WireguardUtils::PeerStatus> WireguardUtilsLinux::readPeerStatus() {
   wg_device* device = nullptr;
   wg_peer* peer = nullptr;
   QList<WireguardUtils::PeerStatus> peerList;
@@ -327,6 +441,9 @@ QList<WireguardUtils::PeerStatus> WireguardUtilsLinux::getPeerStatus() {
 bool WireguardUtilsLinux::updateRoutePrefix(const IPAddress& prefix,
                                             int hopindex) {
   logger.debug() << "Adding route to" << prefix.toString();
+
+  m_routeMonitor.addRoute(prefix, hopindex);
+
   const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE | NLM_F_ACK;
   return rtmSendRoute(RTM_NEWROUTE, flags, prefix, hopindex);
 }
@@ -334,18 +451,88 @@ bool WireguardUtilsLinux::updateRoutePrefix(const IPAddress& prefix,
 bool WireguardUtilsLinux::deleteRoutePrefix(const IPAddress& prefix,
                                             int hopindex) {
   logger.debug() << "Removing route to" << prefix.toString();
+
+  m_routeMonitor.removeRoute(prefix, hopindex);
+
   const int flags = NLM_F_REQUEST | NLM_F_ACK;
   return rtmSendRoute(RTM_DELROUTE, flags, prefix, hopindex);
 }
 
+void WireguardUtilsLinux::beginRouteBatch() {
+  Q_ASSERT(!m_routeBatching);
+  m_routeBatching = true;
+  m_routeBatch.clear();
+  m_routeBatchPrefixes.clear();
+}
+
+QList<IPAddress> WireguardUtilsLinux::commitRouteBatch() {
+  QList<IPAddress> failed;
+
+  m_routeBatching = false;
+  auto guard = qScopeGuard([&] {
+    m_routeBatch.clear();
+    m_routeBatchPrefixes.clear();
+  });
+
+  if (m_routeBatch.isEmpty()) {
+    return failed;
+  }
+
+  logger.debug() << "Sending" << m_routeBatchPrefixes.count()
+                 << "route updates";
+
+  QDeadlineTimer deadline(NETLINK_BATCH_TIMEOUT_MSEC);
+  char* data = m_routeBatch.data();
+  size_t remaining = m_routeBatch.size();
+  while (remaining > 0) {
+    // The kernel is too slow: the rest of the batch is not sent.
+    if (deadline.hasExpired()) {
+      logger.error() << "Timed out sending the route updates";
+      int left = remaining;
+      for (struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(data);
+           NLMSG_OK(nlmsg, left); nlmsg = NLMSG_NEXT(nlmsg, left)) {
+        failed.append(m_routeBatchPrefixes.value(nlmsg->nlmsg_seq));
+      }
+      break;
+    }
+
+    size_t chunkLen = 0;
+    struct nlmsghdr* last = nullptr;
+    while (chunkLen < remaining) {
+      struct nlmsghdr* nlmsg =
+          reinterpret_cast<struct nlmsghdr*>(data + chunkLen);
+      size_t msgLen = NLMSG_ALIGN(nlmsg->nlmsg_len);
+      if (last && (chunkLen + msgLen > NETLINK_BATCH_MAX_SIZE)) {
+        break;
+      }
+      last = nlmsg;
+      chunkLen += msgLen;
+    }
+
+    Q_ASSERT(last);
+    QList<quint32> failedSeqs;
+    nlTransact(data, chunkLen, &failedSeqs, &deadline);
+    for (quint32 seq : failedSeqs) {
+      failed.append(m_routeBatchPrefixes.value(seq));
+    }
+
+    data += chunkLen;
+    remaining -= chunkLen;
+  }
+
+  return failed;
+}
+
 bool WireguardUtilsLinux::addExclusionRoute(const QHostAddress& address) {
   logger.debug() << "Adding exclusion route for" << address.toString();
+  m_routeMonitor.addExclusion(address);
   const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE | NLM_F_ACK;
   return rtmSendExclude(RTM_NEWRULE, flags, address);
 }
 
 bool WireguardUtilsLinux::deleteExclusionRoute(const QHostAddress& address) {
   logger.debug() << "Removing exclusion route for" << address.toString();
+  m_routeMonitor.removeExclusion(address);
   return rtmSendExclude(RTM_DELRULE, NLM_F_REQUEST | NLM_F_ACK, address);
 }
 
@@ -354,14 +541,13 @@ bool WireguardUtilsLinux::rtmSendRoute(int action, int flags,
   constexpr size_t rtm_max_size = sizeof(struct rtmsg) +
                                   2 * RTA_SPACE(sizeof(uint32_t)) +
                                   RTA_SPACE(sizeof(struct in6_addr));
-  int index = if_nametoindex(WG_INTERFACE);
+  int index = interfaceIndex();
   if (index <= 0) {
-    logger.error() << "if_nametoindex() failed:" << strerror(errno);
     return false;
   }
 
   wg_allowedip ip;
-  if (!buildAllowedIp(&ip, prefix)) {
+  if (!WireguardDeviceBuilder::buildAllowedIp(&ip, prefix)) {
     logger.warning() << "Invalid destination prefix";
     return false;
   }
@@ -397,109 +583,163 @@ bool WireguardUtilsLinux::rtmSendRoute(int action, int flags,
   }
   nlmsg_append_attr32(nlmsg, sizeof(buf), RTA_OIF, index);
 
-  struct sockaddr_nl nladdr;
-  memset(&nladdr, 0, sizeof(nladdr));
-  nladdr.nl_family = AF_NETLINK;
-  size_t result = sendto(m_nlsock, buf, nlmsg->nlmsg_len, 0,
-                         (struct sockaddr*)&nladdr, sizeof(nladdr));
-  return (result == nlmsg->nlmsg_len);
+  if (m_routeBatching) {
+    m_routeBatch.append(buf, NLMSG_ALIGN(nlmsg->nlmsg_len));
+    m_routeBatchPrefixes.insert(nlmsg->nlmsg_seq, prefix);
+    return true;
+  }
+
+  return nlTransact(buf, nlmsg->nlmsg_len);
 }
 
-// PRIVATE METHODS
-QStringList WireguardUtilsLinux::currentInterfaces() {
-  char* deviceNames = wg_list_device_names();
-  QStringList devices;
-  if (!deviceNames) {
-    return devices;
-  }
-  char* deviceName;
-  size_t len;
-  wg_for_each_device_name(deviceNames, deviceName, len) {
-    devices.append(deviceName);
+// Sends one or more netlink messages at once, and waits until the kernel has
+// processed all of them. Errors are reported even without NLM_F_ACK and the
+// messages are processed in order: only the last one needs to be
+// acknowledged. The sequence numbers of the messages which failed, or whose
+// result is unknown, are appended to `failed`. Without a `deadline`, the
+// acknowledgement is awaited for NETLINK_ACK_TIMEOUT_MSEC.
+bool WireguardUtilsLinux::nlTransact(char* buf, size_t len,
+                                     QList<quint32>* failed,
+                                     const QDeadlineTimer* batchDeadline) {
+  struct nlmsghdr* first = reinterpret_cast<struct nlmsghdr*>(buf);
+  struct nlmsghdr* last = nullptr;
+  int remaining = len;
+  for (struct nlmsghdr* nlmsg = first; NLMSG_OK(nlmsg, remaining);
+       nlmsg = NLMSG_NEXT(nlmsg, remaining)) {
+    nlmsg->nlmsg_flags &= ~NLM_F_ACK;
+    last = nlmsg;
+  }
+  if (!last) {
+    return true;
   }
-  free(deviceNames);
-  return devices;
-}
+  last->nlmsg_flags |= NLM_F_ACK;
 
-bool WireguardUtilsLinux::setPeerEndpoint(struct sockaddr* sa,
-                                          const QString& address, int port) {
-  QString portString = QString::number(port);
+  const quint32 firstSeq = first->nlmsg_seq;
+  const quint32 lastSeq = last->nlmsg_seq;
+  const int type = last->nlmsg_type;
 
-  struct addrinfo hints;
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_UNSPEC;
-  hints.ai_socktype = SOCK_DGRAM;
-  hints.ai_protocol = IPPROTO_UDP;
+  bool ok = true;
+  bool done = false;
+  bool replied = false;
+  quint32 lastReplied = 0;
 
-  struct addrinfo* resolved = nullptr;
-  auto guard = qScopeGuard([&] { freeaddrinfo(resolved); });
-  int retries = 15;
+  QElapsedTimer timer;
+  timer.start();
 
-  for (unsigned int timeout = 1000000;;
-       timeout = std::min((unsigned int)20000000, timeout * 6 / 5)) {
-    int rv = getaddrinfo(address.toLocal8Bit(), portString.toLocal8Bit(),
-                         &hints, &resolved);
-    if (!rv) {
-      break;
-    }
+  struct sockaddr_nl nladdr;
+  memset(&nladdr, 0, sizeof(nladdr));
+  nladdr.nl_family = AF_NETLINK;
+  ssize_t result = sendto(m_nlsock, buf, len, 0, (struct sockaddr*)&nladdr,
+                          sizeof(nladdr));
+  if (result != (ssize_t)len) {
+    logger.error() << "Failed to send" << nlmsgTypeName(type) << "request:"
+                   << strerror(errno);
+  } else {
+    QDeadlineTimer deadline = batchDeadline
+                                  ? *batchDeadline
+                                  : QDeadlineTimer(NETLINK_ACK_TIMEOUT_MSEC);
+    char rbuf[NETLINK_RECV_SIZE];
+    while (!done) {
+      struct pollfd pfd = {m_nlsock, POLLIN, 0};
+      int rv = poll(&pfd, 1, (int)deadline.remainingTime());
+      if (rv < 0 && errno == EINTR) {
+        continue;
+      }
+      if (rv <= 0) {
+        logger.error() << "Timed out waiting for" << nlmsgTypeName(type)
+                       << "acknowledgement";
+        break;
+      }
 
-    /* The set of return codes that are "permanent failures". All other
-     * possibilities are potentially transient.
-     *
-     * This is according to https://sourceware.org/glibc/wiki/NameResolver which
-     * states: "From the perspective of the application that calls getaddrinfo()
-     * it perhaps doesn't matter that much since EAI_FAIL, EAI_NONAME and
-     * EAI_NODATA are all permanent failure codes and the causes are all
-     * permanent failures in the sense that there is no point in retrying
-     * later."
-     *
-     * So this is what we do, except FreeBSD removed EAI_NODATA some time ago,
-     * so that's conditional.
-     */
-    if (rv == EAI_NONAME || rv == EAI_FAIL ||
-#ifdef EAI_NODATA
-        rv == EAI_NODATA ||
-#endif
-        (retries >= 0 && !retries--)) {
-      logger.error() << "Failed to resolve the address endpoint";
-      return false;
-    }
+      ssize_t rlen = recv(m_nlsock, rbuf, sizeof(rbuf), MSG_DONTWAIT);
+      if (rlen < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+          continue;
+        }
+        logger.error() << "Failed to read" << nlmsgTypeName(type)
+                       << "acknowledgement:" << strerror(errno);
+        break;
+      }
 
-    logger.warning() << "Trying again in" << (timeout / 1000000.0) << "seconds";
-    usleep(timeout);
+      int rremaining = rlen;
+      struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(rbuf);
+      for (; NLMSG_OK(nlmsg, rremaining);
+           nlmsg = NLMSG_NEXT(nlmsg, rremaining)) {
+        if (nlmsg->nlmsg_type != NLMSG_ERROR) {
+          continue;
+        }
+
+        struct nlmsgerr* err = static_cast<struct nlmsgerr*>(NLMSG_DATA(nlmsg));
+        // The sequence numbers wrap around: compare the offsets.
+        if (quint32(nlmsg->nlmsg_seq - firstSeq) >
+            quint32(lastSeq - firstSeq)) {
+          // A late reply to a request which has already timed out.
+          if (err->error != 0) {
+            logger.debug() << "Netlink request failed:"
+                           << strerror(-err->error);
+          }
+          continue;
+        }
+
+        if (err->error != 0 && !nlmsgErrorIsHarmless(err)) {
+          logger.error() << nlmsgTypeName(err->msg.nlmsg_type)
+                         << "request failed:" << strerror(-err->error);
+          if (failed) {
+            failed->append(nlmsg->nlmsg_seq);
+          }
+          ok = false;
+        }
+
+        replied = true;
+        lastReplied = nlmsg->nlmsg_seq;
+        if (lastReplied == lastSeq) {
+          done = true;
+        }
+      }
+    }
   }
 
-  if ((resolved->ai_family == AF_INET &&
-       resolved->ai_addrlen == sizeof(struct sockaddr_in)) ||
-      (resolved->ai_family == AF_INET6 &&
-       resolved->ai_addrlen == sizeof(struct sockaddr_in6))) {
-    memcpy(sa, resolved->ai_addr, resolved->ai_addrlen);
-    return true;
+  if (done) {
+    m_nlLatency[type].record(timer.nsecsElapsed() / 1000);
+    return ok;
   }
 
-  logger.error() << "Invalid endpoint" << address;
+  // We don't know what happened to the messages after the last reply.
+  if (failed) {
+    remaining = len;
+    for (struct nlmsghdr* nlmsg = first; NLMSG_OK(nlmsg, remaining);
+         nlmsg = NLMSG_NEXT(nlmsg, remaining)) {
+      if (!replied || quint32(nlmsg->nlmsg_seq - firstSeq) >
+                          quint32(lastReplied - firstSeq)) {
+        failed->append(nlmsg->nlmsg_seq);
+      }
+    }
+  }
   return false;
 }
 
-bool WireguardUtilsLinux::addPeerPrefix(wg_peer* peer,
-                                        const IPAddress& prefix) {
-  Q_ASSERT(peer);
-
-  wg_allowedip* allowedip =
-      static_cast<wg_allowedip*>(calloc(1, sizeof(*allowedip)));
-  if (!allowedip) {
-    logger.error() << "Allocation failure";
-    return false;
+void WireguardUtilsLinux::logNetlinkLatency() const {
+  for (auto i = m_nlLatency.constBegin(); i != m_nlLatency.constEnd(); ++i) {
+    logger.debug() << "Netlink" << nlmsgTypeName(i.key()) << "latency:"
+                   << QJsonDocument(i.value().toJson()).toJson(
+                          QJsonDocument::Compact);
   }
+}
 
-  if (!peer->first_allowedip) {
-    peer->first_allowedip = allowedip;
-  } else {
-    peer->last_allowedip->next_allowedip = allowedip;
+// PRIVATE METHODS
+QStringList WireguardUtilsLinux::currentInterfaces() {
+  char* deviceNames = wg_list_device_names();
+  QStringList devices;
+  if (!deviceNames) {
+    return devices;
   }
-  peer->last_allowedip = allowedip;
-
-  return buildAllowedIp(allowedip, prefix);
+  char* deviceName;
+  size_t len;
+  wg_for_each_device_name(deviceNames, deviceName, len) {
+    devices.append(deviceName);
+  }
+  free(deviceNames);
+  return devices;
 }
 
 static void nlmsg_append_attr(struct nlmsghdr* nlmsg, size_t maxlen,
@@ -525,19 +765,17 @@ bool WireguardUtilsLinux::rtmSendRule(int action, int flags, int addrfamily) {
   constexpr size_t fib_max_size =
       sizeof(struct fib_rule_hdr) + 2 * RTA_SPACE(sizeof(uint32_t));
 
-  char buf[NLMSG_SPACE(fib_max_size)];
-  struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
-  struct fib_rule_hdr* rule =
-      static_cast<struct fib_rule_hdr*>(NLMSG_DATA(nlmsg));
-  struct sockaddr_nl nladdr;
-  memset(&nladdr, 0, sizeof(nladdr));
-  nladdr.nl_family = AF_NETLINK;
+  // Both rules are sent in the same request.
+  char buf[2 * NLMSG_SPACE(fib_max_size)];
+  memset(buf, 0, sizeof(buf));
 
   /* Create a routing policy rule to select the wireguard routing table for
    * unmarked packets. This is equivalent to:
    *     ip rule add not fwmark $WG_FIREWALL_MARK table $WG_ROUTE_TABLE
    */
-  memset(buf, 0, sizeof(buf));
+  struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
+  struct fib_rule_hdr* rule =
+      static_cast<struct fib_rule_hdr*>(NLMSG_DATA(nlmsg));
   nlmsg->nlmsg_len = NLMSG_LENGTH(sizeof(struct fib_rule_hdr));
   nlmsg->nlmsg_type = action;
   nlmsg->nlmsg_flags = flags;
@@ -547,19 +785,18 @@ bool WireguardUtilsLinux::rtmSendRule(int action, int flags, int addrfamily) {
   rule->table = RT_TABLE_UNSPEC;
   rule->action = FR_ACT_TO_TBL;
   rule->flags = FIB_RULE_INVERT;
-  nlmsg_append_attr32(nlmsg, sizeof(buf), FRA_FWMARK, WG_FIREWALL_MARK);
-  nlmsg_append_attr32(nlmsg, sizeof(buf), FRA_TABLE, WG_ROUTE_TABLE);
-  ssize_t result = sendto(m_nlsock, buf, nlmsg->nlmsg_len, 0,
-                          (struct sockaddr*)&nladdr, sizeof(nladdr));
-  if (result != nlmsg->nlmsg_len) {
-    return false;
-  }
+  nlmsg_append_attr32(nlmsg, NLMSG_SPACE(fib_max_size), FRA_FWMARK,
+                      WG_FIREWALL_MARK);
+  nlmsg_append_attr32(nlmsg, NLMSG_SPACE(fib_max_size), FRA_TABLE,
+                      WG_ROUTE_TABLE);
+  size_t len = NLMSG_ALIGN(nlmsg->nlmsg_len);
 
   /* Create a routing policy rule to suppress zero-length prefix lookups from
    * in the main routing table. This is equivalent to:
    *     ip rule add table main suppress_prefixlength 0
    */
-  memset(buf, 0, sizeof(buf));
+  nlmsg = reinterpret_cast<struct nlmsghdr*>(buf + len);
+  rule = static_cast<struct fib_rule_hdr*>(NLMSG_DATA(nlmsg));
   nlmsg->nlmsg_len = NLMSG_LENGTH(sizeof(struct fib_rule_hdr));
   nlmsg->nlmsg_type = action;
   nlmsg->nlmsg_flags = flags;
@@ -569,14 +806,11 @@ bool WireguardUtilsLinux::rtmSendRule(int action, int flags, int addrfamily) {
   rule->table = RT_TABLE_MAIN;
   rule->action = FR_ACT_TO_TBL;
   rule->flags = 0;
-  nlmsg_append_attr32(nlmsg, sizeof(buf), FRA_SUPPRESS_PREFIXLEN, 0);
-  result = sendto(m_nlsock, buf, nlmsg->nlmsg_len, 0, (struct sockaddr*)&nladdr,
-                  sizeof(nladdr));
-  if (result != nlmsg->nlmsg_len) {
-    return false;
-  }
+  nlmsg_append_attr32(nlmsg, NLMSG_SPACE(fib_max_size),
+                      FRA_SUPPRESS_PREFIXLEN, 0);
+  len += nlmsg->nlmsg_len;
 
-  return true;
+  return nlTransact(buf, len);
 }
 
 bool WireguardUtilsLinux::rtmSendExclude(int action, int flags,
@@ -588,9 +822,6 @@ bool WireguardUtilsLinux::rtmSendExclude(int action, int flags,
   struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
   struct fib_rule_hdr* rule =
       static_cast<struct fib_rule_hdr*>(NLMSG_DATA(nlmsg));
-  struct sockaddr_nl nladdr;
-  memset(&nladdr, 0, sizeof(nladdr));
-  nladdr.nl_family = AF_NETLINK;
 
   /* Create a routing policy rule to select the main routing table for
    * packets matching the destination address. This is equivalent to:
@@ -620,17 +851,11 @@ bool WireguardUtilsLinux::rtmSendExclude(int action, int flags,
     return false;
   }
 
-  ssize_t result = sendto(m_nlsock, buf, nlmsg->nlmsg_len, 0,
-                          (struct sockaddr*)&nladdr, sizeof(nladdr));
-  if (result != nlmsg->nlmsg_len) {
-    return false;
-  }
-
-  return true;
+  return nlTransact(buf, nlmsg->nlmsg_len);
 }
 
 void WireguardUtilsLinux::nlsockReady() {
-  char buf[1024];
+  char buf[NETLINK_RECV_SIZE];
   ssize_t len = recv(m_nlsock, buf, sizeof(buf), MSG_DONTWAIT);
   if (len <= 0) {
     return;
@@ -675,33 +900,68 @@ bool WireguardUtilsLinux::setupCgroupClass(const QString& path,
   return true;
 }
 
-QString WireguardUtilsLinux::getExcludeCgroup() const {
+QString WireguardUtilsLinux::getDefaultCgroup() {
+  initialize();
+  return m_cgroups;
+}
+
+QString WireguardUtilsLinux::getExcludeCgroup() {
+  initialize();
   if (m_cgroups.isNull()) {
     return QString();
   }
   return m_cgroups + VPN_EXCLUDE_CGROUP;
 }
 
-QString WireguardUtilsLinux::getBlockCgroup() const {
+QString WireguardUtilsLinux::getBlockCgroup() {
+  initialize();
   if (m_cgroups.isNull()) {
     return QString();
   }
   return m_cgroups + VPN_BLOCK_CGROUP;
 }
 
-// static
-bool WireguardUtilsLinux::buildAllowedIp(wg_allowedip* ip,
-                                         const IPAddress& prefix) {
-  const char* addrString = qPrintable(prefix.address().toString());
-  if (prefix.type() == QAbstractSocket::IPv4Protocol) {
-    ip->family = AF_INET;
-    ip->cidr = prefix.prefixLength();
-    return inet_pton(AF_INET, addrString, &ip->ip4) == 1;
-  }
-  if (prefix.type() == QAbstractSocket::IPv6Protocol) {
-    ip->family = AF_INET6;
-    ip->cidr = prefix.prefixLength();
-    return inet_pton(AF_INET6, addrString, &ip->ip6) == 1;
+// The index of the interface created by addInterface(). An interface left by
+// a previous instance of the daemon is looked up once.
+int WireguardUtilsLinux::interfaceIndex() {
+  if (m_ifindex <= 0) {
+    m_ifindex = if_nametoindex(WG_INTERFACE);
+    if (m_ifindex <= 0) {
+      logger.error() << "if_nametoindex() failed:" << strerror(errno);
+    }
+  }
+  return m_ifindex;
+}
+
+// Restores the routes and rules which have been removed by someone else.
+void WireguardUtilsLinux::restoreRoutes(
+    const QList<RouteMonitor::Route>& routes) {
+  logger.warning() << "Restoring" << routes.count() << "routes";
+  const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE | NLM_F_ACK;
+  beginRouteBatch();
+  for (const RouteMonitor::Route& route : routes) {
+    rtmSendRoute(RTM_NEWROUTE, flags, route.m_prefix, route.m_hopindex);
+  }
+  for (const IPAddress& ip : commitRouteBatch()) {
+    logger.error() << "Failed to restore the route to" << ip.toString();
+  }
+}
+
+// The rules are created exclusively, so that the ones which still exist are
+// not duplicated.
+void WireguardUtilsLinux::restoreRules(int family) {
+  logger.warning() << "Restoring the routing rules";
+  const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
+  if (!rtmSendRule(RTM_NEWRULE, flags, family)) {
+    logger.error() << "Failed to restore the routing rules";
+  }
+}
+
+void WireguardUtilsLinux::restoreExclusion(const QHostAddress& address) {
+  logger.warning() << "Restoring the exclusion route for"
+                   << address.toString();
+  const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
+  if (!rtmSendExclude(RTM_NEWRULE, flags, address)) {
+    logger.error() << "Failed to restore the exclusion route";
   }
-  return false;
 }
@@ -6,10 +6,21 @@
 #define WIREGUARDUTILSLINUX_H
 
 #include "daemon/wireguardutils.h"
+#include "endpointresolver.h"
+#include "latencyhistogram.h"
+#include "routemonitor.h"
+#include "wireguarddevicebuilder.h"
+#include "wireguardpeerwriter.h"
+#include "wireguardstatslinux.h"
+#include <QByteArray>
+#include <QDeadlineTimer>
+#include <QHash>
 #include <QHostAddress>
 #include <QObject>
+#include <QSet>
 #include <QSocketNotifier>
 #include <QStringList>
+#include <QTimer>
 
 class WireguardUtilsLinux final : public WireguardUtils {
   Q_OBJECT
@@ -21,38 +32,82 @@ class WireguardUtilsLinux final : public WireguardUtils {
   bool addInterface(const InterfaceConfig& config) override;
   bool deleteInterface() override;
 
+  void prefetchPeerEndpoint(const InterfaceConfig& config) override;
   bool updatePeer(const InterfaceConfig& config) override;
   bool deletePeer(const InterfaceConfig& config) override;
+  bool supportStandbyPeer() const override { return true; }
+  bool addStandbyPeer(const InterfaceConfig& config) override;
+  bool promoteStandbyPeer(const InterfaceConfig& config,
+                          const InterfaceConfig& previous) override;
   QList<PeerStatus> getPeerStatus() override;
+  // Reads the peer status with the wireguard library, which opens its own
+  // socket: this can be called from any thread.
+  static QList<PeerStatus> readPeerStatus();
 
   bool updateRoutePrefix(const IPAddress& prefix, int hopindex) override;
   bool deleteRoutePrefix(const IPAddress& prefix, int hopindex) override;
 
+  void beginRouteBatch() override;
+  QList<IPAddress> commitRouteBatch() override;
+
   bool addExclusionRoute(const QHostAddress& address) override;
   bool deleteExclusionRoute(const QHostAddress& address) override;
 
-  QString getDefaultCgroup() const { return m_cgroups; }
-  QString getExcludeCgroup() const;
-  QString getBlockCgroup() const;
+  // Sets up the netfilter tables and the cgroups of the split tunnelling.
+  // This is done on first use, not to slow down the startup of the daemon.
+  void initialize();
+
+  QString getDefaultCgroup();
+  QString getExcludeCgroup();
+  QString getBlockCgroup();
 
  private:
   QStringList currentInterfaces();
-  bool setPeerEndpoint(struct sockaddr* sa, const QString& address, int port);
-  bool addPeerPrefix(struct wg_peer* peer, const IPAddress& prefix);
+  bool setPeer(const InterfaceConfig& config,
+               const QList<IPAddress>& allowedIPs,
+               const InterfaceConfig* removed);
+  void resolvePeerEndpoint(const InterfaceConfig& config);
+  bool setPeerEndpoint(const QString& pubkey, const struct sockaddr* sa);
   bool rtmSendRule(int action, int flags, int addrfamily);
   bool rtmSendRoute(int action, int flags, const IPAddress& prefix,
                     int hopindex);
+  bool nlTransact(char* buf, size_t len, QList<quint32>* failed = nullptr,
+                  const QDeadlineTimer* batchDeadline = nullptr);
+  void logNetlinkLatency() const;
+  int interfaceIndex();
   bool rtmSendExclude(int action, int flags, const QHostAddress& address);
   static bool setupCgroupClass(const QString& path, unsigned long classid);
-  static bool buildAllowedIp(struct wg_allowedip*, const IPAddress& prefix);
 
+  bool m_initialized = false;
   int m_nlsock = -1;
-  int m_nlseq = 0;
+  int m_ifindex = 0;
+  quint32 m_nlseq = 0;
   QSocketNotifier* m_notifier = nullptr;
   QString m_cgroups;
+  WireguardStatsLinux m_stats;
+  EndpointResolver m_resolver;
+  // The peers configured without their endpoint, and their hostname.
+  QHash<QString, QString> m_pendingEndpoints;
+  WireguardDeviceBuilder m_builder;
+  WireguardPeerWriter m_peerWriter;
+
+  // Route messages queued between beginRouteBatch() and commitRouteBatch(),
+  // and their prefixes indexed by sequence number.
+  bool m_routeBatching = false;
+  QByteArray m_routeBatch;
+  QHash<quint32, IPAddress> m_routeBatchPrefixes;
+
+  // Round-trip time of the netlink requests, by message type.
+  QHash<int, LatencyHistogram> m_nlLatency;
+
+  // Restores the routes and rules removed by someone else.
+  RouteMonitor m_routeMonitor;
 
  private slots:
   void nlsockReady();
+  void restoreRoutes(const QList<RouteMonitor::Route>& routes);
+  void restoreRules(int family);
+  void restoreExclusion(const QHostAddress& address);
 };
 
 #endif  // WIREGUARDUTILSLINUX_H
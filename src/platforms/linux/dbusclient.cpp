@@ -10,6 +10,7 @@
 #include "models/keys.h"
 #include "models/server.h"
 #include "mozillavpn.h"
+#include "pendingrequests.h"
 #include "settingsholder.h"
 
 #include <QDBusPendingCall>
@@ -33,24 +34,41 @@ DBusClient::DBusClient(QObject* parent) : QObject(parent) {
           &DBusClient::connected);
   connect(m_dbus, &OrgMozillaVpnDbusInterface::disconnected, this,
           &DBusClient::disconnected);
+  connect(m_dbus, &OrgMozillaVpnDbusInterface::statusChanged, this,
+          &DBusClient::statusChanged);
+
+  m_requests = new PendingRequests(this);
 }
 
 DBusClient::~DBusClient() { MVPN_COUNT_DTOR(DBusClient); }
 
-QDBusPendingCallWatcher* DBusClient::version() {
-  logger.debug() << "Version via DBus";
-  QDBusPendingReply<QString> reply = m_dbus->version();
-  QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(reply, this);
+// DBus matches the replies with the calls, and times them out. The calls are
+// tracked only to measure their latency.
+QDBusPendingCallWatcher* DBusClient::watch(const QString& method,
+                                           const QDBusPendingCall& call) {
+  quint32 id = m_requests->start(method, 0);
+
+  QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(call, this);
+  QObject::connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                   [this, id] { m_requests->finish(id); });
   QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher,
                    &QDBusPendingCallWatcher::deleteLater);
   return watcher;
 }
 
-QDBusPendingCallWatcher* DBusClient::activate(
+QJsonObject DBusClient::metrics() const { return m_requests->metrics(); }
+
+QDBusPendingCallWatcher* DBusClient::version() {
+  logger.debug() << "Version via DBus";
+  QDBusPendingReply<QString> reply = m_dbus->version();
+  return watch("version", reply);
+}
+
+QJsonObject DBusClient::hopConfig(
     const Server& server, const Device* device, const Keys* keys, int hopindex,
     const QList<IPAddress>& allowedIPAddressRanges,
     const QStringList& excludedAddresses, const QStringList& vpnDisabledApps,
-    const QHostAddress& dnsServer) {
+    const QHostAddress& dnsServer) const {
   QJsonObject json;
   json.insert("privateKey", QJsonValue(keys->privateKey()));
   json.insert("deviceIpv4Address", QJsonValue(device->ipv4Address()));
@@ -64,16 +82,22 @@ QDBusPendingCallWatcher* DBusClient::activate(
   json.insert("dnsServer", QJsonValue(dnsServer.toString()));
   json.insert("hopindex", QJsonValue((double)hopindex));
 
-  QJsonArray allowedIPAddesses;
-  for (const IPAddress& i : allowedIPAddressRanges) {
-    QJsonObject range;
-    range.insert("address", QJsonValue(i.address().toString()));
-    range.insert("range", QJsonValue((double)i.prefixLength()));
-    range.insert("isIpv6",
-                 QJsonValue(i.type() == QAbstractSocket::IPv6Protocol));
-    allowedIPAddesses.append(range);
-  };
-  json.insert("allowedIPAddressRanges", allowedIPAddesses);
+  if (m_daemonVersion >= DAEMON_PROTOCOL_VERSION_PACKED_RANGES) {
+    json.insert("allowedIPAddressRangesPacked",
+                QJsonValue(QString::fromLatin1(
+                    IPAddress::packList(allowedIPAddressRanges).toBase64())));
+  } else {
+    QJsonArray allowedIPAddesses;
+    for (const IPAddress& i : allowedIPAddressRanges) {
+      QJsonObject range;
+      range.insert("address", QJsonValue(i.address().toString()));
+      range.insert("range", QJsonValue((double)i.prefixLength()));
+      range.insert("isIpv6",
+                   QJsonValue(i.type() == QAbstractSocket::IPv6Protocol));
+      allowedIPAddesses.append(range);
+    };
+    json.insert("allowedIPAddressRanges", allowedIPAddesses);
+  }
 
   QJsonArray jsExcludedAddresses;
   for (const QString& i : excludedAddresses) {
@@ -87,48 +111,80 @@ QDBusPendingCallWatcher* DBusClient::activate(
     logger.debug() << "Disabling:" << i;
   }
   json.insert("vpnDisabledApps", disabledApps);
+  return json;
+}
+
+QDBusPendingCallWatcher* DBusClient::activate(
+    const Server& server, const Device* device, const Keys* keys, int hopindex,
+    const QList<IPAddress>& allowedIPAddressRanges,
+    const QStringList& excludedAddresses, const QStringList& vpnDisabledApps,
+    const QHostAddress& dnsServer) {
+  QJsonObject json =
+      hopConfig(server, device, keys, hopindex, allowedIPAddressRanges,
+                excludedAddresses, vpnDisabledApps, dnsServer);
 
   logger.debug() << "Activate via DBus";
   QDBusPendingReply<bool> reply =
       m_dbus->activate(QJsonDocument(json).toJson(QJsonDocument::Compact));
-  QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(reply, this);
-  QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher,
-                   &QDBusPendingCallWatcher::deleteLater);
-  return watcher;
+  return watch("activate", reply);
+}
+
+QDBusPendingCallWatcher* DBusClient::activateMultihop(const QJsonArray& hops) {
+  Q_ASSERT(m_daemonVersion >= DAEMON_PROTOCOL_VERSION_MULTIHOP_BATCH);
+
+  QJsonObject json;
+  json.insert("hops", hops);
+
+  logger.debug() << "Activate multihop via DBus";
+  QDBusPendingReply<QString> reply = m_dbus->activateMultihop(
+      QJsonDocument(json).toJson(QJsonDocument::Compact));
+  return watch("activateMultihop", reply);
 }
 
 QDBusPendingCallWatcher* DBusClient::deactivate() {
   logger.debug() << "Deactivate via DBus";
   QDBusPendingReply<bool> reply = m_dbus->deactivate();
-  QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(reply, this);
-  QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher,
-                   &QDBusPendingCallWatcher::deleteLater);
-  return watcher;
+  return watch("deactivate", reply);
 }
 
 QDBusPendingCallWatcher* DBusClient::status() {
   logger.debug() << "Status via DBus";
   QDBusPendingReply<QString> reply = m_dbus->status();
-  QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(reply, this);
-  QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher,
-                   &QDBusPendingCallWatcher::deleteLater);
-  return watcher;
+  return watch("status", reply);
+}
+
+QDBusPendingCallWatcher* DBusClient::connectionStatus() {
+  logger.debug() << "Connection status via DBus";
+  QDBusPendingReply<DaemonStatus> reply = m_dbus->connectionStatus();
+  return watch("connectionStatus", reply);
+}
+
+QDBusPendingCallWatcher* DBusClient::subscribeStatus(int intervalMsec) {
+  logger.debug() << "Subscribe status via DBus";
+  QDBusPendingReply<> reply = m_dbus->subscribeStatus(intervalMsec);
+  return watch("subscribeStatus", reply);
+}
+
+QDBusPendingCallWatcher* DBusClient::unsubscribeStatus() {
+  logger.debug() << "Unsubscribe status via DBus";
+  QDBusPendingReply<> reply = m_dbus->unsubscribeStatus();
+  return watch("unsubscribeStatus", reply);
+}
+
+QDBusPendingCallWatcher* DBusClient::subscribeCounters() {
+  logger.debug() << "Subscribe counters via DBus";
+  QDBusPendingReply<bool> reply = m_dbus->subscribeCounters();
+  return watch("subscribeCounters", reply);
 }
 
 QDBusPendingCallWatcher* DBusClient::getLogs() {
   logger.debug() << "Get logs via DBus";
   QDBusPendingReply<QString> reply = m_dbus->getLogs();
-  QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(reply, this);
-  QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher,
-                   &QDBusPendingCallWatcher::deleteLater);
-  return watcher;
+  return watch("getLogs", reply);
 }
 
 QDBusPendingCallWatcher* DBusClient::cleanupLogs() {
   logger.debug() << "Cleanup logs via DBus";
   QDBusPendingReply<QString> reply = m_dbus->cleanupLogs();
-  QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(reply, this);
-  QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher,
-                   &QDBusPendingCallWatcher::deleteLater);
-  return watcher;
+  return watch("cleanupLogs", reply);
 }
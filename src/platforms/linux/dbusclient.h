@@ -5,8 +5,11 @@
 #ifndef DBUSCLIENT_H
 #define DBUSCLIENT_H
 
+#include "daemon/daemonprotocol.h"
 #include "dbus_interface.h"
 
+#include <QJsonArray>
+#include <QJsonObject>
 #include <QList>
 #include <QObject>
 #include <QHostAddress>
@@ -15,6 +18,8 @@ class Server;
 class Device;
 class Keys;
 class IPAddress;
+class PendingRequests;
+class QDBusPendingCall;
 class QDBusPendingCallWatcher;
 
 class DBusClient final : public QObject {
@@ -27,26 +32,70 @@ class DBusClient final : public QObject {
 
   QDBusPendingCallWatcher* version();
 
+  // The protocol version reported by the daemon. Some encodings are used only
+  // when the daemon supports them.
+  void setDaemonVersion(int version) { m_daemonVersion = version; }
+  int daemonVersion() const { return m_daemonVersion; }
+
+  // The JSON configuration of a single hop, as expected by the daemon.
+  QJsonObject hopConfig(const Server& server, const Device* device,
+                        const Keys* keys, int hopindex,
+                        const QList<IPAddress>& allowedIPAddressRanges,
+                        const QStringList& excludedAddresses,
+                        const QStringList& vpnDisabledApps,
+                        const QHostAddress& dnsServer) const;
+
   QDBusPendingCallWatcher* activate(
       const Server& server, const Device* device, const Keys* keys,
       int hopindex, const QList<IPAddress>& allowedIPAddressRanges,
       const QStringList& excludedAddresses, const QStringList& vpnDisabledApps,
       const QHostAddress& dnsServer);
 
+  // Activates all the hops with a single request. The hop configurations are
+  // ordered from the outermost one.
+  QDBusPendingCallWatcher* activateMultihop(const QJsonArray& hops);
+
   QDBusPendingCallWatcher* deactivate();
 
   QDBusPendingCallWatcher* status();
 
+  // The status as a DaemonStatus structure. Requires a daemon supporting
+  // DAEMON_PROTOCOL_VERSION_TYPED_STATUS.
+  QDBusPendingCallWatcher* connectionStatus();
+
+  // The daemon emits statusChanged every `intervalMsec` milliseconds while
+  // this client is subscribed.
+  QDBusPendingCallWatcher* subscribeStatus(int intervalMsec);
+  QDBusPendingCallWatcher* unsubscribeStatus();
+
+  // The daemon lets this client read the counters page, until it
+  // unsubscribes from the status. Requires a daemon supporting
+  // DAEMON_PROTOCOL_VERSION_COUNTERS_PAGE.
+  QDBusPendingCallWatcher* subscribeCounters();
+
   QDBusPendingCallWatcher* getLogs();
 
   QDBusPendingCallWatcher* cleanupLogs();
 
+  // The latency of the calls, per method.
+  QJsonObject metrics() const;
+
  signals:
   void connected(const QString& pubkey);
   void disconnected();
+  void statusChanged(const QString& serverIpv4Gateway,
+                     const QString& deviceIpv4Address, qulonglong txBytes,
+                     qulonglong rxBytes, qlonglong handshakeAge);
+
+ private:
+  QDBusPendingCallWatcher* watch(const QString& method,
+                                 const QDBusPendingCall& call);
 
  private:
   OrgMozillaVpnDbusInterface* m_dbus;
+  PendingRequests* m_requests = nullptr;
+
+  int m_daemonVersion = DAEMON_PROTOCOL_VERSION_MIN;
 };
 
 #endif  // DBUSCLIENT_H
@@ -15,6 +15,7 @@
 #include "mozillavpn.h"
 
 #include <QDBusPendingCallWatcher>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
@@ -33,6 +34,8 @@ LinuxController::LinuxController() {
           &LinuxController::peerConnected);
   connect(m_dbus, &DBusClient::disconnected, this,
           &LinuxController::disconnected);
+  connect(m_dbus, &DBusClient::statusChanged, this,
+          &LinuxController::statusChanged);
 }
 
 LinuxController::~LinuxController() { MVPN_COUNT_DTOR(LinuxController); }
@@ -41,6 +44,23 @@ void LinuxController::initialize(const Device* device, const Keys* keys) {
   Q_UNUSED(device);
   Q_UNUSED(keys);
 
+  QDBusPendingCallWatcher* watcher = m_dbus->version();
+  connect(watcher, &QDBusPendingCallWatcher::finished, this,
+          &LinuxController::versionCompleted);
+}
+
+void LinuxController::versionCompleted(QDBusPendingCallWatcher* call) {
+  QDBusPendingReply<QString> reply = *call;
+  if (reply.isError()) {
+    logger.error() << "Error received from the DBus service";
+    emit initialized(false, false, QDateTime());
+    return;
+  }
+
+  int version = reply.argumentAt<0>().toInt();
+  logger.debug() << "Daemon protocol version:" << version;
+  m_dbus->setDaemonVersion(version);
+
   QDBusPendingCallWatcher* watcher = m_dbus->status();
   connect(watcher, &QDBusPendingCallWatcher::finished, this,
           &LinuxController::initializeCompleted);
@@ -119,9 +139,33 @@ void LinuxController::activate(const QList<Server>& serverList,
   m_activationQueue.append(lastHop);
 
   logger.debug() << "LinuxController activated";
+
+  // Recent daemons configure all the hops at once, without waiting for the
+  // handshake of each hop before sending the next one.
+  m_multihopBatch =
+      m_activationQueue.count() > 1 &&
+      m_dbus->daemonVersion() >= DAEMON_PROTOCOL_VERSION_MULTIHOP_BATCH;
+  if (m_multihopBatch) {
+    activateAll();
+    return;
+  }
+
   activateNext();
 }
 
+void LinuxController::activateAll() {
+  QJsonArray hops;
+  for (const HopConnection& hop : m_activationQueue) {
+    hops.append(m_dbus->hopConfig(
+        hop.m_server, m_device, m_keys, hop.m_hopindex,
+        hop.m_allowedIPAddressRanges, hop.m_excludedAddresses,
+        hop.m_vpnDisabledApps, hop.m_dnsServer));
+  }
+
+  connect(m_dbus->activateMultihop(hops), &QDBusPendingCallWatcher::finished,
+          this, &LinuxController::multihopCompleted);
+}
+
 void LinuxController::activateNext() {
   const HopConnection& hop = m_activationQueue.first();
   connect(
@@ -168,23 +212,54 @@ void LinuxController::operationCompleted(QDBusPendingCallWatcher* call) {
   emit disconnected();
 }
 
+void LinuxController::multihopCompleted(QDBusPendingCallWatcher* call) {
+  QDBusPendingReply<QString> reply = *call;
+  if (reply.isError()) {
+    logger.error() << "Error received from the DBus service";
+    MozillaVPN::instance()->errorHandle(ErrorHandler::ControllerError);
+    emit disconnected();
+    return;
+  }
+
+  QJsonObject obj =
+      QJsonDocument::fromJson(reply.argumentAt<0>().toLocal8Bit()).object();
+  for (const QJsonValue& hop : obj.value("hops").toArray()) {
+    QJsonObject result = hop.toObject();
+    logger.debug() << "Hop" << result.value("hopindex").toInt()
+                   << "status:" << result.value("status").toBool();
+  }
+
+  if (obj.value("status").toBool()) {
+    logger.debug() << "DBus service says: all good.";
+    // we will receive the connected() signal for each hop;
+    return;
+  }
+
+  logger.error() << "DBus service says: error.";
+  MozillaVPN::instance()->errorHandle(ErrorHandler::ControllerError);
+  emit disconnected();
+}
+
 // When the daemon reports that a peer connected, activate the next
 // connection in the queue, or emit a connected() signal when we are done.
+// When all the hops have been activated together, their handshakes can
+// complete in any order.
 void LinuxController::peerConnected(const QString& pubkey) {
   logger.debug() << "handshake completed with:" << pubkey;
-  if (m_activationQueue.isEmpty()) {
-    return;
-  }
 
-  const HopConnection& hop = m_activationQueue.first();
-  if (hop.m_server.publicKey() != pubkey) {
+  int index = 0;
+  while (index < m_activationQueue.count() &&
+         m_activationQueue[index].m_server.publicKey() != pubkey) {
+    ++index;
+  }
+  if (index >= m_activationQueue.count() || (!m_multihopBatch && index > 0)) {
     return;
   }
 
-  m_activationQueue.removeFirst();
+  m_activationQueue.removeAt(index);
   if (m_activationQueue.isEmpty()) {
     emit connected();
-  } else {
+  } else if (!m_multihopBatch) {
     activateNext();
   }
 }
@@ -192,11 +267,35 @@ void LinuxController::peerConnected(const QString& pubkey) {
 void LinuxController::checkStatus() {
   logger.debug() << "Check status";
 
+  if (m_dbus->daemonVersion() >= DAEMON_PROTOCOL_VERSION_TYPED_STATUS) {
+    QDBusPendingCallWatcher* watcher = m_dbus->connectionStatus();
+    connect(watcher, &QDBusPendingCallWatcher::finished, this,
+            &LinuxController::connectionStatusCompleted);
+    return;
+  }
+
   QDBusPendingCallWatcher* watcher = m_dbus->status();
   connect(watcher, &QDBusPendingCallWatcher::finished, this,
           &LinuxController::checkStatusCompleted);
 }
 
+void LinuxController::connectionStatusCompleted(QDBusPendingCallWatcher* call) {
+  QDBusPendingReply<DaemonStatus> reply = *call;
+  if (reply.isError()) {
+    logger.error() << "Error received from the DBus service";
+    return;
+  }
+
+  DaemonStatus status = reply.argumentAt<0>();
+  if (!status.connected) {
+    logger.error() << "Unable to retrieve the status from the interface.";
+    return;
+  }
+
+  emit statusUpdated(status.serverIpv4Gateway, status.deviceIpv4Address,
+                     status.txBytes, status.rxBytes);
+}
+
 void LinuxController::checkStatusCompleted(QDBusPendingCallWatcher* call) {
   QDBusPendingReply<QString> reply = *call;
   if (reply.isError()) {
@@ -240,6 +339,69 @@ void LinuxController::checkStatusCompleted(QDBusPendingCallWatcher* call) {
                      txBytes.toDouble(), rxBytes.toDouble());
 }
 
+bool LinuxController::subscribeStatus(int intervalMsec) {
+  if (m_dbus->daemonVersion() < DAEMON_PROTOCOL_VERSION_STATUS_STREAM) {
+    return false;
+  }
+
+  logger.debug() << "Subscribe status";
+  m_statusSubscribed = true;
+
+  QDBusPendingCallWatcher* watcher = m_dbus->subscribeStatus(intervalMsec);
+  connect(watcher, &QDBusPendingCallWatcher::finished, this,
+          [](QDBusPendingCallWatcher* call) {
+            QDBusPendingReply<> reply = *call;
+            if (reply.isError()) {
+              logger.error() << "Status subscription failed";
+            }
+          });
+  return true;
+}
+
+void LinuxController::unsubscribeStatus() {
+  if (!m_statusSubscribed && !m_countersSubscribed) {
+    return;
+  }
+
+  logger.debug() << "Unsubscribe status";
+  m_statusSubscribed = false;
+  m_countersSubscribed = false;
+  m_dbus->unsubscribeStatus();
+}
+
+bool LinuxController::subscribeCounters() {
+  if (m_dbus->daemonVersion() < DAEMON_PROTOCOL_VERSION_COUNTERS_PAGE) {
+    return false;
+  }
+
+  logger.debug() << "Subscribe counters";
+  m_countersSubscribed = true;
+
+  QDBusPendingCallWatcher* watcher = m_dbus->subscribeCounters();
+  connect(watcher, &QDBusPendingCallWatcher::finished, this,
+          [this](QDBusPendingCallWatcher* call) {
+            QDBusPendingReply<bool> reply = *call;
+            if (reply.isError()) {
+              logger.error() << "Counters subscription failed";
+            }
+            emit countersSubscribed(!reply.isError() && reply.value());
+          });
+  return true;
+}
+
+// The DBus signal reaches all the clients: ignore it if not subscribed.
+void LinuxController::statusChanged(const QString& serverIpv4Gateway,
+                                    const QString& deviceIpv4Address,
+                                    qulonglong txBytes, qulonglong rxBytes,
+                                    qlonglong handshakeAge) {
+  if (!m_statusSubscribed) {
+    return;
+  }
+
+  logger.debug() << "Status changed - handshake age:" << handshakeAge;
+  emit statusStreamed(serverIpv4Gateway, deviceIpv4Address, txBytes, rxBytes);
+}
+
 void LinuxController::getBackendLogs(
     std::function<void(const QString&)>&& a_callback) {
   std::function<void(const QString&)> callback = std::move(a_callback);
@@ -251,3 +413,5 @@ void LinuxController::getBackendLogs(
 }
 
 void LinuxController::cleanupBackendLogs() { m_dbus->cleanupLogs(); }
+
+QJsonObject LinuxController::metrics() const { return m_dbus->metrics(); }
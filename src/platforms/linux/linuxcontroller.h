@@ -33,18 +33,33 @@ class LinuxController final : public ControllerImpl {
 
   void checkStatus() override;
 
+  bool subscribeStatus(int intervalMsec) override;
+
+  void unsubscribeStatus() override;
+
+  bool subscribeCounters() override;
+
   void getBackendLogs(std::function<void(const QString&)>&& callback) override;
 
   void cleanupBackendLogs() override;
 
+  QJsonObject metrics() const override;
+
  private slots:
   void checkStatusCompleted(QDBusPendingCallWatcher* call);
+  void connectionStatusCompleted(QDBusPendingCallWatcher* call);
+  void versionCompleted(QDBusPendingCallWatcher* call);
   void initializeCompleted(QDBusPendingCallWatcher* call);
   void operationCompleted(QDBusPendingCallWatcher* call);
+  void multihopCompleted(QDBusPendingCallWatcher* call);
   void peerConnected(const QString& pubkey);
+  void statusChanged(const QString& serverIpv4Gateway,
+                     const QString& deviceIpv4Address, qulonglong txBytes,
+                     qulonglong rxBytes, qlonglong handshakeAge);
 
  private:
   void activateNext();
+  void activateAll();
 
  private:
   class HopConnection {
@@ -58,6 +73,9 @@ class LinuxController final : public ControllerImpl {
     QHostAddress m_dnsServer;
   };
   QList<HopConnection> m_activationQueue;
+  bool m_multihopBatch = false;
+  bool m_statusSubscribed = false;
+  bool m_countersSubscribed = false;
   const Device* m_device = nullptr;
   const Keys* m_keys = nullptr;
 
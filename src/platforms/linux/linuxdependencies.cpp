@@ -3,6 +3,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "linuxdependencies.h"
+#include "daemon/daemonprotocol.h"
 #include "dbusclient.h"
 #include "logger.h"
 
@@ -45,8 +46,12 @@ bool checkDaemonVersion() {
           return;
         }
 
+        // Older daemons are still supported: the client falls back to the
+        // features they know about.
         QString version = reply.argumentAt<0>();
-        *value = version == PROTOCOL_VERSION;
+        int versionNumber = version.toInt();
+        *value = versionNumber >= DAEMON_PROTOCOL_VERSION_MIN &&
+                 versionNumber <= DAEMON_PROTOCOL_VERSION;
 
         logger.debug() << "DBus message received - daemon version:" << version
                        << " - current version:" << PROTOCOL_VERSION;
@@ -34,6 +34,8 @@ MacOSDaemon::MacOSDaemon() : Daemon(nullptr) {
 
   Q_ASSERT(s_daemon == nullptr);
   s_daemon = this;
+
+  publishCounters(COUNTERS_PAGE_NAME);
 }
 
 MacOSDaemon::~MacOSDaemon() {
@@ -3,8 +3,14 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "rfc1112.h"
+#include "rfcprefix.h"
+
+namespace {
+// 224.0.0.0/4
+constexpr RFCIPv4Prefix s_multicast = {0xE0000000, 4};
+}  // namespace
 
 // static
 IPAddress RFC1112::ipv4MulticastAddressBlock() {
-  return IPAddress("224.0.0.0/4");
+  return s_multicast.toIPAddress();
 }
@@ -3,25 +3,20 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "rfc1918.h"
+#include "rfcprefix.h"
 
-// static
-QList<IPAddress> RFC1918::ipv4() {
-  QList<IPAddress> list;
-
-  // From RFC1918: https://tools.ietf.org/html/rfc1918
-  list.append(IPAddress("10.0.0.0/8"));
-  list.append(IPAddress("172.16.0.0/12"));
-  list.append(IPAddress("192.168.0.0/16"));
+namespace {
+// From RFC1918: https://tools.ietf.org/html/rfc1918
+constexpr RFCIPv4Prefix s_ipv4[] = {
+    {0x0A000000, 8},   // 10.0.0.0/8
+    {0xAC100000, 12},  // 172.16.0.0/12
+    {0xC0A80000, 16},  // 192.168.0.0/16
+};
+}  // namespace
 
-  return list;
-}
+// static
+QList<IPAddress> RFC1918::ipv4() { return RFCIPv4Prefix::toList(s_ipv4); }
 
 bool RFC1918::contains(const QHostAddress& ip) {
-  QList<IPAddress> list = ipv4();
-  foreach (const IPAddress& addr, list) {
-    if (addr.contains(ip)) {
-      return true;
-    }
-  }
-  return false;
+  return RFCIPv4Prefix::contains(s_ipv4, ip);
 }
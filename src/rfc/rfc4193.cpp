@@ -3,22 +3,17 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "rfc4193.h"
+#include "rfcprefix.h"
 
-// static
-QList<IPAddress> RFC4193::ipv6() {
-  QList<IPAddress> list;
-
-  list.append(IPAddress("fc00::/7"));
+namespace {
+constexpr RFCIPv6Prefix s_ipv6[] = {
+    {0xFC00000000000000, 0, 7},  // fc00::/7
+};
+}  // namespace
 
-  return list;
-}
+// static
+QList<IPAddress> RFC4193::ipv6() { return RFCIPv6Prefix::toList(s_ipv6); }
 
 bool RFC4193::contains(const QHostAddress& ip) {
-  QList<IPAddress> list = ipv6();
-  foreach (const IPAddress& addr, list) {
-    if (addr.contains(ip)) {
-      return true;
-    }
-  }
-  return false;
+  return RFCIPv6Prefix::contains(s_ipv6, ip);
 }
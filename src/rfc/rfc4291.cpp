@@ -3,9 +3,21 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "rfc4291.h"
+#include "rfcprefix.h"
+
+namespace {
+// ::1/128
+constexpr RFCIPv6Prefix s_loopback = {0, 1, 128};
+// ff00::/8
+constexpr RFCIPv6Prefix s_multicast = {0xFF00000000000000, 0, 8};
+}  // namespace
 
 // static
-IPAddress RFC4291::ipv6LoopbackAddressBlock() { return IPAddress("::1/128"); }
+IPAddress RFC4291::ipv6LoopbackAddressBlock() {
+  return s_loopback.toIPAddress();
+}
 
 // static
-IPAddress RFC4291::ipv6MulticastAddressBlock() { return IPAddress("ff00::/8"); }
+IPAddress RFC4291::ipv6MulticastAddressBlock() {
+  return s_multicast.toIPAddress();
+}
@@ -3,9 +3,15 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "rfc5735.h"
+#include "rfcprefix.h"
+
+namespace {
+// https://datatracker.ietf.org/doc/html/rfc5735#section-3
+// 127.0.0.0/8
+constexpr RFCIPv4Prefix s_loopback = {0x7F000000, 8};
+}  // namespace
 
 // static
 IPAddress RFC5735::ipv4LoopbackAddressBlock() {
-  // https://datatracker.ietf.org/doc/html/rfc5735#section-3
-  return IPAddress("127.0.0.0/8");
+  return s_loopback.toIPAddress();
 }
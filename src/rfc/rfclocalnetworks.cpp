@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "rfclocalnetworks.h"
+#include "rfcprefix.h"
+
+namespace {
+// 0.0.0.0/0 minus 10.0.0.0/8, 172.16.0.0/12, 192.168.0.0/16 and 224.0.0.0/4.
+constexpr RFCIPv4Prefix s_ipv4Complement[] = {
+    {0x00000000, 5},   // 0.0.0.0/5
+    {0x08000000, 7},   // 8.0.0.0/7
+    {0x0B000000, 8},   // 11.0.0.0/8
+    {0x0C000000, 6},   // 12.0.0.0/6
+    {0x10000000, 4},   // 16.0.0.0/4
+    {0x20000000, 3},   // 32.0.0.0/3
+    {0x40000000, 2},   // 64.0.0.0/2
+    {0x80000000, 3},   // 128.0.0.0/3
+    {0xA0000000, 5},   // 160.0.0.0/5
+    {0xA8000000, 6},   // 168.0.0.0/6
+    {0xAC000000, 12},  // 172.0.0.0/12
+    {0xAC200000, 11},  // 172.32.0.0/11
+    {0xAC400000, 10},  // 172.64.0.0/10
+    {0xAC800000, 9},   // 172.128.0.0/9
+    {0xAD000000, 8},   // 173.0.0.0/8
+    {0xAE000000, 7},   // 174.0.0.0/7
+    {0xB0000000, 4},   // 176.0.0.0/4
+    {0xC0000000, 9},   // 192.0.0.0/9
+    {0xC0800000, 11},  // 192.128.0.0/11
+    {0xC0A00000, 13},  // 192.160.0.0/13
+    {0xC0A90000, 16},  // 192.169.0.0/16
+    {0xC0AA0000, 15},  // 192.170.0.0/15
+    {0xC0AC0000, 14},  // 192.172.0.0/14
+    {0xC0B00000, 12},  // 192.176.0.0/12
+    {0xC0C00000, 10},  // 192.192.0.0/10
+    {0xC1000000, 8},   // 193.0.0.0/8
+    {0xC2000000, 7},   // 194.0.0.0/7
+    {0xC4000000, 6},   // 196.0.0.0/6
+    {0xC8000000, 5},   // 200.0.0.0/5
+    {0xD0000000, 4},   // 208.0.0.0/4
+    {0xF0000000, 4},   // 240.0.0.0/4
+};
+
+// ::/0 minus fc00::/7 and ff00::/8.
+constexpr RFCIPv6Prefix s_ipv6Complement[] = {
+    {0x0000000000000000, 0, 1},  // ::/1
+    {0x8000000000000000, 0, 2},  // 8000::/2
+    {0xC000000000000000, 0, 3},  // c000::/3
+    {0xE000000000000000, 0, 4},  // e000::/4
+    {0xF000000000000000, 0, 5},  // f000::/5
+    {0xF800000000000000, 0, 6},  // f800::/6
+    {0xFE00000000000000, 0, 8},  // fe00::/8
+};
+}  // namespace
+
+// static
+QList<IPAddress> RFCLocalNetworks::ipv4Complement() {
+  return RFCIPv4Prefix::toList(s_ipv4Complement);
+}
+
+// static
+QList<IPAddress> RFCLocalNetworks::ipv6Complement() {
+  return RFCIPv6Prefix::toList(s_ipv6Complement);
+}
@@ -0,0 +1,23 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef RFCLOCALNETWORKS_H
+#define RFCLOCALNETWORKS_H
+
+#include "ipaddress.h"
+
+#include <QList>
+
+// The "catch-all minus LAN" address sets, used when the local area network
+// access is enabled. These are the complements of the RFC1918 and RFC1112
+// (multicast) blocks for IPv4, and of the RFC4193 and RFC4291 (multicast)
+// blocks for IPv6. They are precomputed: see the unit-tests to validate them
+// against IPAddress::excludeAddresses().
+class RFCLocalNetworks final {
+ public:
+  static QList<IPAddress> ipv4Complement();
+  static QList<IPAddress> ipv6Complement();
+};
+
+#endif  // RFCLOCALNETWORKS_H
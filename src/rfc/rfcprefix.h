@@ -0,0 +1,125 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef RFCPREFIX_H
+#define RFCPREFIX_H
+
+#include "ipaddress.h"
+
+#include <QList>
+
+// Compile-time descriptions of the address blocks defined by the RFCs. They
+// are converted into IPAddress objects without any string parsing, and they
+// can be matched against a QHostAddress with plain integer operations.
+
+struct RFCIPv4Prefix final {
+  quint32 address;
+  int prefixLength;
+
+  constexpr quint32 netmask() const {
+    return prefixLength == 0 ? 0 : 0xFFFFFFFF << (32 - prefixLength);
+  }
+
+  constexpr bool contains(quint32 ip) const {
+    return ((ip ^ address) & netmask()) == 0;
+  }
+
+  IPAddress toIPAddress() const {
+    return IPAddress(QHostAddress(address), prefixLength);
+  }
+
+  template <size_t N>
+  static QList<IPAddress> toList(const RFCIPv4Prefix (&prefixes)[N]) {
+    QList<IPAddress> list;
+    list.reserve(N);
+    for (const RFCIPv4Prefix& prefix : prefixes) {
+      list.append(prefix.toIPAddress());
+    }
+    return list;
+  }
+
+  template <size_t N>
+  static bool contains(const RFCIPv4Prefix (&prefixes)[N],
+                       const QHostAddress& address) {
+    if (address.protocol() != QAbstractSocket::IPv4Protocol) {
+      return false;
+    }
+
+    quint32 ip = address.toIPv4Address();
+    for (const RFCIPv4Prefix& prefix : prefixes) {
+      if (prefix.contains(ip)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+struct RFCIPv6Prefix final {
+  // The address is stored as two 64-bit words in host byte order.
+  quint64 high;
+  quint64 low;
+  int prefixLength;
+
+  constexpr quint64 highNetmask() const {
+    return prefixLength >= 64  ? ~quint64(0)
+           : prefixLength == 0 ? 0
+                               : ~quint64(0) << (64 - prefixLength);
+  }
+
+  constexpr quint64 lowNetmask() const {
+    return prefixLength <= 64    ? 0
+           : prefixLength >= 128 ? ~quint64(0)
+                                 : ~quint64(0) << (128 - prefixLength);
+  }
+
+  constexpr bool contains(quint64 ipHigh, quint64 ipLow) const {
+    return ((ipHigh ^ high) & highNetmask()) == 0 &&
+           ((ipLow ^ low) & lowNetmask()) == 0;
+  }
+
+  IPAddress toIPAddress() const {
+    Q_IPV6ADDR raw;
+    for (int i = 0; i < 8; ++i) {
+      raw[i] = (quint8)(high >> (56 - i * 8));
+      raw[i + 8] = (quint8)(low >> (56 - i * 8));
+    }
+    return IPAddress(QHostAddress(raw), prefixLength);
+  }
+
+  template <size_t N>
+  static QList<IPAddress> toList(const RFCIPv6Prefix (&prefixes)[N]) {
+    QList<IPAddress> list;
+    list.reserve(N);
+    for (const RFCIPv6Prefix& prefix : prefixes) {
+      list.append(prefix.toIPAddress());
+    }
+    return list;
+  }
+
+  template <size_t N>
+  static bool contains(const RFCIPv6Prefix (&prefixes)[N],
+                       const QHostAddress& address) {
+    if (address.protocol() != QAbstractSocket::IPv6Protocol) {
+      return false;
+    }
+
+    Q_IPV6ADDR raw = address.toIPv6Address();
+    quint64 ipHigh = 0;
+    quint64 ipLow = 0;
+    for (int i = 0; i < 8; ++i) {
+      ipHigh = (ipHigh << 8) | raw[i];
+      ipLow = (ipLow << 8) | raw[i + 8];
+    }
+
+    for (const RFCIPv6Prefix& prefix : prefixes) {
+      if (prefix.contains(ipHigh, ipLow)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif  // RFCPREFIX_H
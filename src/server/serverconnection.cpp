@@ -17,6 +17,7 @@
 #include <QJsonObject>
 #include <QMetaEnum>
 #include <QTcpSocket>
+#include <QtEndian>
 
 constexpr uint32_t MAX_MSG_SIZE = 1024 * 1024;
 
@@ -182,20 +183,17 @@ ServerConnection::~ServerConnection() {
 
 void ServerConnection::readData() {
   QByteArray input = m_connection->readAll();
-  m_buffer.append(input);
+  m_reader.append(input);
 
   while (true) {
     switch (m_state) {
       case ReadingLength: {
-        if (m_buffer.length() < 4) {
+        QByteArray messageLength;
+        if (!m_reader.read(sizeof(uint32_t), messageLength)) {
           return;
         }
 
-        QByteArray messageLength = m_buffer.left(4);
-        m_buffer.remove(0, 4);
-
-        m_messageLength =
-            *reinterpret_cast<const uint32_t*>(messageLength.constData());
+        m_messageLength = qFromUnaligned<uint32_t>(messageLength.constData());
 
         if (!m_messageLength || m_messageLength > MAX_MSG_SIZE) {
           m_connection->close();
@@ -208,13 +206,11 @@ void ServerConnection::readData() {
       }
 
       case ReadingBody: {
-        if (m_buffer.length() < (int)m_messageLength) {
+        QByteArray message;
+        if (!m_reader.read(m_messageLength, message)) {
           return;
         }
 
-        QByteArray message = m_buffer.left(m_messageLength);
-        m_buffer.remove(0, m_messageLength);
-
         processMessage(message);
 
         m_messageLength = 0;
@@ -5,6 +5,8 @@
 #ifndef SERVERCONNECTION_H
 #define SERVERCONNECTION_H
 
+#include "framereader.h"
+
 #include <QByteArray>
 #include <QObject>
 
@@ -40,7 +42,7 @@ class ServerConnection final : public QObject {
     ReadingBody,
   } m_state = ReadingLength;
 
-  QByteArray m_buffer;
+  FrameReader m_reader;
   uint32_t m_messageLength = 0;
 };
 
@@ -83,6 +83,7 @@ SOURCES += \
         connectionhealth.cpp \
         constants.cpp \
         controller.cpp \
+        counterspage.cpp \
         cryptosettings.cpp \
         curve25519.cpp \
         dnshelper.cpp \
@@ -90,6 +91,7 @@ SOURCES += \
         featurelist.cpp \
         filterproxymodel.cpp \
         fontloader.cpp \
+        framereader.cpp \
         hacl-star/Hacl_Chacha20.c \
         hacl-star/Hacl_Chacha20Poly1305_32.c \
         hacl-star/Hacl_Curve25519_51.c \
@@ -100,7 +102,9 @@ SOURCES += \
         inspector/inspectorwebsocketconnection.cpp \
         inspector/inspectorwebsocketserver.cpp \
         ipaddress.cpp \
+        ipaddressclassifier.cpp \
         l18nstringsimpl.cpp \
+        latencyhistogram.cpp \
         leakdetector.cpp \
         localizer.cpp \
         logger.cpp \
@@ -129,6 +133,7 @@ SOURCES += \
         networkrequest.cpp \
         networkwatcher.cpp \
         notificationhandler.cpp \
+        pendingrequests.cpp \
         pinghelper.cpp \
         pingsender.cpp \
         platforms/dummy/dummyapplistprovider.cpp \
@@ -142,6 +147,7 @@ SOURCES += \
         rfc/rfc4193.cpp \
         rfc/rfc4291.cpp \
         rfc/rfc5735.cpp \
+        rfc/rfclocalnetworks.cpp \
         serveri18n.cpp \
         settingsholder.cpp \
         simplenetworkmanager.cpp \
@@ -204,6 +210,7 @@ HEADERS += \
         constants.h \
         controller.h \
         controllerimpl.h \
+        counterspage.h \
         cryptosettings.h \
         curve25519.h \
         dnshelper.h \
@@ -225,12 +232,15 @@ HEADERS += \
         features/featureunsecurednetworknotification.h \
         filterproxymodel.h \
         fontloader.h \
+        framereader.h \
         hawkauth.h \
         hkdf.h \
         iaphandler.h \
         inspector/inspectorwebsocketconnection.h \
         inspector/inspectorwebsocketserver.h \
         ipaddress.h \
+        ipaddressclassifier.h \
+        latencyhistogram.h \
         leakdetector.h \
         localizer.h \
         logger.h \
@@ -259,6 +269,7 @@ HEADERS += \
         networkwatcher.h \
         networkwatcherimpl.h \
         notificationhandler.h \
+        pendingrequests.h \
         pinghelper.h \
         pingsender.h \
         platforms/dummy/dummyapplistprovider.h \
@@ -272,6 +283,8 @@ HEADERS += \
         rfc/rfc4193.h \
         rfc/rfc4291.h \
         rfc/rfc5735.h \
+        rfc/rfclocalnetworks.h \
+        rfc/rfcprefix.h \
         serveri18n.h \
         settingsholder.h \
         simplenetworkmanager.h \
@@ -388,6 +401,9 @@ else:linux:!android {
     CONFIG += c++14
 
     DEFINES += MVPN_LINUX
+
+    # shm_open() is in librt before glibc 2.34.
+    LIBS += -lrt
     DEFINES += PROTOCOL_VERSION=\\\"$$DBUS_PROTOCOL_VERSION\\\"
 
     SOURCES += \
@@ -425,29 +441,44 @@ else:linux:!android {
     SOURCES += \
             ../3rdparty/wireguard-tools/contrib/embeddable-wg-library/wireguard.c \
             daemon/daemon.cpp \
+            daemon/handshakewatcher.cpp \
+            daemon/querydispatcher.cpp \
             platforms/linux/daemon/apptracker.cpp \
             platforms/linux/daemon/dbusservice.cpp \
             platforms/linux/daemon/dnsutilslinux.cpp \
+            platforms/linux/daemon/endpointresolver.cpp \
             platforms/linux/daemon/iputilslinux.cpp \
             platforms/linux/daemon/linuxdaemon.cpp \
             platforms/linux/daemon/pidtracker.cpp \
             platforms/linux/daemon/polkithelper.cpp \
+            platforms/linux/daemon/routemonitor.cpp \
+            platforms/linux/daemon/wireguarddevicebuilder.cpp \
+            platforms/linux/daemon/wireguardpeerwriter.cpp \
+            platforms/linux/daemon/wireguardstatslinux.cpp \
             platforms/linux/daemon/wireguardutilslinux.cpp
 
     HEADERS += \
             ../3rdparty/wireguard-tools/contrib/embeddable-wg-library/wireguard.h \
             daemon/interfaceconfig.h \
             daemon/daemon.h \
+            daemon/daemonprotocol.h \
             daemon/dnsutils.h \
+            daemon/handshakewatcher.h \
             daemon/iputils.h \
+            daemon/querydispatcher.h \
             daemon/wireguardutils.h \
             platforms/linux/daemon/apptracker.h \
             platforms/linux/daemon/dbusservice.h \
             platforms/linux/daemon/dbustypeslinux.h \
             platforms/linux/daemon/dnsutilslinux.h \
+            platforms/linux/daemon/endpointresolver.h \
             platforms/linux/daemon/iputilslinux.h \
             platforms/linux/daemon/pidtracker.h \
             platforms/linux/daemon/polkithelper.h \
+            platforms/linux/daemon/routemonitor.h \
+            platforms/linux/daemon/wireguarddevicebuilder.h \
+            platforms/linux/daemon/wireguardpeerwriter.h \
+            platforms/linux/daemon/wireguardstatslinux.h \
             platforms/linux/daemon/wireguardutilslinux.h
 
     isEmpty(USRPATH) {
@@ -459,6 +490,8 @@ else:linux:!android {
 
     DBUS_ADAPTORS += platforms/linux/daemon/org.mozilla.vpn.dbus.xml
     DBUS_INTERFACES = platforms/linux/daemon/org.mozilla.vpn.dbus.xml
+    QDBUSXML2CPP_ADAPTOR_HEADER_FLAGS += -i platforms/linux/daemon/dbustypeslinux.h
+    QDBUSXML2CPP_INTERFACE_HEADER_FLAGS += -i platforms/linux/daemon/dbustypeslinux.h
 
     GO_MODULES = ../linux/netfilter/netfilter.go
 
@@ -696,8 +729,10 @@ else:macos {
 
         SOURCES += \
                    daemon/daemon.cpp \
+                   daemon/daemonframe.cpp \
                    daemon/daemonlocalserver.cpp \
                    daemon/daemonlocalserverconnection.cpp \
+                   daemon/handshakewatcher.cpp \
                    localsocketcontroller.cpp \
                    wgquickprocess.cpp \
                    platforms/macos/daemon/dnsutilsmacos.cpp \
@@ -709,9 +744,12 @@ else:macos {
         HEADERS += \
                    daemon/interfaceconfig.h \
                    daemon/daemon.h \
+                   daemon/daemonframe.h \
+                   daemon/daemonprotocol.h \
                    daemon/daemonlocalserver.h \
                    daemon/daemonlocalserverconnection.h \
                    daemon/dnsutils.h \
+                   daemon/handshakewatcher.h \
                    daemon/iputils.h \
                    daemon/wireguardutils.h \
                    localsocketcontroller.h \
@@ -837,8 +875,10 @@ else:win* {
 
     SOURCES += \
         daemon/daemon.cpp \
+        daemon/daemonframe.cpp \
         daemon/daemonlocalserver.cpp \
         daemon/daemonlocalserverconnection.cpp \
+        daemon/handshakewatcher.cpp \
         eventlistener.cpp \
         localsocketcontroller.cpp \
         platforms/windows/windowsapplistprovider.cpp  \
@@ -868,9 +908,12 @@ else:win* {
     HEADERS += \
         daemon/interfaceconfig.h \
         daemon/daemon.h \
+        daemon/daemonframe.h \
+        daemon/daemonprotocol.h \
         daemon/daemonlocalserver.h \
         daemon/daemonlocalserverconnection.h \
         daemon/dnsutils.h \
+        daemon/handshakewatcher.h \
         daemon/iputils.h \
         daemon/wireguardutils.h \
         eventlistener.h \
@@ -24,6 +24,10 @@ TimerController::TimerController(ControllerImpl* impl) : m_impl(impl) {
           [this] { TimerController::maybeDone(false); });
   connect(m_impl, &ControllerImpl::statusUpdated, this,
           &ControllerImpl::statusUpdated);
+  connect(m_impl, &ControllerImpl::statusStreamed, this,
+          &ControllerImpl::statusStreamed);
+  connect(m_impl, &ControllerImpl::countersSubscribed, this,
+          &ControllerImpl::countersSubscribed);
 
   m_timer.setSingleShot(true);
   connect(&m_timer, &QTimer::timeout, this, &TimerController::timeout);
@@ -150,6 +154,20 @@ void TimerController::maybeDone(bool isConnected) {
 
 void TimerController::checkStatus() { m_impl->checkStatus(); }
 
+bool TimerController::requestStatus(StatusCallback&& callback) {
+  return m_impl->requestStatus(std::move(callback));
+}
+
+bool TimerController::subscribeStatus(int intervalMsec) {
+  return m_impl->subscribeStatus(intervalMsec);
+}
+
+void TimerController::unsubscribeStatus() { m_impl->unsubscribeStatus(); }
+
+bool TimerController::subscribeCounters() {
+  return m_impl->subscribeCounters();
+}
+
 void TimerController::getBackendLogs(
     std::function<void(const QString&)>&& a_callback) {
   std::function<void(const QString&)> callback = std::move(a_callback);
@@ -157,3 +175,5 @@ void TimerController::getBackendLogs(
 }
 
 void TimerController::cleanupBackendLogs() { m_impl->cleanupBackendLogs(); }
+
+QJsonObject TimerController::metrics() const { return m_impl->metrics(); }
@@ -37,10 +37,20 @@ class TimerController final : public ControllerImpl {
 
   void checkStatus() override;
 
+  bool requestStatus(StatusCallback&& callback) override;
+
+  bool subscribeStatus(int intervalMsec) override;
+
+  void unsubscribeStatus() override;
+
+  bool subscribeCounters() override;
+
   void getBackendLogs(std::function<void(const QString&)>&& callback) override;
 
   void cleanupBackendLogs() override;
 
+  QJsonObject metrics() const override;
+
  private slots:
   void timeout();
 
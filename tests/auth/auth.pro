@@ -56,6 +56,7 @@ HEADERS += \
     ../../src/rfc/rfc4193.h \
     ../../src/rfc/rfc4291.h \
     ../../src/rfc/rfc5735.h \
+    ../../src/rfc/rfcprefix.h \
     ../../src/settingsholder.h \
     ../../src/simplenetworkmanager.h \
     ../../src/task.h \
@@ -0,0 +1,241 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef DUMMYDAEMON_H
+#define DUMMYDAEMON_H
+
+#include "../../src/daemon/daemon.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QPair>
+#include <QSet>
+
+#include <limits>
+
+// How long a peer needs to complete its handshake once added.
+constexpr qint64 HANDSHAKE_DELAY_MSEC = 100;
+
+// A wireguard interface which keeps track of its peers, routes and
+// exclusions. The transfer counters of the peers are set by the tests.
+//
+// It can also measure the blackhole: how long some routed prefix has had no
+// peer able to carry its traffic, either because no peer has it in its
+// allowed-IPs, or because the handshake of its peer is not completed.
+class DummyWireguardUtils final : public WireguardUtils {
+ public:
+  DummyWireguardUtils(QObject* parent, bool standby)
+      : WireguardUtils(parent), m_standby(standby) {
+    m_clock.start();
+    m_epoch = QDateTime::currentMSecsSinceEpoch();
+  }
+
+  bool interfaceExists() override { return m_exists; }
+  bool addInterface(const InterfaceConfig&) override {
+    m_exists = true;
+    return true;
+  }
+  bool deleteInterface() override {
+    meter();
+    m_exists = false;
+    m_peers.clear();
+    m_routes.clear();
+    return true;
+  }
+
+  bool updatePeer(const InterfaceConfig& config) override {
+    ++m_peerUpdates;
+    setPeer(config.m_serverPublicKey, config.m_allowedIPAddressRanges);
+    return true;
+  }
+  bool deletePeer(const InterfaceConfig& config) override {
+    meter();
+    m_peers.remove(config.m_serverPublicKey);
+    return true;
+  }
+
+  bool supportStandbyPeer() const override { return m_standby; }
+  bool addStandbyPeer(const InterfaceConfig& config) override {
+    ++m_peerUpdates;
+    setPeer(config.m_serverPublicKey, QList<IPAddress>());
+    return true;
+  }
+  // A failed promotion leaves the previous peer in place, without the new
+  // one.
+  bool promoteStandbyPeer(const InterfaceConfig& config,
+                          const InterfaceConfig& previous) override {
+    meter();
+    if (m_failPromote) {
+      m_peers.remove(config.m_serverPublicKey);
+      return false;
+    }
+    m_peers.remove(previous.m_serverPublicKey);
+    setPeer(config.m_serverPublicKey, config.m_allowedIPAddressRanges);
+    return true;
+  }
+
+  QList<PeerStatus> getPeerStatus() override {
+    QList<PeerStatus> peers;
+    for (const QString& pubkey : m_peers.keys()) {
+      PeerStatus status(pubkey);
+      if (m_clock.elapsed() >= ready(pubkey)) {
+        status.m_handshake = m_epoch + ready(pubkey);
+      }
+      status.m_txBytes = m_transfer.value(pubkey).first;
+      status.m_rxBytes = m_transfer.value(pubkey).second;
+      peers.append(status);
+    }
+    return peers;
+  }
+
+  bool updateRoutePrefix(const IPAddress& prefix, int) override {
+    meter();
+    ++m_routeUpdates;
+    if (!m_routes.contains(prefix)) {
+      m_routes.append(prefix);
+    }
+    return true;
+  }
+  bool deleteRoutePrefix(const IPAddress& prefix, int) override {
+    meter();
+    m_routes.removeAll(prefix);
+    return true;
+  }
+  bool addExclusionRoute(const QHostAddress& address) override {
+    m_exclusions.insert(address);
+    return true;
+  }
+  bool deleteExclusionRoute(const QHostAddress& address) override {
+    m_exclusions.remove(address);
+    return true;
+  }
+
+  QStringList peers() const { return m_peers.keys(); }
+  QList<IPAddress> allowedIPs(const QString& pubkey) const {
+    return m_peers.value(pubkey);
+  }
+  QList<IPAddress> routes() const { return m_routes; }
+  QSet<QHostAddress> exclusions() const { return m_exclusions; }
+
+  void setFailPromote(bool fail) { m_failPromote = fail; }
+
+  // How many times the peers and the routes have been configured.
+  int peerUpdates() const { return m_peerUpdates; }
+  int routeUpdates() const { return m_routeUpdates; }
+
+  void setTransfer(const QString& pubkey, qint64 txBytes, qint64 rxBytes) {
+    m_transfer[pubkey] = qMakePair(txBytes, rxBytes);
+  }
+
+  // The blackhole is measured from this call on.
+  void startBlackholeMeter() {
+    m_metering = true;
+    m_blackhole = 0;
+    m_segmentStart = m_clock.elapsed();
+  }
+
+  // The blackhole measured so far, in milliseconds.
+  qint64 blackhole() {
+    meter();
+    return m_blackhole;
+  }
+
+ private:
+  // Adds the blackhole since the previous change, with the configuration in
+  // place until now. Called before each change.
+  void meter() {
+    qint64 now = m_clock.elapsed();
+    if (m_metering) {
+      qint64 usable = qMax(usableSince(), m_segmentStart);
+      m_blackhole += qMin(usable, now) - m_segmentStart;
+    }
+    m_segmentStart = now;
+  }
+
+  // When all the routed prefixes can be carried by a peer, if nothing
+  // changes.
+  qint64 usableSince() const {
+    qint64 usable = 0;
+    for (const IPAddress& route : m_routes) {
+      qint64 covered = -1;
+      for (auto i = m_peers.constBegin(); i != m_peers.constEnd(); ++i) {
+        if (i.value().contains(route) &&
+            (covered < 0 || ready(i.key()) < covered)) {
+          covered = ready(i.key());
+        }
+      }
+      if (covered < 0) {
+        return std::numeric_limits<qint64>::max();
+      }
+      usable = qMax(usable, covered);
+    }
+    return usable;
+  }
+
+  void setPeer(const QString& pubkey, const QList<IPAddress>& allowedIPs) {
+    meter();
+    if (!m_peers.contains(pubkey)) {
+      m_added[pubkey] = m_clock.elapsed();
+      m_transfer.remove(pubkey);
+    }
+    // An allowed-IP belongs to a single peer.
+    for (QList<IPAddress>& other : m_peers) {
+      for (const IPAddress& ip : allowedIPs) {
+        other.removeAll(ip);
+      }
+    }
+    m_peers[pubkey] = allowedIPs;
+  }
+
+  qint64 ready(const QString& pubkey) const {
+    return m_added.value(pubkey) + HANDSHAKE_DELAY_MSEC;
+  }
+
+  bool m_standby;
+  bool m_exists = false;
+  bool m_failPromote = false;
+  bool m_metering = false;
+  qint64 m_segmentStart = 0;
+  qint64 m_blackhole = 0;
+  int m_peerUpdates = 0;
+  int m_routeUpdates = 0;
+  QElapsedTimer m_clock;
+  qint64 m_epoch = 0;
+  QMap<QString, QList<IPAddress>> m_peers;
+  QMap<QString, qint64> m_added;
+  QMap<QString, QPair<qint64, qint64>> m_transfer;
+  QList<IPAddress> m_routes;
+  QSet<QHostAddress> m_exclusions;
+};
+
+// A daemon configuring the dummy wireguard interface.
+class DummyDaemon final : public Daemon {
+ public:
+  explicit DummyDaemon(bool standby) : Daemon(nullptr) {
+    m_wgutils = new DummyWireguardUtils(this, standby);
+  }
+
+  DummyWireguardUtils* dummy() const { return m_wgutils; }
+
+ protected:
+  WireguardUtils* wgutils() const override { return m_wgutils; }
+
+ private:
+  DummyWireguardUtils* m_wgutils;
+};
+
+// A single hop configuration, routing everything through the given peer.
+inline InterfaceConfig dummyConfig(const QString& pubkey) {
+  InterfaceConfig config;
+  config.m_privateKey = "private";
+  config.m_deviceIpv4Address = "10.64.0.2/32";
+  config.m_serverIpv4Gateway = "10.64.0.1";
+  config.m_serverIpv4AddrIn = "192.0.2.1";
+  config.m_serverPublicKey = pubkey;
+  config.m_allowedIPAddressRanges.append(IPAddress("0.0.0.0/0"));
+  return config;
+}
+
+#endif  // DUMMYDAEMON_H
@@ -66,6 +66,14 @@ void Controller::getStatus(
   callback("127.0.0.1", "127.0.0.1", 0, 0);
 }
 
+bool Controller::subscribeStatus(int) { return false; }
+
+void Controller::unsubscribeStatus() {}
+
+bool Controller::subscribeCounters() { return false; }
+
+QJsonObject Controller::backendMetrics() const { return QJsonObject(); }
+
 void Controller::quit() {}
 
 void Controller::connectionConfirmed() {}
@@ -10,7 +10,7 @@ namespace {
 QString toBase2(const BigInt& a) {
   QString x;
   for (int i = 0; i < a.size(); ++i) {
-    QString tmp = QString::number(a.value()[i], 2);
+    QString tmp = QString::number(a.valueAt(i), 2);
     for (int j = tmp.length(); j < 8; ++j) x += "0";
     x += tmp;
   }
@@ -145,4 +145,37 @@ void TestBigInt::bitShiftOperator() {
   }
 }
 
+void TestBigInt::benchmarkIncrement() {
+  BigInt a(16);
+  QBENCHMARK {
+    for (int i = 0; i < 65536; ++i) ++a;
+  }
+}
+
+void TestBigInt::benchmarkSum() {
+  BigInt a(16);
+  BigInt b(16);
+  for (int i = 0; i < 16; ++i) b.setValueAt(0x55, i);
+
+  QBENCHMARK {
+    for (int i = 0; i < 65536; ++i) a += b;
+  }
+}
+
+void TestBigInt::benchmarkBitShift() {
+  BigInt a(16);
+  for (int i = 0; i < 16; ++i) a.setValueAt((uint8_t)i, i);
+
+  BigInt b(16);
+  QBENCHMARK {
+    for (int i = 0; i < 128; ++i) {
+      b = a >> i;
+    }
+  }
+
+  // Checked out of the benchmark, not to be measured with the shifts.
+  QVERIFY(b <= a);
+  QVERIFY(b == BigInt(16));
+}
+
 static TestBigInt s_testBigInt;
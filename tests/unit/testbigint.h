@@ -12,4 +12,8 @@ class TestBigInt final : public TestHelper {
   void mathOperators();
   void comparisonOperators();
   void bitShiftOperator();
+
+  void benchmarkIncrement();
+  void benchmarkSum();
+  void benchmarkBitShift();
 };
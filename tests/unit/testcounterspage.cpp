@@ -0,0 +1,136 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testcounterspage.h"
+#include "../../src/counterspage.h"
+#include "dummydaemon.h"
+#include "helper.h"
+
+#include <QCoreApplication>
+#include <QSignalSpy>
+
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MACOS)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace {
+QString pageName() {
+  return QString("/mvpn-test-%1").arg(QCoreApplication::applicationPid());
+}
+
+uint readerGroup() {
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MACOS)
+  return getgid();
+#else
+  return 0;
+#endif
+}
+}  // namespace
+
+void TestCountersPage::readWrite() {
+  CountersPage writer;
+  if (!writer.create(pageName())) {
+    QSKIP("No shared memory on this platform");
+  }
+
+  CountersPage reader;
+  QVERIFY(reader.open(pageName()));
+
+  CountersPage::Counters counters;
+  QVERIFY(reader.read(counters, 1000));
+  QVERIFY(!counters.m_connected);
+
+  CountersPage::Counters published;
+  published.m_connected = true;
+  published.m_txBytes = 1ULL << 40;
+  published.m_rxBytes = 42;
+  published.m_handshake = 1234;
+  published.m_connectionDate = 5678;
+  writer.publish(published);
+
+  QVERIFY(reader.read(counters, 1000));
+  QVERIFY(counters.m_connected);
+  QCOMPARE(counters.m_txBytes, published.m_txBytes);
+  QCOMPARE(counters.m_rxBytes, published.m_rxBytes);
+  QCOMPARE(counters.m_handshake, published.m_handshake);
+  QCOMPARE(counters.m_connectionDate, published.m_connectionDate);
+
+  // The page goes away with the daemon.
+  writer.close();
+  CountersPage other;
+  QVERIFY(!other.open(pageName()));
+}
+
+void TestCountersPage::stale() {
+  CountersPage writer;
+  if (!writer.create(pageName())) {
+    QSKIP("No shared memory on this platform");
+  }
+
+  CountersPage reader;
+  QVERIFY(reader.open(pageName()));
+
+  CountersPage::Counters counters;
+  QVERIFY(!reader.read(counters, -1));
+}
+
+void TestCountersPage::permissions() {
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MACOS)
+  CountersPage writer;
+  QVERIFY(writer.create(pageName()));
+
+  auto mode = []() -> mode_t {
+    int fd = shm_open(qPrintable(pageName()), O_RDONLY, 0);
+    struct stat st;
+    bool ok = fd >= 0 && fstat(fd, &st) == 0;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return ok ? st.st_mode & 0777 : 0;
+  };
+
+  // Only the owner can read the page, until a group is allowed.
+  QCOMPARE(mode(), mode_t(S_IRUSR | S_IWUSR));
+
+  QVERIFY(writer.allowGroup(readerGroup()));
+  QCOMPARE(mode(), mode_t(S_IRUSR | S_IWUSR | S_IRGRP));
+#else
+  QSKIP("No shared memory on this platform");
+#endif
+}
+
+void TestCountersPage::daemon() {
+  DummyDaemon daemon(true);
+  if (!daemon.publishCounters(pageName())) {
+    QSKIP("No shared memory on this platform");
+  }
+
+  CountersPage reader;
+  QVERIFY(reader.open(pageName()));
+
+  QSignalSpy spy(&daemon, &Daemon::connected);
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QVERIFY(spy.wait(2000));
+
+  // The page is updated without any request to the daemon, while somebody
+  // is subscribed.
+  QVERIFY(daemon.subscribeCounters("reader", readerGroup()));
+  daemon.dummy()->setTransfer("first", 10, 20);
+  CountersPage::Counters counters;
+  QTRY_VERIFY(reader.read(counters, 5000) && counters.m_txBytes == 10);
+  QVERIFY(counters.m_connected);
+  QCOMPARE(counters.m_rxBytes, quint64(20));
+  QVERIFY(counters.m_handshake > 0);
+  QVERIFY(counters.m_connectionDate > 0);
+
+  QVERIFY(daemon.deactivate());
+  QVERIFY(reader.read(counters, 5000));
+  QVERIFY(!counters.m_connected);
+  daemon.unsubscribeCounters("reader");
+}
+
+static TestCountersPage s_testCountersPage;
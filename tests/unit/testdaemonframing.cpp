@@ -0,0 +1,259 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testdaemonframing.h"
+#include "../../src/daemon/daemonframe.h"
+#include "../../src/daemon/daemonlocalserverconnection.h"
+#include "../../src/daemon/daemonprotocol.h"
+#include "../../src/framereader.h"
+#include "dummydaemon.h"
+#include "helper.h"
+
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSignalSpy>
+#include <QtEndian>
+
+namespace {
+
+QByteArray command(const QString& type) {
+  QJsonObject json;
+  json.insert("type", type);
+  return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+QByteArray request(quint32 id, const QString& type) {
+  return DaemonFrame::encode(id, DaemonFrame::Json, command(type));
+}
+
+// Runs the event loop, for the daemon to reply, until some data is received.
+bool receive(QLocalSocket* socket, FrameReader& reader) {
+  if (!socket->bytesAvailable()) {
+    QSignalSpy spy(socket, &QLocalSocket::readyRead);
+    if (!spy.wait(2000)) {
+      return false;
+    }
+  }
+
+  reader.append(socket->readAll());
+  return true;
+}
+
+QJsonObject readLine(QLocalSocket* socket, FrameReader& reader) {
+  QByteArray line;
+  while (!reader.readLine(line)) {
+    if (!receive(socket, reader)) {
+      return QJsonObject();
+    }
+  }
+  return QJsonDocument::fromJson(line).object();
+}
+
+bool readFrame(QLocalSocket* socket, FrameReader& reader, DaemonFrame& frame) {
+  while (true) {
+    DaemonFrame::ReadResult result = DaemonFrame::read(reader, frame);
+    if (result != DaemonFrame::Incomplete) {
+      return result == DaemonFrame::Complete;
+    }
+    if (!receive(socket, reader)) {
+      return false;
+    }
+  }
+}
+
+// Switches the connection to the binary framing. The first framed request is
+// sent along with the "binary" command.
+bool negotiate(QLocalSocket* socket, FrameReader& reader,
+               const QByteArray& request) {
+  socket->write(command("version") + "\n");
+  if (readLine(socket, reader).value("version").toInt() <
+      DAEMON_PROTOCOL_VERSION_BINARY_FRAMING) {
+    return false;
+  }
+
+  socket->write(command("binary") + "\n" + request);
+  return readLine(socket, reader).value("type").toString() == "binary";
+}
+
+}  // namespace
+
+void TestDaemonFraming::initTestCase() {
+  m_daemon = new DummyDaemon(false);
+
+  QString name = QString("mozillavpn-testdaemonframing-%1")
+                     .arg(QCoreApplication::applicationPid());
+  QLocalServer::removeServer(name);
+
+  m_server = new QLocalServer(this);
+  QVERIFY(m_server->listen(name));
+  connect(m_server, &QLocalServer::newConnection, this, [this] {
+    while (m_server->hasPendingConnections()) {
+      QLocalSocket* socket = m_server->nextPendingConnection();
+      DaemonLocalServerConnection* connection =
+          new DaemonLocalServerConnection(m_server, socket);
+      connect(socket, &QLocalSocket::disconnected, connection,
+              &DaemonLocalServerConnection::deleteLater);
+    }
+  });
+}
+
+void TestDaemonFraming::cleanupTestCase() {
+  delete m_server;
+  m_server = nullptr;
+
+  delete m_daemon;
+  m_daemon = nullptr;
+}
+
+QLocalSocket* TestDaemonFraming::connectClient() {
+  QLocalSocket* socket = new QLocalSocket(this);
+  socket->connectToServer(m_server->fullServerName());
+  if (!socket->waitForConnected(2000)) {
+    delete socket;
+    return nullptr;
+  }
+  return socket;
+}
+
+void TestDaemonFraming::frames() {
+  QByteArray binary("\n\0|", 3);
+  QByteArray first = request(42, "status");
+  QByteArray second = DaemonFrame::encode(7, DaemonFrame::More, binary);
+
+  // The first frame is received one byte at a time.
+  FrameReader reader;
+  DaemonFrame frame;
+  for (int i = 0; i < first.length(); ++i) {
+    QCOMPARE(DaemonFrame::read(reader, frame), DaemonFrame::Incomplete);
+    reader.append(first.mid(i, 1));
+  }
+
+  QCOMPARE(DaemonFrame::read(reader, frame), DaemonFrame::Complete);
+  QCOMPARE(frame.m_id, quint32(42));
+  QCOMPARE(frame.m_flags, quint8(DaemonFrame::Json));
+  QCOMPARE(frame.m_payload, command("status"));
+
+  reader.append(second);
+  QCOMPARE(DaemonFrame::read(reader, frame), DaemonFrame::Complete);
+  QCOMPARE(frame.m_id, quint32(7));
+  QCOMPARE(frame.m_flags, quint8(DaemonFrame::More));
+  QCOMPARE(frame.m_payload, binary);
+  QVERIFY(reader.isEmpty());
+
+  // Too large.
+  QByteArray header(DaemonFrame::HEADER_SIZE, 0);
+  qToBigEndian<quint32>(DaemonFrame::MAX_PAYLOAD_SIZE + 1, header.data());
+  reader.append(header);
+  QCOMPARE(DaemonFrame::read(reader, frame), DaemonFrame::Invalid);
+}
+
+void TestDaemonFraming::lines() {
+  QLocalSocket* socket = connectClient();
+  QVERIFY(socket);
+
+  // The clients not asking for the binary framing keep using the lines.
+  FrameReader reader;
+  socket->write(command("version") + "\n" + command("status") + "\n");
+  QCOMPARE(readLine(socket, reader).value("version").toInt(),
+           DAEMON_PROTOCOL_VERSION);
+
+  QJsonObject status = readLine(socket, reader);
+  QCOMPARE(status.value("type").toString(), QString("status"));
+  QCOMPARE(status.value("connected").toBool(), false);
+
+  delete socket;
+}
+
+void TestDaemonFraming::binary() {
+  QLocalSocket* socket = connectClient();
+  QVERIFY(socket);
+
+  FrameReader reader;
+  QVERIFY(negotiate(socket, reader, request(7, "status")));
+
+  // The response has the ID of the request.
+  DaemonFrame frame;
+  QVERIFY(readFrame(socket, reader, frame));
+  QCOMPARE(frame.m_id, quint32(7));
+  QCOMPARE(frame.m_flags, quint8(DaemonFrame::Json));
+  QCOMPARE(QJsonDocument::fromJson(frame.m_payload)
+               .object()
+               .value("type")
+               .toString(),
+           QString("status"));
+
+  // The lines are not accepted anymore: the daemon closes the connection.
+  QSignalSpy disconnected(socket, &QLocalSocket::disconnected);
+  socket->write("{\"type\":\"status\"}\n");
+  QVERIFY(disconnected.wait(2000));
+
+  delete socket;
+}
+
+void TestDaemonFraming::multiplexing() {
+  QLocalSocket* socket = connectClient();
+  QVERIFY(socket);
+
+  // Both requests are in flight at the same time.
+  FrameReader reader;
+  QVERIFY(negotiate(socket, reader,
+                    request(1, "logs") + request(2, "status")));
+
+  QByteArray logs;
+  bool logsDone = false;
+  bool statusDone = false;
+  while (!logsDone || !statusDone) {
+    DaemonFrame frame;
+    QVERIFY(readFrame(socket, reader, frame));
+
+    if (frame.m_id == 1) {
+      // The logs are streamed as binary data.
+      QVERIFY(!logsDone);
+      QVERIFY(!(frame.m_flags & DaemonFrame::Json));
+      logs.append(frame.m_payload);
+      logsDone = !(frame.m_flags & DaemonFrame::More);
+      continue;
+    }
+
+    QCOMPARE(frame.m_id, quint32(2));
+    QCOMPARE(frame.m_flags, quint8(DaemonFrame::Json));
+    statusDone = true;
+  }
+
+  // No escaping of the newlines.
+  QVERIFY(logs.contains("Daemon metrics: {"));
+  QVERIFY(logs.endsWith("\n"));
+
+  delete socket;
+}
+
+void TestDaemonFraming::results() {
+  QLocalSocket* socket = connectClient();
+  QVERIFY(socket);
+
+  // The commands without data get a result with the ID of the request.
+  FrameReader reader;
+  QVERIFY(negotiate(socket, reader,
+                    request(3, "cleanlogs") + request(4, "unknown")));
+
+  for (quint32 id : {3, 4}) {
+    DaemonFrame frame;
+    QVERIFY(readFrame(socket, reader, frame));
+    QCOMPARE(frame.m_id, id);
+    QCOMPARE(frame.m_flags, quint8(DaemonFrame::Json));
+
+    QJsonObject obj = QJsonDocument::fromJson(frame.m_payload).object();
+    QCOMPARE(obj.value("type").toString(), QString("result"));
+    QCOMPARE(obj.value("result").toBool(), id == 3);
+    QCOMPARE(obj.value("command").toString(),
+             QString(id == 3 ? "cleanlogs" : "unknown"));
+  }
+
+  delete socket;
+}
+
+static TestDaemonFraming s_testDaemonFraming;
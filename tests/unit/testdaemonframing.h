@@ -0,0 +1,29 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "helper.h"
+
+class DummyDaemon;
+class QLocalServer;
+class QLocalSocket;
+
+class TestDaemonFraming final : public TestHelper {
+  Q_OBJECT
+
+ private slots:
+  void initTestCase();
+  void cleanupTestCase();
+
+  void frames();
+  void lines();
+  void binary();
+  void multiplexing();
+  void results();
+
+ private:
+  QLocalSocket* connectClient();
+
+  DummyDaemon* m_daemon = nullptr;
+  QLocalServer* m_server = nullptr;
+};
@@ -0,0 +1,97 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testdaemonstatus.h"
+#include "dummydaemon.h"
+#include "helper.h"
+
+#include <QSignalSpy>
+
+void TestDaemonStatus::deltas() {
+  DummyDaemon daemon(false);
+  QSignalSpy connected(&daemon, &Daemon::connected);
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QVERIFY(connected.wait(2000));
+
+  // The first signal sets the reference counters.
+  QSignalSpy spy(&daemon, &Daemon::statusChanged);
+  daemon.dummy()->setTransfer("first", 100, 200);
+  daemon.subscribeStatus("client", 100);
+  QCOMPARE(spy.count(), 1);
+  QCOMPARE(spy.last().at(0).toString(), QString("10.64.0.1"));
+  QCOMPARE(spy.last().at(1).toString(), QString("10.64.0.2/32"));
+  QCOMPARE(spy.last().at(2).toULongLong(), qulonglong(0));
+  QCOMPARE(spy.last().at(3).toULongLong(), qulonglong(0));
+  QVERIFY(spy.last().at(4).toLongLong() >= 0);
+
+  daemon.dummy()->setTransfer("first", 1100, 2200);
+  QVERIFY(spy.wait(1000));
+  QCOMPARE(spy.last().at(2).toULongLong(), qulonglong(1000));
+  QCOMPARE(spy.last().at(3).toULongLong(), qulonglong(2000));
+
+  QVERIFY(spy.wait(1000));
+  QCOMPARE(spy.last().at(2).toULongLong(), qulonglong(0));
+  QCOMPARE(spy.last().at(3).toULongLong(), qulonglong(0));
+
+  // The counters of a new peer start from zero.
+  QVERIFY(daemon.activate(dummyConfig("second")));
+  daemon.dummy()->setTransfer("second", 300, 400);
+  QVERIFY(spy.wait(1000));
+  QCOMPARE(spy.last().at(2).toULongLong(), qulonglong(300));
+  QCOMPARE(spy.last().at(3).toULongLong(), qulonglong(400));
+
+  QVERIFY(daemon.deactivate());
+}
+
+void TestDaemonStatus::subscribers() {
+  DummyDaemon daemon(false);
+  QSignalSpy connected(&daemon, &Daemon::connected);
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QVERIFY(connected.wait(2000));
+
+  // The shortest interval wins.
+  QSignalSpy spy(&daemon, &Daemon::statusChanged);
+  daemon.subscribeStatus("a", 100);
+  daemon.subscribeStatus("b", 5000);
+  spy.clear();
+  QVERIFY(spy.wait(1000));
+
+  daemon.unsubscribeStatus("a");
+  spy.clear();
+  QVERIFY(!spy.wait(500));
+
+  // Subscribing again updates the interval, within the bounds.
+  daemon.subscribeStatus("b", 1);
+  spy.clear();
+  QVERIFY(spy.wait(1000));
+
+  // Nobody is interested anymore.
+  daemon.unsubscribeStatus("b");
+  daemon.unsubscribeStatus("unknown");
+  spy.clear();
+  QTest::qWait(300);
+  QCOMPARE(spy.count(), 0);
+
+  QVERIFY(daemon.deactivate());
+}
+
+void TestDaemonStatus::inactive() {
+  DummyDaemon daemon(false);
+  QSignalSpy spy(&daemon, &Daemon::statusChanged);
+
+  // Nothing is pushed while the VPN is off.
+  daemon.subscribeStatus("client", 100);
+  QTest::qWait(300);
+  QCOMPARE(spy.count(), 0);
+
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QCOMPARE(spy.count(), 1);
+
+  QVERIFY(daemon.deactivate());
+  spy.clear();
+  QTest::qWait(300);
+  QCOMPARE(spy.count(), 0);
+}
+
+static TestDaemonStatus s_testDaemonStatus;
@@ -0,0 +1,168 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testdaemonswitch.h"
+#include "dummydaemon.h"
+#include "helper.h"
+
+#include <QSignalSpy>
+
+void TestDaemonSwitch::makeBeforeBreak() {
+  DummyDaemon daemon(true);
+  QSignalSpy spy(&daemon, &Daemon::connected);
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QVERIFY(spy.wait(2000));
+
+  InterfaceConfig second = dummyConfig("second");
+  second.m_allowedIPAddressRanges.append(IPAddress("::/0"));
+  QVERIFY(daemon.activate(second));
+
+  // Until its handshake, the new peer has no allowed-IPs: the previous peer
+  // keeps the traffic, and the new prefix is not routed yet.
+  QCOMPARE(daemon.dummy()->peers(), QStringList({"first", "second"}));
+  QVERIFY(daemon.dummy()->allowedIPs("second").isEmpty());
+  QVERIFY(!daemon.dummy()->routes().contains(IPAddress("::/0")));
+
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(spy.last().at(0).toString(), QString("second"));
+  QCOMPARE(daemon.dummy()->peers(), QStringList{"second"});
+  QCOMPARE(daemon.dummy()->allowedIPs("second"),
+           second.m_allowedIPAddressRanges);
+  QVERIFY(daemon.dummy()->routes().contains(IPAddress("::/0")));
+  QVERIFY(daemon.deactivate());
+}
+
+void TestDaemonSwitch::failedPromote() {
+  DummyDaemon daemon(true);
+  QSignalSpy connected(&daemon, &Daemon::connected);
+  QSignalSpy failure(&daemon, &Daemon::backendFailure);
+  InterfaceConfig first = dummyConfig("first");
+  QVERIFY(daemon.activate(first));
+  QVERIFY(connected.wait(2000));
+  QList<IPAddress> routes = daemon.dummy()->routes();
+
+  InterfaceConfig second = dummyConfig("second");
+  second.m_allowedIPAddressRanges.append(IPAddress("::/0"));
+  second.m_excludedAddresses.append("192.0.2.9");
+  daemon.dummy()->setFailPromote(true);
+  QVERIFY(daemon.activate(second));
+  QVERIFY(daemon.dummy()->exclusions().contains(QHostAddress("192.0.2.9")));
+
+  // The new peer completes its handshake but cannot take the traffic.
+  QVERIFY(failure.wait(2000));
+  QCOMPARE(connected.count(), 1);
+
+  // The previous peer, its routes and its exclusions are still in place.
+  QCOMPARE(daemon.dummy()->peers(), QStringList{"first"});
+  QCOMPARE(daemon.dummy()->allowedIPs("first"),
+           first.m_allowedIPAddressRanges);
+  QCOMPARE(daemon.dummy()->routes(), routes);
+  QVERIFY(daemon.dummy()->exclusions().isEmpty());
+
+  // The daemon knows it: the previous configuration has nothing to change.
+  int peerUpdates = daemon.dummy()->peerUpdates();
+  QVERIFY(daemon.activate(first));
+  QCOMPARE(daemon.dummy()->peerUpdates(), peerUpdates);
+  QCOMPARE(daemon.metrics().value("activationCacheHits").toInt(), 1);
+  QVERIFY(connected.wait(2000));
+  QCOMPARE(connected.last().at(0).toString(), QString("first"));
+  QVERIFY(daemon.deactivate());
+}
+
+void TestDaemonSwitch::samePeer() {
+  // Nothing to wait for when the peer doesn't change.
+  DummyDaemon daemon(true);
+  QSignalSpy spy(&daemon, &Daemon::connected);
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QVERIFY(spy.wait(2000));
+
+  InterfaceConfig other = dummyConfig("first");
+  other.m_serverIpv4AddrIn = "192.0.2.2";
+  QVERIFY(daemon.activate(other));
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(daemon.dummy()->peers(), QStringList{"first"});
+  QVERIFY(daemon.deactivate());
+}
+
+void TestDaemonSwitch::sameConfig() {
+  DummyDaemon daemon(true);
+  QSignalSpy spy(&daemon, &Daemon::connected);
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QVERIFY(spy.wait(2000));
+
+  // Nothing is configured again, but the client is still told about the
+  // connection.
+  int peerUpdates = daemon.dummy()->peerUpdates();
+  int routeUpdates = daemon.dummy()->routeUpdates();
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QCOMPARE(daemon.dummy()->peerUpdates(), peerUpdates);
+  QCOMPARE(daemon.dummy()->routeUpdates(), routeUpdates);
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(spy.last().at(0).toString(), QString("first"));
+  QCOMPARE(daemon.metrics().value("activationCacheHits").toInt(), 1);
+  QVERIFY(daemon.deactivate());
+}
+
+void TestDaemonSwitch::partialUpdate() {
+  DummyDaemon daemon(true);
+  QSignalSpy spy(&daemon, &Daemon::connected);
+  InterfaceConfig config = dummyConfig("first");
+  config.m_excludedAddresses.append("192.0.2.1");
+  QVERIFY(daemon.activate(config));
+  QVERIFY(spy.wait(2000));
+
+  // Only the exclusions change: the peer and its routes are left alone.
+  int peerUpdates = daemon.dummy()->peerUpdates();
+  int routeUpdates = daemon.dummy()->routeUpdates();
+  config.m_excludedAddresses.append("192.0.2.3");
+  QVERIFY(daemon.activate(config));
+  QCOMPARE(daemon.dummy()->peerUpdates(), peerUpdates);
+  QCOMPARE(daemon.dummy()->routeUpdates(), routeUpdates);
+  QVERIFY(spy.wait(2000));
+
+  // A new prefix: the peer is updated, and only the new route is added.
+  config.m_allowedIPAddressRanges.append(IPAddress("::/0"));
+  QVERIFY(daemon.activate(config));
+  QCOMPARE(daemon.dummy()->peerUpdates(), peerUpdates + 1);
+  QCOMPARE(daemon.dummy()->routeUpdates(), routeUpdates + 1);
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(daemon.metrics().value("activationCacheHits").toInt(), 0);
+  QVERIFY(daemon.deactivate());
+}
+
+void TestDaemonSwitch::benchmarkBlackhole_data() {
+  QTest::addColumn<bool>("standby");
+
+  QTest::addRow("make-before-break") << true;
+  QTest::addRow("break-before-make") << false;
+}
+
+// How long the traffic has no usable peer while switching to a new server.
+void TestDaemonSwitch::benchmarkBlackhole() {
+  QFETCH(bool, standby);
+
+  DummyDaemon daemon(standby);
+  QSignalSpy spy(&daemon, &Daemon::connected);
+  QVERIFY(daemon.activate(dummyConfig("first")));
+  QVERIFY(spy.wait(2000));
+
+  daemon.dummy()->startBlackholeMeter();
+  QVERIFY(daemon.activate(dummyConfig("second")));
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(spy.last().at(0).toString(), QString("second"));
+
+  // The previous peer carries the traffic until the new one is ready.
+  // Otherwise, nothing does until the handshake of the new peer.
+  qint64 blackhole = daemon.dummy()->blackhole();
+  if (standby) {
+    QCOMPARE(blackhole, qint64(0));
+  } else {
+    QVERIFY(blackhole >= HANDSHAKE_DELAY_MSEC / 2);
+  }
+  QVERIFY(daemon.deactivate());
+
+  QTest::setBenchmarkResult(blackhole, QTest::WalltimeMilliseconds);
+}
+
+static TestDaemonSwitch s_testDaemonSwitch;
@@ -0,0 +1,122 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testdbusstatus.h"
+#include "helper.h"
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusServer>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+
+constexpr const char* PEER_CONNECTION = "testdbusstatus";
+
+// The legacy encoding, as produced by Daemon::getStatus().
+QString DBusStatusService::status() {
+  QJsonObject json;
+  json.insert("connected", QJsonValue(m_status.connected));
+  json.insert("serverIpv4Gateway", QJsonValue(m_status.serverIpv4Gateway));
+  json.insert("deviceIpv4Address", QJsonValue(m_status.deviceIpv4Address));
+  json.insert("date",
+              QDateTime::fromMSecsSinceEpoch(m_status.handshake).toString());
+  json.insert("txBytes", QJsonValue(qint64(m_status.txBytes)));
+  json.insert("rxBytes", QJsonValue(qint64(m_status.rxBytes)));
+  return QString(QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+DaemonStatus DBusStatusService::connectionStatus() { return m_status; }
+
+void TestDBusStatus::initTestCase() {
+  qDBusRegisterMetaType<DaemonStatus>();
+
+  m_service.m_status.connected = true;
+  m_service.m_status.serverIpv4Gateway = "10.64.0.1";
+  m_service.m_status.deviceIpv4Address = "10.64.0.2/32";
+  m_service.m_status.txBytes = 123456789012;
+  m_service.m_status.rxBytes = 987654321;
+  m_service.m_status.handshake = QDateTime::currentMSecsSinceEpoch();
+
+  // A peer-to-peer connection, to run without a bus.
+  m_server = new QDBusServer(this);
+  QVERIFY(m_server->isConnected());
+  connect(m_server, &QDBusServer::newConnection, this,
+          [this](const QDBusConnection& connection) {
+            m_connections.append(connection);
+            m_connections.last().registerObject(
+                "/", &m_service, QDBusConnection::ExportAllSlots);
+          });
+
+  QDBusConnection client =
+      QDBusConnection::connectToPeer(m_server->address(), PEER_CONNECTION);
+  QVERIFY(client.isConnected());
+  QTRY_VERIFY(!m_connections.isEmpty());
+}
+
+void TestDBusStatus::cleanupTestCase() {
+  QDBusConnection::disconnectFromPeer(PEER_CONNECTION);
+  for (const QDBusConnection& connection : m_connections) {
+    QDBusConnection::disconnectFromPeer(connection.name());
+  }
+  m_connections.clear();
+
+  delete m_server;
+  m_server = nullptr;
+}
+
+QDBusMessage TestDBusStatus::call(const QString& method) {
+  QDBusMessage message =
+      QDBusMessage::createMethodCall(QString(), "/", QString(), method);
+  // The service lives in this thread: wait for the reply in an event loop.
+  return QDBusConnection(PEER_CONNECTION).call(message, QDBus::BlockWithGui);
+}
+
+void TestDBusStatus::typedStatus() {
+  QDBusMessage reply = call("connectionStatus");
+  QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+  QCOMPARE(reply.signature(), QString("(bssttx)"));
+
+  DaemonStatus status = qdbus_cast<DaemonStatus>(reply.arguments().at(0));
+  const DaemonStatus& expected = m_service.m_status;
+  QCOMPARE(status.connected, expected.connected);
+  QCOMPARE(status.serverIpv4Gateway, expected.serverIpv4Gateway);
+  QCOMPARE(status.deviceIpv4Address, expected.deviceIpv4Address);
+  QCOMPARE(status.txBytes, expected.txBytes);
+  QCOMPARE(status.rxBytes, expected.rxBytes);
+  QCOMPARE(status.handshake, expected.handshake);
+}
+
+// A status call, as done by LinuxController, with the legacy JSON string or
+// with the typed structure.
+void TestDBusStatus::benchmarkStatus_data() {
+  QTest::addColumn<bool>("typed");
+
+  QTest::addRow("json") << false;
+  QTest::addRow("typed") << true;
+}
+
+void TestDBusStatus::benchmarkStatus() {
+  QFETCH(bool, typed);
+
+  quint64 txBytes = 0;
+  QBENCHMARK {
+    if (typed) {
+      QDBusMessage reply = call("connectionStatus");
+      DaemonStatus status = qdbus_cast<DaemonStatus>(reply.arguments().at(0));
+      txBytes = status.txBytes;
+    } else {
+      QDBusMessage reply = call("status");
+      QJsonDocument json = QJsonDocument::fromJson(
+          reply.arguments().at(0).toString().toLocal8Bit());
+      txBytes = json.object().value("txBytes").toDouble();
+    }
+  }
+
+  QCOMPARE(txBytes, m_service.m_status.txBytes);
+}
+
+static TestDBusStatus s_testDBusStatus;
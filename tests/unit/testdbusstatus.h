@@ -0,0 +1,39 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "helper.h"
+#include "../../src/platforms/linux/daemon/dbustypeslinux.h"
+
+// Serves the two flavors of the status method of the daemon.
+class DBusStatusService final : public QObject {
+  Q_OBJECT
+
+ public:
+  DaemonStatus m_status;
+
+ public slots:
+  QString status();
+  DaemonStatus connectionStatus();
+};
+
+class TestDBusStatus final : public TestHelper {
+  Q_OBJECT
+
+ private slots:
+  void initTestCase();
+  void cleanupTestCase();
+
+  void typedStatus();
+
+  void benchmarkStatus_data();
+  void benchmarkStatus();
+
+ private:
+  QDBusMessage call(const QString& method);
+
+ private:
+  DBusStatusService m_service;
+  QDBusServer* m_server = nullptr;
+  QList<QDBusConnection> m_connections;
+};
@@ -0,0 +1,161 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testendpointresolver.h"
+#include "../../src/platforms/linux/daemon/endpointresolver.h"
+#include "helper.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+
+namespace {
+
+// Resolves every hostname to 192.0.2.1, after `delayMsec`.
+EndpointResolver::LookupFunction fakeLookup(QAtomicInt* calls, int result,
+                                            int delayMsec = 0) {
+  return [calls, result, delayMsec](const QByteArray&,
+                                    struct sockaddr_storage* addr) {
+    calls->ref();
+    if (delayMsec) {
+      QThread::msleep(delayMsec);
+    }
+    if (result) {
+      return result;
+    }
+
+    struct sockaddr_in* sin = reinterpret_cast<struct sockaddr_in*>(addr);
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0xC0000201);
+    return 0;
+  };
+}
+
+QString toString(const struct sockaddr* sa) {
+  if (!sa || sa->sa_family != AF_INET) {
+    return QString();
+  }
+  const struct sockaddr_in* sin =
+      reinterpret_cast<const struct sockaddr_in*>(sa);
+  char buf[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &sin->sin_addr, buf, sizeof(buf));
+  return QString("%1:%2").arg(buf).arg(ntohs(sin->sin_port));
+}
+
+}  // namespace
+
+void TestEndpointResolver::literal() {
+  QAtomicInt calls;
+  EndpointResolver resolver(fakeLookup(&calls, 0));
+
+  struct sockaddr_storage addr;
+  struct sockaddr* sa = reinterpret_cast<struct sockaddr*>(&addr);
+  QVERIFY(resolver.resolveNow("198.51.100.7", 51820, sa));
+  QCOMPARE(toString(sa), QString("198.51.100.7:51820"));
+
+  // The callback is called at once.
+  QString result;
+  resolver.resolve("198.51.100.7", 443, this, [&](const struct sockaddr* sa) {
+    result = toString(sa);
+  });
+  QCOMPARE(result, QString("198.51.100.7:443"));
+  QCOMPARE(calls.loadAcquire(), 0);
+}
+
+void TestEndpointResolver::hostname() {
+  QAtomicInt calls;
+  EndpointResolver resolver(fakeLookup(&calls, 0, 50));
+
+  struct sockaddr_storage addr;
+  struct sockaddr* sa = reinterpret_cast<struct sockaddr*>(&addr);
+  QVERIFY(!resolver.resolveNow("vpn.example.com", 51820, sa));
+
+  // The lookup doesn't block the caller.
+  QElapsedTimer timer;
+  timer.start();
+  bool done = false;
+  QString result;
+  resolver.resolve("vpn.example.com", 51820, this,
+                   [&](const struct sockaddr* sa) {
+                     done = true;
+                     result = toString(sa);
+                   });
+  QVERIFY(!done);
+  QVERIFY(timer.elapsed() < 50);
+
+  QTRY_VERIFY(done);
+  QCOMPARE(result, QString("192.0.2.1:51820"));
+
+  // Cached.
+  QVERIFY(resolver.resolveNow("vpn.example.com", 1234, sa));
+  QCOMPARE(toString(sa), QString("192.0.2.1:1234"));
+  QCOMPARE(calls.loadAcquire(), 1);
+}
+
+void TestEndpointResolver::failure() {
+  QAtomicInt calls;
+  EndpointResolver resolver(fakeLookup(&calls, EAI_NONAME));
+
+  bool done = false;
+  bool ok = true;
+  resolver.resolve("missing.example.com", 51820, this,
+                   [&](const struct sockaddr* sa) {
+                     done = true;
+                     ok = sa != nullptr;
+                   });
+
+  // A permanent failure is not retried, and not cached.
+  QTRY_VERIFY(done);
+  QVERIFY(!ok);
+  QCOMPARE(calls.loadAcquire(), 1);
+
+  struct sockaddr_storage addr;
+  QVERIFY(!resolver.resolveNow("missing.example.com", 51820,
+                               reinterpret_cast<struct sockaddr*>(&addr)));
+}
+
+void TestEndpointResolver::timeout() {
+  QAtomicInt calls;
+  EndpointResolver resolver(fakeLookup(&calls, EAI_AGAIN));
+  resolver.setTimeouts(20, 200);
+
+  // A transient failure is retried until the request times out.
+  bool done = false;
+  bool ok = true;
+  resolver.resolve("slow.example.com", 51820, this,
+                   [&](const struct sockaddr* sa) {
+                     done = true;
+                     ok = sa != nullptr;
+                   });
+
+  QTRY_VERIFY(done);
+  QVERIFY(!ok);
+  QVERIFY(calls.loadAcquire() > 1);
+
+  // The destructor interrupts the retries.
+}
+
+void TestEndpointResolver::context() {
+  QAtomicInt calls;
+  EndpointResolver resolver(fakeLookup(&calls, 0, 50));
+
+  // No callback after the context is gone.
+  bool called = false;
+  QObject* context = new QObject();
+  resolver.resolve("vpn.example.com", 51820, context,
+                   [&](const struct sockaddr*) { called = true; });
+  delete context;
+
+  QTRY_COMPARE(calls.loadAcquire(), 1);
+  QTest::qWait(100);
+  QVERIFY(!called);
+}
+
+static TestEndpointResolver s_testEndpointResolver;
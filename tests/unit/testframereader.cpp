@@ -0,0 +1,136 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testframereader.h"
+#include "../../src/framereader.h"
+#include "helper.h"
+
+#include <QtEndian>
+
+void TestFrameReader::lines_data() {
+  QTest::addColumn<QList<QByteArray>>("chunks");
+  QTest::addColumn<QList<QByteArray>>("lines");
+  QTest::addColumn<QByteArray>("pending");
+
+  QTest::addRow("empty") << QList<QByteArray>{} << QList<QByteArray>{}
+                         << QByteArray();
+  QTest::addRow("partial") << QList<QByteArray>{"abc"} << QList<QByteArray>{}
+                           << QByteArray("abc");
+  QTest::addRow("one") << QList<QByteArray>{"abc\n"}
+                       << QList<QByteArray>{"abc"} << QByteArray();
+  QTest::addRow("split") << QList<QByteArray>{"a", "b", "c\nd"}
+                         << QList<QByteArray>{"abc"} << QByteArray("d");
+  QTest::addRow("many") << QList<QByteArray>{"a\nb\n\nc\n"}
+                        << QList<QByteArray>{"a", "b", "", "c"}
+                        << QByteArray();
+  QTest::addRow("trimmed") << QList<QByteArray>{"  a b \r\n", "\t\r\n"}
+                           << QList<QByteArray>{"a b", ""} << QByteArray();
+}
+
+void TestFrameReader::lines() {
+  QFETCH(QList<QByteArray>, chunks);
+  QFETCH(QList<QByteArray>, lines);
+  QFETCH(QByteArray, pending);
+
+  FrameReader reader;
+  QList<QByteArray> result;
+  for (const QByteArray& chunk : chunks) {
+    reader.append(chunk);
+
+    QByteArray line;
+    while (reader.readLine(line)) {
+      // The views are valid until the next append.
+      result.append(QByteArray(line.constData(), line.size()));
+    }
+  }
+
+  QCOMPARE(result, lines);
+  QCOMPARE(reader.pending(), pending);
+  QCOMPARE(reader.pendingSize(), pending.size());
+  QCOMPARE(reader.isEmpty(), pending.isEmpty());
+}
+
+void TestFrameReader::blocks() {
+  QByteArray body("{\"t\":\"status\"}");
+  uint32_t length = body.length();
+
+  QByteArray message(sizeof(uint32_t), 0);
+  qToUnaligned(length, message.data());
+  message.append(body);
+
+  // A length-prefixed message received one byte at a time.
+  FrameReader reader;
+  QByteArray data;
+  for (int i = 0; i < message.length(); ++i) {
+    QVERIFY(!reader.read(message.length(), data));
+    reader.append(message.mid(i, 1));
+  }
+
+  QVERIFY(reader.read(sizeof(uint32_t), data));
+  QCOMPARE(qFromUnaligned<uint32_t>(data.constData()), length);
+  QVERIFY(!reader.read(length + 1, data));
+  QVERIFY(reader.read(length, data));
+  QCOMPARE(data, body);
+  QVERIFY(reader.isEmpty());
+
+  // Lines and blocks can be mixed.
+  reader.append("ab\ncd");
+  QVERIFY(reader.read(1, data));
+  QCOMPARE(data, QByteArray("a"));
+  QVERIFY(reader.readLine(data));
+  QCOMPARE(data, QByteArray("b"));
+  QVERIFY(!reader.readLine(data));
+  QCOMPARE(reader.pending(), QByteArray("cd"));
+}
+
+void TestFrameReader::compaction() {
+  // Lines larger than the compaction threshold, with a part of the next line
+  // always pending.
+  QByteArray line(5000, 'x');
+  QByteArray data = line + "\n" + line;
+
+  FrameReader reader;
+  reader.append(data.left(3000));
+  for (int i = 0; i < 10; ++i) {
+    QByteArray result;
+    QVERIFY(!reader.readLine(result));
+    reader.append(data.mid(3000));
+    QVERIFY(reader.readLine(result));
+    QCOMPARE(result, line);
+    QCOMPARE(reader.pendingSize(), line.size());
+
+    reader.append("\n");
+    QVERIFY(reader.readLine(result));
+    QCOMPARE(result, line);
+    QVERIFY(reader.isEmpty());
+
+    reader.append(data.left(3000));
+  }
+
+  QCOMPARE(reader.pending(), data.left(3000));
+}
+
+// Many small commands received in a single chunk, as parsed by the daemon.
+void TestFrameReader::benchmarkLines() {
+  QByteArray chunk;
+  for (int i = 0; i < 1000; ++i) {
+    chunk.append("{\"type\":\"status\"}\n");
+  }
+
+  int count = 0;
+  QBENCHMARK {
+    FrameReader reader;
+    reader.append(chunk);
+
+    count = 0;
+    QByteArray line;
+    while (reader.readLine(line)) {
+      ++count;
+    }
+  }
+
+  QCOMPARE(count, 1000);
+}
+
+static TestFrameReader s_testFrameReader;
@@ -0,0 +1,92 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testhandshakewatcher.h"
+#include "../../src/daemon/handshakewatcher.h"
+#include "helper.h"
+
+#include <QSignalSpy>
+
+namespace {
+WireguardUtils::PeerStatus peer(const QString& pubkey, qint64 handshake) {
+  WireguardUtils::PeerStatus status(pubkey);
+  status.m_handshake = handshake;
+  return status;
+}
+}  // namespace
+
+void TestHandshakeWatcher::handshake() {
+  int fetches = 0;
+  HandshakeWatcher watcher(nullptr, [&]() {
+    QList<WireguardUtils::PeerStatus> peers;
+    ++fetches;
+    peers.append(peer("other", 42));
+    peers.append(peer("server", fetches >= 3 ? 1234 : 0));
+    return peers;
+  });
+
+  QSignalSpy spy(&watcher, &HandshakeWatcher::handshakeCompleted);
+  watcher.watch(0, "server");
+  QVERIFY(watcher.isWatching());
+
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(spy.count(), 1);
+  QCOMPARE(spy.at(0).at(0).toInt(), 0);
+  QCOMPARE(spy.at(0).at(1).toString(), QString("server"));
+  QCOMPARE(spy.at(0).at(2).toLongLong(), qint64(1234));
+
+  QCOMPARE(fetches, 3);
+  QVERIFY(!watcher.isWatching());
+  QCOMPARE(watcher.timeToFirstHandshake().count(), quint64(1));
+
+  // No more fetches once all the handshakes are done.
+  QTest::qWait(100);
+  QCOMPARE(fetches, 3);
+}
+
+void TestHandshakeWatcher::multihop() {
+  int fetches = 0;
+  HandshakeWatcher watcher(nullptr, [&]() {
+    QList<WireguardUtils::PeerStatus> peers;
+    ++fetches;
+    peers.append(peer("entry", fetches >= 2 ? 1 : 0));
+    peers.append(peer("exit", fetches >= 4 ? 2 : 0));
+    return peers;
+  });
+
+  QSignalSpy spy(&watcher, &HandshakeWatcher::handshakeCompleted);
+  watcher.watch(1, "entry");
+  watcher.watch(0, "exit");
+
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(spy.count(), 1);
+  QCOMPARE(spy.at(0).at(0).toInt(), 1);
+
+  QVERIFY(spy.wait(2000));
+  QCOMPARE(spy.count(), 2);
+  QCOMPARE(spy.at(1).at(0).toInt(), 0);
+
+  // A single fetch is shared by both hops.
+  QCOMPARE(fetches, 4);
+  QCOMPARE(watcher.timeToFirstHandshake().count(), quint64(2));
+}
+
+void TestHandshakeWatcher::clear() {
+  int fetches = 0;
+  HandshakeWatcher watcher(nullptr, [&]() {
+    ++fetches;
+    return QList<WireguardUtils::PeerStatus>();
+  });
+
+  QSignalSpy spy(&watcher, &HandshakeWatcher::handshakeCompleted);
+  watcher.watch(0, "server");
+  watcher.clear();
+  QVERIFY(!watcher.isWatching());
+
+  QTest::qWait(100);
+  QCOMPARE(fetches, 0);
+  QCOMPARE(spy.count(), 0);
+}
+
+static TestHandshakeWatcher s_testHandshakeWatcher;
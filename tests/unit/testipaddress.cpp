@@ -4,8 +4,16 @@
 
 #include "testipaddress.h"
 #include "../../src/ipaddress.h"
+#include "../../src/rfc/rfc1112.h"
+#include "../../src/rfc/rfc1918.h"
+#include "../../src/rfc/rfc4193.h"
+#include "../../src/rfc/rfc4291.h"
+#include "../../src/rfc/rfc5735.h"
+#include "../../src/rfc/rfclocalnetworks.h"
 #include "helper.h"
 
+#include <QRandomGenerator>
+
 void TestIpAddress::ctor() {
   IPAddress ip;
   QCOMPARE(ip, ip);
@@ -276,4 +284,212 @@ void TestIpAddress::excludeAddresses() {
   QVERIFY(list.join(",") == result);
 }
 
+void TestIpAddress::aggregate_data() {
+  QTest::addColumn<QString>("input");
+  QTest::addColumn<QString>("result");
+
+  QTest::addRow("empty") << ""
+                         << "";
+  QTest::addRow("single") << "10.0.0.0/8"
+                          << "10.0.0.0/8";
+  QTest::addRow("duplicates") << "10.0.0.0/8,10.0.0.0/8"
+                              << "10.0.0.0/8";
+  QTest::addRow("not normalized") << "10.1.2.3/8"
+                                  << "10.0.0.0/8";
+  QTest::addRow("siblings") << "10.0.0.0/9,10.128.0.0/9"
+                            << "10.0.0.0/8";
+  QTest::addRow("not siblings") << "10.128.0.0/9,11.0.0.0/9"
+                                << "10.128.0.0/9,11.0.0.0/9";
+  QTest::addRow("covered") << "10.1.0.0/16,10.0.0.0/8,10.255.255.255/32"
+                           << "10.0.0.0/8";
+  QTest::addRow("cascade") << "0.0.0.0/2,64.0.0.0/2,128.0.0.0/2,192.0.0.0/3,"
+                              "224.0.0.0/4,240.0.0.0/4"
+                           << "0.0.0.0/0";
+  QTest::addRow("world vs localhost")
+      << "0.0.0.0/2,112.0.0.0/5,120.0.0.0/6,124.0.0.0/7,126.0.0.0/8,127.0.0.0/"
+         "32,127.0.0.128/25,127.0.0.16/28,127.0.0.2/31,127.0.0.32/27,127.0.0.4/"
+         "30,127.0.0.64/26,127.0.0.8/29,127.0.1.0/24,127.0.128.0/17,127.0.16.0/"
+         "20,127.0.2.0/23,127.0.32.0/19,127.0.4.0/22,127.0.64.0/18,127.0.8.0/"
+         "21,127.1.0.0/16,127.128.0.0/9,127.16.0.0/12,127.2.0.0/15,127.32.0.0/"
+         "11,127.4.0.0/14,127.64.0.0/10,127.8.0.0/13,128.0.0.0/1,64.0.0.0/"
+         "3,96.0.0.0/4,127.0.0.1/32"
+      << "0.0.0.0/0";
+  QTest::addRow("v6 siblings") << "fc00::/8,fd00::/8,::/0"
+                               << "::/0";
+  QTest::addRow("v6 and v4") << "fc00::/8,10.0.0.0/9,fd00::/8,10.128.0.0/9"
+                             << "10.0.0.0/8,fc00::/7";
+}
+
+void TestIpAddress::aggregate() {
+  QFETCH(QString, input);
+  QList<IPAddress> list;
+  for (const QString& ip : input.split(",", Qt::SkipEmptyParts)) {
+    list.append(IPAddress(ip));
+  }
+
+  QStringList aggregated;
+  for (const IPAddress& ip : IPAddress::aggregate(list)) {
+    aggregated.append(ip.toString());
+  }
+
+  QFETCH(QString, result);
+  QCOMPARE(aggregated.join(","), result);
+}
+
+void TestIpAddress::aggregateBruteForce() {
+  // Random sets of prefixes inside a /24: the aggregated list must cover
+  // exactly the same addresses, and it must be minimal.
+  QRandomGenerator generator(42);
+  quint32 base = QHostAddress("10.0.0.0").toIPv4Address();
+
+  for (int run = 0; run < 500; ++run) {
+    QList<IPAddress> list;
+    int count = generator.bounded(16);
+    for (int i = 0; i < count; ++i) {
+      quint32 address = base + generator.bounded(256);
+      int prefixLength = 24 + generator.bounded(9);
+      list.append(IPAddress(QHostAddress(address), prefixLength));
+    }
+
+    QList<IPAddress> aggregated = IPAddress::aggregate(list);
+    QVERIFY(aggregated.length() <= list.length());
+
+    for (quint32 address = base; address < base + 256; ++address) {
+      QHostAddress host(address);
+      bool expected = false;
+      for (const IPAddress& ip : list) {
+        expected |= ip.contains(host);
+      }
+
+      int matches = 0;
+      for (const IPAddress& ip : aggregated) {
+        matches += ip.contains(host) ? 1 : 0;
+      }
+      QCOMPARE(matches, expected ? 1 : 0);
+    }
+
+    // No siblings left.
+    for (const IPAddress& a : aggregated) {
+      if (a.prefixLength() == 0) {
+        continue;
+      }
+      QList<IPAddress> sn =
+          IPAddress(a.address(), a.prefixLength() - 1).subnets();
+      for (const IPAddress& b : aggregated) {
+        QVERIFY(a == b || sn[0] != a || sn[1] != b);
+      }
+    }
+  }
+}
+
+void TestIpAddress::packList() {
+  QList<IPAddress> list = {
+      IPAddress("0.0.0.0/0"),       IPAddress("10.0.0.0/8"),
+      IPAddress("1.2.3.4/32"),      IPAddress("::/0"),
+      IPAddress("fc00::/7"),        IPAddress("2001:db8::1/128"),
+      IPAddress("::ffff:0:0/96"),   IPAddress("::ffff:10.0.0.0/104"),
+  };
+
+  QByteArray packed = IPAddress::packList(list);
+  QCOMPARE(packed.length(), 3 * 6 + 5 * 18);
+
+  // The IPv4-mapped IPv6 ranges stay IPv6.
+  QList<IPAddress> unpacked;
+  QVERIFY(IPAddress::unpackList(packed, unpacked));
+  QCOMPARE(unpacked.length(), list.length());
+  for (int i = 0; i < list.length(); ++i) {
+    QCOMPARE(unpacked[i].toString(), list[i].toString());
+    QCOMPARE(unpacked[i].type(), list[i].type());
+  }
+
+  // Truncated.
+  QVERIFY(!IPAddress::unpackList(packed.left(packed.length() - 1), unpacked));
+  QVERIFY(!IPAddress::unpackList(packed.left(1), unpacked));
+
+  // Invalid prefix lengths.
+  QByteArray invalid = IPAddress::packList({IPAddress("::/0")});
+  invalid[1] = (char)129;
+  QVERIFY(!IPAddress::unpackList(invalid, unpacked));
+
+  invalid = IPAddress::packList({IPAddress("1.2.3.4/32")});
+  invalid[1] = (char)33;
+  QVERIFY(!IPAddress::unpackList(invalid, unpacked));
+
+  // Invalid family.
+  invalid[0] = (char)5;
+  QVERIFY(!IPAddress::unpackList(invalid, unpacked));
+}
+
+void TestIpAddress::rfcContains_data() {
+  QTest::addColumn<QString>("address");
+  QTest::addColumn<bool>("rfc1918");
+  QTest::addColumn<bool>("rfc4193");
+
+  QTest::addRow("10.0.0.1") << "10.0.0.1" << true << false;
+  QTest::addRow("11.0.0.1") << "11.0.0.1" << false << false;
+  QTest::addRow("172.16.0.1") << "172.16.0.1" << true << false;
+  QTest::addRow("172.31.255.255") << "172.31.255.255" << true << false;
+  QTest::addRow("172.32.0.0") << "172.32.0.0" << false << false;
+  QTest::addRow("192.168.1.1") << "192.168.1.1" << true << false;
+  QTest::addRow("192.169.1.1") << "192.169.1.1" << false << false;
+  QTest::addRow("fc00::1") << "fc00::1" << false << true;
+  QTest::addRow("fdff::1") << "fdff::1" << false << true;
+  QTest::addRow("fe00::1") << "fe00::1" << false << false;
+  QTest::addRow("::1") << "::1" << false << false;
+}
+
+void TestIpAddress::rfcContains() {
+  QFETCH(QString, address);
+  QHostAddress ip(address);
+
+  QFETCH(bool, rfc1918);
+  QCOMPARE(RFC1918::contains(ip), rfc1918);
+
+  QFETCH(bool, rfc4193);
+  QCOMPARE(RFC4193::contains(ip), rfc4193);
+}
+
+void TestIpAddress::rfcBlocks() {
+  QCOMPARE(RFC1918::ipv4()[0].toString(), "10.0.0.0/8");
+  QCOMPARE(RFC4193::ipv6()[0].toString(), "fc00::/7");
+  QCOMPARE(RFC1112::ipv4MulticastAddressBlock().toString(), "224.0.0.0/4");
+  QCOMPARE(RFC4291::ipv6LoopbackAddressBlock().toString(), "::1/128");
+  QCOMPARE(RFC4291::ipv6MulticastAddressBlock().toString(), "ff00::/8");
+  QCOMPARE(RFC5735::ipv4LoopbackAddressBlock().toString(), "127.0.0.0/8");
+}
+
+void TestIpAddress::rfcLocalNetworksComplement() {
+  // The precomputed tables must match what excludeAddresses() computes.
+  QList<IPAddress> excludeIPv4s = RFC1918::ipv4();
+  excludeIPv4s.append(RFC1112::ipv4MulticastAddressBlock());
+  QList<IPAddress> excludeIPv6s = RFC4193::ipv6();
+  excludeIPv6s.append(RFC4291::ipv6MulticastAddressBlock());
+
+  struct {
+    QList<IPAddress> computed;
+    QList<IPAddress> precomputed;
+  } sets[] = {
+      {IPAddress::excludeAddresses({IPAddress("0.0.0.0/0")}, excludeIPv4s),
+       RFCLocalNetworks::ipv4Complement()},
+      {IPAddress::excludeAddresses({IPAddress("::/0")}, excludeIPv6s),
+       RFCLocalNetworks::ipv6Complement()},
+  };
+
+  for (const auto& set : sets) {
+    QStringList computed;
+    for (const IPAddress& ip : set.computed) {
+      computed.append(ip.toString());
+    }
+    std::sort(computed.begin(), computed.end());
+
+    QStringList precomputed;
+    for (const IPAddress& ip : set.precomputed) {
+      precomputed.append(ip.toString());
+    }
+    std::sort(precomputed.begin(), precomputed.end());
+
+    QCOMPARE(precomputed, computed);
+  }
+}
+
 static TestIpAddress s_testIpAddress;
@@ -24,4 +24,16 @@ class TestIpAddress final : public TestHelper {
 
   void excludeAddresses_data();
   void excludeAddresses();
+
+  void aggregate_data();
+  void aggregate();
+  void aggregateBruteForce();
+
+  void packList();
+
+  void rfcContains_data();
+  void rfcContains();
+  void rfcBlocks();
+
+  void rfcLocalNetworksComplement();
 };
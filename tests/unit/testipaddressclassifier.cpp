@@ -0,0 +1,118 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testipaddressclassifier.h"
+#include "../../src/ipaddressclassifier.h"
+#include "../../src/rfc/rfc1918.h"
+#include "../../src/rfc/rfc4193.h"
+#include "helper.h"
+
+#include <QRandomGenerator>
+
+namespace {
+IPAddressClassifier createClassifier() {
+  IPAddressClassifier classifier;
+  classifier.addRange(IPAddress("0.0.0.0/0"), 0);
+  classifier.addRanges(RFC1918::ipv4(), 1);
+  classifier.addRange(IPAddress("10.1.0.0/16"), 2);
+  classifier.addRange(IPAddress("10.255.255.255/32"), 3);
+  classifier.addRange(IPAddress("255.255.255.255/32"), 4);
+  classifier.addRanges(RFC4193::ipv6(), 5);
+  classifier.addRange(IPAddress("fd00::/8"), 6);
+  classifier.addRange(IPAddress("ffff::/16"), 7);
+  // Identical ranges: the last one wins.
+  classifier.addRange(IPAddress("172.16.0.0/12"), 8);
+  return classifier;
+}
+}  // namespace
+
+void TestIPAddressClassifier::empty() {
+  IPAddressClassifier classifier;
+  QCOMPARE(classifier.classify(QHostAddress("1.2.3.4")),
+           IPAddressClassifier::Unclassified);
+  QCOMPARE(classifier.classify(QHostAddress("::1")),
+           IPAddressClassifier::Unclassified);
+  QCOMPARE(classifier.classify(QHostAddress()),
+           IPAddressClassifier::Unclassified);
+  QVERIFY(!classifier.contains(QHostAddress("1.2.3.4")));
+}
+
+void TestIPAddressClassifier::classify_data() {
+  QTest::addColumn<QString>("address");
+  QTest::addColumn<int>("category");
+
+  QTest::addRow("v4 min") << "0.0.0.0" << 0;
+  QTest::addRow("v4 world") << "1.2.3.4" << 0;
+  QTest::addRow("v4 10/8 first") << "10.0.0.0" << 1;
+  QTest::addRow("v4 10/8") << "10.0.255.255" << 1;
+  QTest::addRow("v4 10.1/16 first") << "10.1.0.0" << 2;
+  QTest::addRow("v4 10.1/16 last") << "10.1.255.255" << 2;
+  QTest::addRow("v4 after 10.1/16") << "10.2.0.0" << 1;
+  QTest::addRow("v4 before /32") << "10.255.255.254" << 1;
+  QTest::addRow("v4 /32") << "10.255.255.255" << 3;
+  QTest::addRow("v4 after 10/8") << "11.0.0.0" << 0;
+  QTest::addRow("v4 172.16/12") << "172.20.1.1" << 8;
+  QTest::addRow("v4 after 172.16/12") << "172.32.0.0" << 0;
+  QTest::addRow("v4 192.168/16") << "192.168.1.1" << 1;
+  QTest::addRow("v4 max - 1") << "255.255.255.254" << 0;
+  QTest::addRow("v4 max") << "255.255.255.255" << 4;
+
+  QTest::addRow("v6 min") << "::" << IPAddressClassifier::Unclassified;
+  QTest::addRow("v6 world") << "2001:db8::1"
+                            << IPAddressClassifier::Unclassified;
+  QTest::addRow("v6 fc00::/7") << "fc00::1" << 5;
+  QTest::addRow("v6 fd00::/8") << "fd12:3456::1" << 6;
+  QTest::addRow("v6 fdff") << "fdff:ffff:ffff:ffff:ffff:ffff:ffff:ffff" << 6;
+  QTest::addRow("v6 after fc00::/7")
+      << "fe00::" << IPAddressClassifier::Unclassified;
+  QTest::addRow("v6 max") << "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff" << 7;
+}
+
+void TestIPAddressClassifier::classify() {
+  IPAddressClassifier classifier = createClassifier();
+
+  QFETCH(QString, address);
+  QFETCH(int, category);
+  QCOMPARE(classifier.classify(QHostAddress(address)), category);
+}
+
+void TestIPAddressClassifier::benchmarkIPv4() {
+  IPAddressClassifier classifier = createClassifier();
+
+  QVector<quint32> addresses(1000000);
+  QRandomGenerator generator(42);
+  for (quint32& address : addresses) {
+    address = generator.generate();
+  }
+
+  int matches = 0;
+  QBENCHMARK {
+    for (quint32 address : addresses) {
+      matches += classifier.classifyIPv4(address) != 0;
+    }
+  }
+  QVERIFY(matches > 0);
+}
+
+void TestIPAddressClassifier::benchmarkIPv6() {
+  IPAddressClassifier classifier = createClassifier();
+
+  QVector<Q_IPV6ADDR> addresses(1000000);
+  QRandomGenerator generator(42);
+  for (Q_IPV6ADDR& address : addresses) {
+    generator.fillRange(reinterpret_cast<quint32*>(address.c), 4);
+    // Make a subset of the addresses local.
+    if (address[15] & 1) address[0] = 0xfd;
+  }
+
+  int matches = 0;
+  QBENCHMARK {
+    for (const Q_IPV6ADDR& address : addresses) {
+      matches += classifier.classifyIPv6(address) == 6;
+    }
+  }
+  QVERIFY(matches > 0);
+}
+
+static TestIPAddressClassifier s_testIPAddressClassifier;
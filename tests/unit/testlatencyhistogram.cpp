@@ -0,0 +1,86 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testlatencyhistogram.h"
+#include "../../src/latencyhistogram.h"
+#include "helper.h"
+
+void TestLatencyHistogram::empty() {
+  LatencyHistogram histogram;
+  QCOMPARE(histogram.count(), quint64(0));
+  QCOMPARE(histogram.min(), qint64(0));
+  QCOMPARE(histogram.max(), qint64(0));
+  QCOMPARE(histogram.mean(), qint64(0));
+  QCOMPARE(histogram.percentile(50), qint64(0));
+}
+
+void TestLatencyHistogram::buckets_data() {
+  QTest::addColumn<qint64>("usec");
+  QTest::addColumn<int>("bucket");
+
+  QTest::addRow("negative") << qint64(-5) << 0;
+  QTest::addRow("zero") << qint64(0) << 0;
+  QTest::addRow("one") << qint64(1) << 1;
+  QTest::addRow("two") << qint64(2) << 2;
+  QTest::addRow("three") << qint64(3) << 2;
+  QTest::addRow("four") << qint64(4) << 3;
+  QTest::addRow("1023") << qint64(1023) << 10;
+  QTest::addRow("1024") << qint64(1024) << 11;
+  QTest::addRow("huge") << (qint64(1) << 40) << LatencyHistogram::BUCKETS - 1;
+}
+
+void TestLatencyHistogram::buckets() {
+  QFETCH(qint64, usec);
+  QFETCH(int, bucket);
+
+  QCOMPARE(LatencyHistogram::bucketFor(usec), bucket);
+
+  LatencyHistogram histogram;
+  histogram.record(usec);
+  QCOMPARE(histogram.bucketCount(bucket), quint64(1));
+  QCOMPARE(histogram.count(), quint64(1));
+}
+
+void TestLatencyHistogram::percentiles() {
+  LatencyHistogram histogram;
+
+  // 90 fast samples and 10 slow ones.
+  for (int i = 0; i < 90; ++i) {
+    histogram.record(100);
+  }
+  for (int i = 0; i < 10; ++i) {
+    histogram.record(5000);
+  }
+
+  QCOMPARE(histogram.count(), quint64(100));
+  QCOMPARE(histogram.min(), qint64(100));
+  QCOMPARE(histogram.max(), qint64(5000));
+  QCOMPARE(histogram.mean(), qint64((90 * 100 + 10 * 5000) / 100));
+
+  // 100us is in the [64, 128) bucket, 5000us in the [4096, 8192) one.
+  QCOMPARE(histogram.percentile(50), qint64(127));
+  QCOMPARE(histogram.percentile(90), qint64(127));
+  QCOMPARE(histogram.percentile(91), qint64(5000));
+  QCOMPARE(histogram.percentile(100), qint64(5000));
+
+  histogram.clear();
+  QCOMPARE(histogram.count(), quint64(0));
+  QCOMPARE(histogram.max(), qint64(0));
+}
+
+void TestLatencyHistogram::json() {
+  LatencyHistogram histogram;
+  histogram.record(10);
+  histogram.record(30);
+
+  QJsonObject obj = histogram.toJson();
+  QCOMPARE(obj.value("count").toInt(), 2);
+  QCOMPARE(obj.value("min").toInt(), 10);
+  QCOMPARE(obj.value("mean").toInt(), 20);
+  QCOMPARE(obj.value("max").toInt(), 30);
+  QCOMPARE(obj.value("p50").toInt(), 15);
+  QCOMPARE(obj.value("p99").toInt(), 30);
+}
+
+static TestLatencyHistogram s_testLatencyHistogram;
@@ -0,0 +1,113 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testpendingrequests.h"
+#include "../../src/pendingrequests.h"
+#include "helper.h"
+
+#include <QSignalSpy>
+
+void TestPendingRequests::ids() {
+  PendingRequests requests(nullptr);
+
+  quint32 status = requests.start("status", 0);
+  quint32 logs = requests.start("logs", 0);
+  QVERIFY(status != 0);
+  QVERIFY(logs != 0);
+  QVERIFY(status != logs);
+  QCOMPARE(requests.count(), 2);
+
+  // The responses can come in any order, once.
+  QVERIFY(requests.finish(logs));
+  QVERIFY(!requests.finish(logs));
+  QVERIFY(requests.finish(status));
+  QVERIFY(!requests.finish(42));
+  QCOMPARE(requests.count(), 0);
+
+  QJsonObject metrics = requests.metrics();
+  QCOMPARE(metrics.value("status").toObject().value("count").toInt(), 1);
+  QCOMPARE(metrics.value("logs").toObject().value("count").toInt(), 1);
+  QCOMPARE(metrics.value("logs").toObject().value("timeouts").toInt(), 0);
+}
+
+void TestPendingRequests::interleaved() {
+  PendingRequests requests(nullptr);
+
+  QJsonObject first;
+  QJsonObject second;
+  quint32 a = requests.start("status", 0, [&first](const QJsonObject& reply) {
+    first = reply;
+  });
+  quint32 b = requests.start("status", 0, [&second](const QJsonObject& reply) {
+    second = reply;
+  });
+
+  QJsonObject replyA;
+  replyA.insert("txBytes", 1);
+  QJsonObject replyB;
+  replyB.insert("txBytes", 2);
+
+  // Each handler receives the reply to its own request.
+  QVERIFY(requests.finish(b, replyB));
+  QVERIFY(first.isEmpty());
+  QCOMPARE(second, replyB);
+
+  QVERIFY(requests.finish(a, replyA));
+  QCOMPARE(first, replyA);
+  QCOMPARE(second, replyB);
+
+  // A request which times out gets an empty reply.
+  bool called = false;
+  QJsonObject late = replyA;
+  requests.start("activate", 50, [&](const QJsonObject& reply) {
+    called = true;
+    late = reply;
+  });
+  QTRY_VERIFY_WITH_TIMEOUT(called, 1000);
+  QVERIFY(late.isEmpty());
+}
+
+void TestPendingRequests::timeouts() {
+  PendingRequests requests(nullptr);
+  QSignalSpy spy(&requests, &PendingRequests::timedOut);
+
+  quint32 slow = requests.start("activate", 300);
+  quint32 fast = requests.start("status", 50);
+  quint32 never = requests.start("logs", 0);
+
+  // Each request has its own deadline.
+  QVERIFY(spy.wait(1000));
+  QCOMPARE(spy.count(), 1);
+  QCOMPARE(spy.last().at(0).toUInt(), fast);
+  QCOMPARE(spy.last().at(1).toString(), QString("status"));
+  QVERIFY(requests.contains(slow));
+
+  QVERIFY(spy.wait(1000));
+  QCOMPARE(spy.count(), 2);
+  QCOMPARE(spy.last().at(0).toUInt(), slow);
+
+  // A late response is ignored.
+  QVERIFY(!requests.finish(fast));
+  QVERIFY(requests.finish(never));
+
+  QJsonObject metrics = requests.metrics();
+  QCOMPARE(metrics.value("status").toObject().value("timeouts").toInt(), 1);
+  QCOMPARE(metrics.value("status").toObject().value("count").toInt(), 0);
+  QCOMPARE(metrics.value("activate").toObject().value("timeouts").toInt(), 1);
+  QCOMPARE(metrics.value("logs").toObject().value("count").toInt(), 1);
+}
+
+void TestPendingRequests::clear() {
+  PendingRequests requests(nullptr);
+  QSignalSpy spy(&requests, &PendingRequests::timedOut);
+
+  requests.start("status", 50);
+  requests.clear();
+  QCOMPARE(requests.count(), 0);
+
+  QTest::qWait(200);
+  QCOMPARE(spy.count(), 0);
+}
+
+static TestPendingRequests s_testPendingRequests;
@@ -0,0 +1,58 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testquerydispatcher.h"
+#include "../../src/daemon/querydispatcher.h"
+#include "helper.h"
+
+#include <QSemaphore>
+
+void TestQueryDispatcher::concurrency() {
+  QueryDispatcher dispatcher(2);
+
+  // Both queries run at the same time, without the main thread.
+  QSemaphore started;
+  QSemaphore release;
+  for (int i = 0; i < 2; ++i) {
+    dispatcher.dispatch("status", [&]() {
+      started.release();
+      release.acquire();
+    });
+  }
+  QVERIFY(started.tryAcquire(2, 2000));
+  release.release(2);
+  dispatcher.waitForDone();
+
+  QJsonObject queries = dispatcher.metrics().value("queries").toObject();
+  QJsonObject status = queries.value("status").toObject();
+  QCOMPARE(status.value("run").toObject().value("count").toInt(), 2);
+  QCOMPARE(status.value("wait").toObject().value("count").toInt(), 2);
+}
+
+void TestQueryDispatcher::queueDepth() {
+  QueryDispatcher dispatcher(1);
+
+  QSemaphore started;
+  QSemaphore release;
+  dispatcher.dispatch("logs", [&]() {
+    started.release();
+    release.acquire();
+  });
+  dispatcher.dispatch("status", []() {});
+
+  // The second query waits for the only worker.
+  QVERIFY(started.tryAcquire(1, 2000));
+  QCOMPARE(dispatcher.queueDepth(), 2);
+
+  release.release();
+  dispatcher.waitForDone();
+  QCOMPARE(dispatcher.queueDepth(), 0);
+
+  QJsonObject metrics = dispatcher.metrics();
+  QCOMPARE(metrics.value("queueDepth").toInt(), 0);
+  QCOMPARE(metrics.value("maxQueueDepth").toInt(), 2);
+  QCOMPARE(metrics.value("queries").toObject().count(), 2);
+}
+
+static TestQueryDispatcher s_testQueryDispatcher;
@@ -0,0 +1,182 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testroutemonitor.h"
+#include "../../src/platforms/linux/daemon/routemonitor.h"
+#include "helper.h"
+
+#include <arpa/inet.h>
+#include <linux/fib_rules.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <string.h>
+
+namespace {
+
+constexpr quint32 TABLE = 0xca6c;
+constexpr quint32 FWMARK = 0xca6c;
+constexpr int IFINDEX = 7;
+constexpr int OTHER_IFINDEX = 2;
+
+void appendAttr(QByteArray& data, quint16 type, const void* payload,
+                size_t len) {
+  struct rtattr attr;
+  attr.rta_type = type;
+  attr.rta_len = RTA_LENGTH(len);
+  data.append(reinterpret_cast<const char*>(&attr), sizeof(attr));
+  data.append(static_cast<const char*>(payload), len);
+  data.append(RTA_ALIGN(data.length()) - data.length(), '\0');
+}
+
+// A RTM_DELROUTE notification for an IPv4 prefix.
+QByteArray delRoute(const char* dst, int prefixlen, quint32 table, int oif) {
+  struct nlmsghdr header;
+  memset(&header, 0, sizeof(header));
+  header.nlmsg_type = RTM_DELROUTE;
+
+  struct rtmsg rtm;
+  memset(&rtm, 0, sizeof(rtm));
+  rtm.rtm_family = AF_INET;
+  rtm.rtm_dst_len = prefixlen;
+  rtm.rtm_table = table < 256 ? table : RT_TABLE_UNSPEC;
+
+  QByteArray payload(reinterpret_cast<const char*>(&rtm), sizeof(rtm));
+  payload.append(NLMSG_ALIGN(payload.length()) - payload.length(), '\0');
+
+  struct in_addr addr;
+  inet_pton(AF_INET, dst, &addr);
+  appendAttr(payload, RTA_DST, &addr, sizeof(addr));
+  appendAttr(payload, RTA_TABLE, &table, sizeof(table));
+  quint32 index = oif;
+  appendAttr(payload, RTA_OIF, &index, sizeof(index));
+
+  header.nlmsg_len = NLMSG_LENGTH(payload.length());
+  QByteArray data(reinterpret_cast<const char*>(&header), sizeof(header));
+  data.append(NLMSG_ALIGN(data.length()) - data.length(), '\0');
+  data.append(payload);
+  return data;
+}
+
+// A RTM_DELRULE notification for the rule sending the unmarked packets to
+// the VPN table.
+QByteArray delRule(int family) {
+  struct nlmsghdr header;
+  memset(&header, 0, sizeof(header));
+  header.nlmsg_type = RTM_DELRULE;
+
+  struct fib_rule_hdr rule;
+  memset(&rule, 0, sizeof(rule));
+  rule.family = family;
+  rule.table = RT_TABLE_UNSPEC;
+
+  QByteArray payload(reinterpret_cast<const char*>(&rule), sizeof(rule));
+  payload.append(NLMSG_ALIGN(payload.length()) - payload.length(), '\0');
+  appendAttr(payload, FRA_TABLE, &TABLE, sizeof(TABLE));
+  appendAttr(payload, FRA_FWMARK, &FWMARK, sizeof(FWMARK));
+
+  header.nlmsg_len = NLMSG_LENGTH(payload.length());
+  QByteArray data(reinterpret_cast<const char*>(&header), sizeof(header));
+  data.append(NLMSG_ALIGN(data.length()) - data.length(), '\0');
+  data.append(payload);
+  return data;
+}
+
+void handle(RouteMonitor& monitor, const QByteArray& data) {
+  monitor.handleMessage(reinterpret_cast<const struct nlmsghdr*>(data.data()));
+}
+
+}  // namespace
+
+void TestRouteMonitor::restoreRoute() {
+  RouteMonitor monitor(TABLE, FWMARK);
+  monitor.start(IFINDEX);
+  monitor.addRoute(IPAddress("0.0.0.0/0"), 0);
+  monitor.addRoute(IPAddress("10.64.0.0/10"), 1);
+
+  QList<RouteMonitor::Route> restored;
+  connect(&monitor, &RouteMonitor::routesMissing,
+          [&](const QList<RouteMonitor::Route>& routes) { restored = routes; });
+
+  // Someone else deletes the default route of the VPN table, and one of the
+  // routes of the inner hop in the main table.
+  handle(monitor, delRoute("0.0.0.0", 0, TABLE, IFINDEX));
+  handle(monitor, delRoute("10.64.0.0", 10, RT_TABLE_MAIN, IFINDEX));
+  monitor.reconcile();
+
+  QCOMPARE(restored.count(), 2);
+  QSet<QString> prefixes;
+  for (const RouteMonitor::Route& route : restored) {
+    prefixes.insert(QString("%1@%2")
+                        .arg(route.m_prefix.toString())
+                        .arg(route.m_hopindex));
+  }
+  QVERIFY(prefixes.contains("0.0.0.0/0@0"));
+  QVERIFY(prefixes.contains("10.64.0.0/10@1"));
+
+  // Once restored, nothing is missing anymore.
+  restored.clear();
+  monitor.reconcile();
+  QVERIFY(restored.isEmpty());
+}
+
+void TestRouteMonitor::otherInterface() {
+  RouteMonitor monitor(TABLE, FWMARK);
+  monitor.start(IFINDEX);
+  monitor.addRoute(IPAddress("10.64.0.0/10"), 1);
+
+  int calls = 0;
+  connect(&monitor, &RouteMonitor::routesMissing,
+          [&](const QList<RouteMonitor::Route>&) { ++calls; });
+
+  // The same prefix through another interface of the main table, and
+  // prefixes which are not ours.
+  handle(monitor, delRoute("10.64.0.0", 10, RT_TABLE_MAIN, OTHER_IFINDEX));
+  handle(monitor, delRoute("10.64.0.0", 16, RT_TABLE_MAIN, IFINDEX));
+  handle(monitor, delRoute("192.168.1.0", 24, RT_TABLE_MAIN, IFINDEX));
+  monitor.reconcile();
+
+  QCOMPARE(calls, 0);
+}
+
+void TestRouteMonitor::removedByUs() {
+  RouteMonitor monitor(TABLE, FWMARK);
+  monitor.start(IFINDEX);
+  monitor.addRoute(IPAddress("0.0.0.0/0"), 0);
+
+  int calls = 0;
+  connect(&monitor, &RouteMonitor::routesMissing,
+          [&](const QList<RouteMonitor::Route>&) { ++calls; });
+
+  // The notification of our own deletion arrives after the route is
+  // forgotten.
+  monitor.removeRoute(IPAddress("0.0.0.0/0"), 0);
+  handle(monitor, delRoute("0.0.0.0", 0, TABLE, IFINDEX));
+  monitor.reconcile();
+  QCOMPARE(calls, 0);
+
+  // After stop(), nothing is restored.
+  monitor.addRoute(IPAddress("0.0.0.0/0"), 0);
+  monitor.stop();
+  handle(monitor, delRoute("0.0.0.0", 0, TABLE, IFINDEX));
+  monitor.reconcile();
+  QCOMPARE(calls, 0);
+}
+
+void TestRouteMonitor::rules() {
+  RouteMonitor monitor(TABLE, FWMARK);
+  monitor.start(IFINDEX);
+  monitor.addRules(AF_INET);
+
+  QList<int> families;
+  connect(&monitor, &RouteMonitor::rulesMissing,
+          [&](int family) { families.append(family); });
+
+  handle(monitor, delRule(AF_INET));
+  handle(monitor, delRule(AF_INET6));
+  monitor.reconcile();
+
+  QCOMPARE(families, QList<int>{AF_INET});
+}
+
+static TestRouteMonitor s_testRouteMonitor;
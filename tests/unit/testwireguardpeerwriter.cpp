@@ -0,0 +1,131 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testwireguardpeerwriter.h"
+#include "../../src/ipaddress.h"
+#include "../../src/platforms/linux/daemon/wireguarddevicebuilder.h"
+#include "../../src/platforms/linux/daemon/wireguardpeerwriter.h"
+#include "helper.h"
+
+// Import wireguard C library for Linux
+#if defined(__cplusplus)
+extern "C" {
+#endif
+#include "../../3rdparty/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#if defined(__cplusplus)
+}
+#endif
+// End import wireguard
+
+namespace {
+
+constexpr const char* PUBKEY = "o2sEU8w1cOaZBkZ2kTzyFMtLWz3mqnJfN5Dcx2bQAkY=";
+constexpr const char* OLD_PUBKEY =
+    "dMjAy1FRKeBgiVUTfLGJBHLLiNEJu0VCJg7J0Qw9fHQ=";
+
+// What wg_set_device() received, peer by peer.
+class Update {
+ public:
+  int m_peers = 0;
+  int m_allowedips = 0;
+  bool m_replace = false;
+  bool m_remove = false;
+  bool m_removeOld = false;
+};
+
+QList<IPAddress> prefixes(int count) {
+  QList<IPAddress> list;
+  for (int i = 0; i < count; ++i) {
+    list.append(IPAddress(QString("10.%1.%2.0/24").arg(i / 256).arg(i % 256)));
+  }
+  return list;
+}
+
+// Records the updates, and fails the one at index `failAt`.
+WireguardPeerWriter::SetDeviceFunction recorder(QList<Update>* updates,
+                                                int failAt = -1) {
+  return [updates, failAt](wg_device* device) {
+    wg_key key;
+    wg_key_from_base64(key, PUBKEY);
+
+    Update update;
+    wg_peer* peer;
+    wg_for_each_peer(device, peer) {
+      update.m_peers++;
+      bool isNew = memcmp(peer->public_key, key, sizeof(wg_key)) == 0;
+      if (isNew) {
+        update.m_replace |= !!(peer->flags & WGPEER_REPLACE_ALLOWEDIPS);
+        update.m_remove |= !!(peer->flags & WGPEER_REMOVE_ME);
+      } else {
+        update.m_removeOld |= !!(peer->flags & WGPEER_REMOVE_ME);
+      }
+
+      wg_allowedip* ip;
+      wg_for_each_allowedip(peer, ip) { update.m_allowedips++; }
+    }
+
+    int index = updates->count();
+    updates->append(update);
+    return index == failAt ? -1 : 0;
+  };
+}
+
+}  // namespace
+
+void TestWireguardPeerWriter::slices() {
+  QList<Update> updates;
+  WireguardDeviceBuilder builder;
+  WireguardPeerWriter writer(builder, recorder(&updates));
+
+  int count = WireguardPeerWriter::ALLOWEDIPS_PER_UPDATE + 10;
+  QVERIFY(writer.setPeer("moz0", PUBKEY, nullptr, 60, prefixes(count),
+                         OLD_PUBKEY));
+
+  // Only the first update replaces the allowed-IPs, and only the last one
+  // removes the previous peer.
+  QCOMPARE(updates.count(), 2);
+  QVERIFY(updates[0].m_replace);
+  QCOMPARE(updates[0].m_allowedips,
+           WireguardPeerWriter::ALLOWEDIPS_PER_UPDATE);
+  QVERIFY(!updates[0].m_removeOld);
+  QVERIFY(!updates[1].m_replace);
+  QCOMPARE(updates[1].m_allowedips, 10);
+  QCOMPARE(updates[1].m_peers, 2);
+  QVERIFY(updates[1].m_removeOld);
+}
+
+void TestWireguardPeerWriter::failedFirstSlice() {
+  QList<Update> updates;
+  WireguardDeviceBuilder builder;
+  WireguardPeerWriter writer(builder, recorder(&updates, 0));
+
+  int count = WireguardPeerWriter::ALLOWEDIPS_PER_UPDATE + 10;
+  QVERIFY(!writer.setPeer("moz0", PUBKEY, nullptr, 60, prefixes(count),
+                          QString()));
+
+  // Nothing has been applied: there is nothing to undo.
+  QCOMPARE(updates.count(), 1);
+}
+
+void TestWireguardPeerWriter::failedSecondSlice() {
+  QList<Update> updates;
+  WireguardDeviceBuilder builder;
+  WireguardPeerWriter writer(builder, recorder(&updates, 1));
+
+  int count = 2 * WireguardPeerWriter::ALLOWEDIPS_PER_UPDATE + 10;
+  QVERIFY(!writer.setPeer("moz0", PUBKEY, nullptr, 60, prefixes(count),
+                          OLD_PUBKEY));
+
+  // The peer with a truncated list is removed, the third slice is never
+  // sent and the previous peer is left alone.
+  QCOMPARE(updates.count(), 3);
+  QVERIFY(updates[0].m_replace);
+  QVERIFY(!updates[1].m_removeOld);
+  QCOMPARE(updates[2].m_peers, 1);
+  QCOMPARE(updates[2].m_allowedips, 0);
+  QVERIFY(updates[2].m_remove);
+  QVERIFY(!updates[2].m_removeOld);
+}
+
+static TestWireguardPeerWriter s_testWireguardPeerWriter;
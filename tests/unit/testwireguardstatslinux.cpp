@@ -0,0 +1,134 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "testwireguardstatslinux.h"
+#include "../../src/platforms/linux/daemon/wireguardstatslinux.h"
+#include "helper.h"
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+
+namespace {
+
+// From linux/wireguard.h.
+constexpr quint16 WGDEVICE_A_IFNAME = 2;
+constexpr quint16 WGDEVICE_A_PEERS = 8;
+constexpr quint16 WGPEER_A_PUBLIC_KEY = 1;
+constexpr quint16 WGPEER_A_LAST_HANDSHAKE_TIME = 6;
+constexpr quint16 WGPEER_A_RX_BYTES = 7;
+constexpr quint16 WGPEER_A_TX_BYTES = 8;
+constexpr quint16 WGPEER_A_ALLOWEDIPS = 9;
+
+QByteArray attr(quint16 type, const QByteArray& payload) {
+  struct nlattr header;
+  header.nla_type = type;
+  header.nla_len = NLA_HDRLEN + payload.length();
+
+  QByteArray data(reinterpret_cast<const char*>(&header), sizeof(header));
+  data.append(payload);
+  data.append(NLA_ALIGN(data.length()) - data.length(), '\0');
+  return data;
+}
+
+QByteArray nested(quint16 type, const QByteArray& payload) {
+  return attr(type | NLA_F_NESTED, payload);
+}
+
+template <typename T>
+QByteArray raw(const T& value) {
+  return QByteArray(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+QByteArray key(char c) { return QByteArray(32, c); }
+
+QByteArray peer(char c, qint64 handshakeSec, quint64 rx, quint64 tx) {
+  qint64 timespec[2] = {handshakeSec, 500000000};
+  return nested(0, attr(WGPEER_A_PUBLIC_KEY, key(c)) +
+                       attr(WGPEER_A_LAST_HANDSHAKE_TIME, raw(timespec)) +
+                       attr(WGPEER_A_RX_BYTES, raw(rx)) +
+                       attr(WGPEER_A_TX_BYTES, raw(tx)) +
+                       nested(WGPEER_A_ALLOWEDIPS, QByteArray(64, '\x01')));
+}
+
+// A WG_CMD_GET_DEVICE reply, as sent by the kernel.
+QByteArray device(const QByteArray& attrs) {
+  struct nlmsghdr header;
+  memset(&header, 0, sizeof(header));
+  header.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + attrs.length());
+  header.nlmsg_flags = NLM_F_MULTI;
+
+  struct genlmsghdr genl;
+  memset(&genl, 0, sizeof(genl));
+  genl.version = 1;
+
+  QByteArray data = raw(header) + raw(genl) + attrs;
+  data.append(NLMSG_ALIGN(data.length()) - data.length(), '\0');
+  return data;
+}
+
+const struct nlmsghdr* header(const QByteArray& message) {
+  return reinterpret_cast<const struct nlmsghdr*>(message.constData());
+}
+
+}  // namespace
+
+void TestWireguardStatsLinux::parseDevice() {
+  QByteArray message = device(
+      attr(WGDEVICE_A_IFNAME, QByteArray("wg0", 4)) +
+      nested(WGDEVICE_A_PEERS,
+             peer('a', 1000, 10, 20) + peer('b', 2000, 1ULL << 40, 0)));
+
+  WireguardStatsLinux stats;
+  QList<WireguardUtils::PeerStatus> peers;
+  stats.parseDevice(header(message), peers);
+
+  QCOMPARE(peers.length(), 2);
+  QCOMPARE(peers[0].m_pubkey, QString(key('a').toBase64()));
+  QCOMPARE(peers[0].m_handshake, qint64(1000500));
+  QCOMPARE(peers[0].m_rxBytes, qint64(10));
+  QCOMPARE(peers[0].m_txBytes, qint64(20));
+  QCOMPARE(peers[1].m_pubkey, QString(key('b').toBase64()));
+  QCOMPARE(peers[1].m_handshake, qint64(2000500));
+  QCOMPARE(peers[1].m_rxBytes, qint64(1LL << 40));
+}
+
+void TestWireguardStatsLinux::continuedPeer() {
+  // The allowed-IPs of a big peer continue in the next message of the dump,
+  // with its key only.
+  QByteArray first = device(nested(WGDEVICE_A_PEERS, peer('a', 1000, 1, 2)));
+  QByteArray second = device(nested(
+      WGDEVICE_A_PEERS,
+      nested(0, attr(WGPEER_A_PUBLIC_KEY, key('a')) +
+                    nested(WGPEER_A_ALLOWEDIPS, QByteArray(64, '\x02')))));
+
+  WireguardStatsLinux stats;
+  QList<WireguardUtils::PeerStatus> peers;
+  stats.parseDevice(header(first), peers);
+  stats.parseDevice(header(second), peers);
+
+  QCOMPARE(peers.length(), 1);
+  QCOMPARE(peers[0].m_pubkey, QString(key('a').toBase64()));
+}
+
+void TestWireguardStatsLinux::truncated() {
+  QByteArray message = device(nested(
+      WGDEVICE_A_PEERS, peer('a', 1000, 1, 2) + peer('b', 2000, 3, 4)));
+
+  // The second peer is cut: its attribute overflows the message.
+  struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(message.data());
+  nlmsg->nlmsg_len -= 16;
+
+  WireguardStatsLinux stats;
+  QList<WireguardUtils::PeerStatus> peers;
+  stats.parseDevice(header(message), peers);
+  QVERIFY(peers.length() <= 1);
+
+  // Too short for the generic netlink header.
+  nlmsg->nlmsg_len = NLMSG_LENGTH(0);
+  peers.clear();
+  stats.parseDevice(header(message), peers);
+  QVERIFY(peers.isEmpty());
+}
+
+static TestWireguardStatsLinux s_testWireguardStatsLinux;
@@ -44,11 +44,24 @@ HEADERS += \
     ../../src/connectiondataholder.h \
     ../../src/constants.h \
     ../../src/controller.h \
+    ../../src/counterspage.h \
     ../../src/curve25519.h \
+    ../../src/daemon/daemon.h \
+    ../../src/daemon/daemonframe.h \
+    ../../src/daemon/daemonlocalserverconnection.h \
+    ../../src/daemon/dnsutils.h \
+    ../../src/daemon/handshakewatcher.h \
+    ../../src/daemon/interfaceconfig.h \
+    ../../src/daemon/iputils.h \
+    ../../src/daemon/querydispatcher.h \
+    ../../src/daemon/wireguardutils.h \
     ../../src/errorhandler.h \
     ../../src/featurelist.h \
+    ../../src/framereader.h \
     ../../src/inspector/inspectorwebsocketconnection.h \
     ../../src/ipaddress.h \
+    ../../src/ipaddressclassifier.h \
+    ../../src/latencyhistogram.h \
     ../../src/leakdetector.h \
     ../../src/localizer.h \
     ../../src/logger.h \
@@ -75,6 +88,7 @@ HEADERS += \
     ../../src/networkrequest.h \
     ../../src/networkwatcher.h \
     ../../src/networkwatcherimpl.h \
+    ../../src/pendingrequests.h \
     ../../src/pinghelper.h \
     ../../src/pingsender.h \
     ../../src/platforms/android/androiddatamigration.h \
@@ -83,10 +97,13 @@ HEADERS += \
     ../../src/platforms/dummy/dummypingsender.h \
     ../../src/qmlengineholder.h \
     ../../src/releasemonitor.h \
+    ../../src/rfc/rfc1112.h \
     ../../src/rfc/rfc1918.h \
     ../../src/rfc/rfc4193.h \
     ../../src/rfc/rfc4291.h \
     ../../src/rfc/rfc5735.h \
+    ../../src/rfc/rfclocalnetworks.h \
+    ../../src/rfc/rfcprefix.h \
     ../../src/serveri18n.h \
     ../../src/settingsholder.h \
     ../../src/simplenetworkmanager.h \
@@ -103,21 +120,32 @@ HEADERS += \
     ../../src/update/updater.h \
     ../../src/update/versionapi.h \
     ../../src/urlopener.h \
+    dummydaemon.h \
     helper.h \
     testadjust.h \
     testandroidmigration.h \
     testbigint.h \
     testcommandlineparser.h \
     testconnectiondataholder.h \
+    testcounterspage.h \
+    testdaemonframing.h \
+    testdaemonstatus.h \
+    testdaemonswitch.h \
     testfeature.h \
+    testframereader.h \
+    testhandshakewatcher.h \
     testlocalizer.h \
     testlogger.h \
     testipaddress.h \
+    testipaddressclassifier.h \
     testipfinder.h \
+    testlatencyhistogram.h \
     testlicense.h \
     testmodels.h \
     testmozillavpnh.h \
     testnetworkmanager.h \
+    testpendingrequests.h \
+    testquerydispatcher.h \
     testreleasemonitor.h \
     teststatusicon.h \
     testtasks.h \
@@ -133,15 +161,24 @@ SOURCES += \
     ../../src/connectioncheck.cpp \
     ../../src/connectiondataholder.cpp \
     ../../src/constants.cpp \
+    ../../src/counterspage.cpp \
     ../../src/curve25519.cpp \
+    ../../src/daemon/daemon.cpp \
+    ../../src/daemon/daemonframe.cpp \
+    ../../src/daemon/daemonlocalserverconnection.cpp \
+    ../../src/daemon/handshakewatcher.cpp \
+    ../../src/daemon/querydispatcher.cpp \
     ../../src/errorhandler.cpp \
     ../../src/featurelist.cpp \
+    ../../src/framereader.cpp \
     ../../src/hacl-star/Hacl_Chacha20.c \
     ../../src/hacl-star/Hacl_Chacha20Poly1305_32.c \
     ../../src/hacl-star/Hacl_Curve25519_51.c \
     ../../src/hacl-star/Hacl_Poly1305_32.c \
     ../../src/ipaddress.cpp \
+    ../../src/ipaddressclassifier.cpp \
     ../../src/l18nstringsimpl.cpp \
+    ../../src/latencyhistogram.cpp \
     ../../src/leakdetector.cpp \
     ../../src/localizer.cpp \
     ../../src/logger.cpp \
@@ -165,6 +202,7 @@ SOURCES += \
     ../../src/models/whatsnewmodel.cpp \
     ../../src/networkmanager.cpp \
     ../../src/networkwatcher.cpp \
+    ../../src/pendingrequests.cpp \
     ../../src/pinghelper.cpp \
     ../../src/platforms/android/androiddatamigration.cpp \
     ../../src/platforms/android/androidsharedprefs.cpp \
@@ -172,10 +210,12 @@ SOURCES += \
     ../../src/platforms/dummy/dummypingsender.cpp \
     ../../src/qmlengineholder.cpp \
     ../../src/releasemonitor.cpp \
+    ../../src/rfc/rfc1112.cpp \
     ../../src/rfc/rfc1918.cpp \
     ../../src/rfc/rfc4193.cpp \
     ../../src/rfc/rfc4291.cpp \
     ../../src/rfc/rfc5735.cpp \
+    ../../src/rfc/rfclocalnetworks.cpp \
     ../../src/serveri18n.cpp \
     ../../src/settingsholder.cpp \
     ../../src/simplenetworkmanager.cpp \
@@ -201,15 +241,25 @@ SOURCES += \
     testbigint.cpp \
     testcommandlineparser.cpp \
     testconnectiondataholder.cpp \
+    testcounterspage.cpp \
+    testdaemonframing.cpp \
+    testdaemonstatus.cpp \
+    testdaemonswitch.cpp \
     testfeature.cpp \
+    testframereader.cpp \
+    testhandshakewatcher.cpp \
     testlocalizer.cpp \
     testlogger.cpp \
     testipaddress.cpp \
+    testipaddressclassifier.cpp \
     testipfinder.cpp \
+    testlatencyhistogram.cpp \
     testlicense.cpp \
     testmodels.cpp \
     testmozillavpnh.cpp \
     testnetworkmanager.cpp \
+    testpendingrequests.cpp \
+    testquerydispatcher.cpp \
     testreleasemonitor.cpp \
     teststatusicon.cpp \
     testtasks.cpp \
@@ -225,6 +275,37 @@ exists($$PWD/../../translations/generated/l18nstrings.h) {
 # Platform-specific: Linux
 linux {
     # QMAKE_CXXFLAGS *= -Werror
+
+    QT += dbus
+
+    # shm_open() is in librt before glibc 2.34.
+    LIBS += -lrt
+
+    HEADERS += \
+            ../../src/platforms/linux/daemon/dbustypeslinux.h \
+            ../../src/platforms/linux/daemon/endpointresolver.h \
+            ../../src/platforms/linux/daemon/routemonitor.h \
+            ../../src/platforms/linux/daemon/wireguarddevicebuilder.h \
+            ../../src/platforms/linux/daemon/wireguardpeerwriter.h \
+            ../../src/platforms/linux/daemon/wireguardstatslinux.h \
+            testdbusstatus.h \
+            testendpointresolver.h \
+            testroutemonitor.h \
+            testwireguardpeerwriter.h \
+            testwireguardstatslinux.h
+
+    SOURCES += \
+            ../../3rdparty/wireguard-tools/contrib/embeddable-wg-library/wireguard.c \
+            ../../src/platforms/linux/daemon/endpointresolver.cpp \
+            ../../src/platforms/linux/daemon/routemonitor.cpp \
+            ../../src/platforms/linux/daemon/wireguarddevicebuilder.cpp \
+            ../../src/platforms/linux/daemon/wireguardpeerwriter.cpp \
+            ../../src/platforms/linux/daemon/wireguardstatslinux.cpp \
+            testdbusstatus.cpp \
+            testendpointresolver.cpp \
+            testroutemonitor.cpp \
+            testwireguardpeerwriter.cpp \
+            testwireguardstatslinux.cpp
 }
 
 # Platform-specific: MacOS
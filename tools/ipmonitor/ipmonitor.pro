@@ -23,7 +23,8 @@ HEADERS += \
         ../../src/leakdetector.h \
         ../../src/loghandler.h \
         ../../src/logger.h \
-        ../../src/rfc/rfc1918.h
+        ../../src/rfc/rfc1918.h \
+        ../../src/rfc/rfcprefix.h
 SOURCES += \
         main.cpp \
         ../../src/ipaddress.cpp \
@@ -4,4 +4,4 @@
 
 !defined(VERSION, var):VERSION = 2.7.0
 
-DBUS_PROTOCOL_VERSION = 1
+DBUS_PROTOCOL_VERSION = 8